@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed capacity lock-free queue that supports multiple producer and consumer threads (Vyukov
+// bounded queue). The slots are pre-allocated and filled in place so a push never allocates or
+// blocks. A push fails (returns false) when the queue is full so the caller can count the drop.
+//
+// The capacity must be a power of two.
+
+template <typename T, size_t kCapacity>
+class BoundedQueue {
+  static_assert(kCapacity >= 2 && (kCapacity & (kCapacity - 1)) == 0, "Capacity must be a power of 2");
+
+ public:
+  BoundedQueue() {
+    for (size_t i = 0; i < kCapacity; ++i) cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  // Reserves a slot and calls fill(T&) to populate it in place. Returns false if full.
+  template <typename Fill>
+  bool TryPush(Fill&& fill) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & (kCapacity - 1)];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;  // Full.
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(cell->data);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Calls consume(T&) with the oldest slot and releases it. Returns false if empty.
+  template <typename Consume>
+  bool TryPop(Consume&& consume) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & (kCapacity - 1)];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;  // Empty.
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    consume(cell->data);
+    cell->sequence.store(pos + kCapacity, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of queued entries (exact only when quiescent).
+  size_t ApproxSize() const {
+    size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+    return (tail > head) ? (tail - head) : 0;
+  }
+
+  static constexpr size_t Capacity() { return kCapacity; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  static constexpr size_t kCacheLine = 64;
+  alignas(kCacheLine) Cell cells_[kCapacity];
+  alignas(kCacheLine) std::atomic<size_t> enqueue_pos_ = 0;
+  alignas(kCacheLine) std::atomic<size_t> dequeue_pos_ = 0;
+};
@@ -0,0 +1,115 @@
+#include "command_channel.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+#include "bounded_queue.h"
+#include "logger.h"
+
+namespace CommandChannelInt {
+namespace {
+
+static constexpr size_t kQueueSize = 64;  // Parameterized requests are rare (video mode changes).
+static constexpr DWORD kWaitPollMs = 50;   // RunAndWait() re-checks the wait conditions at this rate.
+
+struct Call {
+  std::function<void()> function;
+  std::shared_ptr<std::promise<void>> done;
+};
+
+HWND hwnd_ = nullptr;
+DWORD window_thread_id_ = 0;
+std::atomic<unsigned int> pending_commands_ = 0;
+std::atomic<bool> wake_posted_ = false;
+std::atomic<bool> suspended_ = true;  // Until Initialize().
+BoundedQueue<Call, kQueueSize> calls_;
+
+// Posts the wakeup message unless one is already in flight.
+void PostWake() {
+  if (wake_posted_.exchange(true, std::memory_order_acq_rel) || !hwnd_) return;
+  if (!::PostMessageA(hwnd_, CommandChannel::kWakeMsgId, 0, 0)) {
+    wake_posted_ = false;
+    Logger::Error("CommandChannel: Failed to post wakeup: 0x%08x", ::GetLastError());
+  }
+}
+
+}  // namespace
+}  // namespace CommandChannelInt
+
+void CommandChannel::Initialize(HWND hwnd) {
+  CommandChannelInt::hwnd_ = hwnd;
+  CommandChannelInt::window_thread_id_ = ::GetCurrentThreadId();
+  CommandChannelInt::suspended_ = false;
+}
+
+void CommandChannel::Post(unsigned int commands) {
+  unsigned int previous = CommandChannelInt::pending_commands_.fetch_or(commands, std::memory_order_acq_rel);
+  if ((previous & commands) != commands) CommandChannelInt::PostWake();  // Else coalesced with a pending post.
+}
+
+std::future<void> CommandChannel::Run(std::function<void()> call) {
+  using namespace CommandChannelInt;
+  auto done = std::make_shared<std::promise<void>>();
+  std::future<void> future = done->get_future();
+  if (::GetCurrentThreadId() == window_thread_id_) {
+    call();
+    done->set_value();
+    return future;
+  }
+
+  bool pushed = calls_.TryPush([&](Call& entry) {
+    entry.function = std::move(call);
+    entry.done = done;
+  });
+  if (!pushed) {
+    Logger::Error("CommandChannel: Queue full, dropping request");
+    done->set_exception(std::make_exception_ptr(std::runtime_error("CommandChannel queue full")));
+    return future;
+  }
+  PostWake();
+  return future;
+}
+
+bool CommandChannel::RunAndWait(std::function<void()> call, bool (*keep_waiting)()) {
+  using namespace CommandChannelInt;
+  enum State { kQueued, kStarted, kCancelled };
+  auto state = std::make_shared<std::atomic<int>>(kQueued);
+  std::future<void> done = Run([call = std::move(call), state]() {
+    int expected = kQueued;
+    if (state->compare_exchange_strong(expected, kStarted)) call();
+  });
+
+  while (done.wait_for(std::chrono::milliseconds(kWaitPollMs)) != std::future_status::ready) {
+    if (!suspended_ && (!keep_waiting || keep_waiting())) continue;
+    int expected = kQueued;
+    if (state->compare_exchange_strong(expected, kCancelled)) return false;  // Else it is running, so finish.
+  }
+  try {
+    done.get();
+  } catch (const std::exception&) {
+    return false;  // Queue full (already logged).
+  }
+  return *state == kStarted;
+}
+
+void CommandChannel::Suspend() { CommandChannelInt::suspended_ = true; }
+
+void CommandChannel::Wake() {
+  CommandChannelInt::suspended_ = false;
+  CommandChannelInt::wake_posted_ = false;
+  if (CommandChannelInt::pending_commands_ || CommandChannelInt::calls_.ApproxSize()) CommandChannelInt::PostWake();
+}
+
+unsigned int CommandChannel::Process() {
+  using namespace CommandChannelInt;
+  wake_posted_.store(false, std::memory_order_release);  // Cleared first so new posts re-wake.
+
+  Call call;
+  while (calls_.TryPop([&](Call& entry) { call = std::move(entry); })) {
+    call.function();
+    call.done->set_value();
+  }
+  return pending_commands_.exchange(0, std::memory_order_acq_rel);
+}
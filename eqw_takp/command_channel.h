@@ -0,0 +1,54 @@
+#pragma once
+#include <windows.h>
+
+#include <functional>
+#include <future>
+
+// Non-blocking channel for the game thread (and external callers) to request work on the
+// window (wndproc) thread. Replaces the blocking SendMessage() calls that stalled the game
+// thread until the window thread woke up (worst during modal window drag or resize loops).
+//
+// Simple notifications are coalesced into a pending bitmask, so a flood of cursor refresh
+// notifications collapses into a single update. Parameterized requests are queued in a
+// lock-free queue and return a future that completes once the window thread ran them.
+// A single PostMessage() wakes the window thread, which calls Process().
+//
+// Requests that must not overlap the game thread's rendering (device recovery and video mode
+// changes) use RunAndWait() so the caller blocks like the original SendMessage() did.
+
+namespace CommandChannel {
+
+static constexpr UINT kWakeMsgId = 0x4647;  // Custom WM_USER message ID.
+
+// Coalesced commands (bitmask).
+enum Command : unsigned int {
+  kRefreshCursor = 1 << 0,  // Re-evaluate the win32 cursor visibility.
+};
+
+// Binds the channel to the window. Must be called on the window's thread.
+void Initialize(HWND hwnd);
+
+// Sets the command bits and wakes the window thread if they were not already pending.
+void Post(unsigned int commands);
+
+// Queues the call for the window thread. Executes immediately if called on the window thread.
+// Callers may wait on the future, but never from the game thread.
+std::future<void> Run(std::function<void()> call);
+
+// Queues the call like Run() and blocks until it completed. The wait gives up when the channel is
+// suspended or keep_waiting (polled, optional) returns false, and the call is then skipped if it
+// had not started. Returns true if the call ran.
+bool RunAndWait(std::function<void()> call, bool (*keep_waiting)() = nullptr);
+
+// Stops RunAndWait() waiting while another wndproc (eqmain) owns the window. Queued requests are
+// kept until Wake().
+void Suspend();
+
+// Reposts the wakeup (used when the game wndproc regains control of the window).
+void Wake();
+
+// Executes the queued calls and returns (and clears) the pending command bits. Call from the
+// window thread in response to kWakeMsgId.
+unsigned int Process();
+
+}  // namespace CommandChannel
@@ -0,0 +1,131 @@
+#include "content_hash.h"
+
+#include <cstring>
+
+#if !defined(CONTENT_HASH_SCALAR) && (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__))
+#include <emmintrin.h>
+#define CONTENT_HASH_SSE2
+#endif
+
+namespace ContentHashInt {
+namespace {
+
+static constexpr uint32_t kStripeSize = 32;
+static constexpr uint32_t kStripesPerScramble = 16;  // Folds the high accumulator bits back every 512 bytes.
+static constexpr uint32_t kPrime32 = 0x9e3779b1u;
+static constexpr uint64_t kPrime64 = 0x9e3779b185ebca87ull;
+
+// Lane keys (the xxh3 secret prefix). Each stripe of a scramble window starts one key further, so
+// reordered stripes don't commute in the accumulators.
+static constexpr uint64_t kKeys[kStripesPerScramble + 4] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+    0xcb00c391bb52283cull, 0xa32e531b8b65d088ull, 0x4ef90da297486471ull, 0xd8acdea946ef1938ull,
+    0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull, 0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull,
+    0xc3ebd33483acc5eaull, 0xeb6313faffa081c5ull, 0x49daf0b751dd0d17ull, 0x9e68d429265516d3ull,
+};
+
+inline uint64_t Load64(const uint8_t* data) {
+  uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline uint64_t Rotl(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+inline uint64_t Avalanche(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdull;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ull;
+  value ^= value >> 33;
+  return value;
+}
+
+}  // namespace
+}  // namespace ContentHashInt
+
+ContentHash::Hasher::Hasher() {
+  accumulators_[0] = ContentHashInt::kPrime64;
+  accumulators_[1] = ContentHashInt::kKeys[15];
+  accumulators_[2] = ContentHashInt::kKeys[7];
+  accumulators_[3] = ContentHashInt::kPrime32;
+}
+
+void ContentHash::Hasher::Accumulate(const uint8_t* stripe) {
+  using namespace ContentHashInt;
+  const uint64_t* keys = kKeys + stripes_ % kStripesPerScramble;
+  uint64_t tweak = (stripes_ + 1ull) * kPrime64;  // Also separates the same position in other windows.
+  bool scramble = (++stripes_ % kStripesPerScramble) == 0;
+#ifdef CONTENT_HASH_SSE2
+  __m128i* accumulators = reinterpret_cast<__m128i*>(accumulators_);
+  const __m128i prime = _mm_set1_epi32(static_cast<int>(kPrime32));
+  const __m128i tweaks = _mm_set_epi32(static_cast<int>(tweak >> 32), static_cast<int>(tweak),
+                                       static_cast<int>(tweak >> 32), static_cast<int>(tweak));
+  for (int half = 0; half < 2; ++half) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe + half * 16));
+    __m128i key = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + half * 2)), tweaks);
+    __m128i data_key = _mm_xor_si128(data, key);
+    __m128i product = _mm_mul_epu32(data_key, _mm_srli_epi64(data_key, 32));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i accumulator = _mm_loadu_si128(accumulators + half);
+    accumulator = _mm_add_epi64(accumulator, _mm_add_epi64(product, swapped));
+    if (scramble) {
+      accumulator = _mm_xor_si128(accumulator, _mm_srli_epi64(accumulator, 47));
+      accumulator = _mm_xor_si128(accumulator, key);
+      __m128i low = _mm_mul_epu32(accumulator, prime);
+      __m128i high = _mm_mul_epu32(_mm_srli_epi64(accumulator, 32), prime);
+      accumulator = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+    }
+    _mm_storeu_si128(accumulators + half, accumulator);
+  }
+#else
+  for (int lane = 0; lane < 4; ++lane) {
+    uint64_t data = Load64(stripe + lane * 8);
+    uint64_t key = keys[lane] ^ tweak;
+    uint64_t data_key = data ^ key;
+    uint64_t& accumulator = accumulators_[lane];
+    accumulator += (data_key & 0xffffffff) * (data_key >> 32) + Load64(stripe + (lane ^ 1) * 8);
+    if (scramble) {
+      accumulator ^= accumulator >> 47;
+      accumulator ^= key;
+      accumulator *= kPrime32;
+    }
+  }
+#endif
+}
+
+void ContentHash::Hasher::Update(const void* data, size_t size) {
+  using namespace ContentHashInt;
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  length_ += size;
+  if (buffered_) {
+    size_t count = (size < kStripeSize - buffered_) ? size : kStripeSize - buffered_;
+    std::memcpy(buffer_ + buffered_, bytes, count);
+    buffered_ += count;
+    bytes += count;
+    size -= count;
+    if (buffered_ < kStripeSize) return;
+    Accumulate(buffer_);
+    buffered_ = 0;
+  }
+  for (; size >= kStripeSize; size -= kStripeSize, bytes += kStripeSize) Accumulate(bytes);
+  std::memcpy(buffer_, bytes, size);
+  buffered_ = size;
+}
+
+ContentHash::Hash128 ContentHash::Hasher::Finish() const {
+  using namespace ContentHashInt;
+  Hasher last = *this;  // Keeps Finish() const so a hasher can be extended after a peek.
+  if (last.buffered_) {
+    std::memset(last.buffer_ + last.buffered_, 0, kStripeSize - last.buffered_);
+    last.Accumulate(last.buffer_);  // The zero padding is disambiguated by the length.
+  }
+  const uint64_t* a = last.accumulators_;
+  uint64_t m0 = Avalanche(a[0] + kKeys[0]), m1 = Avalanche(a[1] + kKeys[1]);
+  uint64_t m2 = Avalanche(a[2] + kKeys[2]), m3 = Avalanche(a[3] + kKeys[3]);
+  Hash128 hash;
+  hash.low = Avalanche(m0 ^ Rotl(m1, 17) ^ Rotl(m2, 31) ^ m3 ^ length_);
+  hash.high = Avalanche(m3 ^ Rotl(m2, 23) ^ Rotl(m1, 41) ^ m0 ^ (length_ * kPrime64));
+  return hash;
+}
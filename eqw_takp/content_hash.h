@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Portable 128-bit non-cryptographic hash for identifying duplicate resource contents. The inner
+// loop is an xxh3 style multiply-accumulate over 32-byte stripes that uses SSE2 when available
+// (define CONTENT_HASH_SCALAR to force the scalar path, which produces identical hashes).
+
+namespace ContentHash {
+
+struct Hash128 {
+  uint64_t low;
+  uint64_t high;
+
+  bool operator==(const Hash128& other) const { return low == other.low && high == other.high; }
+  bool operator!=(const Hash128& other) const { return !(*this == other); }
+};
+
+// Incremental hasher. The result only depends on the concatenated data, not on how it was split
+// into Update() calls.
+class Hasher {
+ public:
+  Hasher();
+
+  void Update(const void* data, size_t size);
+  Hash128 Finish() const;
+
+ private:
+  void Accumulate(const uint8_t* stripe);
+
+  uint64_t accumulators_[4];
+  uint8_t buffer_[32];  // Partial stripe.
+  size_t buffered_ = 0;
+  uint64_t length_ = 0;
+  uint32_t stripes_ = 0;
+};
+
+}  // namespace ContentHash
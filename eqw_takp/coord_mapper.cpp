@@ -0,0 +1,45 @@
+#include "coord_mapper.h"
+
+void CoordMapper::Axis::Configure(int client_size, int game_size) {
+  client_size = (client_size < 1) ? 1 : client_size;  // Minimized windows report a zero size.
+  game_size = (game_size < 1) ? 1 : game_size;
+  if (client_size == client_size_ && game_size == game_size_) return;
+
+  client_size_ = client_size;
+  game_size_ = game_size;
+  to_game_ = (static_cast<int64_t>(game_size) << 16) / client_size;
+  to_client_ = (static_cast<int64_t>(client_size) << 16) / game_size;
+  has_anchor_ = false;
+}
+
+int CoordMapper::Axis::ToGame(int client) {
+  if (!is_scaled()) return client;
+  if (has_anchor_ && client == anchor_client_) return anchor_game_;
+
+  // The truncated factor can undershoot by one, so correct against the exact product.
+  int64_t target = static_cast<int64_t>(client) * game_size_;  // Exact result is floor(target / client_size_).
+  int64_t game = (static_cast<int64_t>(client) * to_game_) >> 16;
+  while ((game + 1) * client_size_ <= target) ++game;
+  while (game * client_size_ > target) --game;
+
+  anchor_client_ = client;
+  anchor_game_ = static_cast<int>(game);
+  has_anchor_ = true;
+  return anchor_game_;
+}
+
+int CoordMapper::Axis::ToClient(int game) {
+  if (!is_scaled()) return game;
+  if (has_anchor_ && game == anchor_game_) return anchor_client_;
+
+  // Smallest client coordinate that maps back to game: ceil(game * client_size_ / game_size_).
+  int64_t target = static_cast<int64_t>(game) * client_size_;
+  int64_t client = (static_cast<int64_t>(game) * to_client_) >> 16;
+  while (client * game_size_ < target) ++client;
+  while ((client - 1) * game_size_ >= target) --client;
+
+  anchor_client_ = static_cast<int>(client);
+  anchor_game_ = game;
+  has_anchor_ = true;
+  return anchor_client_;
+}
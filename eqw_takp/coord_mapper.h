@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Maps cursor coordinates between the client area and the (possibly different) game resolution.
+//
+// The Q16.16 scale factors are only recomputed when the sizes change. The factors give a fast
+// estimate that is corrected to the exact rational result, so the mapping does not lose
+// precision for any coordinate. Each axis also remembers the last mapped pair, which carries the
+// sub-pixel position across frames: mapping a point to the other space and back returns the
+// original point instead of drifting by a pixel whenever the scale is not an integer.
+//
+// Not thread safe; owned by the game thread.
+
+class CoordMapper {
+ public:
+  class Axis {
+   public:
+    // Sets the client and game sizes (clamped to >= 1). No-op if unchanged.
+    void Configure(int client_size, int game_size);
+
+    int ToGame(int client);  // floor(client * game_size / client_size).
+    int ToClient(int game);  // ceil(game * client_size / game_size), the exact inverse of ToGame().
+
+    bool is_scaled() const { return client_size_ != game_size_; }
+
+   private:
+    int client_size_ = 1;
+    int game_size_ = 1;
+    int64_t to_game_ = 1 << 16;  // Q16.16 scale factors.
+    int64_t to_client_ = 1 << 16;
+    int anchor_client_ = 0;  // Last mapped pair.
+    int anchor_game_ = 0;
+    bool has_anchor_ = false;
+  };
+
+  void Configure(int client_width, int client_height, int game_width, int game_height) {
+    x_.Configure(client_width, game_width);
+    y_.Configure(client_height, game_height);
+  }
+
+  bool is_scaled() const { return x_.is_scaled() || y_.is_scaled(); }
+
+  Axis& x() { return x_; }
+  Axis& y() { return y_; }
+
+ private:
+  Axis x_;
+  Axis y_;
+};
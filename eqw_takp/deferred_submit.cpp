@@ -0,0 +1,971 @@
+#include "deferred_submit.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "device_call_hook.h"
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace DeferredSubmitInt {
+namespace {
+
+static constexpr size_t kMaxListBytes = 4 << 20;  // Submits early if a frame records more.
+
+enum Op : uint32_t {
+  kBeginScene,
+  kEndScene,
+  kClear,
+  kSetTransform,
+  kSetViewport,
+  kSetMaterial,
+  kSetLight,
+  kLightEnable,
+  kSetRenderState,
+  kSetTexture,
+  kSetTextureStageState,
+  kDrawPrimitive,
+  kDrawIndexedPrimitive,
+  kDrawPrimitiveUP,
+  kDrawIndexedPrimitiveUP,
+  kSetVertexShader,
+  kSetStreamSource,
+  kSetIndices,
+  kPresent,
+};
+
+// Each recorded command is a header followed by the arguments and any copied data.
+struct Header {
+  Op op;
+  uint32_t size;  // Bytes including the header (a multiple of 4).
+};
+
+struct NoArgs {};
+
+struct ClearArgs {
+  DWORD count;  // Rects following the arguments.
+  DWORD flags;
+  D3DCOLOR color;
+  float z;
+  DWORD stencil;
+};
+
+struct TransformArgs {
+  D3DTRANSFORMSTATETYPE state;
+  D3DMATRIX matrix;
+};
+
+struct LightArgs {
+  DWORD index;
+  D3DLIGHT8 light;
+};
+
+struct LightEnableArgs {
+  DWORD index;
+  BOOL enable;
+};
+
+struct RenderStateArgs {
+  D3DRENDERSTATETYPE state;
+  DWORD value;
+};
+
+struct TextureArgs {
+  DWORD stage;
+  IDirect3DBaseTexture8* texture;
+};
+
+struct TextureStageStateArgs {
+  DWORD stage;
+  D3DTEXTURESTAGESTATETYPE type;
+  DWORD value;
+};
+
+struct DrawArgs {
+  D3DPRIMITIVETYPE type;
+  UINT start;
+  UINT count;
+};
+
+struct DrawIndexedArgs {
+  D3DPRIMITIVETYPE type;
+  UINT min_index;
+  UINT vertices;
+  UINT start;
+  UINT count;
+};
+
+struct DrawUPArgs {  // Followed by the vertices.
+  D3DPRIMITIVETYPE type;
+  UINT count;
+  UINT stride;
+};
+
+struct DrawIndexedUPArgs {  // Followed by the indices and the vertices.
+  D3DPRIMITIVETYPE type;
+  UINT min_index;
+  UINT vertices;
+  UINT count;
+  D3DFORMAT index_format;
+  UINT index_bytes;
+  UINT stride;
+};
+
+struct StreamSourceArgs {
+  UINT stream;
+  IDirect3DVertexBuffer8* buffer;
+  UINT stride;
+};
+
+struct IndicesArgs {
+  IDirect3DIndexBuffer8* buffer;
+  UINT base_vertex;
+};
+
+struct PresentArgs {
+  HWND window;
+  bool has_source;
+  bool has_dest;
+  RECT source;
+  RECT dest;
+};
+
+// A frame's recorded commands. The arena memory is kept across frames.
+struct CommandList {
+  std::vector<uint8_t> commands;
+  std::vector<IUnknown*> references;  // Held until replayed, released on the game thread.
+};
+
+bool enabled_ = false;      // Ini file setting.
+bool deferred_ = false;     // Recording (cleared if the locks can't be tracked).
+bool state_block_ = false;  // Between BeginStateBlock() and EndStateBlock(), the calls run directly.
+IDirect3DDevice8* device_ = nullptr;
+void** device_vtable_ = nullptr;
+
+CommandList lists_[2];
+int recording_ = 0;                // List being recorded by the game thread.
+int submitted_ = 0;                // List being replayed by the submission thread.
+bool in_flight_ = false;           // Game thread view of the submission thread being busy.
+HRESULT present_result_ = D3D_OK;  // Of the last replayed Present().
+HANDLE submit_event_ = nullptr;
+HANDLE done_event_ = nullptr;
+
+// Guards the lists against device calls from other threads, e.g. the Reset() of a device recovery
+// on the wndproc thread. Recursive, as the flushing calls are also made by the recording hooks.
+CRITICAL_SECTION recorder_lock_;
+
+class RecorderLock {
+ public:
+  RecorderLock() { ::EnterCriticalSection(&recorder_lock_); }
+  ~RecorderLock() { ::LeaveCriticalSection(&recorder_lock_); }
+  RecorderLock(const RecorderLock&) = delete;
+  RecorderLock& operator=(const RecorderLock&) = delete;
+};
+
+// References on the resources bound by the recorded calls (see Bind()).
+static constexpr DWORD kMaxTextureStages = 8;
+static constexpr UINT kMaxStreams = 16;
+IUnknown* bound_textures_[kMaxTextureStages] = {};
+IUnknown* bound_streams_[kMaxStreams] = {};
+IUnknown* bound_indices_ = nullptr;
+
+// Resource vtables with lock hooks. Each hook supports a single vtable.
+void** texture_vtable_ = nullptr;
+void** surface_vtable_ = nullptr;
+void** vertex_buffer_vtable_ = nullptr;
+void** index_buffer_vtable_ = nullptr;
+
+VTableHook hook_Reset_;
+VTableHook hook_Present_;
+VTableHook hook_GetBackBuffer_;
+VTableHook hook_CreateTexture_;
+VTableHook hook_CreateVertexBuffer_;
+VTableHook hook_CreateIndexBuffer_;
+VTableHook hook_CreateRenderTarget_;
+VTableHook hook_CreateDepthStencilSurface_;
+VTableHook hook_CreateImageSurface_;
+VTableHook hook_GetRenderTarget_;
+VTableHook hook_GetDepthStencilSurface_;
+VTableHook hook_BeginScene_;
+VTableHook hook_EndScene_;
+VTableHook hook_Clear_;
+VTableHook hook_SetTransform_;
+VTableHook hook_SetViewport_;
+VTableHook hook_SetMaterial_;
+VTableHook hook_SetLight_;
+VTableHook hook_LightEnable_;
+VTableHook hook_SetRenderState_;
+VTableHook hook_BeginStateBlock_;
+VTableHook hook_EndStateBlock_;
+VTableHook hook_SetTexture_;
+VTableHook hook_SetTextureStageState_;
+VTableHook hook_DrawPrimitive_;
+VTableHook hook_DrawIndexedPrimitive_;
+VTableHook hook_DrawPrimitiveUP_;
+VTableHook hook_DrawIndexedPrimitiveUP_;
+VTableHook hook_SetVertexShader_;
+VTableHook hook_SetStreamSource_;
+VTableHook hook_SetIndices_;
+VTableHook hook_TextureGetSurfaceLevel_;  // Direct3DTexture.
+VTableHook hook_TextureLockRect_;         // Direct3DTexture.
+VTableHook hook_SurfaceLockRect_;         // Direct3DSurface.
+VTableHook hook_VertexBufferLock_;        // Direct3DVertexBuffer.
+VTableHook hook_IndexBufferLock_;         // Direct3DIndexBuffer.
+
+HRESULT WINAPI D3DDeviceBeginSceneHook(IDirect3DDevice8* Device);
+HRESULT WINAPI D3DDeviceEndSceneHook(IDirect3DDevice8* Device);
+HRESULT WINAPI D3DDeviceClearHook(IDirect3DDevice8* Device, DWORD Count, CONST D3DRECT* pRects, DWORD Flags,
+                                  D3DCOLOR Color, float Z, DWORD Stencil);
+HRESULT WINAPI D3DDeviceSetTransformHook(IDirect3DDevice8* Device, D3DTRANSFORMSTATETYPE State,
+                                         CONST D3DMATRIX* pMatrix);
+HRESULT WINAPI D3DDeviceSetViewportHook(IDirect3DDevice8* Device, CONST D3DVIEWPORT8* pViewport);
+HRESULT WINAPI D3DDeviceSetMaterialHook(IDirect3DDevice8* Device, CONST D3DMATERIAL8* pMaterial);
+HRESULT WINAPI D3DDeviceSetLightHook(IDirect3DDevice8* Device, DWORD Index, CONST D3DLIGHT8* pLight);
+HRESULT WINAPI D3DDeviceLightEnableHook(IDirect3DDevice8* Device, DWORD Index, BOOL Enable);
+HRESULT WINAPI D3DDeviceSetRenderStateHook(IDirect3DDevice8* Device, D3DRENDERSTATETYPE State, DWORD Value);
+HRESULT WINAPI D3DDeviceSetTextureHook(IDirect3DDevice8* Device, DWORD Stage, IDirect3DBaseTexture8* pTexture);
+HRESULT WINAPI D3DDeviceSetTextureStageStateHook(IDirect3DDevice8* Device, DWORD Stage,
+                                                 D3DTEXTURESTAGESTATETYPE Type, DWORD Value);
+HRESULT WINAPI D3DDeviceDrawPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                          UINT StartVertex, UINT PrimitiveCount);
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                 UINT MinIndex, UINT NumVertices, UINT StartIndex,
+                                                 UINT PrimitiveCount);
+HRESULT WINAPI D3DDeviceDrawPrimitiveUPHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                            UINT PrimitiveCount, CONST void* pVertexStreamZeroData,
+                                            UINT VertexStreamZeroStride);
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveUPHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                   UINT MinVertexIndex, UINT NumVertexIndices,
+                                                   UINT PrimitiveCount, CONST void* pIndexData,
+                                                   D3DFORMAT IndexDataFormat, CONST void* pVertexStreamZeroData,
+                                                   UINT VertexStreamZeroStride);
+HRESULT WINAPI D3DDeviceSetVertexShaderHook(IDirect3DDevice8* Device, DWORD Handle);
+HRESULT WINAPI D3DDeviceSetStreamSourceHook(IDirect3DDevice8* Device, UINT StreamNumber,
+                                            IDirect3DVertexBuffer8* pStreamData, UINT Stride);
+HRESULT WINAPI D3DDeviceSetIndicesHook(IDirect3DDevice8* Device, IDirect3DIndexBuffer8* pIndexData,
+                                       UINT BaseVertexIndex);
+HRESULT WINAPI D3DDevicePresentHook(IDirect3DDevice8* Device, CONST RECT* pSourceRect, CONST RECT* pDestRect,
+                                    HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion);
+
+UINT GetVertexCount(D3DPRIMITIVETYPE type, UINT primitives) {
+  switch (type) {
+    case D3DPT_LINELIST:
+      return primitives * 2;
+    case D3DPT_LINESTRIP:
+      return primitives + 1;
+    case D3DPT_TRIANGLELIST:
+      return primitives * 3;
+    case D3DPT_TRIANGLESTRIP:
+    case D3DPT_TRIANGLEFAN:
+      return primitives + 2;
+    default:
+      return primitives;
+  }
+}
+
+// Replays a list against the real device. Runs on the submission thread.
+void Replay(IDirect3DDevice8* device, const CommandList& list) {
+  const uint8_t* data = list.commands.data();
+  const uint8_t* end = data + list.commands.size();
+  while (data < end) {
+    const Header* header = reinterpret_cast<const Header*>(data);
+    const void* args = header + 1;
+    data += header->size;
+    switch (header->op) {
+      case kBeginScene:
+        hook_BeginScene_.original(D3DDeviceBeginSceneHook)(device);
+        break;
+      case kEndScene:
+        hook_EndScene_.original(D3DDeviceEndSceneHook)(device);
+        break;
+      case kClear: {
+        const ClearArgs* a = static_cast<const ClearArgs*>(args);
+        const D3DRECT* rects = a->count ? reinterpret_cast<const D3DRECT*>(a + 1) : nullptr;
+        hook_Clear_.original(D3DDeviceClearHook)(device, a->count, rects, a->flags, a->color, a->z, a->stencil);
+        break;
+      }
+      case kSetTransform: {
+        const TransformArgs* a = static_cast<const TransformArgs*>(args);
+        hook_SetTransform_.original(D3DDeviceSetTransformHook)(device, a->state, &a->matrix);
+        break;
+      }
+      case kSetViewport:
+        hook_SetViewport_.original(D3DDeviceSetViewportHook)(device, static_cast<const D3DVIEWPORT8*>(args));
+        break;
+      case kSetMaterial:
+        hook_SetMaterial_.original(D3DDeviceSetMaterialHook)(device, static_cast<const D3DMATERIAL8*>(args));
+        break;
+      case kSetLight: {
+        const LightArgs* a = static_cast<const LightArgs*>(args);
+        hook_SetLight_.original(D3DDeviceSetLightHook)(device, a->index, &a->light);
+        break;
+      }
+      case kLightEnable: {
+        const LightEnableArgs* a = static_cast<const LightEnableArgs*>(args);
+        hook_LightEnable_.original(D3DDeviceLightEnableHook)(device, a->index, a->enable);
+        break;
+      }
+      case kSetRenderState: {
+        const RenderStateArgs* a = static_cast<const RenderStateArgs*>(args);
+        hook_SetRenderState_.original(D3DDeviceSetRenderStateHook)(device, a->state, a->value);
+        break;
+      }
+      case kSetTexture: {
+        const TextureArgs* a = static_cast<const TextureArgs*>(args);
+        hook_SetTexture_.original(D3DDeviceSetTextureHook)(device, a->stage, a->texture);
+        break;
+      }
+      case kSetTextureStageState: {
+        const TextureStageStateArgs* a = static_cast<const TextureStageStateArgs*>(args);
+        hook_SetTextureStageState_.original(D3DDeviceSetTextureStageStateHook)(device, a->stage, a->type, a->value);
+        break;
+      }
+      case kDrawPrimitive: {
+        const DrawArgs* a = static_cast<const DrawArgs*>(args);
+        hook_DrawPrimitive_.original(D3DDeviceDrawPrimitiveHook)(device, a->type, a->start, a->count);
+        break;
+      }
+      case kDrawIndexedPrimitive: {
+        const DrawIndexedArgs* a = static_cast<const DrawIndexedArgs*>(args);
+        hook_DrawIndexedPrimitive_.original(D3DDeviceDrawIndexedPrimitiveHook)(device, a->type, a->min_index,
+                                                                               a->vertices, a->start, a->count);
+        break;
+      }
+      case kDrawPrimitiveUP: {
+        const DrawUPArgs* a = static_cast<const DrawUPArgs*>(args);
+        hook_DrawPrimitiveUP_.original(D3DDeviceDrawPrimitiveUPHook)(device, a->type, a->count, a + 1, a->stride);
+        break;
+      }
+      case kDrawIndexedPrimitiveUP: {
+        const DrawIndexedUPArgs* a = static_cast<const DrawIndexedUPArgs*>(args);
+        const uint8_t* indices = reinterpret_cast<const uint8_t*>(a + 1);
+        hook_DrawIndexedPrimitiveUP_.original(D3DDeviceDrawIndexedPrimitiveUPHook)(
+            device, a->type, a->min_index, a->vertices, a->count, indices, a->index_format,
+            indices + a->index_bytes, a->stride);
+        break;
+      }
+      case kSetVertexShader:
+        hook_SetVertexShader_.original(D3DDeviceSetVertexShaderHook)(device, *static_cast<const DWORD*>(args));
+        break;
+      case kSetStreamSource: {
+        const StreamSourceArgs* a = static_cast<const StreamSourceArgs*>(args);
+        hook_SetStreamSource_.original(D3DDeviceSetStreamSourceHook)(device, a->stream, a->buffer, a->stride);
+        break;
+      }
+      case kSetIndices: {
+        const IndicesArgs* a = static_cast<const IndicesArgs*>(args);
+        hook_SetIndices_.original(D3DDeviceSetIndicesHook)(device, a->buffer, a->base_vertex);
+        break;
+      }
+      case kPresent: {
+        const PresentArgs* a = static_cast<const PresentArgs*>(args);
+        present_result_ = hook_Present_.original(D3DDevicePresentHook)(
+            device, a->has_source ? &a->source : nullptr, a->has_dest ? &a->dest : nullptr, a->window, nullptr);
+        break;
+      }
+    }
+  }
+}
+
+DWORD WINAPI SubmissionThread(LPVOID) {
+  for (;;) {
+    ::WaitForSingleObject(submit_event_, INFINITE);
+    Replay(device_, lists_[submitted_]);
+    ::SetEvent(done_event_);
+  }
+  return 0;
+}
+
+bool StartThread() {
+  if (submit_event_) return true;
+  HANDLE submit_event = ::CreateEventA(nullptr, FALSE, FALSE, nullptr);
+  HANDLE done_event = submit_event ? ::CreateEventA(nullptr, FALSE, FALSE, nullptr) : nullptr;
+  submit_event_ = submit_event;
+  done_event_ = done_event;
+  HANDLE thread = done_event ? ::CreateThread(nullptr, 0, SubmissionThread, nullptr, 0, nullptr) : nullptr;
+  if (!thread) {
+    if (submit_event) ::CloseHandle(submit_event);
+    if (done_event) ::CloseHandle(done_event);
+    submit_event_ = done_event_ = nullptr;
+    Logger::Error("DeferredSubmit: Failed to start the submission thread");
+    return false;
+  }
+  ::CloseHandle(thread);
+  ::InitializeCriticalSection(&recorder_lock_);
+  return true;
+}
+
+// Releases the references held by a replayed list and empties it (keeping the memory).
+void Recycle(CommandList& list) {
+  for (IUnknown* object : list.references) object->Release();
+  list.references.clear();
+  list.commands.clear();
+}
+
+// Drops the binding references once the device's own bindings are current (after a flush).
+void ReleaseBindings() {
+  for (IUnknown*& object : bound_textures_) {
+    if (object) object->Release();
+    object = nullptr;
+  }
+  for (IUnknown*& object : bound_streams_) {
+    if (object) object->Release();
+    object = nullptr;
+  }
+  if (bound_indices_) bound_indices_->Release();
+  bound_indices_ = nullptr;
+}
+
+// Waits for the submission thread to finish the list in flight.
+void WaitIdle() {
+  if (!in_flight_) return;
+  ::WaitForSingleObject(done_event_, INFINITE);
+  in_flight_ = false;
+  Recycle(lists_[submitted_]);
+}
+
+// Hands the recorded list to the submission thread and starts recording into the other list.
+void Submit() {
+  WaitIdle();
+  submitted_ = recording_;
+  recording_ ^= 1;
+  in_flight_ = true;
+  ::SetEvent(submit_event_);
+}
+
+// Replays all recorded commands ahead of a synchronous call.
+void Flush() {
+  RecorderLock lock;
+  if (!lists_[recording_].commands.empty()) Submit();
+  WaitIdle();
+}
+
+// A state block only captures the calls that reach the device while it is being recorded.
+bool IsDeferred(IDirect3DDevice8* device) { return deferred_ && device == device_ && !state_block_; }
+
+void Disable(const char* reason) {
+  RecorderLock lock;
+  if (!deferred_) return;
+  Flush();
+  ReleaseBindings();  // The calls now go straight to the device.
+  deferred_ = false;
+  Logger::Error("DeferredSubmit: Disabled, %s", reason);
+}
+
+// Appends a command with room for its arguments followed by extra bytes of copied data.
+template <typename T>
+T* Record(Op op, size_t extra = 0) {
+  if (lists_[recording_].commands.size() > kMaxListBytes) Submit();  // Bounds the memory of long frames.
+  std::vector<uint8_t>& list = lists_[recording_].commands;
+  size_t size = (sizeof(Header) + sizeof(T) + extra + 3) & ~static_cast<size_t>(3);
+  size_t offset = list.size();
+  list.resize(offset + size);
+  Header* header = reinterpret_cast<Header*>(list.data() + offset);
+  header->op = op;
+  header->size = static_cast<uint32_t>(size);
+  return reinterpret_cast<T*>(header + 1);
+}
+
+// Records a new binding of a texture stage, stream or the indices. A reference is kept on each
+// bound resource, and a replaced binding's reference is moved to the list so it is only released
+// (on the recording thread) after the replay. So the replayed Set*() call, which drops the device's
+// reference on the replaced resource, never makes the final release on the submission thread. An
+// out of range slot (an invalid call) only holds the resource until the replay. Call after
+// recording the command so an early submit can't separate the two.
+void Bind(IUnknown** binding, IUnknown* object) {
+  if (object) object->AddRef();
+  IUnknown* replaced = binding ? *binding : object;
+  if (binding) *binding = object;
+  if (replaced) lists_[recording_].references.push_back(replaced);
+}
+
+// Hooks the lock methods of a resource's vtable. A different vtable for the same kind of resource
+// can't be hooked (the hooks hold one original function), so it disables the deferral.
+bool HookResource(void* resource, void**& hooked_vtable) {
+  void** vtable = *reinterpret_cast<void***>(resource);
+  if (vtable == hooked_vtable) return false;
+  if (hooked_vtable) {
+    Disable("unexpected resource vtable");
+    return false;
+  }
+  hooked_vtable = vtable;
+  return true;
+}
+
+HRESULT WINAPI D3DSurfaceLockRectHook(IDirect3DSurface8* Surface, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect,
+                                      DWORD Flags) {
+  Flush();
+  return hook_SurfaceLockRect_.original(D3DSurfaceLockRectHook)(Surface, pLockedRect, pRect, Flags);
+}
+
+void HookSurface(HRESULT result, IDirect3DSurface8** surface) {
+  if (FAILED(result) || !surface || !*surface || !HookResource(*surface, surface_vtable_)) return;
+  hook_SurfaceLockRect_ = VTableHook(surface_vtable_, 9, D3DSurfaceLockRectHook, false);
+}
+
+HRESULT WINAPI D3DTextureGetSurfaceLevelHook(IDirect3DTexture8* Texture, UINT Level,
+                                             IDirect3DSurface8** ppSurfaceLevel) {
+  HRESULT result = hook_TextureGetSurfaceLevel_.original(D3DTextureGetSurfaceLevelHook)(Texture, Level,
+                                                                                       ppSurfaceLevel);
+  HookSurface(result, ppSurfaceLevel);
+  return result;
+}
+
+HRESULT WINAPI D3DTextureLockRectHook(IDirect3DTexture8* Texture, UINT Level, D3DLOCKED_RECT* pLockedRect,
+                                      CONST RECT* pRect, DWORD Flags) {
+  Flush();
+  return hook_TextureLockRect_.original(D3DTextureLockRectHook)(Texture, Level, pLockedRect, pRect, Flags);
+}
+
+// A no overwrite lock promises not to touch data used by the recorded draws.
+HRESULT WINAPI D3DVertexBufferLockHook(IDirect3DVertexBuffer8* Buffer, UINT OffsetToLock, UINT SizeToLock,
+                                       BYTE** ppbData, DWORD Flags) {
+  if (!(Flags & D3DLOCK_NOOVERWRITE)) Flush();
+  return hook_VertexBufferLock_.original(D3DVertexBufferLockHook)(Buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+}
+
+HRESULT WINAPI D3DIndexBufferLockHook(IDirect3DIndexBuffer8* Buffer, UINT OffsetToLock, UINT SizeToLock,
+                                      BYTE** ppbData, DWORD Flags) {
+  if (!(Flags & D3DLOCK_NOOVERWRITE)) Flush();
+  return hook_IndexBufferLock_.original(D3DIndexBufferLockHook)(Buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+}
+
+// Device methods without a recorded form replay the recorded commands and then run synchronously.
+struct SyncCall {
+  static void Before(IDirect3DDevice8* device) {
+    if (device == device_) Flush();
+  }
+};
+
+#define DEFERRED_SYNC_HOOK(index, method) InstallDeviceCallHook<SyncCall, index>(vtable, &IDirect3DDevice8::method)
+
+// Holds the recorder lock across the Reset() so the game thread can't record or submit meanwhile.
+HRESULT WINAPI D3DDeviceResetHook(IDirect3DDevice8* Device, D3DPRESENT_PARAMETERS* pPresentationParameters) {
+  if (Device != device_) return hook_Reset_.original(D3DDeviceResetHook)(Device, pPresentationParameters);
+  RecorderLock lock;
+  Flush();
+  HRESULT result = hook_Reset_.original(D3DDeviceResetHook)(Device, pPresentationParameters);
+  if (SUCCEEDED(result)) ReleaseBindings();  // The Reset() unbinds all resources.
+  present_result_ = D3D_OK;
+  state_block_ = false;
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceBeginStateBlockHook(IDirect3DDevice8* Device) {
+  if (Device == device_) Flush();
+  HRESULT result = hook_BeginStateBlock_.original(D3DDeviceBeginStateBlockHook)(Device);
+  if (Device == device_ && SUCCEEDED(result)) state_block_ = true;
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceEndStateBlockHook(IDirect3DDevice8* Device, DWORD* pToken) {
+  if (Device == device_) state_block_ = false;
+  return hook_EndStateBlock_.original(D3DDeviceEndStateBlockHook)(Device, pToken);
+}
+
+HRESULT WINAPI D3DDeviceGetBackBufferHook(IDirect3DDevice8* Device, UINT BackBuffer, D3DBACKBUFFER_TYPE Type,
+                                          IDirect3DSurface8** ppBackBuffer) {
+  HRESULT result = hook_GetBackBuffer_.original(D3DDeviceGetBackBufferHook)(Device, BackBuffer, Type, ppBackBuffer);
+  HookSurface(result, ppBackBuffer);
+  return result;
+}
+
+// The resource creation does not affect the recorded commands, so it runs without waiting.
+HRESULT WINAPI D3DDeviceCreateTextureHook(IDirect3DDevice8* Device, UINT Width, UINT Height, UINT Levels,
+                                          DWORD Usage, D3DFORMAT Format, D3DPOOL Pool,
+                                          IDirect3DTexture8** ppTexture) {
+  HRESULT result = hook_CreateTexture_.original(D3DDeviceCreateTextureHook)(Device, Width, Height, Levels, Usage,
+                                                                            Format, Pool, ppTexture);
+  if (SUCCEEDED(result) && ppTexture && *ppTexture && HookResource(*ppTexture, texture_vtable_)) {
+    hook_TextureGetSurfaceLevel_ = VTableHook(texture_vtable_, 15, D3DTextureGetSurfaceLevelHook, false);
+    hook_TextureLockRect_ = VTableHook(texture_vtable_, 16, D3DTextureLockRectHook, false);
+  }
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateVertexBufferHook(IDirect3DDevice8* Device, UINT Length, DWORD Usage, DWORD FVF,
+                                               D3DPOOL Pool, IDirect3DVertexBuffer8** ppVertexBuffer) {
+  HRESULT result = hook_CreateVertexBuffer_.original(D3DDeviceCreateVertexBufferHook)(Device, Length, Usage, FVF,
+                                                                                      Pool, ppVertexBuffer);
+  if (SUCCEEDED(result) && ppVertexBuffer && *ppVertexBuffer && HookResource(*ppVertexBuffer, vertex_buffer_vtable_))
+    hook_VertexBufferLock_ = VTableHook(vertex_buffer_vtable_, 11, D3DVertexBufferLockHook, false);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateIndexBufferHook(IDirect3DDevice8* Device, UINT Length, DWORD Usage, D3DFORMAT Format,
+                                              D3DPOOL Pool, IDirect3DIndexBuffer8** ppIndexBuffer) {
+  HRESULT result = hook_CreateIndexBuffer_.original(D3DDeviceCreateIndexBufferHook)(Device, Length, Usage, Format,
+                                                                                    Pool, ppIndexBuffer);
+  if (SUCCEEDED(result) && ppIndexBuffer && *ppIndexBuffer && HookResource(*ppIndexBuffer, index_buffer_vtable_))
+    hook_IndexBufferLock_ = VTableHook(index_buffer_vtable_, 11, D3DIndexBufferLockHook, false);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateRenderTargetHook(IDirect3DDevice8* Device, UINT Width, UINT Height, D3DFORMAT Format,
+                                               D3DMULTISAMPLE_TYPE MultiSample, BOOL Lockable,
+                                               IDirect3DSurface8** ppSurface) {
+  HRESULT result = hook_CreateRenderTarget_.original(D3DDeviceCreateRenderTargetHook)(Device, Width, Height, Format,
+                                                                                      MultiSample, Lockable, ppSurface);
+  HookSurface(result, ppSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateDepthStencilSurfaceHook(IDirect3DDevice8* Device, UINT Width, UINT Height,
+                                                      D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample,
+                                                      IDirect3DSurface8** ppSurface) {
+  HRESULT result = hook_CreateDepthStencilSurface_.original(D3DDeviceCreateDepthStencilSurfaceHook)(
+      Device, Width, Height, Format, MultiSample, ppSurface);
+  HookSurface(result, ppSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateImageSurfaceHook(IDirect3DDevice8* Device, UINT Width, UINT Height, D3DFORMAT Format,
+                                               IDirect3DSurface8** ppSurface) {
+  HRESULT result =
+      hook_CreateImageSurface_.original(D3DDeviceCreateImageSurfaceHook)(Device, Width, Height, Format, ppSurface);
+  HookSurface(result, ppSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceGetRenderTargetHook(IDirect3DDevice8* Device, IDirect3DSurface8** ppRenderTarget) {
+  if (Device == device_) Flush();
+  HRESULT result = hook_GetRenderTarget_.original(D3DDeviceGetRenderTargetHook)(Device, ppRenderTarget);
+  HookSurface(result, ppRenderTarget);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceGetDepthStencilSurfaceHook(IDirect3DDevice8* Device, IDirect3DSurface8** ppZStencilSurface) {
+  if (Device == device_) Flush();
+  HRESULT result =
+      hook_GetDepthStencilSurface_.original(D3DDeviceGetDepthStencilSurfaceHook)(Device, ppZStencilSurface);
+  HookSurface(result, ppZStencilSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceBeginSceneHook(IDirect3DDevice8* Device) {
+  if (!IsDeferred(Device)) return hook_BeginScene_.original(D3DDeviceBeginSceneHook)(Device);
+  RecorderLock lock;
+  Record<NoArgs>(kBeginScene);
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceEndSceneHook(IDirect3DDevice8* Device) {
+  if (!IsDeferred(Device)) return hook_EndScene_.original(D3DDeviceEndSceneHook)(Device);
+  RecorderLock lock;
+  Record<NoArgs>(kEndScene);
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceClearHook(IDirect3DDevice8* Device, DWORD Count, CONST D3DRECT* pRects, DWORD Flags,
+                                  D3DCOLOR Color, float Z, DWORD Stencil) {
+  if (!IsDeferred(Device))
+    return hook_Clear_.original(D3DDeviceClearHook)(Device, Count, pRects, Flags, Color, Z, Stencil);
+  RecorderLock lock;
+  DWORD count = pRects ? Count : 0;
+  ClearArgs* args = Record<ClearArgs>(kClear, count * sizeof(D3DRECT));
+  *args = {count, Flags, Color, Z, Stencil};
+  if (count) std::memcpy(args + 1, pRects, count * sizeof(D3DRECT));
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetTransformHook(IDirect3DDevice8* Device, D3DTRANSFORMSTATETYPE State,
+                                         CONST D3DMATRIX* pMatrix) {
+  if (!IsDeferred(Device) || !pMatrix)
+    return hook_SetTransform_.original(D3DDeviceSetTransformHook)(Device, State, pMatrix);
+  RecorderLock lock;
+  *Record<TransformArgs>(kSetTransform) = {State, *pMatrix};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetViewportHook(IDirect3DDevice8* Device, CONST D3DVIEWPORT8* pViewport) {
+  if (!IsDeferred(Device) || !pViewport)
+    return hook_SetViewport_.original(D3DDeviceSetViewportHook)(Device, pViewport);
+  RecorderLock lock;
+  *Record<D3DVIEWPORT8>(kSetViewport) = *pViewport;
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetMaterialHook(IDirect3DDevice8* Device, CONST D3DMATERIAL8* pMaterial) {
+  if (!IsDeferred(Device) || !pMaterial)
+    return hook_SetMaterial_.original(D3DDeviceSetMaterialHook)(Device, pMaterial);
+  RecorderLock lock;
+  *Record<D3DMATERIAL8>(kSetMaterial) = *pMaterial;
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetLightHook(IDirect3DDevice8* Device, DWORD Index, CONST D3DLIGHT8* pLight) {
+  if (!IsDeferred(Device) || !pLight) return hook_SetLight_.original(D3DDeviceSetLightHook)(Device, Index, pLight);
+  RecorderLock lock;
+  *Record<LightArgs>(kSetLight) = {Index, *pLight};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceLightEnableHook(IDirect3DDevice8* Device, DWORD Index, BOOL Enable) {
+  if (!IsDeferred(Device)) return hook_LightEnable_.original(D3DDeviceLightEnableHook)(Device, Index, Enable);
+  RecorderLock lock;
+  *Record<LightEnableArgs>(kLightEnable) = {Index, Enable};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetRenderStateHook(IDirect3DDevice8* Device, D3DRENDERSTATETYPE State, DWORD Value) {
+  if (!IsDeferred(Device)) return hook_SetRenderState_.original(D3DDeviceSetRenderStateHook)(Device, State, Value);
+  RecorderLock lock;
+  *Record<RenderStateArgs>(kSetRenderState) = {State, Value};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetTextureHook(IDirect3DDevice8* Device, DWORD Stage, IDirect3DBaseTexture8* pTexture) {
+  if (!IsDeferred(Device)) return hook_SetTexture_.original(D3DDeviceSetTextureHook)(Device, Stage, pTexture);
+  RecorderLock lock;
+  *Record<TextureArgs>(kSetTexture) = {Stage, pTexture};
+  Bind((Stage < kMaxTextureStages) ? &bound_textures_[Stage] : nullptr, pTexture);
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetTextureStageStateHook(IDirect3DDevice8* Device, DWORD Stage,
+                                                 D3DTEXTURESTAGESTATETYPE Type, DWORD Value) {
+  if (!IsDeferred(Device))
+    return hook_SetTextureStageState_.original(D3DDeviceSetTextureStageStateHook)(Device, Stage, Type, Value);
+  RecorderLock lock;
+  *Record<TextureStageStateArgs>(kSetTextureStageState) = {Stage, Type, Value};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceDrawPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                          UINT StartVertex, UINT PrimitiveCount) {
+  if (!IsDeferred(Device))
+    return hook_DrawPrimitive_.original(D3DDeviceDrawPrimitiveHook)(Device, PrimitiveType, StartVertex,
+                                                                    PrimitiveCount);
+  RecorderLock lock;
+  *Record<DrawArgs>(kDrawPrimitive) = {PrimitiveType, StartVertex, PrimitiveCount};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                 UINT MinIndex, UINT NumVertices, UINT StartIndex,
+                                                 UINT PrimitiveCount) {
+  if (!IsDeferred(Device))
+    return hook_DrawIndexedPrimitive_.original(D3DDeviceDrawIndexedPrimitiveHook)(
+        Device, PrimitiveType, MinIndex, NumVertices, StartIndex, PrimitiveCount);
+  RecorderLock lock;
+  *Record<DrawIndexedArgs>(kDrawIndexedPrimitive) = {PrimitiveType, MinIndex, NumVertices, StartIndex,
+                                                     PrimitiveCount};
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceDrawPrimitiveUPHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                            UINT PrimitiveCount, CONST void* pVertexStreamZeroData,
+                                            UINT VertexStreamZeroStride) {
+  if (!IsDeferred(Device) || !pVertexStreamZeroData)
+    return hook_DrawPrimitiveUP_.original(D3DDeviceDrawPrimitiveUPHook)(Device, PrimitiveType, PrimitiveCount,
+                                                                        pVertexStreamZeroData, VertexStreamZeroStride);
+  RecorderLock lock;
+  size_t bytes = static_cast<size_t>(GetVertexCount(PrimitiveType, PrimitiveCount)) * VertexStreamZeroStride;
+  DrawUPArgs* args = Record<DrawUPArgs>(kDrawPrimitiveUP, bytes);
+  *args = {PrimitiveType, PrimitiveCount, VertexStreamZeroStride};
+  std::memcpy(args + 1, pVertexStreamZeroData, bytes);
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveUPHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                   UINT MinVertexIndex, UINT NumVertexIndices,
+                                                   UINT PrimitiveCount, CONST void* pIndexData,
+                                                   D3DFORMAT IndexDataFormat, CONST void* pVertexStreamZeroData,
+                                                   UINT VertexStreamZeroStride) {
+  if (!IsDeferred(Device) || !pIndexData || !pVertexStreamZeroData)
+    return hook_DrawIndexedPrimitiveUP_.original(D3DDeviceDrawIndexedPrimitiveUPHook)(
+        Device, PrimitiveType, MinVertexIndex, NumVertexIndices, PrimitiveCount, pIndexData, IndexDataFormat,
+        pVertexStreamZeroData, VertexStreamZeroStride);
+  RecorderLock lock;
+
+  // The indices address the vertices from the start of the stream.
+  UINT index_size = (IndexDataFormat == D3DFMT_INDEX32) ? 4 : 2;
+  UINT index_bytes = GetVertexCount(PrimitiveType, PrimitiveCount) * index_size;
+  size_t vertex_bytes = static_cast<size_t>(MinVertexIndex + NumVertexIndices) * VertexStreamZeroStride;
+  DrawIndexedUPArgs* args = Record<DrawIndexedUPArgs>(kDrawIndexedPrimitiveUP, index_bytes + vertex_bytes);
+  *args = {PrimitiveType,   MinVertexIndex, NumVertexIndices,      PrimitiveCount,
+           IndexDataFormat, index_bytes,    VertexStreamZeroStride};
+  uint8_t* data = reinterpret_cast<uint8_t*>(args + 1);
+  std::memcpy(data, pIndexData, index_bytes);
+  std::memcpy(data + index_bytes, pVertexStreamZeroData, vertex_bytes);
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetVertexShaderHook(IDirect3DDevice8* Device, DWORD Handle) {
+  if (!IsDeferred(Device)) return hook_SetVertexShader_.original(D3DDeviceSetVertexShaderHook)(Device, Handle);
+  RecorderLock lock;
+  *Record<DWORD>(kSetVertexShader) = Handle;
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetStreamSourceHook(IDirect3DDevice8* Device, UINT StreamNumber,
+                                            IDirect3DVertexBuffer8* pStreamData, UINT Stride) {
+  if (!IsDeferred(Device))
+    return hook_SetStreamSource_.original(D3DDeviceSetStreamSourceHook)(Device, StreamNumber, pStreamData, Stride);
+  RecorderLock lock;
+  *Record<StreamSourceArgs>(kSetStreamSource) = {StreamNumber, pStreamData, Stride};
+  Bind((StreamNumber < kMaxStreams) ? &bound_streams_[StreamNumber] : nullptr, pStreamData);
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceSetIndicesHook(IDirect3DDevice8* Device, IDirect3DIndexBuffer8* pIndexData,
+                                       UINT BaseVertexIndex) {
+  if (!IsDeferred(Device))
+    return hook_SetIndices_.original(D3DDeviceSetIndicesHook)(Device, pIndexData, BaseVertexIndex);
+  RecorderLock lock;
+  *Record<IndicesArgs>(kSetIndices) = {pIndexData, BaseVertexIndex};
+  Bind(&bound_indices_, pIndexData);
+  return D3D_OK;
+}
+
+// Submits the frame. Returns the result of the previous frame's Present(), so a lost device is
+// reported one frame late.
+HRESULT WINAPI D3DDevicePresentHook(IDirect3DDevice8* Device, CONST RECT* pSourceRect, CONST RECT* pDestRect,
+                                    HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion) {
+  if (!IsDeferred(Device) || pDirtyRegion) {
+    if (Device == device_) Flush();
+    return hook_Present_.original(D3DDevicePresentHook)(Device, pSourceRect, pDestRect, hDestWindowOverride,
+                                                        pDirtyRegion);
+  }
+  RecorderLock lock;
+  PresentArgs* args = Record<PresentArgs>(kPresent);
+  *args = {hDestWindowOverride, pSourceRect != nullptr, pDestRect != nullptr};
+  if (pSourceRect) args->source = *pSourceRect;
+  if (pDestRect) args->dest = *pDestRect;
+  WaitIdle();  // The fence: the previous frame has been replayed.
+  HRESULT result = present_result_;
+  Submit();
+  return result;
+}
+
+}  // namespace
+}  // namespace DeferredSubmitInt
+
+void DeferredSubmit::Initialize(const std::filesystem::path& ini_file) {
+  using namespace DeferredSubmitInt;
+  enabled_ = Ini::GetValue<bool>("EqwGeneral", "DeferredSubmission", false, ini_file.string().c_str());
+  if (enabled_) Logger::Info("DeferredSubmit: Enabled");
+}
+
+bool DeferredSubmit::IsEnabled() { return DeferredSubmitInt::enabled_; }
+
+void DeferredSubmit::InstallHooks(IDirect3DDevice8* device) {
+  using namespace DeferredSubmitInt;
+  if (!enabled_ || !StartThread()) return;
+
+  device_ = device;
+  deferred_ = true;
+  state_block_ = false;
+  present_result_ = D3D_OK;
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Still installed below the other hooks.
+  device_vtable_ = vtable;
+
+  DEFERRED_SYNC_HOOK(3, TestCooperativeLevel);
+  DEFERRED_SYNC_HOOK(4, GetAvailableTextureMem);
+  DEFERRED_SYNC_HOOK(5, ResourceManagerDiscardBytes);
+  DEFERRED_SYNC_HOOK(6, GetDirect3D);
+  DEFERRED_SYNC_HOOK(7, GetDeviceCaps);
+  DEFERRED_SYNC_HOOK(8, GetDisplayMode);
+  DEFERRED_SYNC_HOOK(9, GetCreationParameters);
+  DEFERRED_SYNC_HOOK(10, SetCursorProperties);
+  DEFERRED_SYNC_HOOK(11, SetCursorPosition);
+  DEFERRED_SYNC_HOOK(12, ShowCursor);
+  DEFERRED_SYNC_HOOK(13, CreateAdditionalSwapChain);
+  hook_Reset_ = VTableHook(vtable, 14, D3DDeviceResetHook, false);
+  hook_Present_ = VTableHook(vtable, 15, D3DDevicePresentHook, false);
+  hook_GetBackBuffer_ = VTableHook(vtable, 16, D3DDeviceGetBackBufferHook, false);
+  DEFERRED_SYNC_HOOK(17, GetRasterStatus);
+  DEFERRED_SYNC_HOOK(18, SetGammaRamp);
+  DEFERRED_SYNC_HOOK(19, GetGammaRamp);
+  hook_CreateTexture_ = VTableHook(vtable, 20, D3DDeviceCreateTextureHook, false);
+  DEFERRED_SYNC_HOOK(21, CreateVolumeTexture);
+  DEFERRED_SYNC_HOOK(22, CreateCubeTexture);
+  hook_CreateVertexBuffer_ = VTableHook(vtable, 23, D3DDeviceCreateVertexBufferHook, false);
+  hook_CreateIndexBuffer_ = VTableHook(vtable, 24, D3DDeviceCreateIndexBufferHook, false);
+  hook_CreateRenderTarget_ = VTableHook(vtable, 25, D3DDeviceCreateRenderTargetHook, false);
+  hook_CreateDepthStencilSurface_ = VTableHook(vtable, 26, D3DDeviceCreateDepthStencilSurfaceHook, false);
+  hook_CreateImageSurface_ = VTableHook(vtable, 27, D3DDeviceCreateImageSurfaceHook, false);
+  DEFERRED_SYNC_HOOK(28, CopyRects);
+  DEFERRED_SYNC_HOOK(29, UpdateTexture);
+  DEFERRED_SYNC_HOOK(30, GetFrontBuffer);
+  DEFERRED_SYNC_HOOK(31, SetRenderTarget);
+  hook_GetRenderTarget_ = VTableHook(vtable, 32, D3DDeviceGetRenderTargetHook, false);
+  hook_GetDepthStencilSurface_ = VTableHook(vtable, 33, D3DDeviceGetDepthStencilSurfaceHook, false);
+  hook_BeginScene_ = VTableHook(vtable, 34, D3DDeviceBeginSceneHook, false);
+  hook_EndScene_ = VTableHook(vtable, 35, D3DDeviceEndSceneHook, false);
+  hook_Clear_ = VTableHook(vtable, 36, D3DDeviceClearHook, false);
+  hook_SetTransform_ = VTableHook(vtable, 37, D3DDeviceSetTransformHook, false);
+  DEFERRED_SYNC_HOOK(38, GetTransform);
+  DEFERRED_SYNC_HOOK(39, MultiplyTransform);
+  hook_SetViewport_ = VTableHook(vtable, 40, D3DDeviceSetViewportHook, false);
+  DEFERRED_SYNC_HOOK(41, GetViewport);
+  hook_SetMaterial_ = VTableHook(vtable, 42, D3DDeviceSetMaterialHook, false);
+  DEFERRED_SYNC_HOOK(43, GetMaterial);
+  hook_SetLight_ = VTableHook(vtable, 44, D3DDeviceSetLightHook, false);
+  DEFERRED_SYNC_HOOK(45, GetLight);
+  hook_LightEnable_ = VTableHook(vtable, 46, D3DDeviceLightEnableHook, false);
+  DEFERRED_SYNC_HOOK(47, GetLightEnable);
+  DEFERRED_SYNC_HOOK(48, SetClipPlane);
+  DEFERRED_SYNC_HOOK(49, GetClipPlane);
+  hook_SetRenderState_ = VTableHook(vtable, 50, D3DDeviceSetRenderStateHook, false);
+  DEFERRED_SYNC_HOOK(51, GetRenderState);
+  hook_BeginStateBlock_ = VTableHook(vtable, 52, D3DDeviceBeginStateBlockHook, false);
+  hook_EndStateBlock_ = VTableHook(vtable, 53, D3DDeviceEndStateBlockHook, false);
+  DEFERRED_SYNC_HOOK(54, ApplyStateBlock);
+  DEFERRED_SYNC_HOOK(55, CaptureStateBlock);
+  DEFERRED_SYNC_HOOK(56, DeleteStateBlock);
+  DEFERRED_SYNC_HOOK(57, CreateStateBlock);
+  DEFERRED_SYNC_HOOK(58, SetClipStatus);
+  DEFERRED_SYNC_HOOK(59, GetClipStatus);
+  DEFERRED_SYNC_HOOK(60, GetTexture);
+  hook_SetTexture_ = VTableHook(vtable, 61, D3DDeviceSetTextureHook, false);
+  DEFERRED_SYNC_HOOK(62, GetTextureStageState);
+  hook_SetTextureStageState_ = VTableHook(vtable, 63, D3DDeviceSetTextureStageStateHook, false);
+  DEFERRED_SYNC_HOOK(64, ValidateDevice);
+  DEFERRED_SYNC_HOOK(65, GetInfo);
+  DEFERRED_SYNC_HOOK(66, SetPaletteEntries);
+  DEFERRED_SYNC_HOOK(67, GetPaletteEntries);
+  DEFERRED_SYNC_HOOK(68, SetCurrentTexturePalette);
+  DEFERRED_SYNC_HOOK(69, GetCurrentTexturePalette);
+  hook_DrawPrimitive_ = VTableHook(vtable, 70, D3DDeviceDrawPrimitiveHook, false);
+  hook_DrawIndexedPrimitive_ = VTableHook(vtable, 71, D3DDeviceDrawIndexedPrimitiveHook, false);
+  hook_DrawPrimitiveUP_ = VTableHook(vtable, 72, D3DDeviceDrawPrimitiveUPHook, false);
+  hook_DrawIndexedPrimitiveUP_ = VTableHook(vtable, 73, D3DDeviceDrawIndexedPrimitiveUPHook, false);
+  DEFERRED_SYNC_HOOK(74, ProcessVertices);
+  DEFERRED_SYNC_HOOK(75, CreateVertexShader);
+  hook_SetVertexShader_ = VTableHook(vtable, 76, D3DDeviceSetVertexShaderHook, false);
+  DEFERRED_SYNC_HOOK(77, GetVertexShader);
+  DEFERRED_SYNC_HOOK(78, DeleteVertexShader);
+  DEFERRED_SYNC_HOOK(79, SetVertexShaderConstant);
+  DEFERRED_SYNC_HOOK(80, GetVertexShaderConstant);
+  DEFERRED_SYNC_HOOK(81, GetVertexShaderDeclaration);
+  DEFERRED_SYNC_HOOK(82, GetVertexShaderFunction);
+  hook_SetStreamSource_ = VTableHook(vtable, 83, D3DDeviceSetStreamSourceHook, false);
+  DEFERRED_SYNC_HOOK(84, GetStreamSource);
+  hook_SetIndices_ = VTableHook(vtable, 85, D3DDeviceSetIndicesHook, false);
+  DEFERRED_SYNC_HOOK(86, GetIndices);
+  DEFERRED_SYNC_HOOK(87, CreatePixelShader);
+  DEFERRED_SYNC_HOOK(88, SetPixelShader);
+  DEFERRED_SYNC_HOOK(89, GetPixelShader);
+  DEFERRED_SYNC_HOOK(90, DeletePixelShader);
+  DEFERRED_SYNC_HOOK(91, SetPixelShaderConstant);
+  DEFERRED_SYNC_HOOK(92, GetPixelShaderConstant);
+  DEFERRED_SYNC_HOOK(93, GetPixelShaderFunction);
+  DEFERRED_SYNC_HOOK(94, DrawRectPatch);
+  DEFERRED_SYNC_HOOK(95, DrawTriPatch);
+  DEFERRED_SYNC_HOOK(96, DeletePatch);
+}
+
+void DeferredSubmit::ReleaseResources() {
+  using namespace DeferredSubmitInt;
+  if (!device_) return;
+  RecorderLock lock;
+  Flush();
+  Recycle(lists_[recording_]);
+  ReleaseBindings();
+  deferred_ = false;
+  device_ = nullptr;
+}
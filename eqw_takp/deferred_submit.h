@@ -0,0 +1,34 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) deferred submission of the primary device's rendering commands.
+//
+// The hooks sit below all other device hooks, next to the real device. The frequent state changes,
+// scene and draw calls are recorded into a reused command buffer (with the user pointer vertex and
+// index data copied) and the Present() hands the frame's buffer to a submission thread that replays
+// it against the real device while the game thread records the next frame. Two buffers are used,
+// so the Present() also waits for the replay of the previous frame (the fence) and returns its
+// result. Every other device call and the resource locks first wait for the recorded commands to
+// be replayed and then run synchronously on the calling thread, so Reset() and
+// TestCooperativeLevel() stay on the device's thread. The calls between BeginStateBlock() and
+// EndStateBlock() also run directly so the state block captures them. Recorded resources are held
+// until replayed.
+
+namespace DeferredSubmit {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the enable setting.
+
+bool IsEnabled();  // The device must be created with D3DCREATE_MULTITHREADED when enabled.
+
+// Installs the device hooks. Call after each primary device creation and before any other hooks.
+void InstallHooks(IDirect3DDevice8* device);
+
+// Replays the remaining commands and stops deferring (before the final device Release()).
+void ReleaseResources();
+
+}  // namespace DeferredSubmit
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <windows.h>
+
+#include "d3dx8/d3d8.h"
+#include "vtable_hook.h"
+
+// Generic IDirect3DDevice8 method hooks that call Owner::Before(device) ahead of the original
+// method. Used by the modules that must act on every device call (e.g. to flush held work) without
+// a hand written hook per method signature. Each Owner type gets its own hook functions.
+//
+// Usage: InstallDeviceCallHook<Owner, 28>(vtable, &IDirect3DDevice8::CopyRects);
+
+template <typename Owner, size_t kIndex, typename Method>
+struct DeviceCallHook;
+
+template <typename Owner, size_t kIndex, typename R, typename... Args>
+struct DeviceCallHook<Owner, kIndex, R(WINAPI IDirect3DDevice8::*)(Args...)> {
+  static R WINAPI Hook(IDirect3DDevice8* Device, Args... args) {
+    Owner::Before(Device);
+    return hook.original(Hook)(Device, args...);
+  }
+
+  static VTableHook hook;
+};
+
+template <typename Owner, size_t kIndex, typename R, typename... Args>
+VTableHook DeviceCallHook<Owner, kIndex, R(WINAPI IDirect3DDevice8::*)(Args...)>::hook;
+
+// The method pointer only selects the signature, so it must match the vtable index.
+template <typename Owner, size_t kIndex, typename Method>
+void InstallDeviceCallHook(void** vtable, Method) {
+  using Hook = DeviceCallHook<Owner, kIndex, Method>;
+  Hook::hook = VTableHook(vtable, kIndex, Hook::Hook, false);
+}
@@ -4,8 +4,12 @@
 #define INITGUID
 #include <dinput.h>
 
+#include <atomic>
+#include <cstring>
+
 #include "iat_hook.h"
 #include "logger.h"
+#include "raw_input.h"
 #include "vtable_hook.h"
 
 // Using a DInput namespace instead of a purely static class to reduce the qualifier clutter. The
@@ -13,8 +17,17 @@
 namespace DInput {
 namespace {  // anonymous
 
+static constexpr DWORD kMinMouseBufferSize = 4096;  // Room for several frames of 8 kHz mouse reports.
+static constexpr DWORD kMinKeyboardBufferSize = 256;
+
 bool ignore_prio_result = false;
 
+// Buffered mouse read statistics (see DInputManager::LogStats()).
+std::atomic<unsigned int> mouse_events_read_ = 0;      // Events read from the device.
+std::atomic<unsigned int> mouse_records_returned_ = 0;  // Records returned after coalescing.
+std::atomic<unsigned int> mouse_overflows_ = 0;
+std::atomic<unsigned int> keyboard_overflows_ = 0;
+
 // Allocated DirectInput hardware resources.
 LPDIRECTINPUT8 dinput_ = nullptr;
 LPDIRECTINPUTDEVICE8W keyboard_ = nullptr;
@@ -28,6 +41,7 @@ VTableHook hook_DInputCreateDevice_;
 VTableHook hook_DInputRelease_;
 
 // Device level functional hooks.
+VTableHook hook_key_SetProperty_;
 VTableHook hook_key_SetCooperativeLevel_;
 VTableHook hook_key_GetDeviceData_;
 VTableHook hook_key_GetDeviceState_;
@@ -35,6 +49,7 @@ VTableHook hook_key_Release_;
 VTableHook hook_key_Acquire_;
 VTableHook hook_key_Unacquire_;
 
+VTableHook hook_mouse_SetProperty_;
 VTableHook hook_mouse_SetCooperativeLevel_;
 VTableHook hook_mouse_GetDeviceData_;
 VTableHook hook_mouse_GetDeviceState_;
@@ -55,15 +70,147 @@ HRESULT WINAPI DeviceReleaseHook(LPDIRECTINPUTDEVICE8W device) {
   return DI_OK;
 }
 
+// Serves a buffered data read from the raw input backend.
+HRESULT GetRawDeviceData(LPDIRECTINPUTDEVICE8W device, size_t buffer_size, LPDIDEVICEOBJECTDATA data,
+                         DWORD* event_count_max) {
+  if (!event_count_max) return DIERR_INVALIDPARAM;
+  bool is_mouse = (device == mouse_);
+  if (!data) {  // Flush request.
+    if (is_mouse)
+      RawInput::GetMouse().Flush();
+    else
+      RawInput::GetKeyboard().Flush();
+    *event_count_max = 0;
+    return DI_OK;
+  }
+  if (buffer_size < sizeof(RawInputCore::Event)) {
+    *event_count_max = 0;
+    return DIERR_INVALIDPARAM;
+  }
+
+  static constexpr DWORD kChunkSize = 64;
+  RawInputCore::Event events[kChunkSize];
+  BYTE* output = reinterpret_cast<BYTE*>(data);
+  DWORD count = 0;
+  while (count < *event_count_max) {
+    DWORD request = (*event_count_max - count < kChunkSize) ? *event_count_max - count : kChunkSize;
+    size_t read = is_mouse ? RawInput::GetMouse().ReadEvents(events, request)
+                           : RawInput::GetKeyboard().ReadEvents(events, request);
+    for (size_t i = 0; i < read; ++i, ++count) {
+      auto entry = reinterpret_cast<LPDIDEVICEOBJECTDATA>(output + count * buffer_size);
+      entry->dwOfs = events[i].offset;
+      entry->dwData = events[i].data;
+      entry->dwTimeStamp = events[i].timestamp;
+      entry->dwSequence = events[i].sequence;
+      if (buffer_size >= sizeof(DIDEVICEOBJECTDATA)) entry->uAppData = 0;
+    }
+    if (read < request) break;
+  }
+  *event_count_max = count;
+
+  bool overflow = is_mouse ? RawInput::GetMouse().TakeOverflow() : RawInput::GetKeyboard().TakeOverflow();
+  return overflow ? DI_BUFFEROVERFLOW : DI_OK;
+}
+
+// Serves a device state read from the raw input backend.
+HRESULT GetRawDeviceState(LPDIRECTINPUTDEVICE8W device, size_t buffer_size, void* data) {
+  if (device == keyboard_) {
+    if (buffer_size != 256) return DIERR_INVALIDPARAM;
+    RawInput::GetKeyboard().ReadState(reinterpret_cast<BYTE*>(data));
+    return DI_OK;
+  }
+  if (buffer_size != sizeof(DIMOUSESTATE) && buffer_size != sizeof(DIMOUSESTATE2)) return DIERR_INVALIDPARAM;
+  static_assert(sizeof(RawInputCore::MouseState) == sizeof(DIMOUSESTATE2), "Mouse state layout mismatch");
+  RawInputCore::MouseState state;
+  RawInput::GetMouse().ReadState(&state);
+  std::memcpy(data, &state, buffer_size);
+  return DI_OK;
+}
+
+// Merges runs of consecutive X and Y axis events into (at most) one record per axis, keeping every button and
+// wheel event in order. Compacts the records in place starting at index first and returns the new count.
+// The run state carries across calls so a run can span multiple reads.
+struct AxisRun {
+  int x = -1;  // Index of the run's X and Y records (-1 if none).
+  int y = -1;
+};
+
+DWORD CoalesceMouseEvents(BYTE* data, size_t stride, DWORD first, DWORD count, AxisRun* run) {
+  DWORD out = first;
+  for (DWORD i = first; i < count; ++i) {
+    auto event = reinterpret_cast<LPDIDEVICEOBJECTDATA>(data + i * stride);
+    int* index = (event->dwOfs == DIMOFS_X) ? &run->x : (event->dwOfs == DIMOFS_Y) ? &run->y : nullptr;
+    if (!index) {
+      *run = {};  // Buttons and the wheel end the run.
+    } else if (*index >= 0) {
+      auto merged = reinterpret_cast<LPDIDEVICEOBJECTDATA>(data + *index * stride);
+      merged->dwData = static_cast<DWORD>(static_cast<int>(merged->dwData) + static_cast<int>(event->dwData));
+      merged->dwTimeStamp = event->dwTimeStamp;
+      merged->dwSequence = event->dwSequence;
+      continue;
+    } else {
+      *index = static_cast<int>(out);
+    }
+    if (out != i) std::memcpy(data + out * stride, event, stride);
+    ++out;
+  }
+  return out;
+}
+
+HRESULT WINAPI DeviceGetDeviceDataHook(LPDIRECTINPUTDEVICE8W device, size_t buffer_size, LPDIDEVICEOBJECTDATA data,
+                                       DWORD* event_count_max, LPUNKNOWN unk);
+
+// Reads the buffered mouse data with axis coalescing. Refills the space freed by merging so the client
+// still sees a full buffer when more data is pending.
+HRESULT GetCoalescedMouseData(LPDIRECTINPUTDEVICE8W device, size_t buffer_size, LPDIDEVICEOBJECTDATA data,
+                              DWORD* event_count_max, LPUNKNOWN unk) {
+  auto get_device_data = hook_mouse_GetDeviceData_.original(DeviceGetDeviceDataHook);
+  if (!data || !event_count_max || buffer_size < sizeof(DIDEVICEOBJECTDATA_DX3))
+    return get_device_data(device, buffer_size, data, event_count_max, unk);  // Flush or unexpected layout.
+
+  BYTE* buffer = reinterpret_cast<BYTE*>(data);
+  DWORD max_count = *event_count_max;
+  DWORD count = 0;
+  AxisRun run;
+  HRESULT result = DI_OK;
+  for (;;) {
+    DWORD request = max_count - count;
+    HRESULT read_result = get_device_data(device, buffer_size,
+                                          reinterpret_cast<LPDIDEVICEOBJECTDATA>(buffer + count * buffer_size),
+                                          &request, unk);
+    if (!SUCCEEDED(read_result)) {
+      if (count == 0) return read_result;  // Report the failure (unacquired, etc) if nothing was read.
+      break;
+    }
+    if (read_result == DI_BUFFEROVERFLOW) result = DI_BUFFEROVERFLOW;
+    mouse_events_read_.fetch_add(request, std::memory_order_relaxed);
+    DWORD new_count = CoalesceMouseEvents(buffer, buffer_size, count, count + request, &run);
+    bool full = (count + request == max_count);
+    count = new_count;
+    if (!full || count == max_count) break;  // Drained the device or no room freed up.
+  }
+  mouse_records_returned_.fetch_add(count, std::memory_order_relaxed);
+  *event_count_max = count;
+  return result;
+}
+
 // Wrapper layer to redirect the device and correct an eqgame bug.
 HRESULT WINAPI DeviceGetDeviceDataHook(LPDIRECTINPUTDEVICE8W device, size_t buffer_size, LPDIDEVICEOBJECTDATA data,
                                        DWORD* event_count_max, LPUNKNOWN unk) {
   HRESULT result = DIERR_NOTINITIALIZED;
-  if (device == keyboard_)
+  if ((device == keyboard_ || device == mouse_) && RawInput::IsActive())
+    result = GetRawDeviceData(device, buffer_size, data, event_count_max);
+  else if (device == keyboard_)
     result = hook_key_GetDeviceData_.original(DeviceGetDeviceDataHook)(device, buffer_size, data, event_count_max, unk);
   else if (device == mouse_)
-    result =
-        hook_mouse_GetDeviceData_.original(DeviceGetDeviceDataHook)(device, buffer_size, data, event_count_max, unk);
+    result = GetCoalescedMouseData(device, buffer_size, data, event_count_max, unk);
+
+  if (result == DI_BUFFEROVERFLOW && data) {
+    auto& overflows = (device == mouse_) ? mouse_overflows_ : keyboard_overflows_;
+    unsigned int total = overflows.fetch_add(1, std::memory_order_relaxed) + 1;
+    if ((total & (total - 1)) == 0)  // Log the first and then at powers of two.
+      Logger::Error("DInput %s buffer overflow (total: %u)", GetDeviceStr(device), total);
+  }
 
   // The game client has a bug where it assumes that the event_count_max parameter is always set, even on failure.
   // Ensure that it is set to zero on failure in this layer.
@@ -108,7 +255,9 @@ HRESULT WINAPI DeviceUnacquireHook(LPDIRECTINPUTDEVICE8W device) {
 
 // Wrappers for modifying device state fetches.
 HRESULT WINAPI DeviceGetDeviceStateHook(LPDIRECTINPUTDEVICE8W device, size_t buffer_size, LPDIDEVICEOBJECTDATA data) {
-  if (device == keyboard_)
+  if ((device == keyboard_ || device == mouse_) && RawInput::IsActive())
+    return GetRawDeviceState(device, buffer_size, data);
+  else if (device == keyboard_)
     return hook_key_GetDeviceState_.original(DeviceGetDeviceStateHook)(device, buffer_size, data);
   else if (device == mouse_)
     return hook_mouse_GetDeviceState_.original(DeviceGetDeviceStateHook)(device, buffer_size, data);
@@ -116,6 +265,28 @@ HRESULT WINAPI DeviceGetDeviceStateHook(LPDIRECTINPUTDEVICE8W device, size_t buf
     return DIERR_NOTINITIALIZED;
 }
 
+// Enforces a minimum buffer size. The client's small buffer overflows between frames with high polling rate mice.
+HRESULT WINAPI DeviceSetPropertyHook(LPDIRECTINPUTDEVICE8W device, const GUID& property, LPCDIPROPHEADER header) {
+  DIPROPDWORD buffer_size;
+  if (&property == &DIPROP_BUFFERSIZE && header && header->dwSize == sizeof(DIPROPDWORD)) {
+    buffer_size = *reinterpret_cast<const DIPROPDWORD*>(header);
+    DWORD min_size = (device == mouse_) ? kMinMouseBufferSize : kMinKeyboardBufferSize;
+    if (buffer_size.dwData < min_size) {
+      Logger::Info("DInput %s buffer size increased from %u to %u", GetDeviceStr(device), buffer_size.dwData,
+                   min_size);
+      buffer_size.dwData = min_size;
+      header = &buffer_size.diph;
+    }
+  }
+
+  if (device == keyboard_)
+    return hook_key_SetProperty_.original(DeviceSetPropertyHook)(device, property, header);
+  else if (device == mouse_)
+    return hook_mouse_SetProperty_.original(DeviceSetPropertyHook)(device, property, header);
+  else
+    return DIERR_NOTINITIALIZED;
+}
+
 // Override the cooperative level to make the DInput play nice in windowed mode.
 HRESULT WINAPI DeviceSetCooperativeLevelHook(LPDIRECTINPUTDEVICE8W device, HWND wnd, DWORD flags) {
   // The client varies in how it handles failures to acquire the devices. The eqmain.dll only acquires
@@ -171,6 +342,7 @@ HRESULT WINAPI DirectInputCreateDeviceHook(LPDIRECTINPUT8* ppvOut, GUID& guid, L
                ::GetCurrentThreadId());
   if (is_keyboard) {
     hook_key_Release_ = VTableHook(vtable, 2, DeviceReleaseHook);
+    hook_key_SetProperty_ = VTableHook(vtable, 6, DeviceSetPropertyHook);
     hook_key_Acquire_ = VTableHook(vtable, 7, DeviceAcquireHook);
     hook_key_Unacquire_ = VTableHook(vtable, 8, DeviceUnacquireHook);
     hook_key_GetDeviceState_ = VTableHook(vtable, 9, DeviceGetDeviceStateHook);
@@ -178,6 +350,7 @@ HRESULT WINAPI DirectInputCreateDeviceHook(LPDIRECTINPUT8* ppvOut, GUID& guid, L
     hook_key_SetCooperativeLevel_ = VTableHook(vtable, 13, DeviceSetCooperativeLevelHook);
   } else {
     hook_mouse_Release_ = VTableHook(vtable, 2, DeviceReleaseHook);
+    hook_mouse_SetProperty_ = VTableHook(vtable, 6, DeviceSetPropertyHook);
     hook_mouse_Acquire_ = VTableHook(vtable, 7, DeviceAcquireHook);
     hook_mouse_Unacquire_ = VTableHook(vtable, 8, DeviceUnacquireHook);
     hook_mouse_GetDeviceState_ = VTableHook(vtable, 9, DeviceGetDeviceStateHook);
@@ -250,3 +423,11 @@ void DInputManager::FlushMouse() {
   DWORD items = INFINITE;  // Perform a flush of any stale data.
   DInput::DeviceGetDeviceDataHook(DInput::mouse_, sizeof(DIDEVICEOBJECTDATA), NULL, &items, 0);
 }
+
+void DInputManager::LogStats() {
+  unsigned int read = DInput::mouse_events_read_.load(std::memory_order_relaxed);
+  unsigned int returned = DInput::mouse_records_returned_.load(std::memory_order_relaxed);
+  Logger::Info("DInput stats: mouse events read: %u, returned: %u (%u coalesced), overflows: mouse %u, keyboard %u",
+               read, returned, read - returned, DInput::mouse_overflows_.load(std::memory_order_relaxed),
+               DInput::keyboard_overflows_.load(std::memory_order_relaxed));
+}
@@ -14,7 +14,9 @@
 //
 // This code performs a flush of the devices when they are acquired and
 // patches a bug where the client assumes that a failed GetDeviceData()
-// will set the number of read elements to zero.
+// will set the number of read elements to zero. It also enforces a large
+// data buffer and merges consecutive mouse axis events so high polling
+// rate mice do not overflow the buffer between frames.
 
 namespace DInputManager {
 
@@ -23,5 +25,6 @@ void SetIgnorePrioInAcquire(bool ignore_prio_result);  // Set during eqmain.
 void Acquire(bool keyboard_only = false);
 void Unacquire();
 void FlushMouse();
+void LogStats();  // Logs the buffered read and overflow counters.
 
 };  // namespace DInputManager
@@ -2,6 +2,9 @@
 #include <windows.h>
 
 #include "eq_game.h"
+#include "flight_recorder.h"
+#include "frame_stats.h"
+#include "screenshot.h"
 
 // The .def file aliases this call to ordinal 1.
 extern "C" void __stdcall InitializeEqwDll() {
@@ -25,8 +28,8 @@ extern "C" int __stdcall GetEnableFullScreen() {
   return EqGame::GetEnableFullScreen();  // 0 = Windowed mode, 1 = Full screen mode.
 }
 
-// Performs a blocking SendMessage() call that will block this thread until the
-// WndProc method on the main thread processes this message.
+// Queues the request for the WndProc thread and waits for it to be processed (returns
+// without the change while eqmain owns the window).
 extern "C" void __stdcall SetEnableFullScreen(int enable) {
   EqGame::SetEnableFullScreen(enable);  // 0 = Windowed mode, 1 = Full screen mode.
 }
@@ -48,12 +51,30 @@ extern "C" void __stdcall SetEqCreateWinInitFn(void(__cdecl* init_fn)()) {
   EqGame::SetEqCreateWinInitFn(init_fn);  // Use GetGameWindow() if a handle is needed.
 }
 
-// Performs a blocking SendMessage() call that will perform a reset of the Direct3D8
-// device (including release and reacquisition of game resources) if necessary.
-// The message is ignored if not in the game and only triggers a Reset() if the device
+// Queues a request for the WndProc thread to perform a reset of the Direct3D8 device
+// (including release and reacquisition of game resources) if necessary. Blocks until done.
+// The request is ignored if not in the game and only triggers a Reset() if the device
 // is in the correct state to need a Reset().
 extern "C" void __stdcall ResetD3D8() { EqGame::ResetD3D8(); }
 
+// Writes the in-memory log flight recorder ring to eqw_flight.bin in the game directory.
+extern "C" int __stdcall DumpFlightRecorder() {
+  return FlightRecorder::Dump();  // 0 = Failed, 1 = Success.
+}
+
+// Copies the frame pacing statistics into stats (set stats->size = sizeof(EqwFrameStats) first, see
+// frame_stats.h for the layout). Allows external tools to monitor without installing Present() hooks.
+extern "C" int __stdcall GetFrameStats(EqwFrameStats* stats) {
+  return FrameStats::Get(stats) ? 1 : 0;  // 0 = Failed (invalid size), 1 = Success.
+}
+
+// Requests a screenshot of the next presented frame. The file is encoded and saved to the Screenshots
+// directory by a background thread.
+extern "C" int __stdcall RequestScreenshot() {
+  Screenshot::Request();
+  return 1;  // 1 = Success (queued).
+}
+
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved) {
   return TRUE;  // Do nothing.  The ordinal 1 call above initializes and it is never unloaded.
 }
@@ -0,0 +1,400 @@
+#include "draw_merge.h"
+
+#include "device_call_hook.h"
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace DrawMergeInt {
+namespace {
+
+static constexpr UINT kMaxPrimitives = 0xffff;  // Stays within the MaxPrimitiveCount of older drivers.
+
+// The held back draw. Only list primitives can be concatenated.
+struct HeldDraw {
+  bool indexed;
+  D3DPRIMITIVETYPE type;
+  UINT start;      // First index, or first vertex if not indexed.
+  UINT count;      // Primitives.
+  UINT min_index;  // Vertex range referenced by an indexed draw.
+  UINT end_index;
+};
+
+bool enabled_ = false;  // Ini file setting.
+bool merging_ = false;  // Cleared if the locks can't be tracked.
+IDirect3DDevice8* device_ = nullptr;
+void** device_vtable_ = nullptr;
+bool held_ = false;
+HeldDraw draw_ = {};
+
+// Resource vtables with lock hooks. Each hook supports a single vtable.
+void** texture_vtable_ = nullptr;
+void** surface_vtable_ = nullptr;
+void** vertex_buffer_vtable_ = nullptr;
+void** index_buffer_vtable_ = nullptr;
+
+// Draw calls of the current and the last frame.
+unsigned int requested_ = 0;
+unsigned int submitted_ = 0;
+unsigned int last_requested_ = 0;
+unsigned int last_submitted_ = 0;
+
+VTableHook hook_GetBackBuffer_;
+VTableHook hook_CreateTexture_;
+VTableHook hook_CreateVertexBuffer_;
+VTableHook hook_CreateIndexBuffer_;
+VTableHook hook_CreateRenderTarget_;
+VTableHook hook_CreateDepthStencilSurface_;
+VTableHook hook_CreateImageSurface_;
+VTableHook hook_GetRenderTarget_;
+VTableHook hook_GetDepthStencilSurface_;
+VTableHook hook_DrawPrimitive_;
+VTableHook hook_DrawIndexedPrimitive_;
+VTableHook hook_TextureGetSurfaceLevel_;  // Direct3DTexture.
+VTableHook hook_TextureLockRect_;         // Direct3DTexture.
+VTableHook hook_SurfaceLockRect_;         // Direct3DSurface.
+VTableHook hook_VertexBufferLock_;        // Direct3DVertexBuffer.
+VTableHook hook_IndexBufferLock_;         // Direct3DIndexBuffer.
+
+HRESULT WINAPI D3DDeviceDrawPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                          UINT StartVertex, UINT PrimitiveCount);
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                 UINT MinIndex, UINT NumVertices, UINT StartIndex,
+                                                 UINT PrimitiveCount);
+
+// Returns the number of vertices (or indices) of a list draw, or zero for the other types.
+UINT GetListVertexCount(D3DPRIMITIVETYPE type, UINT primitive_count) {
+  switch (type) {
+    case D3DPT_POINTLIST:
+      return primitive_count;
+    case D3DPT_LINELIST:
+      return primitive_count * 2;
+    case D3DPT_TRIANGLELIST:
+      return primitive_count * 3;
+    default:
+      return 0;
+  }
+}
+
+void Flush() {
+  if (!held_) return;
+  held_ = false;
+  ++submitted_;
+  if (draw_.indexed)
+    hook_DrawIndexedPrimitive_.original(D3DDeviceDrawIndexedPrimitiveHook)(
+        device_, draw_.type, draw_.min_index, draw_.end_index - draw_.min_index, draw_.start, draw_.count);
+  else
+    hook_DrawPrimitive_.original(D3DDeviceDrawPrimitiveHook)(device_, draw_.type, draw_.start, draw_.count);
+}
+
+// Returns true if the draw continues the held draw.
+bool Continues(bool indexed, D3DPRIMITIVETYPE type, UINT start, UINT count) {
+  return held_ && draw_.indexed == indexed && draw_.type == type &&
+         start == draw_.start + GetListVertexCount(type, draw_.count) && draw_.count + count <= kMaxPrimitives;
+}
+
+// The device calls that are not merged issue the held draw first.
+struct OtherCall {
+  static void Before(IDirect3DDevice8* device) {
+    if (device == device_) Flush();
+  }
+};
+
+// User pointer draws are issued as is (after the held draw).
+struct UserDraw {
+  static void Before(IDirect3DDevice8* device) {
+    if (device != device_ || !merging_) return;
+    Flush();
+    ++requested_;
+    ++submitted_;
+  }
+};
+
+#define MERGE_FLUSH_HOOK(index, method) InstallDeviceCallHook<OtherCall, index>(vtable, &IDirect3DDevice8::method)
+
+HRESULT WINAPI D3DDeviceDrawPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                          UINT StartVertex, UINT PrimitiveCount) {
+  if (Device != device_ || !merging_)
+    return hook_DrawPrimitive_.original(D3DDeviceDrawPrimitiveHook)(Device, PrimitiveType, StartVertex,
+                                                                    PrimitiveCount);
+  ++requested_;
+  if (Continues(false, PrimitiveType, StartVertex, PrimitiveCount)) {
+    draw_.count += PrimitiveCount;
+    return D3D_OK;
+  }
+  Flush();
+  if (!GetListVertexCount(PrimitiveType, PrimitiveCount)) {
+    ++submitted_;
+    return hook_DrawPrimitive_.original(D3DDeviceDrawPrimitiveHook)(Device, PrimitiveType, StartVertex,
+                                                                    PrimitiveCount);
+  }
+  draw_ = {false, PrimitiveType, StartVertex, PrimitiveCount, 0, 0};
+  held_ = true;
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                 UINT MinIndex, UINT NumVertices, UINT StartIndex,
+                                                 UINT PrimitiveCount) {
+  if (Device != device_ || !merging_)
+    return hook_DrawIndexedPrimitive_.original(D3DDeviceDrawIndexedPrimitiveHook)(
+        Device, PrimitiveType, MinIndex, NumVertices, StartIndex, PrimitiveCount);
+  ++requested_;
+  if (Continues(true, PrimitiveType, StartIndex, PrimitiveCount)) {
+    draw_.count += PrimitiveCount;
+    if (MinIndex < draw_.min_index) draw_.min_index = MinIndex;
+    if (MinIndex + NumVertices > draw_.end_index) draw_.end_index = MinIndex + NumVertices;
+    return D3D_OK;
+  }
+  Flush();
+  if (!GetListVertexCount(PrimitiveType, PrimitiveCount)) {
+    ++submitted_;
+    return hook_DrawIndexedPrimitive_.original(D3DDeviceDrawIndexedPrimitiveHook)(
+        Device, PrimitiveType, MinIndex, NumVertices, StartIndex, PrimitiveCount);
+  }
+  draw_ = {true, PrimitiveType, StartIndex, PrimitiveCount, MinIndex, MinIndex + NumVertices};
+  held_ = true;
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DTextureLockRectHook(IDirect3DTexture8* Texture, UINT Level, D3DLOCKED_RECT* pLockedRect,
+                                      CONST RECT* pRect, DWORD Flags) {
+  Flush();
+  return hook_TextureLockRect_.original(D3DTextureLockRectHook)(Texture, Level, pLockedRect, pRect, Flags);
+}
+
+// A no overwrite lock promises not to touch data used by the held draw.
+HRESULT WINAPI D3DVertexBufferLockHook(IDirect3DVertexBuffer8* Buffer, UINT OffsetToLock, UINT SizeToLock,
+                                       BYTE** ppbData, DWORD Flags) {
+  if (!(Flags & D3DLOCK_NOOVERWRITE)) Flush();
+  return hook_VertexBufferLock_.original(D3DVertexBufferLockHook)(Buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+}
+
+HRESULT WINAPI D3DIndexBufferLockHook(IDirect3DIndexBuffer8* Buffer, UINT OffsetToLock, UINT SizeToLock,
+                                      BYTE** ppbData, DWORD Flags) {
+  if (!(Flags & D3DLOCK_NOOVERWRITE)) Flush();
+  return hook_IndexBufferLock_.original(D3DIndexBufferLockHook)(Buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+}
+
+// Returns true if the resource's vtable still needs its lock hook. A different vtable for the same
+// kind of resource can't be hooked (the hooks hold one original function), so it stops the merging.
+bool HookResource(void* resource, void**& hooked_vtable) {
+  void** vtable = *reinterpret_cast<void***>(resource);
+  if (vtable == hooked_vtable) return false;
+  if (hooked_vtable) {
+    if (merging_) Logger::Error("DrawMerge: Disabled, unexpected resource vtable");
+    Flush();
+    merging_ = false;
+    return false;
+  }
+  hooked_vtable = vtable;
+  return true;
+}
+
+HRESULT WINAPI D3DSurfaceLockRectHook(IDirect3DSurface8* Surface, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect,
+                                      DWORD Flags) {
+  Flush();
+  return hook_SurfaceLockRect_.original(D3DSurfaceLockRectHook)(Surface, pLockedRect, pRect, Flags);
+}
+
+// Texture levels and other surfaces can also be written through the surface lock.
+void HookSurface(HRESULT result, IDirect3DSurface8** surface) {
+  if (FAILED(result) || !surface || !*surface || !HookResource(*surface, surface_vtable_)) return;
+  hook_SurfaceLockRect_ = VTableHook(surface_vtable_, 9, D3DSurfaceLockRectHook, false);
+}
+
+HRESULT WINAPI D3DTextureGetSurfaceLevelHook(IDirect3DTexture8* Texture, UINT Level,
+                                             IDirect3DSurface8** ppSurfaceLevel) {
+  HRESULT result = hook_TextureGetSurfaceLevel_.original(D3DTextureGetSurfaceLevelHook)(Texture, Level,
+                                                                                       ppSurfaceLevel);
+  HookSurface(result, ppSurfaceLevel);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceGetBackBufferHook(IDirect3DDevice8* Device, UINT BackBuffer, D3DBACKBUFFER_TYPE Type,
+                                          IDirect3DSurface8** ppBackBuffer) {
+  if (Device == device_) Flush();
+  HRESULT result = hook_GetBackBuffer_.original(D3DDeviceGetBackBufferHook)(Device, BackBuffer, Type, ppBackBuffer);
+  HookSurface(result, ppBackBuffer);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateTextureHook(IDirect3DDevice8* Device, UINT Width, UINT Height, UINT Levels,
+                                          DWORD Usage, D3DFORMAT Format, D3DPOOL Pool,
+                                          IDirect3DTexture8** ppTexture) {
+  HRESULT result = hook_CreateTexture_.original(D3DDeviceCreateTextureHook)(Device, Width, Height, Levels, Usage,
+                                                                            Format, Pool, ppTexture);
+  if (SUCCEEDED(result) && ppTexture && *ppTexture && HookResource(*ppTexture, texture_vtable_)) {
+    hook_TextureGetSurfaceLevel_ = VTableHook(texture_vtable_, 15, D3DTextureGetSurfaceLevelHook, false);
+    hook_TextureLockRect_ = VTableHook(texture_vtable_, 16, D3DTextureLockRectHook, false);
+  }
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateVertexBufferHook(IDirect3DDevice8* Device, UINT Length, DWORD Usage, DWORD FVF,
+                                               D3DPOOL Pool, IDirect3DVertexBuffer8** ppVertexBuffer) {
+  HRESULT result = hook_CreateVertexBuffer_.original(D3DDeviceCreateVertexBufferHook)(Device, Length, Usage, FVF,
+                                                                                      Pool, ppVertexBuffer);
+  if (SUCCEEDED(result) && ppVertexBuffer && *ppVertexBuffer && HookResource(*ppVertexBuffer, vertex_buffer_vtable_))
+    hook_VertexBufferLock_ = VTableHook(vertex_buffer_vtable_, 11, D3DVertexBufferLockHook, false);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateIndexBufferHook(IDirect3DDevice8* Device, UINT Length, DWORD Usage, D3DFORMAT Format,
+                                              D3DPOOL Pool, IDirect3DIndexBuffer8** ppIndexBuffer) {
+  HRESULT result = hook_CreateIndexBuffer_.original(D3DDeviceCreateIndexBufferHook)(Device, Length, Usage, Format,
+                                                                                    Pool, ppIndexBuffer);
+  if (SUCCEEDED(result) && ppIndexBuffer && *ppIndexBuffer && HookResource(*ppIndexBuffer, index_buffer_vtable_))
+    hook_IndexBufferLock_ = VTableHook(index_buffer_vtable_, 11, D3DIndexBufferLockHook, false);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateRenderTargetHook(IDirect3DDevice8* Device, UINT Width, UINT Height, D3DFORMAT Format,
+                                               D3DMULTISAMPLE_TYPE MultiSample, BOOL Lockable,
+                                               IDirect3DSurface8** ppSurface) {
+  HRESULT result = hook_CreateRenderTarget_.original(D3DDeviceCreateRenderTargetHook)(Device, Width, Height, Format,
+                                                                                      MultiSample, Lockable, ppSurface);
+  HookSurface(result, ppSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateDepthStencilSurfaceHook(IDirect3DDevice8* Device, UINT Width, UINT Height,
+                                                      D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample,
+                                                      IDirect3DSurface8** ppSurface) {
+  HRESULT result = hook_CreateDepthStencilSurface_.original(D3DDeviceCreateDepthStencilSurfaceHook)(
+      Device, Width, Height, Format, MultiSample, ppSurface);
+  HookSurface(result, ppSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceCreateImageSurfaceHook(IDirect3DDevice8* Device, UINT Width, UINT Height, D3DFORMAT Format,
+                                               IDirect3DSurface8** ppSurface) {
+  HRESULT result =
+      hook_CreateImageSurface_.original(D3DDeviceCreateImageSurfaceHook)(Device, Width, Height, Format, ppSurface);
+  HookSurface(result, ppSurface);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceGetRenderTargetHook(IDirect3DDevice8* Device, IDirect3DSurface8** ppRenderTarget) {
+  if (Device == device_) Flush();
+  HRESULT result = hook_GetRenderTarget_.original(D3DDeviceGetRenderTargetHook)(Device, ppRenderTarget);
+  HookSurface(result, ppRenderTarget);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceGetDepthStencilSurfaceHook(IDirect3DDevice8* Device, IDirect3DSurface8** ppZStencilSurface) {
+  if (Device == device_) Flush();
+  HRESULT result =
+      hook_GetDepthStencilSurface_.original(D3DDeviceGetDepthStencilSurfaceHook)(Device, ppZStencilSurface);
+  HookSurface(result, ppZStencilSurface);
+  return result;
+}
+
+}  // namespace
+}  // namespace DrawMergeInt
+
+void DrawMerge::Initialize(const std::filesystem::path& ini_file) {
+  using namespace DrawMergeInt;
+  enabled_ = Ini::GetValue<bool>("EqwGeneral", "MergeDrawCalls", false, ini_file.string().c_str());
+  if (enabled_) Logger::Info("DrawMerge: Enabled");
+}
+
+bool DrawMerge::IsEnabled() { return DrawMergeInt::merging_; }
+
+void DrawMerge::InstallHooks(IDirect3DDevice8* device) {
+  using namespace DrawMergeInt;
+  if (!enabled_) return;
+  device_ = device;
+  merging_ = true;
+  held_ = false;
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Still installed below the other hooks.
+  device_vtable_ = vtable;
+
+  MERGE_FLUSH_HOOK(3, TestCooperativeLevel);
+  MERGE_FLUSH_HOOK(5, ResourceManagerDiscardBytes);
+  MERGE_FLUSH_HOOK(13, CreateAdditionalSwapChain);
+  MERGE_FLUSH_HOOK(14, Reset);
+  MERGE_FLUSH_HOOK(15, Present);
+  hook_GetBackBuffer_ = VTableHook(vtable, 16, D3DDeviceGetBackBufferHook, false);
+  MERGE_FLUSH_HOOK(18, SetGammaRamp);
+  hook_CreateTexture_ = VTableHook(vtable, 20, D3DDeviceCreateTextureHook, false);
+  hook_CreateVertexBuffer_ = VTableHook(vtable, 23, D3DDeviceCreateVertexBufferHook, false);
+  hook_CreateIndexBuffer_ = VTableHook(vtable, 24, D3DDeviceCreateIndexBufferHook, false);
+  hook_CreateRenderTarget_ = VTableHook(vtable, 25, D3DDeviceCreateRenderTargetHook, false);
+  hook_CreateDepthStencilSurface_ = VTableHook(vtable, 26, D3DDeviceCreateDepthStencilSurfaceHook, false);
+  hook_CreateImageSurface_ = VTableHook(vtable, 27, D3DDeviceCreateImageSurfaceHook, false);
+  MERGE_FLUSH_HOOK(28, CopyRects);
+  MERGE_FLUSH_HOOK(29, UpdateTexture);
+  MERGE_FLUSH_HOOK(30, GetFrontBuffer);
+  MERGE_FLUSH_HOOK(31, SetRenderTarget);
+  hook_GetRenderTarget_ = VTableHook(vtable, 32, D3DDeviceGetRenderTargetHook, false);
+  hook_GetDepthStencilSurface_ = VTableHook(vtable, 33, D3DDeviceGetDepthStencilSurfaceHook, false);
+  MERGE_FLUSH_HOOK(34, BeginScene);
+  MERGE_FLUSH_HOOK(35, EndScene);
+  MERGE_FLUSH_HOOK(36, Clear);
+  MERGE_FLUSH_HOOK(37, SetTransform);
+  MERGE_FLUSH_HOOK(38, GetTransform);
+  MERGE_FLUSH_HOOK(39, MultiplyTransform);
+  MERGE_FLUSH_HOOK(40, SetViewport);
+  MERGE_FLUSH_HOOK(41, GetViewport);
+  MERGE_FLUSH_HOOK(42, SetMaterial);
+  MERGE_FLUSH_HOOK(43, GetMaterial);
+  MERGE_FLUSH_HOOK(44, SetLight);
+  MERGE_FLUSH_HOOK(45, GetLight);
+  MERGE_FLUSH_HOOK(46, LightEnable);
+  MERGE_FLUSH_HOOK(47, GetLightEnable);
+  MERGE_FLUSH_HOOK(48, SetClipPlane);
+  MERGE_FLUSH_HOOK(49, GetClipPlane);
+  MERGE_FLUSH_HOOK(50, SetRenderState);
+  MERGE_FLUSH_HOOK(51, GetRenderState);
+  MERGE_FLUSH_HOOK(52, BeginStateBlock);
+  MERGE_FLUSH_HOOK(53, EndStateBlock);
+  MERGE_FLUSH_HOOK(54, ApplyStateBlock);
+  MERGE_FLUSH_HOOK(55, CaptureStateBlock);
+  MERGE_FLUSH_HOOK(56, DeleteStateBlock);
+  MERGE_FLUSH_HOOK(57, CreateStateBlock);
+  MERGE_FLUSH_HOOK(58, SetClipStatus);
+  MERGE_FLUSH_HOOK(59, GetClipStatus);
+  MERGE_FLUSH_HOOK(60, GetTexture);
+  MERGE_FLUSH_HOOK(61, SetTexture);
+  MERGE_FLUSH_HOOK(62, GetTextureStageState);
+  MERGE_FLUSH_HOOK(63, SetTextureStageState);
+  MERGE_FLUSH_HOOK(64, ValidateDevice);
+  MERGE_FLUSH_HOOK(66, SetPaletteEntries);
+  MERGE_FLUSH_HOOK(68, SetCurrentTexturePalette);
+  hook_DrawPrimitive_ = VTableHook(vtable, 70, D3DDeviceDrawPrimitiveHook, false);
+  hook_DrawIndexedPrimitive_ = VTableHook(vtable, 71, D3DDeviceDrawIndexedPrimitiveHook, false);
+  InstallDeviceCallHook<UserDraw, 72>(vtable, &IDirect3DDevice8::DrawPrimitiveUP);
+  InstallDeviceCallHook<UserDraw, 73>(vtable, &IDirect3DDevice8::DrawIndexedPrimitiveUP);
+  MERGE_FLUSH_HOOK(74, ProcessVertices);
+  MERGE_FLUSH_HOOK(75, CreateVertexShader);
+  MERGE_FLUSH_HOOK(76, SetVertexShader);
+  MERGE_FLUSH_HOOK(77, GetVertexShader);
+  MERGE_FLUSH_HOOK(78, DeleteVertexShader);
+  MERGE_FLUSH_HOOK(79, SetVertexShaderConstant);
+  MERGE_FLUSH_HOOK(80, GetVertexShaderConstant);
+  MERGE_FLUSH_HOOK(83, SetStreamSource);
+  MERGE_FLUSH_HOOK(84, GetStreamSource);
+  MERGE_FLUSH_HOOK(85, SetIndices);
+  MERGE_FLUSH_HOOK(86, GetIndices);
+  MERGE_FLUSH_HOOK(87, CreatePixelShader);
+  MERGE_FLUSH_HOOK(88, SetPixelShader);
+  MERGE_FLUSH_HOOK(90, DeletePixelShader);
+  MERGE_FLUSH_HOOK(91, SetPixelShaderConstant);
+  MERGE_FLUSH_HOOK(94, DrawRectPatch);
+  MERGE_FLUSH_HOOK(95, DrawTriPatch);
+  MERGE_FLUSH_HOOK(96, DeletePatch);
+}
+
+void DrawMerge::OnPresent() {
+  using namespace DrawMergeInt;
+  last_requested_ = requested_;
+  last_submitted_ = submitted_;
+  requested_ = 0;
+  submitted_ = 0;
+}
+
+unsigned int DrawMerge::GetRequestedDraws() { return DrawMergeInt::last_requested_; }
+
+unsigned int DrawMerge::GetSubmittedDraws() { return DrawMergeInt::last_submitted_; }
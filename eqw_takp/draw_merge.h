@@ -0,0 +1,38 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) merging of consecutive draw calls of the primary device.
+//
+// A point, line or triangle list draw is held back, and the following draws of the same type that
+// continue its index range (or vertex range for DrawPrimitive()) are appended to it. The held draw
+// is issued as one call ahead of any other device call that changes or reads the rendering state,
+// so any state, texture, stream or index change, EndScene() or Present() flushes it, as do the
+// texture, surface and buffer locks (except no overwrite locks). The hooks sit below StateFilter so the
+// redundant state calls it drops do not split a batch.
+//
+// With DynamicDraw, the indices of consecutive user pointer draws are rebased onto the bound base
+// vertex while they are copied, so the converted draws continue the same index range instead of
+// rebinding the index buffer for every draw.
+
+namespace DrawMerge {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the enable setting.
+
+bool IsEnabled();
+
+// Installs the device hooks. Call after each primary device creation, after DeferredSubmit and
+// before the other device hooks.
+void InstallHooks(IDirect3DDevice8* device);
+
+void OnPresent();  // Latches the per-frame draw counts. Call from the game thread on each Present().
+
+// Returns the number of draw calls in the last frame before and after the merging.
+unsigned int GetRequestedDraws();
+unsigned int GetSubmittedDraws();
+
+}  // namespace DrawMerge
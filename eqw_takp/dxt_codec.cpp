@@ -0,0 +1,293 @@
+#include "dxt_codec.h"
+
+#include <cstring>
+
+#if !defined(DXT_CODEC_SCALAR) && (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__))
+#include <emmintrin.h>
+#define DXT_CODEC_SSE2
+#endif
+
+namespace DxtCodecInt {
+namespace {
+
+static constexpr int kColorIndex[4] = {1, 3, 2, 0};               // Projection level to DXT color index.
+static constexpr int kAlphaIndex[8] = {1, 7, 6, 5, 4, 3, 2, 0};  // Projection level to DXT5 alpha index.
+
+inline uint8_t Expand5(uint32_t value) { return static_cast<uint8_t>((value << 3) | (value >> 2)); }
+inline uint8_t Expand6(uint32_t value) { return static_cast<uint8_t>((value << 2) | (value >> 4)); }
+
+inline uint16_t To565(const uint8_t bgr[3]) {
+  return static_cast<uint16_t>(((bgr[2] >> 3) << 11) | ((bgr[1] >> 2) << 5) | (bgr[0] >> 3));
+}
+
+inline void From565(uint16_t color, uint8_t bgr[3]) {
+  bgr[0] = Expand5(color & 0x1f);
+  bgr[1] = Expand6((color >> 5) & 0x3f);
+  bgr[2] = Expand5(color >> 11);
+}
+
+inline void Store16(uint8_t* dest, uint32_t value) {
+  dest[0] = static_cast<uint8_t>(value);
+  dest[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void Store32(uint8_t* dest, uint32_t value) {
+  for (int i = 0; i < 4; ++i) dest[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+// Copies a 4x4 block into B, G, R, A pixels. Pixels beyond the image edge repeat the last row or
+// column so they don't affect the endpoints.
+void LoadBlock(DxtCodec::SourceFormat format, const uint8_t* source, int pitch, int width, int height, int x0,
+               int y0, uint8_t block[64]) {
+  for (int y = 0; y < 4; ++y) {
+    int sy = (y0 + y < height) ? y0 + y : height - 1;
+    const uint8_t* row = source + static_cast<ptrdiff_t>(sy) * pitch;
+    for (int x = 0; x < 4; ++x) {
+      int sx = (x0 + x < width) ? x0 + x : width - 1;
+      uint8_t* pixel = block + (y * 4 + x) * 4;
+      if (format == DxtCodec::SourceFormat::kRgb565) {
+        From565(static_cast<uint16_t>(row[sx * 2] | (row[sx * 2 + 1] << 8)), pixel);
+        pixel[3] = 0xff;
+      } else {
+        std::memcpy(pixel, row + sx * 4, 4);
+        if (format == DxtCodec::SourceFormat::kXrgb8888) pixel[3] = 0xff;
+      }
+    }
+  }
+}
+
+void StorePixel(DxtCodec::SourceFormat format, const uint8_t bgra[4], uint8_t* dest) {
+  if (format == DxtCodec::SourceFormat::kRgb565) {
+    Store16(dest, To565(bgra));
+  } else {
+    std::memcpy(dest, bgra, 4);
+    if (format == DxtCodec::SourceFormat::kXrgb8888) dest[3] = 0xff;
+  }
+}
+
+// Returns the per channel minimum and maximum of the block.
+void GetExtents(const uint8_t block[64], uint8_t minimum[4], uint8_t maximum[4]) {
+#ifdef DXT_CODEC_SSE2
+  const __m128i* rows = reinterpret_cast<const __m128i*>(block);
+  __m128i r0 = _mm_loadu_si128(rows), r1 = _mm_loadu_si128(rows + 1);
+  __m128i r2 = _mm_loadu_si128(rows + 2), r3 = _mm_loadu_si128(rows + 3);
+  __m128i low = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+  __m128i high = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+  low = _mm_min_epu8(low, _mm_srli_si128(low, 8));
+  low = _mm_min_epu8(low, _mm_srli_si128(low, 4));
+  high = _mm_max_epu8(high, _mm_srli_si128(high, 8));
+  high = _mm_max_epu8(high, _mm_srli_si128(high, 4));
+  Store32(minimum, static_cast<uint32_t>(_mm_cvtsi128_si32(low)));
+  Store32(maximum, static_cast<uint32_t>(_mm_cvtsi128_si32(high)));
+#else
+  std::memcpy(minimum, block, 4);
+  std::memcpy(maximum, block, 4);
+  for (int i = 4; i < 64; ++i) {
+    int c = i & 3;
+    if (block[i] < minimum[c]) minimum[c] = block[i];
+    if (block[i] > maximum[c]) maximum[c] = block[i];
+  }
+#endif
+}
+
+// Computes the projection level (0 = color1 to 3 = color0) of each pixel onto the axis from
+// endpoint e1 to e0. The thresholds are at 1/6, 1/2, and 5/6 of the axis length.
+void GetColorLevels(const uint8_t block[64], const uint8_t e0[3], const uint8_t e1[3], int levels[16]) {
+  int d[3] = {e0[0] - e1[0], e0[1] - e1[1], e0[2] - e1[2]};
+  int length = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+#ifdef DXT_CODEC_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i origin = _mm_set_epi16(0, e1[2], e1[1], e1[0], 0, e1[2], e1[1], e1[0]);
+  const __m128i axis = _mm_set_epi16(0, static_cast<short>(d[2]), static_cast<short>(d[1]), static_cast<short>(d[0]),
+                                     0, static_cast<short>(d[2]), static_cast<short>(d[1]), static_cast<short>(d[0]));
+  const __m128i threshold1 = _mm_set1_epi32(length);
+  const __m128i threshold2 = _mm_set1_epi32(3 * length);
+  const __m128i threshold3 = _mm_set1_epi32(5 * length);
+  for (int row = 0; row < 4; ++row) {
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + row * 16));
+    __m128i low = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(pixels, zero), origin), axis);
+    __m128i high = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(pixels, zero), origin), axis);
+    __m128 low_ps = _mm_castsi128_ps(low), high_ps = _mm_castsi128_ps(high);
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(low_ps, high_ps, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(low_ps, high_ps, _MM_SHUFFLE(3, 1, 3, 1)));
+    __m128i t = _mm_add_epi32(even, odd);
+    __m128i t6 = _mm_add_epi32(_mm_slli_epi32(t, 2), _mm_slli_epi32(t, 1));
+    __m128i level = _mm_add_epi32(_mm_set1_epi32(3), _mm_cmplt_epi32(t6, threshold1));
+    level = _mm_add_epi32(level, _mm_cmplt_epi32(t6, threshold2));
+    level = _mm_add_epi32(level, _mm_cmplt_epi32(t6, threshold3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + row * 4), level);
+  }
+#else
+  for (int i = 0; i < 16; ++i) {
+    const uint8_t* pixel = block + i * 4;
+    int t = (pixel[0] - e1[0]) * d[0] + (pixel[1] - e1[1]) * d[1] + (pixel[2] - e1[2]) * d[2];
+    int t6 = t * 6;
+    levels[i] = (t6 >= length) + (t6 >= 3 * length) + (t6 >= 5 * length);
+  }
+#endif
+}
+
+// Computes the projection level (0 = a1 to 7 = a0) of each pixel's alpha.
+void GetAlphaLevels(const uint8_t block[64], int a0, int a1, int levels[16]) {
+  int range = a0 - a1;
+#ifdef DXT_CODEC_SSE2
+  const __m128i* rows = reinterpret_cast<const __m128i*>(block);
+  __m128i alpha_low = _mm_packs_epi32(_mm_srli_epi32(_mm_loadu_si128(rows), 24),
+                                      _mm_srli_epi32(_mm_loadu_si128(rows + 1), 24));
+  __m128i alpha_high = _mm_packs_epi32(_mm_srli_epi32(_mm_loadu_si128(rows + 2), 24),
+                                       _mm_srli_epi32(_mm_loadu_si128(rows + 3), 24));
+  const __m128i origin = _mm_set1_epi16(static_cast<short>(a1));
+  const __m128i scale = _mm_set1_epi16(14);
+  __m128i t_low = _mm_mullo_epi16(_mm_sub_epi16(alpha_low, origin), scale);
+  __m128i t_high = _mm_mullo_epi16(_mm_sub_epi16(alpha_high, origin), scale);
+  __m128i level_low = _mm_set1_epi16(7), level_high = level_low;
+  for (int k = 0; k < 7; ++k) {
+    __m128i threshold = _mm_set1_epi16(static_cast<short>((2 * k + 1) * range));
+    level_low = _mm_add_epi16(level_low, _mm_cmplt_epi16(t_low, threshold));
+    level_high = _mm_add_epi16(level_high, _mm_cmplt_epi16(t_high, threshold));
+  }
+  int16_t values[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(values), level_low);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(values + 8), level_high);
+  for (int i = 0; i < 16; ++i) levels[i] = values[i];
+#else
+  for (int i = 0; i < 16; ++i) {
+    int t = (block[i * 4 + 3] - a1) * 14;
+    int level = 0;
+    for (int k = 0; k < 7; ++k) level += (t >= (2 * k + 1) * range);
+    levels[i] = level;
+  }
+#endif
+}
+
+void EncodeColorBlock(const uint8_t block[64], const uint8_t minimum[4], const uint8_t maximum[4], uint8_t* dest) {
+  // Inset the extents by 1/16 of the range to reduce the error of the interpolated colors.
+  uint8_t low[3], high[3];
+  for (int c = 0; c < 3; ++c) {
+    int inset = (maximum[c] - minimum[c]) >> 4;
+    low[c] = static_cast<uint8_t>(minimum[c] + inset);
+    high[c] = static_cast<uint8_t>(maximum[c] - inset);
+  }
+  uint16_t color0 = To565(high), color1 = To565(low);  // color0 >= color1 since high >= low per channel.
+  Store16(dest, color0);
+  Store16(dest + 2, color1);
+  if (color0 == color1) {
+    Store32(dest + 4, 0);  // All pixels use color0.
+    return;
+  }
+
+  uint8_t e0[3], e1[3];
+  From565(color0, e0);
+  From565(color1, e1);
+  int levels[16];
+  GetColorLevels(block, e0, e1, levels);
+  uint32_t indices = 0;
+  for (int i = 0; i < 16; ++i) indices |= static_cast<uint32_t>(kColorIndex[levels[i]]) << (2 * i);
+  Store32(dest + 4, indices);
+}
+
+void EncodeAlphaBlock(const uint8_t block[64], int a0, int a1, uint8_t* dest) {
+  dest[0] = static_cast<uint8_t>(a0);
+  dest[1] = static_cast<uint8_t>(a1);
+  std::memset(dest + 2, 0, 6);
+  if (a0 == a1) return;  // All pixels use a0.
+
+  int levels[16];
+  GetAlphaLevels(block, a0, a1, levels);
+  uint64_t indices = 0;
+  for (int i = 0; i < 16; ++i) indices |= static_cast<uint64_t>(kAlphaIndex[levels[i]]) << (3 * i);
+  for (int i = 0; i < 6; ++i) dest[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+void DecodeColorBlock(const uint8_t* source, uint8_t block[64], bool opaque_only) {
+  uint16_t color0 = static_cast<uint16_t>(source[0] | (source[1] << 8));
+  uint16_t color1 = static_cast<uint16_t>(source[2] | (source[3] << 8));
+  uint8_t palette[4][4];
+  From565(color0, palette[0]);
+  From565(color1, palette[1]);
+  bool four_colors = !opaque_only || color0 > color1;  // DXT5 color blocks always use four colors.
+  for (int c = 0; c < 3; ++c) {
+    if (four_colors) {
+      palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+      palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+    } else {
+      palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+      palette[3][c] = 0;
+    }
+  }
+  for (int i = 0; i < 4; ++i) palette[i][3] = 0xff;
+  if (!four_colors) palette[3][3] = 0;  // Transparent black.
+
+  uint32_t indices = source[4] | (source[5] << 8) | (source[6] << 16) | (static_cast<uint32_t>(source[7]) << 24);
+  for (int i = 0; i < 16; ++i) std::memcpy(block + i * 4, palette[(indices >> (2 * i)) & 3], 4);
+}
+
+void DecodeAlphaBlock(const uint8_t* source, uint8_t block[64]) {
+  int a0 = source[0], a1 = source[1];
+  uint8_t palette[8] = {static_cast<uint8_t>(a0), static_cast<uint8_t>(a1)};
+  for (int i = 2; i < 8; ++i) {
+    if (a0 > a1)
+      palette[i] = static_cast<uint8_t>(((8 - i) * a0 + (i - 1) * a1) / 7);
+    else
+      palette[i] = (i < 6) ? static_cast<uint8_t>(((6 - i) * a0 + (i - 1) * a1) / 5) : (i == 6 ? 0 : 0xff);
+  }
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; ++i) indices |= static_cast<uint64_t>(source[2 + i]) << (8 * i);
+  for (int i = 0; i < 16; ++i) block[i * 4 + 3] = palette[(indices >> (3 * i)) & 7];
+}
+
+inline size_t GetBlockSize(DxtCodec::BlockFormat format) { return format == DxtCodec::BlockFormat::kDxt1 ? 8 : 16; }
+
+}  // namespace
+}  // namespace DxtCodecInt
+
+size_t DxtCodec::GetBlockRowSize(BlockFormat format, int width) {
+  return static_cast<size_t>((width + 3) / 4) * DxtCodecInt::GetBlockSize(format);
+}
+
+size_t DxtCodec::GetEncodedSize(BlockFormat format, int width, int height) {
+  return GetBlockRowSize(format, width) * ((height + 3) / 4);
+}
+
+void DxtCodec::EncodeImage(SourceFormat source_format, const uint8_t* source, int pitch, int width, int height,
+                           BlockFormat format, uint8_t* blocks) {
+  using namespace DxtCodecInt;
+  uint8_t block[64];
+  for (int y = 0; y < height; y += 4) {
+    for (int x = 0; x < width; x += 4) {
+      LoadBlock(source_format, source, pitch, width, height, x, y, block);
+      uint8_t minimum[4], maximum[4];
+      GetExtents(block, minimum, maximum);
+      if (format == BlockFormat::kDxt5) {
+        EncodeAlphaBlock(block, maximum[3], minimum[3], blocks);
+        blocks += 8;
+      }
+      EncodeColorBlock(block, minimum, maximum, blocks);
+      blocks += 8;
+    }
+  }
+}
+
+void DxtCodec::DecodeImage(BlockFormat format, const uint8_t* blocks, int width, int height, SourceFormat dest_format,
+                           uint8_t* dest, int pitch) {
+  using namespace DxtCodecInt;
+  const int bytes_per_pixel = (dest_format == SourceFormat::kRgb565) ? 2 : 4;
+  uint8_t block[64];
+  for (int y = 0; y < height; y += 4) {
+    for (int x = 0; x < width; x += 4) {
+      if (format == BlockFormat::kDxt5) {
+        DecodeColorBlock(blocks + 8, block, false);
+        DecodeAlphaBlock(blocks, block);
+        blocks += 16;
+      } else {
+        DecodeColorBlock(blocks, block, true);
+        blocks += 8;
+      }
+      for (int by = 0; by < 4 && y + by < height; ++by) {
+        uint8_t* row = dest + static_cast<ptrdiff_t>(y + by) * pitch;
+        for (int bx = 0; bx < 4 && x + bx < width; ++bx)
+          StorePixel(dest_format, block + (by * 4 + bx) * 4, row + (x + bx) * bytes_per_pixel);
+      }
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Portable DXT1 and DXT5 block compression used by the texture compression worker thread and the
+// tools/dxt_bench.cpp benchmark. The encoder is a fast bounding box encoder: the color endpoints
+// are the inset per channel extents of the block and the pixels are assigned to the palette by
+// their projection onto the endpoint axis. The extents and projections use SSE2 when available
+// (define DXT_CODEC_SCALAR to force the scalar path, which produces identical output).
+
+namespace DxtCodec {
+
+enum class SourceFormat {
+  kArgb8888,  // Little-endian 32-bit (B, G, R, A bytes).
+  kXrgb8888,  // Alpha byte ignored.
+  kRgb565,
+};
+
+enum class BlockFormat {
+  kDxt1,  // 8 bytes per 4x4 block, opaque.
+  kDxt5,  // 16 bytes per 4x4 block with interpolated alpha.
+};
+
+// Bytes per row of blocks and for the whole image (any size, partial blocks are padded).
+size_t GetBlockRowSize(BlockFormat format, int width);
+size_t GetEncodedSize(BlockFormat format, int width, int height);
+
+// Encodes the image into tightly packed rows of blocks.
+void EncodeImage(SourceFormat source_format, const uint8_t* source, int pitch, int width, int height,
+                 BlockFormat format, uint8_t* blocks);
+
+// Decodes tightly packed rows of blocks back into the source format.
+void DecodeImage(BlockFormat format, const uint8_t* blocks, int width, int height, SourceFormat dest_format,
+                 uint8_t* dest, int pitch);
+
+}  // namespace DxtCodec
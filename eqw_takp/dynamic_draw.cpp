@@ -0,0 +1,276 @@
+#include "dynamic_draw.h"
+
+#include <emmintrin.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "draw_merge.h"
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace DynamicDrawInt {
+namespace {
+
+static constexpr UINT kVertexBufferSize = 4 * 1024 * 1024;
+static constexpr UINT kIndexBufferSize = 1024 * 1024;
+static constexpr size_t kStreamCopyMinSize = 1024;  // Smaller copies stay in the cache with memcpy().
+
+bool enabled_ = false;
+bool failed_ = false;  // Buffer creation failed, so pass everything through.
+IDirect3DDevice8* device_ = nullptr;
+void** device_vtable_ = nullptr;  // The hooked vtable (the hooks are only installed once).
+IDirect3DVertexBuffer8* vertex_buffer_ = nullptr;
+IDirect3DIndexBuffer8* index_buffer_ = nullptr;
+UINT vertex_position_ = 0;  // Next free byte.
+UINT index_position_ = 0;
+
+// Tracks whether the ring buffers are still bound so the bindings can be skipped.
+UINT bound_stride_ = 0;  // Zero if stream 0 is not bound to the vertex buffer.
+bool indices_bound_ = false;
+UINT bound_base_vertex_ = 0;
+UINT bound_index_stride_ = 0;  // Vertex stride of the bound base vertex.
+
+VTableHook hook_SetStreamSource_;
+VTableHook hook_SetIndices_;
+VTableHook hook_ApplyStateBlock_;
+
+void ClearBindings() {
+  bound_stride_ = 0;
+  indices_bound_ = false;
+}
+
+void ReleaseBuffers() {
+  if (vertex_buffer_) vertex_buffer_->Release();
+  if (index_buffer_) index_buffer_->Release();
+  vertex_buffer_ = nullptr;
+  index_buffer_ = nullptr;
+  device_ = nullptr;
+  ClearBindings();
+}
+
+bool CreateBuffers(IDirect3DDevice8* device) {
+  const DWORD usage = D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY;
+  HRESULT result = device->CreateVertexBuffer(kVertexBufferSize, usage, 0, D3DPOOL_DEFAULT, &vertex_buffer_);
+  if (SUCCEEDED(result))
+    result = device->CreateIndexBuffer(kIndexBufferSize, usage, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &index_buffer_);
+  if (FAILED(result)) {
+    Logger::Error("DynamicDraw: Failed to create buffers, disabling: 0x%08x", result);
+    ReleaseBuffers();
+    failed_ = true;
+    return false;
+  }
+  device_ = device;
+  vertex_position_ = kVertexBufferSize;  // Forces a discard on the first lock.
+  index_position_ = kIndexBufferSize;
+  return true;
+}
+
+// Copies to write-combined memory. Large copies use streaming stores that bypass the cache.
+void CopyToBuffer(BYTE* dest, const BYTE* source, size_t size) {
+  if (size < kStreamCopyMinSize) {
+    std::memcpy(dest, source, size);
+    return;
+  }
+  size_t head = (16 - (reinterpret_cast<uintptr_t>(dest) & 15)) & 15;
+  std::memcpy(dest, source, head);
+  dest += head;
+  source += head;
+  size -= head;
+  for (; size >= 64; size -= 64, dest += 64, source += 64) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 16));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 32));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dest), a);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dest + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dest + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dest + 48), d);
+  }
+  _mm_sfence();
+  std::memcpy(dest, source, size);
+}
+
+// Copies 16-bit indices offset by delta (rebased onto an earlier base vertex).
+void CopyRebasedIndices(BYTE* dest, const BYTE* source, size_t size, WORD delta) {
+  const __m128i offset = _mm_set1_epi16(static_cast<short>(delta));
+  for (; size >= 16; size -= 16, dest += 16, source += 16) {
+    __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_add_epi16(indices, offset));
+  }
+  for (; size >= sizeof(WORD); size -= sizeof(WORD), dest += sizeof(WORD), source += sizeof(WORD)) {
+    WORD index;
+    std::memcpy(&index, source, sizeof(index));
+    index = static_cast<WORD>(index + delta);
+    std::memcpy(dest, &index, sizeof(index));
+  }
+}
+
+// Appends the data to a ring buffer at an offset aligned to alignment, adding index_delta to the
+// 16-bit indices if nonzero. Returns the offset of the data or -1 on a failure.
+template <typename Buffer>
+int Append(Buffer* buffer, UINT buffer_size, UINT& position, const void* data, UINT size, UINT alignment,
+           WORD index_delta = 0) {
+  UINT offset = (position + alignment - 1) / alignment * alignment;
+  DWORD flags = D3DLOCK_NOOVERWRITE;
+  if (offset + size > buffer_size) {
+    offset = 0;
+    flags = D3DLOCK_DISCARD;
+  }
+  BYTE* locked = nullptr;
+  if (FAILED(buffer->Lock(offset, size, &locked, flags))) return -1;
+  if (index_delta)
+    CopyRebasedIndices(locked, static_cast<const BYTE*>(data), size, index_delta);
+  else
+    CopyToBuffer(locked, static_cast<const BYTE*>(data), size);
+  buffer->Unlock();
+  position = offset + size;
+  return static_cast<int>(offset);
+}
+
+UINT GetVertexCount(D3DPRIMITIVETYPE type, UINT primitive_count) {
+  switch (type) {
+    case D3DPT_POINTLIST:
+      return primitive_count;
+    case D3DPT_LINELIST:
+      return primitive_count * 2;
+    case D3DPT_LINESTRIP:
+      return primitive_count + 1;
+    case D3DPT_TRIANGLELIST:
+      return primitive_count * 3;
+    case D3DPT_TRIANGLESTRIP:
+    case D3DPT_TRIANGLEFAN:
+      return primitive_count + 2;
+    default:
+      return 0;
+  }
+}
+
+// Returns false if the buffers are not usable for the device.
+bool PrepareBuffers(IDirect3DDevice8* device) {
+  if (failed_) return false;
+  if (device != device_) ReleaseBuffers();  // The buffers belong to a single device.
+  return vertex_buffer_ || CreateBuffers(device);
+}
+
+// Appends the vertices and binds the vertex buffer to stream 0. Returns the first vertex index.
+int AppendVertices(IDirect3DDevice8* device, const void* vertices, UINT vertex_count, UINT stride) {
+  int offset = Append(vertex_buffer_, kVertexBufferSize, vertex_position_, vertices, vertex_count * stride, stride);
+  if (offset < 0) return -1;
+  if (bound_stride_ != stride) {
+    if (FAILED(device->SetStreamSource(0, vertex_buffer_, stride))) return -1;
+    bound_stride_ = stride;  // Set after the call since the hook clears it.
+  }
+  return offset / static_cast<int>(stride);
+}
+
+bool DrawPrimitiveUP(IDirect3DDevice8* device, D3DPRIMITIVETYPE type, UINT primitive_count, const void* vertices,
+                     UINT stride, HRESULT* result) {
+  if (!stride || !PrepareBuffers(device)) return false;
+  UINT vertex_count = GetVertexCount(type, primitive_count);
+  if (!vertex_count || vertex_count * stride > kVertexBufferSize) return false;
+
+  int start_vertex = AppendVertices(device, vertices, vertex_count, stride);
+  if (start_vertex < 0) return false;
+  *result = device->DrawPrimitive(type, start_vertex, primitive_count);
+  return true;
+}
+
+bool DrawIndexedPrimitiveUP(IDirect3DDevice8* device, D3DPRIMITIVETYPE type, UINT min_index, UINT num_vertices,
+                            UINT primitive_count, const void* indices, D3DFORMAT index_format, const void* vertices,
+                            UINT stride, HRESULT* result) {
+  if (!stride || index_format != D3DFMT_INDEX16 || !PrepareBuffers(device)) return false;
+  UINT index_count = GetVertexCount(type, primitive_count);
+  UINT vertex_count = min_index + num_vertices;  // The indices are relative to the vertices pointer.
+  UINT index_size = index_count * sizeof(WORD);
+  if (!index_count || index_size > kIndexBufferSize || vertex_count * stride > kVertexBufferSize) return false;
+
+  int start_vertex = AppendVertices(device, vertices, vertex_count, stride);
+  if (start_vertex < 0) return false;
+
+  // The base vertex index is part of the D3D8 index binding. When merging, the indices are rebased
+  // onto the bound base vertex so consecutive draws keep the binding and continue the index range.
+  UINT base_vertex = static_cast<UINT>(start_vertex);
+  WORD delta = 0;
+  if (DrawMerge::IsEnabled() && indices_bound_ && bound_index_stride_ == stride &&
+      base_vertex >= bound_base_vertex_ && base_vertex - bound_base_vertex_ + vertex_count <= 0x10000) {
+    delta = static_cast<WORD>(base_vertex - bound_base_vertex_);
+    base_vertex = bound_base_vertex_;
+  }
+  int start_index =
+      Append(index_buffer_, kIndexBufferSize, index_position_, indices, index_size, sizeof(WORD), delta);
+  if (start_index < 0) return false;
+
+  if (!indices_bound_ || bound_base_vertex_ != base_vertex) {
+    if (FAILED(device->SetIndices(index_buffer_, base_vertex))) return false;
+    indices_bound_ = true;
+    bound_base_vertex_ = base_vertex;
+    bound_index_stride_ = stride;
+  }
+  *result = device->DrawIndexedPrimitive(type, min_index + delta, num_vertices,
+                                         static_cast<UINT>(start_index / sizeof(WORD)), primitive_count);
+  return true;
+}
+
+HRESULT WINAPI D3DDeviceSetStreamSourceHook(IDirect3DDevice8* Device, UINT StreamNumber,
+                                            IDirect3DVertexBuffer8* pStreamData, UINT Stride) {
+  if (Device == device_ && StreamNumber == 0) bound_stride_ = 0;
+  return hook_SetStreamSource_.original(D3DDeviceSetStreamSourceHook)(Device, StreamNumber, pStreamData, Stride);
+}
+
+HRESULT WINAPI D3DDeviceSetIndicesHook(IDirect3DDevice8* Device, IDirect3DIndexBuffer8* pIndexData,
+                                       UINT BaseVertexIndex) {
+  if (Device == device_) indices_bound_ = false;
+  return hook_SetIndices_.original(D3DDeviceSetIndicesHook)(Device, pIndexData, BaseVertexIndex);
+}
+
+HRESULT WINAPI D3DDeviceApplyStateBlockHook(IDirect3DDevice8* Device, DWORD Token) {
+  if (Device == device_) ClearBindings();  // State blocks can include the stream and index bindings.
+  return hook_ApplyStateBlock_.original(D3DDeviceApplyStateBlockHook)(Device, Token);
+}
+
+}  // namespace
+}  // namespace DynamicDrawInt
+
+void DynamicDraw::Initialize(const std::filesystem::path& ini_file) {
+  using namespace DynamicDrawInt;
+  enabled_ = Ini::GetValue<bool>("EqwGeneral", "UseDynamicDrawBuffers", false, ini_file.string().c_str());
+  if (enabled_) Logger::Info("DynamicDraw: Enabled");
+}
+
+void DynamicDraw::InstallHooks(IDirect3DDevice8* device) {
+  using namespace DynamicDrawInt;
+  if (!enabled_) return;
+  failed_ = false;
+
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Re-hooking the slot shared with StateFilter would cycle.
+  device_vtable_ = vtable;
+
+  hook_ApplyStateBlock_ = VTableHook(vtable, 54, D3DDeviceApplyStateBlockHook, false);
+  hook_SetStreamSource_ = VTableHook(vtable, 83, D3DDeviceSetStreamSourceHook, false);
+  hook_SetIndices_ = VTableHook(vtable, 85, D3DDeviceSetIndicesHook, false);
+}
+
+bool DynamicDraw::DrawPrimitiveUP(IDirect3DDevice8* device, D3DPRIMITIVETYPE type, UINT primitive_count,
+                                  const void* vertices, UINT stride, HRESULT* result) {
+  if (!DynamicDrawInt::enabled_) return false;
+  if (DynamicDrawInt::DrawPrimitiveUP(device, type, primitive_count, vertices, stride, result)) return true;
+  DynamicDrawInt::ClearBindings();  // The original call unbinds stream 0.
+  return false;
+}
+
+bool DynamicDraw::DrawIndexedPrimitiveUP(IDirect3DDevice8* device, D3DPRIMITIVETYPE type, UINT min_index,
+                                         UINT num_vertices, UINT primitive_count, const void* indices,
+                                         D3DFORMAT index_format, const void* vertices, UINT stride,
+                                         HRESULT* result) {
+  if (!DynamicDrawInt::enabled_) return false;
+  if (DynamicDrawInt::DrawIndexedPrimitiveUP(device, type, min_index, num_vertices, primitive_count, indices,
+                                             index_format, vertices, stride, result))
+    return true;
+  DynamicDrawInt::ClearBindings();  // The original call unbinds stream 0 and the indices.
+  return false;
+}
+
+void DynamicDraw::ReleaseResources() { DynamicDrawInt::ReleaseBuffers(); }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) conversion of the user pointer DrawPrimitiveUP() and
+// DrawIndexedPrimitiveUP() calls into regular draws from dynamic vertex and index buffers. The
+// runtime or d3d8 wrapper otherwise copies the user data into an internal buffer on every call,
+// which is a known cpu bottleneck of the d3d8 to d3d9 translation layers.
+//
+// The data is appended to large write-only ring buffers locked with D3DLOCK_NOOVERWRITE, and
+// the buffers are discarded when they wrap. Large batches are copied with SSE2 streaming stores
+// since the locked buffer memory is typically write-combined. With DrawMerge enabled, the indices
+// are rebased onto the bound base vertex so consecutive indexed draws can be merged.
+
+namespace DynamicDraw {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the enable setting.
+
+// Installs the binding tracking hooks. Call after each successful creation of the primary device.
+void InstallHooks(IDirect3DDevice8* device);
+
+// Draws the user pointer data from the ring buffers. Returns false if the draw was not handled
+// (disabled, unsupported format, or buffer failure) and must be passed to the original call.
+bool DrawPrimitiveUP(IDirect3DDevice8* device, D3DPRIMITIVETYPE type, UINT primitive_count, const void* vertices,
+                     UINT stride, HRESULT* result);
+bool DrawIndexedPrimitiveUP(IDirect3DDevice8* device, D3DPRIMITIVETYPE type, UINT min_index, UINT num_vertices,
+                            UINT primitive_count, const void* indices, D3DFORMAT index_format,
+                            const void* vertices, UINT stride, HRESULT* result);
+
+// Releases the ring buffers (before a device Reset() or the final device Release()). They are
+// recreated on the next draw.
+void ReleaseResources();
+
+}  // namespace DynamicDraw
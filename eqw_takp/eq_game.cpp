@@ -7,15 +7,31 @@
 #include <algorithm>
 #include <filesystem>
 
+#include "command_channel.h"
 #include "cpu_timestamp_fix.h"
+#include "deferred_submit.h"
 #include "dinput_manager.h"
+#include "draw_merge.h"
+#include "dynamic_draw.h"
 #include "eq_gfx.h"
 #include "eq_main.h"
+#include "flight_recorder.h"
+#include "frame_limiter.h"
+#include "frame_stats.h"
 #include "game_input.h"
 #include "iat_hook.h"
 #include "ini.h"
+#include "ini_redirect.h"
 #include "logger.h"
+#include "low_latency.h"
+#include "raw_input.h"
+#include "render_scale.h"
+#include "screenshot.h"
+#include "state_filter.h"
+#include "texture_compress.h"
+#include "texture_dedup.h"
 #include "vtable_hook.h"
+#include "window_state.h"
 
 // Using an EqGameInt namespace instead of a purely static class to reduce the qualifier clutter. The
 // anonymous namespace forces it to private internal scope.
@@ -31,6 +47,9 @@ static constexpr int kDeviceForceReset = EqGfx::kDeviceLostMsgId + 1;
 static constexpr int kIconId = 107;    // Resource ID in the exe.
 static constexpr int kIconSize = 128;  // Largest icon in the exe.
 
+static constexpr UINT_PTR kOcclusionTimerId = 0x4648;  // Polls the occlusion state while in the background.
+static constexpr UINT kOcclusionPollMs = 250;
+
 // State and resources updated at initialization.
 std::filesystem::path exe_path_;  // Full path filename for eqgame.exe file.
 std::filesystem::path ini_path_;  // Full path filename for eqw.ini file.
@@ -112,6 +131,7 @@ void CreateEqWindow() {
   hwnd_ = ::CreateWindowExA(dwexstyle, wc.lpszClassName, "EqW-TAKP", dwstyle, x, y, win_width_, win_height_, NULL, NULL,
                             NULL, NULL);
   EqGfx::SetWindow(hwnd_);
+  CommandChannel::Initialize(hwnd_);
 
   full_screen_mode_ = Ini::GetValue<bool>("EqwGeneral", "FullScreenMode", false, ini_path_.string().c_str());
 
@@ -119,7 +139,9 @@ void CreateEqWindow() {
   bool swap_mouse_buttons = Ini::GetValue<bool>("EqwGeneral", "SwapMouseButtons", false, ini_path_.string().c_str());
   bool disable_keydown_clear =
       Ini::GetValue<bool>("EqwGeneral", "DisableKeydownClear", false, ini_path_.string().c_str());
-  GameInput::Initialize(hwnd_, swap_mouse_buttons, disable_keydown_clear);
+  bool clip_mouse_look = Ini::GetValue<bool>("EqwGeneral", "ClipMouseLook", false, ini_path_.string().c_str());
+  GameInput::Initialize(hwnd_, swap_mouse_buttons, disable_keydown_clear, clip_mouse_look);
+  RawInput::Initialize(hwnd_, Ini::GetValue<bool>("EqwGeneral", "UseRawInput", false, ini_path_.string().c_str()));
 
   if (eqcreatewin_init_fn_) {
     Logger::Info("CreateEqWindow: Executing external init callback");
@@ -222,6 +244,21 @@ HMODULE WINAPI Kernel32LoadLibraryAHook(LPCSTR lpLibFileName) {
     if (!_stricmp(lpLibFileName, "eqgfx_dx8.dll")) {
       EqGfx::Initialize(hmod, eqgfx_init_fn_, [](int width, int height) { SetClientSize(width, height); });
       CpuTimestampFix::Initialize(ini_path_);
+      FrameLimiter::Initialize(ini_path_);
+      FrameStats::Initialize(ini_path_);
+      EqGfx::SetSuppressOccludedRendering(
+          Ini::GetValue<bool>("EqwGeneral", "SuppressOccludedRendering", false, ini_path_.string().c_str()));
+      EqGfx::SetFastResolutionChange(
+          Ini::GetValue<bool>("EqwGeneral", "FastResolutionChange", false, ini_path_.string().c_str()));
+      LowLatency::Initialize(ini_path_);
+      StateFilter::Initialize(ini_path_);
+      DynamicDraw::Initialize(ini_path_);
+      RenderScale::Initialize(ini_path_);
+      Screenshot::Initialize(ini_path_, exe_path_.parent_path() / "Screenshots");
+      TextureCompress::Initialize(ini_path_);
+      TextureDedup::Initialize(ini_path_);
+      DeferredSubmit::Initialize(ini_path_);
+      DrawMerge::Initialize(ini_path_);
     }
   }
   return hmod;
@@ -265,6 +302,7 @@ void InstallHooks(HMODULE handle) {
   hook_ShowWindow_ = IATHook(handle, "user32.dll", "ShowWindow", User32ShowWindowHook);
 
   DInputManager::Initialize(handle);
+  IniRedirect::Initialize(handle);
 }
 
 // Paints the executable icon to the screen.
@@ -324,6 +362,11 @@ LRESULT CALLBACK GameWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     case WM_DESTROY:
     case WM_CLOSE:
       Logger::Info("EqGame: Terminating process");
+      IniRedirect::LogStats();
+      DInputManager::LogStats();
+      Ini::Flush();
+      Logger::Flush();
+      FlightRecorder::Dump();
       ::TerminateProcess(::GetCurrentProcess(), 0);
       break;
 
@@ -335,12 +378,40 @@ LRESULT CALLBACK GameWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
       return 0;
     }
 
+    // Publish the window state used by the per-frame input hooks. Note that returning 0 from
+    // WM_WINDOWPOSCHANGED suppresses the WM_SIZE and WM_MOVE messages.
     case WM_WINDOWPOSCHANGED:
+      WindowState::Update(hwnd);
       StoreWindowOffsets(hwnd);
       return 0;
 
+    case WM_ACTIVATEAPP:
+      WindowState::Update(hwnd, wParam != FALSE);
+      if (wParam) {
+        FrameLimiter::Wake();  // Drop out of a background throttle wait.
+        ::KillTimer(hwnd, kOcclusionTimerId);
+      } else {
+        ::SetTimer(hwnd, kOcclusionTimerId, kOcclusionPollMs, nullptr);
+        GameInput::ReleaseCursorClip();
+        RawInput::HandleFocusLoss();
+      }
+      break;
+
+    case WM_INPUT:
+      RawInput::HandleInput(wParam, lParam);
+      break;  // DefWindowProc() performs the required cleanup.
+
+    case WM_ACTIVATE:
+      WindowState::Update(hwnd, LOWORD(wParam) != WA_INACTIVE);
+      break;
+
+    case WM_DISPLAYCHANGE:
+      WindowState::Update(hwnd);
+      break;
+
     case WM_DPICHANGED:
       Logger::Info("EqMain::DpiChanged to %d", LOWORD(wParam));
+      WindowState::Update(hwnd);
       return 0;  // Skip default processing that would try to rescale.
 
     case WM_SETCURSOR:
@@ -360,7 +431,13 @@ LRESULT CALLBACK GameWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
       }
       break;
 
+    case WM_TIMER:
+      if (wParam != kOcclusionTimerId) break;
+      WindowState::Update(hwnd);  // Covering windows do not send any messages.
+      return 0;
+
     case WM_PAINT:
+      if (WindowState::Get().occluded) WindowState::Update(hwnd);  // Uncovered, so resume rendering.
       if (IsGameInitialized()) {        // Check if the primary game object is allocated.
         ::ValidateRect(hwnd, nullptr);  // Removes entire client area from the update region.
       } else {
@@ -378,6 +455,13 @@ LRESULT CALLBACK GameWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
       SetFullScreenMode(wParam != 0);
       break;
 
+    // Requests from the game thread (see CommandChannel).
+    case CommandChannel::kWakeMsgId: {
+      unsigned int commands = CommandChannel::Process();
+      if (commands & CommandChannel::kRefreshCursor) GameWndProc(hwnd, WM_SETCURSOR, 0, HTCLIENT);
+      return 0;
+    }
+
     // Custom message to handle d3d reset and recovery on the correct thread.
     case EqGfx::kDeviceLostMsgId:
       if (wParam == EqGfx::kDeviceLostMsgId || wParam == kDeviceForceReset)
@@ -402,6 +486,7 @@ void InitializeDebugLog() {
   int log_level = Ini::GetValue<int>("EqwGeneral", "DebugLogLevel", static_cast<int>(Logger::Level::None),
                                      ini_path_.string().c_str());
   std::filesystem::path log_file = exe_path_.parent_path() / "eqw_debug.txt";
+  FlightRecorder::Initialize(exe_path_.parent_path() / "eqw_flight.bin");  // Records regardless of log_level.
   Logger::Initialize(log_file.string().c_str(), static_cast<Logger::Level>(log_level));
 
   Logger::Info("EQW version: %s", EqGame::kVersionStr);
@@ -476,15 +561,16 @@ HWND EqGame::GetGameWindow() {
   return EqGameInt::hwnd_;  // Handle to common shared game window.
 }
 
+bool EqGame::IsInGameState() { return EqGameInt::IsGameInGameState(); }
+
 int EqGame::GetEnableFullScreen() {
   return EqGameInt::full_screen_mode_;  // Note cross-threading is possible.
 }
 
 void EqGame::SetEnableFullScreen(int enable) {
-  // Note this is a cross-threading call (eq game processing thread is spun off
-  // from the main thread with the wndproc) so it will block until that thread
-  // processes the message in the queue.
-  ::SendMessageA(EqGameInt::hwnd_, WM_USER, enable, 0);
+  // Note this is a cross-threading call (eq game processing thread is spun off from the main
+  // thread with the wndproc). It blocks until processed since the mode change resets the device.
+  CommandChannel::RunAndWait([enable]() { EqGameInt::SetFullScreenMode(enable != 0); });
 }
 
 void EqGame::SetEqMainInitFn(void(__cdecl* init_fn)()) { EqGameInt::eqmain_init_fn_ = init_fn; }
@@ -494,7 +580,7 @@ void EqGame::SetEqGfxInitFn(void(__cdecl* init_fn)()) { EqGameInt::eqgfx_init_fn
 void EqGame::SetEqCreateWinInitFn(void(__cdecl* init_fn)()) { EqGameInt::eqcreatewin_init_fn_ = init_fn; }
 
 void EqGame::ResetD3D8() {
-  // Note this is also a potential blocking cross-threading call.
+  // Note this is also a cross-threading call that blocks until the reset completed.
   Logger::Info("EqGame: Sending ResetD3D8 request");
-  ::SendMessage(EqGameInt::hwnd_, EqGfx::kDeviceLostMsgId, EqGameInt::kDeviceForceReset, 0);
+  CommandChannel::RunAndWait([]() { EqGfx::HandleDeviceLost(true); });
 }
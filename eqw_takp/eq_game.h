@@ -11,6 +11,7 @@ static constexpr char kVersionStr[] =
 
 void Initialize();
 HWND GetGameWindow();
+bool IsInGameState();  // True when in the world (versus char select or loading).
 
 int GetEnableFullScreen();
 void SetEnableFullScreen(int enable);
@@ -1,9 +1,23 @@
 #include "eq_gfx.h"
 
+#include "command_channel.h"
 #include "d3dx8/d3d8.h"
+#include "deferred_submit.h"
+#include "draw_merge.h"
+#include "dynamic_draw.h"
+#include "eq_game.h"
+#include "frame_limiter.h"
+#include "frame_stats.h"
 #include "iat_hook.h"
 #include "logger.h"
+#include "low_latency.h"
+#include "render_scale.h"
+#include "screenshot.h"
+#include "state_filter.h"
+#include "texture_compress.h"
+#include "texture_dedup.h"
 #include "vtable_hook.h"
+#include "window_state.h"
 
 // Notes:
 // - This always runs in windowed mode so a custom gamma mode is not supported.
@@ -25,21 +39,119 @@ IATHook hook_SetWindowPos_;
 IATHook hook_Direct3DCreate8_;
 
 // Direct3D hooks installed when the interface and devices are created.
-VTableHook hook_CreateDevice_;  // Direct3D.
-VTableHook hook_Release_;       // Direct3DDevice.
-VTableHook hook_Reset_;         // Direct3DDevice.
-VTableHook hook_SetGammaRamp_;  // Direct3DDevice.
+VTableHook hook_CreateDevice_;     // Direct3D.
+VTableHook hook_Release_;          // Direct3DDevice.
+VTableHook hook_Reset_;            // Direct3DDevice.
+VTableHook hook_Present_;          // Direct3DDevice.
+VTableHook hook_SetGammaRamp_;     // Direct3DDevice.
+VTableHook hook_SetRenderTarget_;  // Direct3DDevice.
+
+// Direct3DDevice hooks used to skip the rendering of occluded frames.
+VTableHook hook_BeginScene_;
+VTableHook hook_EndScene_;
+VTableHook hook_DrawPrimitive_;
+VTableHook hook_DrawIndexedPrimitive_;
+VTableHook hook_DrawPrimitiveUP_;
+VTableHook hook_DrawIndexedPrimitiveUP_;
 
 IDirect3DDevice8* device_ = nullptr;  // Local pointer to the allocated d3d device.
 
+// The rendering of a frame is skipped while the window is fully occluded. The decision is latched
+// at each Present() so a frame's scene, draws, and present are either all skipped or all executed.
+static constexpr DWORD kSkippedFramePeriodMs = 16;  // Pacing of skipped frames without a frame cap.
+bool suppress_occluded_ = false;  // Ini file setting.
+bool suppress_frame_ = false;     // Game thread only.
+
+// Optional cheaper resolution changes. The windowed back buffer is allocated at (at least) the
+// monitor size and the game renders into the top left region of its requested resolution, which
+// Present() then stretches to the client area. A resolution change that fits in the allocated back
+// buffer then only needs the device state defaults restored instead of a full Reset(). This only
+// removes the device Reset() itself (the swap chain reallocation and the eqw default pool resources).
+// The game's t3dSwitchD3DVideoMode still releases and reloads its own resources around the call.
+bool fast_resize_ = false;              // Ini file setting.
+bool full_reset_ = false;               // Set during device recovery to force the real Reset().
+bool oversized_ = false;                // The back buffer of device_ is larger than the game size.
+D3DPRESENT_PARAMETERS allocated_ = {};  // Actual parameters of the oversized back buffer.
+UINT game_width_ = 0;                   // Resolution requested by the game.
+UINT game_height_ = 0;
+DWORD default_state_block_ = 0;         // Captures the device defaults restored by a Reset().
+
 // Internal methods
 
+// Enlarges a windowed back buffer to the monitor size. Called on a copy of the game's parameters
+// so the game keeps seeing its requested resolution.
+void EnlargeBackBuffer(D3DPRESENT_PARAMETERS* params) {
+  game_width_ = params->BackBufferWidth;
+  game_height_ = params->BackBufferHeight;
+  oversized_ = false;
+  if (!fast_resize_ || !game_width_ || !game_height_ || params->BackBufferCount > 1 ||
+      params->MultiSampleType != D3DMULTISAMPLE_NONE)
+    return;
+
+  MONITORINFO info = {sizeof(info)};
+  if (!::GetMonitorInfoA(::MonitorFromWindow(hwnd_, MONITOR_DEFAULTTONEAREST), &info)) return;
+  UINT monitor_width = info.rcMonitor.right - info.rcMonitor.left;
+  UINT monitor_height = info.rcMonitor.bottom - info.rcMonitor.top;
+  params->BackBufferWidth = (game_width_ > monitor_width) ? game_width_ : monitor_width;
+  params->BackBufferHeight = (game_height_ > monitor_height) ? game_height_ : monitor_height;
+  params->SwapEffect = D3DSWAPEFFECT_COPY;  // Required for the Present() source rect.
+  oversized_ = true;
+}
+
+// Limits the rendering to the game's region of the oversized back buffer.
+void SetGameViewport(IDirect3DDevice8* device) {
+  D3DVIEWPORT8 viewport = {0, 0, game_width_, game_height_, 0.f, 1.f};
+  device->SetViewport(&viewport);
+}
+
+// Records the allocated back buffer and the device defaults after a device creation or Reset().
+void OnBackBufferCreated(IDirect3DDevice8* device, const D3DPRESENT_PARAMETERS& params) {
+  if (!oversized_) {
+    game_width_ = params.BackBufferWidth;  // Includes any size filled in by the runtime.
+    game_height_ = params.BackBufferHeight;
+  }
+  RenderScale::OnDeviceReset(device, params, game_width_, game_height_);
+  if (!oversized_) return;
+  allocated_ = params;
+  default_state_block_ = 0;
+  if (FAILED(device->CreateStateBlock(D3DSBT_ALL, &default_state_block_))) default_state_block_ = 0;
+  SetGameViewport(device);
+  Logger::Info("EqGfx: Back buffer allocated at %d x %d", params.BackBufferWidth, params.BackBufferHeight);
+}
+
+// Returns true if the new parameters only change the resolution within the allocated back buffer.
+bool CanResizeWithoutReset(IDirect3DDevice8* device, const D3DPRESENT_PARAMETERS& params) {
+  return oversized_ && !full_reset_ && default_state_block_ && params.Windowed && params.BackBufferWidth &&
+         params.BackBufferHeight && params.BackBufferWidth <= allocated_.BackBufferWidth &&
+         params.BackBufferHeight <= allocated_.BackBufferHeight && params.BackBufferCount <= 1 &&
+         params.BackBufferFormat == allocated_.BackBufferFormat &&
+         params.MultiSampleType == D3DMULTISAMPLE_NONE &&
+         params.EnableAutoDepthStencil == allocated_.EnableAutoDepthStencil &&
+         params.AutoDepthStencilFormat == allocated_.AutoDepthStencilFormat &&
+         device->TestCooperativeLevel() == D3D_OK;
+}
+
 // Null our local pointer to the d3d device if the reference count drops to zero.
 HRESULT WINAPI D3DDeviceReleaseHook(IDirect3DDevice8* Device) {
+  if (Device == device_) {  // Release our resources ahead of the final release.
+    ULONG count = Device->AddRef();
+    hook_Release_.original(D3DDeviceReleaseHook)(Device);
+    if (count == 2) {
+      DeferredSubmit::ReleaseResources();  // First so the recorded commands are replayed.
+      LowLatency::ReleaseResources();
+      DynamicDraw::ReleaseResources();
+      RenderScale::ReleaseResources();
+      Screenshot::ReleaseResources();
+      TextureCompress::ReleaseResources();
+      TextureDedup::Flush();
+    }
+  }
   int new_count = hook_Release_.original(D3DDeviceReleaseHook)(Device);
   if (new_count == 0) {
     Logger::Info("EqGfx: Releasing device: 0x%08x", (int)(Device));
     device_ = nullptr;
+    oversized_ = false;
+    default_state_block_ = 0;
   }
   return new_count;
 }
@@ -65,15 +177,158 @@ HRESULT WINAPI D3DDeviceResetHook(IDirect3DDevice8* Device, D3DPRESENT_PARAMETER
     // Parameters->BackBufferWidth = 0;
     // Parameters->BackBufferHeight = 0;
   }
-  HRESULT result = EqGfxInt::hook_Reset_.original(D3DDeviceResetHook)(Device, Parameters);
-  if (SUCCEEDED(result))
+
+  if (Device == device_ && CanResizeWithoutReset(Device, *Parameters)) {
+    game_width_ = Parameters->BackBufferWidth;
+    game_height_ = Parameters->BackBufferHeight;
+    Device->ApplyStateBlock(default_state_block_);  // Emulate the Reset() of the device state.
+    SetGameViewport(Device);
+    RenderScale::OnDeviceReset(Device, allocated_, game_width_, game_height_);
+    suppress_frame_ = false;
+    Logger::Info("EqGFX: Resized without a device Reset()");
     set_client_size_cb_(Parameters->BackBufferWidth, Parameters->BackBufferHeight);
-  else
+    return D3D_OK;
+  }
+
+  LowLatency::ReleaseResources();  // Default pool resources must be released before a Reset().
+  DynamicDraw::ReleaseResources();
+  RenderScale::ReleaseResources();
+  TextureDedup::Flush();  // Also drops the cache after a lost device.
+  if (Device == device_ && default_state_block_) {
+    Device->DeleteStateBlock(default_state_block_);
+    default_state_block_ = 0;
+  }
+  D3DPRESENT_PARAMETERS params = *Parameters;
+  if (Device == device_) EnlargeBackBuffer(&params);
+  HRESULT result = EqGfxInt::hook_Reset_.original(D3DDeviceResetHook)(Device, &params);
+  if (!oversized_) *Parameters = params;  // Pass back any fields filled in by the runtime.
+  suppress_frame_ = false;
+  StateFilter::Invalidate();  // Reset() restores the default device state.
+  if (SUCCEEDED(result)) {
+    if (Device == device_) OnBackBufferCreated(Device, params);
+    set_client_size_cb_(Parameters->BackBufferWidth, Parameters->BackBufferHeight);
+  } else {
+    oversized_ = false;
     Logger::Error("EqGFX: Reset failure: 0x%08x", result);
+  }
+
+  return result;
+}
+
+// Applies the optional frame rate cap and render ahead limit to the primary device and records the
+// frame pacing statistics.
+HRESULT WINAPI D3DDevicePresentHook(IDirect3DDevice8* Device, CONST RECT* pSourceRect, CONST RECT* pDestRect,
+                                    HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion) {
+  if (Device != device_)
+    return hook_Present_.original(D3DDevicePresentHook)(Device, pSourceRect, pDestRect, hDestWindowOverride,
+                                                        pDirtyRegion);
+
+  // Background clients are throttled to their own cap and skip presenting while minimized (the game
+  // simulation keeps running at the capped rate).
+  WindowState::Snapshot window = WindowState::Get();
+  FrameLimiter::WaitForNextFrame(EqGame::IsInGameState(), !window.foreground || window.iconic);
+  bool skip = suppress_frame_ || (window.iconic && FrameLimiter::IsBackgroundThrottled());
+  suppress_frame_ = suppress_occluded_ && window.occluded;  // Applies to the next frame.
+  StateFilter::OnPresent();
+  DrawMerge::OnPresent();
+  TextureCompress::OnPresent();
+  TextureDedup::OnPresent();
+  if (skip) {
+    // The skipped Present() no longer paces the game loop, so stand in for it without a cap.
+    if (!FrameLimiter::IsPacing()) ::Sleep(kSkippedFramePeriodMs);
+    return D3D_OK;
+  }
+
+  RenderScale::OnPresent(Device);  // Draws the scaled scene if it was not resolved by the UI.
+  Screenshot::OnPresent(Device, game_width_, game_height_, window.foreground);
+
+  RECT game_rect = {0, 0, static_cast<LONG>(game_width_), static_cast<LONG>(game_height_)};
+  if (oversized_ && !pSourceRect) pSourceRect = &game_rect;  // Stretch the game's region to the window.
+  HRESULT result =
+      hook_Present_.original(D3DDevicePresentHook)(Device, pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+  FrameStats::OnPresent();
+  if (SUCCEEDED(result)) LowLatency::OnPresent(Device);
+  return result;
+}
 
+// Resolves a scaled scene before the game changes render targets. Setting a render target also
+// resets the viewport to the full target, so restrict it again when the oversized back buffer is
+// restored as the render target.
+HRESULT WINAPI D3DDeviceSetRenderTargetHook(IDirect3DDevice8* Device, IDirect3DSurface8* pRenderTarget,
+                                            IDirect3DSurface8* pNewZStencil) {
+  RenderScale::OnSetRenderTarget(Device);
+  HRESULT result = hook_SetRenderTarget_.original(D3DDeviceSetRenderTargetHook)(Device, pRenderTarget, pNewZStencil);
+  if (Device != device_ || !oversized_ || !pRenderTarget || FAILED(result)) return result;
+
+  IDirect3DSurface8* back_buffer = nullptr;
+  if (SUCCEEDED(Device->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &back_buffer))) {
+    if (back_buffer == pRenderTarget) SetGameViewport(Device);
+    back_buffer->Release();
+  }
   return result;
 }
 
+// The scene and draw hooks short-circuit the rendering of frames latched as occluded. The device
+// state the game can observe is kept identical to a real draw.
+HRESULT WINAPI D3DDeviceBeginSceneHook(IDirect3DDevice8* Device) {
+  if (Device == device_ && suppress_frame_) return D3D_OK;
+  RenderScale::OnBeginScene(Device);
+  return hook_BeginScene_.original(D3DDeviceBeginSceneHook)(Device);
+}
+
+HRESULT WINAPI D3DDeviceEndSceneHook(IDirect3DDevice8* Device) {
+  if (Device == device_ && suppress_frame_) return D3D_OK;
+  return hook_EndScene_.original(D3DDeviceEndSceneHook)(Device);
+}
+
+HRESULT WINAPI D3DDeviceDrawPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                          UINT StartVertex, UINT PrimitiveCount) {
+  if (Device == device_ && suppress_frame_) return D3D_OK;
+  return hook_DrawPrimitive_.original(D3DDeviceDrawPrimitiveHook)(Device, PrimitiveType, StartVertex,
+                                                                  PrimitiveCount);
+}
+
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                 UINT minIndex, UINT NumVertices, UINT startIndex, UINT primCount) {
+  if (Device == device_ && suppress_frame_) return D3D_OK;
+  return hook_DrawIndexedPrimitive_.original(D3DDeviceDrawIndexedPrimitiveHook)(Device, PrimitiveType, minIndex,
+                                                                                NumVertices, startIndex, primCount);
+}
+
+// The UP draws unbind stream 0 (and the indices) as a side effect, so do the same when skipping.
+// Otherwise the user pointer data is optionally drawn from the DynamicDraw ring buffers.
+HRESULT WINAPI D3DDeviceDrawPrimitiveUPHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                            UINT PrimitiveCount, CONST void* pVertexStreamZeroData,
+                                            UINT VertexStreamZeroStride) {
+  if (Device == device_ && suppress_frame_) return Device->SetStreamSource(0, nullptr, 0);
+  HRESULT result;
+  if (Device == device_ && DynamicDraw::DrawPrimitiveUP(Device, PrimitiveType, PrimitiveCount,
+                                                        pVertexStreamZeroData, VertexStreamZeroStride, &result))
+    return result;
+  return hook_DrawPrimitiveUP_.original(D3DDeviceDrawPrimitiveUPHook)(Device, PrimitiveType, PrimitiveCount,
+                                                                      pVertexStreamZeroData, VertexStreamZeroStride);
+}
+
+HRESULT WINAPI D3DDeviceDrawIndexedPrimitiveUPHook(IDirect3DDevice8* Device, D3DPRIMITIVETYPE PrimitiveType,
+                                                   UINT MinVertexIndex, UINT NumVertexIndices, UINT PrimitiveCount,
+                                                   CONST void* pIndexData, D3DFORMAT IndexDataFormat,
+                                                   CONST void* pVertexStreamZeroData,
+                                                   UINT VertexStreamZeroStride) {
+  if (Device == device_ && suppress_frame_) {
+    Device->SetIndices(nullptr, 0);
+    return Device->SetStreamSource(0, nullptr, 0);
+  }
+  HRESULT result;
+  if (Device == device_ &&
+      DynamicDraw::DrawIndexedPrimitiveUP(Device, PrimitiveType, MinVertexIndex, NumVertexIndices, PrimitiveCount,
+                                          pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride,
+                                          &result))
+    return result;
+  return hook_DrawIndexedPrimitiveUP_.original(D3DDeviceDrawIndexedPrimitiveUPHook)(
+      Device, PrimitiveType, MinVertexIndex, NumVertexIndices, PrimitiveCount, pIndexData, IndexDataFormat,
+      pVertexStreamZeroData, VertexStreamZeroStride);
+}
+
 // This should not have an affect in windowed mode but block it for consistency just in case of some translation layer.
 HRESULT WINAPI D3DDeviceSetGammaRampHook(IDirect3DDevice8* Device, DWORD Flags, CONST D3DGAMMARAMP* pRamp) {
   Logger::Debug("EqGFX: Blocking SetGammaRamp: 0x%08x", Flags);
@@ -103,17 +358,39 @@ HRESULT WINAPI D3D8CreateDeviceHook(IDirect3D8* pD3D, UINT Adapter, D3DDEVTYPE D
     // pPresentationParameters->BackBufferHeight = 0;
   }
 
-  HRESULT result = hook_CreateDevice_.original(D3D8CreateDeviceHook)(
-      pD3D, Adapter, DeviceType, hwnd_, BehaviorFlags, pPresentationParameters, ppReturnedDeviceInterface);
+  D3DPRESENT_PARAMETERS params = *pPresentationParameters;
+  EnlargeBackBuffer(&params);
+  if (DeferredSubmit::IsEnabled()) BehaviorFlags |= D3DCREATE_MULTITHREADED;  // Replayed on another thread.
+  HRESULT result = hook_CreateDevice_.original(D3D8CreateDeviceHook)(pD3D, Adapter, DeviceType, hwnd_, BehaviorFlags,
+                                                                     &params, ppReturnedDeviceInterface);
+  if (!oversized_) *pPresentationParameters = params;
   if (SUCCEEDED(result)) {
     device_ = *ppReturnedDeviceInterface;
     Logger::Info("EqGFX: Installing D3D8CreateDeviceHook (0x%08x)", (int)(device_));
     void** vtable = *(void***)device_;
+    DeferredSubmit::InstallHooks(device_);  // First so it sits below all other hooks.
+    DrawMerge::InstallHooks(device_);       // Below the others so it sees the filtered and final calls.
     hook_Release_ = VTableHook(vtable, 2, D3DDeviceReleaseHook, false);
     hook_Reset_ = VTableHook(vtable, 14, D3DDeviceResetHook, false);
+    hook_Present_ = VTableHook(vtable, 15, D3DDevicePresentHook, false);
     hook_SetGammaRamp_ = VTableHook(vtable, 18, D3DDeviceSetGammaRampHook, false);
+    hook_SetRenderTarget_ = VTableHook(vtable, 31, D3DDeviceSetRenderTargetHook, false);
+    hook_BeginScene_ = VTableHook(vtable, 34, D3DDeviceBeginSceneHook, false);
+    hook_EndScene_ = VTableHook(vtable, 35, D3DDeviceEndSceneHook, false);
+    hook_DrawPrimitive_ = VTableHook(vtable, 70, D3DDeviceDrawPrimitiveHook, false);
+    hook_DrawIndexedPrimitive_ = VTableHook(vtable, 71, D3DDeviceDrawIndexedPrimitiveHook, false);
+    hook_DrawPrimitiveUP_ = VTableHook(vtable, 72, D3DDeviceDrawPrimitiveUPHook, false);
+    hook_DrawIndexedPrimitiveUP_ = VTableHook(vtable, 73, D3DDeviceDrawIndexedPrimitiveUPHook, false);
+    suppress_frame_ = false;
+    StateFilter::InstallHooks(device_);
+    DynamicDraw::InstallHooks(device_);
+    RenderScale::InstallHooks(device_);
+    TextureCompress::InstallHooks(device_);  // After StateFilter so a filtered SetTexture() still completes.
+    TextureDedup::InstallHooks(device_);     // Last so the other hooks only see real textures.
+    OnBackBufferCreated(device_, params);
     set_client_size_cb_(pPresentationParameters->BackBufferWidth, pPresentationParameters->BackBufferHeight);
   } else {
+    oversized_ = false;
     Logger::Error("EqGFX: Create device failure: 0x%08x", result);
   }
   return result;
@@ -199,7 +476,9 @@ void HandleDeviceLost(bool force_reset) {
   FARPROC t3dSwitchD3DVideoMode = handle ? ::GetProcAddress(handle, "t3dSwitchD3DVideoMode") : nullptr;
   if (!t3dSwitchD3DVideoMode) return;
 
+  full_reset_ = true;  // A lost device always needs the real Reset().
   t3dSwitchD3DVideoMode();  // Handles releasing resources, calling D3D Reset(), then restoring resources.
+  full_reset_ = false;
 
   if (recovery_attempt_counter > 5) return;
 
@@ -210,16 +489,17 @@ void HandleDeviceLost(bool force_reset) {
     Logger::Error("EqGfx: Device is not okay: 0x%08x", result);
 }
 
-// Sends a custom user message ID to notify the wndproc thread to attempt device recovery.
-void SendDeviceLostMessage() {
+// Requests a device recovery attempt from the wndproc thread. The recovery releases and reloads the
+// eqgfx resources the game thread renders with, so the game thread waits for it to complete (gives
+// up and skips the request if the game loop exits first).
+void PostDeviceLostCommand() {
   if (!IsMessagePumpActive() || !hwnd_)
     return;  // Only try to recover in-game when the message queue is actively listening.
 
-  static int send_message_counter = 0;
-  if (++send_message_counter <= 5) Logger::Error("EqGfx: Sending device lost");
+  static int post_counter = 0;
+  if (++post_counter <= 5) Logger::Error("EqGfx: Posting device lost");
 
-  // Perform a blocking call that forces a check if the device is ready to recover.
-  ::SendMessageA(hwnd_, EqGfx::kDeviceLostMsgId, EqGfx::kDeviceLostMsgId, 0);
+  CommandChannel::RunAndWait([]() { HandleDeviceLost(false); }, IsMessagePumpActive);
 }
 
 template <typename T>
@@ -242,7 +522,7 @@ void InstallDeviceLostRecoveryPatch(HMODULE handle) {
   Logger::Info("EqGfx: Installing device lost patch");
   const int base_addr = reinterpret_cast<int>(handle);
   const int result_code_patch_addr = base_addr + 0x0006bd07 + 1;  // Change  CMP EAX,0x88760869 to CMP EAX, 0x88760868.
-  const int switch_mode_call_addr = base_addr + 0x0006bd0e + 1;   // Replace the direct reset call with our Send call.
+  const int switch_mode_call_addr = base_addr + 0x0006bd0e + 1;   // Replace the direct reset call with our Post call.
   static const int switch_mode_call_addr_jump_value_unpatched = 0x0002ecd;
   FARPROC update_fn = ::GetProcAddress(handle, "t3dUpdateDisplay");
   // Quick sanity check that the eqfgx_dx8.dll is the one we expect.
@@ -256,7 +536,7 @@ void InstallDeviceLostRecoveryPatch(HMODULE handle) {
   protected_mem_write(result_code_patch_addr, result_code_patch);
 
   const int end_of_call_addr = switch_mode_call_addr + 4;  // Address at end of instruction.
-  const int jump_value = reinterpret_cast<int>(&SendDeviceLostMessage) - end_of_call_addr;
+  const int jump_value = reinterpret_cast<int>(&PostDeviceLostCommand) - end_of_call_addr;
   protected_mem_write(switch_mode_call_addr, jump_value);
 }
 
@@ -295,4 +575,8 @@ void EqGfx::Initialize(HMODULE handle, void(__cdecl* init_fn)(),
 
 void EqGfx::SetWindow(HWND wnd) { EqGfxInt::hwnd_ = wnd; }
 
+void EqGfx::SetSuppressOccludedRendering(bool enable) { EqGfxInt::suppress_occluded_ = enable; }
+
+void EqGfx::SetFastResolutionChange(bool enable) { EqGfxInt::fast_resize_ = enable; }
+
 void EqGfx::HandleDeviceLost(bool force_reset) { EqGfxInt::HandleDeviceLost(force_reset); }
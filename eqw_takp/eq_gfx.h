@@ -13,5 +13,9 @@ void Initialize(HMODULE handle, void(__cdecl* init_fn)(),
 
 void SetWindow(HWND hwnd);
 
+void SetSuppressOccludedRendering(bool enable);  // Skips drawing frames while the window can't be seen.
+
+void SetFastResolutionChange(bool enable);  // Allocates a monitor sized back buffer to avoid device Reset() calls.
+
 void HandleDeviceLost(bool force_reset);  // Attempts to recover the device. Must call from wndproc.
 }  // namespace EqGfx
@@ -11,11 +11,15 @@
 
 #include <ddraw.h>
 
+#include "command_channel.h"
 #include "dinput_manager.h"
 #include "iat_hook.h"
 #include "ini.h"
+#include "ini_redirect.h"
 #include "logger.h"
+#include "raw_input.h"
 #include "vtable_hook.h"
+#include "window_state.h"
 
 // Using an EqMainInt namespace instead of a purely static class to reduce the qualifier clutter. The
 // anonymous namespace forces it to private internal scope.
@@ -361,6 +365,8 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     case WM_DESTROY:
     case WM_CLOSE:
       Logger::Info("EqMain: Terminating process");
+      Ini::Flush();
+      Logger::Flush();
       ::TerminateProcess(::GetCurrentProcess(), 0);
       break;
 
@@ -421,6 +427,7 @@ HWND WINAPI User32CreateWindowExAHook(DWORD dwExStyle, LPCSTR lpClassName, LPCST
 
   original_wndproc_ = reinterpret_cast<WNDPROC>(::GetWindowLongA(hwnd_, GWL_WNDPROC));
   ::SetWindowLongA(hwnd_, GWL_WNDPROC, reinterpret_cast<LONG>(WndProc));
+  CommandChannel::Suspend();  // The game wndproc no longer processes the requests.
 
   if (nWidth != kClientWidth || nHeight != kClientHeight) Logger::Error("EqMain: Ignoring unexpected size");
   UpdateWinSizeFromFixedClientSize(hwnd_);
@@ -441,6 +448,7 @@ HWND WINAPI User32CreateWindowExAHook(DWORD dwExStyle, LPCSTR lpClassName, LPCST
   UpdateClientRegion(hwnd_);
 
   DInputManager::SetIgnorePrioInAcquire(true);  // eqmain.dll throws a fatal error if keyboard acquire fails.
+  RawInput::SetSuspended(true);                 // eqmain.dll uses the DirectInput keyboard.
 
   return hwnd_;
 }
@@ -465,12 +473,16 @@ BOOL WINAPI User32DestroyWindowHook(HWND hwnd) {
   Logger::Info("EqMain: Destroy - Disconnecting eqmain wndproc");
 
   StoreWindowOffsets();  // Save the location if updated.
+  IniRedirect::LogStats();  // Covers the startup and login screen.
 
   // Disable special window handling.
   eqmain_wndproc_ = nullptr;
   ::SetWindowLongA(hwnd_, GWL_WNDPROC, (LONG)original_wndproc_);
+  WindowState::Update(hwnd_);  // Refresh the state missed while eqmain owned the wndproc.
+  CommandChannel::Wake();      // Handle any requests that arrived while eqmain owned the wndproc.
 
   DInputManager::SetIgnorePrioInAcquire(false);  // eqgame.exe can handle sharing keyboard dinput access.
+  RawInput::SetSuspended(false);
 
   return true;
 }
@@ -543,6 +555,7 @@ void InitializeEqMain(HMODULE handle, HWND hwnd, const std::filesystem::path& in
   ini_path_ = ini_path;
 
   DInputManager::Initialize(handle);
+  IniRedirect::Initialize(handle);
 
   // This state should have been cleaned up by the previous release but just in case clean them.
   dd_ = nullptr;
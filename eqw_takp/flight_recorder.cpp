@@ -0,0 +1,184 @@
+#include "flight_recorder.h"
+
+#include <windows.h>
+
+#include <atomic>
+#include <string>
+
+#include "log_packer.h"
+
+// Dump file layout (little endian, no padding):
+//   Header: char magic[8] = "EQWFR01", uint32 entry_count, int64 qpc_frequency, int64 qpc_at_dump
+//   Entry:  uint32 sequence, int64 qpc_timestamp, uint32 thread_id, uint8 level,
+//           uint16 format_length, char format[format_length], uint16 packed_size, uint8 packed[packed_size]
+
+namespace FlightRecorderInt {
+namespace {
+
+static constexpr char kMagic[8] = "EQWFR01";
+static constexpr unsigned int kEntryCount = 2048;  // Must be a power of 2.
+static constexpr size_t kPackedSize = 224;
+
+struct Slot {
+  std::atomic<unsigned int> sequence;  // Zero while being written, else index + 1.
+  LONGLONG timestamp;
+  DWORD thread_id;
+  const char* format;
+  BYTE level;
+  WORD packed_size;
+  BYTE packed[kPackedSize];
+};
+
+Slot ring_[kEntryCount];
+std::atomic<unsigned int> next_index_ = 0;
+std::string dump_file_;
+LPTOP_LEVEL_EXCEPTION_FILTER previous_filter_ = nullptr;
+std::atomic<bool> dumping_ = false;
+
+// Buffered writer using only kernel32 calls so it is usable from the crash handler.
+class DumpWriter {
+ public:
+  explicit DumpWriter(HANDLE file) : file_(file) {}
+
+  ~DumpWriter() { Flush(); }
+
+  void Write(const void* data, size_t size) {
+    const BYTE* bytes = static_cast<const BYTE*>(data);
+    while (size) {
+      size_t chunk = (size < sizeof(buffer_) - used_) ? size : sizeof(buffer_) - used_;
+      memcpy(buffer_ + used_, bytes, chunk);
+      used_ += chunk;
+      bytes += chunk;
+      size -= chunk;
+      if (used_ == sizeof(buffer_)) Flush();
+    }
+  }
+
+  template <typename T>
+  void Put(const T& value) {
+    Write(&value, sizeof(value));
+  }
+
+  void Flush() {
+    DWORD written = 0;
+    if (used_ && !::WriteFile(file_, buffer_, static_cast<DWORD>(used_), &written, nullptr)) failed_ = true;
+    used_ = 0;
+  }
+
+  bool failed() const { return failed_; }
+
+ private:
+  HANDLE file_;
+  BYTE buffer_[16 * 1024];
+  size_t used_ = 0;
+  bool failed_ = false;
+};
+
+bool Dump() {
+  if (dump_file_.empty() || dumping_.exchange(true)) return false;
+
+  HANDLE file = ::CreateFileA(dump_file_.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    dumping_ = false;
+    return false;
+  }
+
+  unsigned int end = next_index_.load(std::memory_order_acquire);
+  unsigned int start = (end > kEntryCount) ? end - kEntryCount : 0;
+  LARGE_INTEGER frequency, now;
+  ::QueryPerformanceFrequency(&frequency);
+  ::QueryPerformanceCounter(&now);
+
+  static BYTE writer_storage[sizeof(DumpWriter)];  // Avoid a large stack allocation in the crash handler.
+  DumpWriter* writer = new (writer_storage) DumpWriter(file);
+  writer->Write(kMagic, sizeof(kMagic));
+  writer->Put<unsigned int>(end - start);  // Upper bound; torn entries are skipped below.
+  writer->Put<LONGLONG>(frequency.QuadPart);
+  writer->Put<LONGLONG>(now.QuadPart);
+
+  unsigned int written = 0;
+  for (unsigned int index = start; index != end; ++index) {
+    const Slot& slot = ring_[index & (kEntryCount - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1) continue;  // Overwritten or in progress.
+
+    Slot copy;
+    copy.timestamp = slot.timestamp;
+    copy.thread_id = slot.thread_id;
+    copy.format = slot.format;
+    copy.level = slot.level;
+    copy.packed_size = (slot.packed_size < kPackedSize) ? slot.packed_size : kPackedSize;
+    memcpy(copy.packed, slot.packed, copy.packed_size);
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1 || !copy.format) continue;  // Torn.
+
+    WORD format_length = static_cast<WORD>(strnlen(copy.format, 0xffff));
+    writer->Put<unsigned int>(index + 1);
+    writer->Put<LONGLONG>(copy.timestamp);
+    writer->Put<DWORD>(copy.thread_id);
+    writer->Put<BYTE>(copy.level);
+    writer->Put<WORD>(format_length);
+    writer->Write(copy.format, format_length);
+    writer->Put<WORD>(copy.packed_size);
+    writer->Write(copy.packed, copy.packed_size);
+    ++written;
+  }
+  writer->Flush();
+  bool success = !writer->failed();
+  writer->~DumpWriter();
+
+  // Patch the header with the actual number of entries written.
+  LARGE_INTEGER count_offset;
+  count_offset.QuadPart = sizeof(kMagic);
+  DWORD bytes = 0;
+  if (::SetFilePointerEx(file, count_offset, nullptr, FILE_BEGIN))
+    success = ::WriteFile(file, &written, sizeof(written), &bytes, nullptr) && success;
+  ::CloseHandle(file);
+
+  dumping_ = false;
+  return success;
+}
+
+// Adds a final entry describing the exception.
+void RecordCrash(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  FlightRecorder::Record(1, format, args);
+  va_end(args);
+}
+
+// Records the exception and dumps the ring before passing the exception along.
+LONG WINAPI UnhandledExceptionFilter(EXCEPTION_POINTERS* info) {
+  if (info && info->ExceptionRecord) {
+    RecordCrash("FlightRecorder: Unhandled exception 0x%08x at 0x%08x", info->ExceptionRecord->ExceptionCode,
+                info->ExceptionRecord->ExceptionAddress);
+  }
+  Dump();
+  return previous_filter_ ? previous_filter_(info) : EXCEPTION_CONTINUE_SEARCH;
+}
+
+}  // namespace
+}  // namespace FlightRecorderInt
+
+void FlightRecorder::Initialize(const std::filesystem::path& dump_file) {
+  FlightRecorderInt::dump_file_ = dump_file.string();
+  FlightRecorderInt::previous_filter_ = ::SetUnhandledExceptionFilter(FlightRecorderInt::UnhandledExceptionFilter);
+}
+
+void FlightRecorder::Record(int level, const char* format, va_list args) {
+  using namespace FlightRecorderInt;
+  unsigned int index = next_index_.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = ring_[index & (kEntryCount - 1)];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  LARGE_INTEGER timestamp;
+  ::QueryPerformanceCounter(&timestamp);
+  slot.timestamp = timestamp.QuadPart;
+  slot.thread_id = ::GetCurrentThreadId();
+  slot.format = format;
+  slot.level = static_cast<BYTE>(level);
+  slot.packed_size = static_cast<WORD>(LogPacker::Pack(format, args, slot.packed, kPackedSize));
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+bool FlightRecorder::Dump() { return FlightRecorderInt::Dump(); }
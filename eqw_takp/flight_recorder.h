@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdarg.h>
+
+#include <filesystem>
+
+// Always-on, fixed size in-memory ring of the most recent log calls (at all levels, independent
+// of the DebugLogLevel setting). Recording only packs the arguments (no formatting or I/O), and
+// the ring is written to disk only on a crash, on window close, or on request through the
+// DumpFlightRecorder() export. Use tools/flight_decode.cpp to convert a dump back into text.
+
+namespace FlightRecorder {
+
+// Sets the dump filename and installs the unhandled exception filter that dumps on a crash.
+void Initialize(const std::filesystem::path& dump_file);
+
+// Captures a log call. The format must be a static string literal. Safe to call from any thread.
+void Record(int level, const char* format, va_list args);
+
+// Writes the ring contents to the dump file. Returns false on failure.
+bool Dump();
+
+}  // namespace FlightRecorder
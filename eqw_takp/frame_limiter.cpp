@@ -0,0 +1,138 @@
+#include "frame_limiter.h"
+
+#include <atomic>
+
+#include "ini.h"
+#include "logger.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002  // Windows 10 1803+.
+#endif
+
+namespace FrameLimiterInt {
+namespace {
+
+static constexpr int kMaxFps = 1000;
+static constexpr LONGLONG kMinSpinUs = 50;     // Spin margin floor.
+static constexpr LONGLONG kMaxSpinUs = 16000;  // Low resolution (15.6 ms) timer fallback.
+
+HANDLE timer_ = nullptr;
+LONGLONG frequency_ = 0;        // QPC ticks per second.
+LONGLONG period_in_game_ = 0;   // QPC ticks per frame (0 = no cap).
+LONGLONG period_char_select_ = 0;
+LONGLONG period_background_ = 0;  // Not foreground or minimized.
+LONGLONG next_deadline_ = 0;
+LONGLONG active_period_ = 0;
+LONGLONG spin_ticks_ = 0;  // Calibrated spin window (timer wakeup lateness estimate).
+std::atomic<bool> wake_ = false;  // Set by Wake() to cut the current wait short.
+unsigned int last_wait_us_ = 0;
+
+LONGLONG Now() {
+  LARGE_INTEGER now;
+  ::QueryPerformanceCounter(&now);
+  return now.QuadPart;
+}
+
+LONGLONG FpsToPeriod(int fps) {
+  if (fps <= 0) return 0;
+  fps = (fps > kMaxFps) ? kMaxFps : fps;
+  return frequency_ / fps;
+}
+
+// Sleeps on the waitable timer for the requested duration and updates the spin calibration.
+void TimerSleep(LONGLONG ticks) {
+  LONGLONG start = Now();
+  LARGE_INTEGER due;
+  due.QuadPart = -(ticks * 10000000 / frequency_);  // Relative, in 100 ns units.
+  if (!due.QuadPart || !::SetWaitableTimer(timer_, &due, 0, nullptr, nullptr, FALSE)) return;
+  ::WaitForSingleObject(timer_, INFINITE);
+  if (wake_) return;  // Interrupted, so not a valid calibration sample.
+
+  // Track the lateness with a fast attack and slow decay so a single late wakeup widens the spin.
+  LONGLONG late = (Now() - start) - ticks;
+  late = (late < 0) ? 0 : late;
+  spin_ticks_ = (late > spin_ticks_) ? late : spin_ticks_ - (spin_ticks_ - late) / 16;
+  LONGLONG min_spin = kMinSpinUs * frequency_ / 1000000;
+  LONGLONG max_spin = kMaxSpinUs * frequency_ / 1000000;
+  spin_ticks_ = (spin_ticks_ < min_spin) ? min_spin : (spin_ticks_ > max_spin) ? max_spin : spin_ticks_;
+}
+
+void WaitForNextFrame(bool in_game, bool background) {
+  LONGLONG period = in_game ? period_in_game_ : period_char_select_;
+  if (background && period_background_) period = period_background_;
+  if (!period) {
+    active_period_ = 0;
+    return;
+  }
+
+  LONGLONG now = Now();
+  if (period != active_period_ || now - next_deadline_ > period) {
+    active_period_ = period;  // Cap changed or we fell more than a frame behind, so restart the schedule.
+    next_deadline_ = now + period;
+  }
+
+  LONGLONG remaining = next_deadline_ - now;
+  if (remaining > spin_ticks_) TimerSleep(remaining - spin_ticks_);
+  while (Now() < next_deadline_ && !wake_) ::YieldProcessor();
+
+  if (wake_.exchange(false)) {
+    active_period_ = 0;  // Restart the schedule with the (likely changed) cap next frame.
+    return;
+  }
+  next_deadline_ += period;
+}
+
+}  // namespace
+}  // namespace FrameLimiterInt
+
+void FrameLimiter::Initialize(const std::filesystem::path& ini_file) {
+  using namespace FrameLimiterInt;
+  int fps_in_game = Ini::GetValue<int>("EqwGeneral", "MaxFpsInGame", 0, ini_file.string().c_str());
+  int fps_char_select = Ini::GetValue<int>("EqwGeneral", "MaxFpsCharSelect", fps_in_game, ini_file.string().c_str());
+  int fps_background = Ini::GetValue<int>("EqwGeneral", "MaxFpsBackground", 0, ini_file.string().c_str());
+  if (fps_in_game <= 0 && fps_char_select <= 0 && fps_background <= 0) return;
+
+  LARGE_INTEGER frequency;
+  if (!::QueryPerformanceFrequency(&frequency)) return;
+  frequency_ = frequency.QuadPart;
+
+  timer_ = ::CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+  if (!timer_) {  // Older Windows, the spin calibration will widen to cover the coarse timer.
+    Logger::Info("FrameLimiter: High resolution timer unavailable");
+    timer_ = ::CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+  }
+  if (!timer_) {
+    Logger::Error("FrameLimiter: Failed to create timer: 0x%08x", ::GetLastError());
+    return;
+  }
+
+  period_in_game_ = FpsToPeriod(fps_in_game);
+  period_char_select_ = FpsToPeriod(fps_char_select);
+  period_background_ = FpsToPeriod(fps_background);
+  spin_ticks_ = kMinSpinUs * frequency_ / 1000000;
+  Logger::Info("FrameLimiter: Max fps in game: %d, char select: %d, background: %d", fps_in_game, fps_char_select,
+               fps_background);
+}
+
+void FrameLimiter::WaitForNextFrame(bool in_game, bool background) {
+  using namespace FrameLimiterInt;
+  if (!timer_) return;
+  LONGLONG start = Now();
+  FrameLimiterInt::WaitForNextFrame(in_game, background);
+  last_wait_us_ = static_cast<unsigned int>((Now() - start) * 1000000 / frequency_);
+}
+
+unsigned int FrameLimiter::GetLastWaitMicroseconds() { return FrameLimiterInt::last_wait_us_; }
+
+bool FrameLimiter::IsPacing() { return FrameLimiterInt::timer_ && FrameLimiterInt::active_period_; }
+
+bool FrameLimiter::IsBackgroundThrottled() { return FrameLimiterInt::period_background_ != 0; }
+
+void FrameLimiter::Wake() {
+  using namespace FrameLimiterInt;
+  if (!timer_) return;
+  wake_ = true;
+  LARGE_INTEGER due;
+  due.QuadPart = -1;  // Fire the timer immediately to release a sleeping game thread.
+  ::SetWaitableTimer(timer_, &due, 0, nullptr, nullptr, FALSE);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+// Optional (ini file setting) frame rate cap applied in the hooked IDirect3DDevice8::Present().
+// Works with any d3d8 wrapper since it does not rely on the driver's limiter.
+//
+// Each frame sleeps on a high resolution waitable timer until shortly before the deadline and
+// then spins for the remainder. The spin window is calibrated from the measured timer wakeup
+// lateness, so the cores stay idle for most of the wait while the frame pacing stays within a
+// small fraction of a millisecond.
+
+namespace FrameLimiter {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the caps.
+
+// Blocks until the next frame deadline for the active cap. The background cap (if set) overrides
+// the others while the window is not the foreground window. Call before presenting.
+void WaitForNextFrame(bool in_game, bool background);
+
+// Returns the time the last frame waited for its deadline in microseconds.
+unsigned int GetLastWaitMicroseconds();
+
+// Returns true if the last WaitForNextFrame() applied a cap (paced the frame).
+bool IsPacing();
+
+// Returns true if a background cap is set. Minimized clients then also skip presenting.
+bool IsBackgroundThrottled();
+
+// Cuts a pending wait short so a refocused client recovers immediately. Safe from any thread.
+void Wake();
+
+}  // namespace FrameLimiter
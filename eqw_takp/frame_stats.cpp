@@ -0,0 +1,173 @@
+#include "frame_stats.h"
+
+#include <windows.h>
+
+#include <cstddef>
+#include <cstring>
+
+#include "draw_merge.h"
+#include "ini.h"
+#include "logger.h"
+#include "seqlock.h"
+#include "state_filter.h"
+#include "texture_dedup.h"
+
+namespace FrameStatsInt {
+namespace {
+
+static constexpr int kWindowFrames = 4096;  // Rolling window (power of 2).
+static constexpr int kSubBucketBits = 5;     // 32 linear sub-buckets per power of 2.
+static constexpr int kSubBuckets = 1 << kSubBucketBits;
+static constexpr uint32_t kMaxFrameUs = (1u << 26) - 1;  // ~67 seconds.
+static constexpr int kBuckets = (26 - kSubBucketBits) * kSubBuckets + 2 * kSubBuckets;
+static constexpr int kPublishesPerSecond = 4;
+
+LONGLONG frequency_ = 0;
+LONGLONG last_present_ = 0;
+LONGLONG last_publish_ = 0;
+LONGLONG last_log_ = 0;
+LONGLONG log_interval_ = 0;  // QPC ticks (0 = disabled).
+
+// Rolling window state (game thread only).
+uint32_t ring_[kWindowFrames] = {};
+uint32_t histogram_[kBuckets] = {};
+uint32_t frames_ = 0;
+uint64_t total_frames_ = 0;
+uint64_t window_us_ = 0;
+uint32_t stutters_ = 0;
+uint32_t stutter_threshold_us_ = 0;  // Twice the last published median.
+
+SeqLock<EqwFrameStats> published_;
+
+int BucketIndex(uint32_t us) {
+  if (us < 2 * kSubBuckets) return static_cast<int>(us);
+  int shift = 0;
+  while ((us >> shift) >= 2 * kSubBuckets) ++shift;  // Keep the top kSubBucketBits + 1 bits.
+  return (shift + 1) * kSubBuckets + static_cast<int>(us >> shift) - kSubBuckets;
+}
+
+// Returns the midpoint of the bucket's value range.
+double BucketValue(int index) {
+  if (index < 2 * kSubBuckets) return index;
+  int shift = index / kSubBuckets - 1;
+  uint32_t low = static_cast<uint32_t>(index % kSubBuckets + kSubBuckets) << shift;
+  return low + ((1u << shift) - 1) / 2.0;
+}
+
+// Returns the value at the requested rank (0-based, ascending).
+double ValueAtRank(uint32_t rank) {
+  uint32_t count = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    count += histogram_[i];
+    if (count > rank) return BucketValue(i);
+  }
+  return BucketValue(kBuckets - 1);
+}
+
+// Returns the mean of the slowest fraction of frames.
+double SlowestMean(double fraction) {
+  uint32_t wanted = static_cast<uint32_t>(frames_ * fraction + 0.999);
+  wanted = wanted ? wanted : 1;
+  uint32_t taken = 0;
+  double sum = 0;
+  for (int i = kBuckets - 1; i >= 0 && taken < wanted; --i) {
+    uint32_t take = (histogram_[i] < wanted - taken) ? histogram_[i] : wanted - taken;
+    sum += take * BucketValue(i);
+    taken += take;
+  }
+  return taken ? sum / taken : 0;
+}
+
+void Publish() {
+  EqwFrameStats stats = {};
+  stats.size = sizeof(stats);
+  stats.frames = frames_;
+  stats.total_frames = total_frames_;
+  stats.stutters = stutters_;
+  stats.window_seconds = static_cast<float>(window_us_ / 1e6);
+  stats.state_calls_forwarded = StateFilter::GetForwardedCalls();
+  stats.state_calls_filtered = StateFilter::GetFilteredCalls();
+  stats.textures_shared = TextureDedup::GetSharedTextures();
+  stats.texture_kb_saved = TextureDedup::GetSavedKilobytes();
+  stats.draws_requested = DrawMerge::GetRequestedDraws();
+  stats.draws_submitted = DrawMerge::GetSubmittedDraws();
+  if (frames_) {
+    double mean_us = static_cast<double>(window_us_) / frames_;
+    double p50_us = ValueAtRank((frames_ - 1) / 2);
+    stats.mean_ms = static_cast<float>(mean_us / 1000);
+    stats.p50_ms = static_cast<float>(p50_us / 1000);
+    stats.p99_ms = static_cast<float>(ValueAtRank(static_cast<uint32_t>((frames_ - 1) * 0.99)) / 1000);
+    stats.p999_ms = static_cast<float>(ValueAtRank(static_cast<uint32_t>((frames_ - 1) * 0.999)) / 1000);
+    stats.fps = mean_us ? static_cast<float>(1e6 / mean_us) : 0;
+    double low_1 = SlowestMean(0.01);
+    double low_01 = SlowestMean(0.001);
+    stats.low_1_fps = low_1 ? static_cast<float>(1e6 / low_1) : 0;
+    stats.low_01_fps = low_01 ? static_cast<float>(1e6 / low_01) : 0;
+    stutter_threshold_us_ = static_cast<uint32_t>(2 * p50_us);
+  }
+  published_.Store(stats);
+}
+
+void AddFrame(LONGLONG elapsed_us) {
+  uint32_t us = (elapsed_us > kMaxFrameUs) ? kMaxFrameUs : static_cast<uint32_t>(elapsed_us);
+  uint32_t& slot = ring_[total_frames_ & (kWindowFrames - 1)];
+  if (frames_ == kWindowFrames) {  // Evict the oldest frame.
+    --histogram_[BucketIndex(slot)];
+    window_us_ -= slot;
+  } else {
+    ++frames_;
+  }
+  slot = us;
+  ++histogram_[BucketIndex(us)];
+  window_us_ += us;
+  ++total_frames_;
+  if (stutter_threshold_us_ && us > stutter_threshold_us_) ++stutters_;
+}
+
+void LogStats() {
+  EqwFrameStats stats = published_.Load();
+  Logger::Info("FrameStats: fps: %.1f, 1%% low: %.1f, 0.1%% low: %.1f, p50: %.2f ms, p99: %.2f ms, p99.9: %.2f ms, "
+               "stutters: %u",
+               stats.fps, stats.low_1_fps, stats.low_01_fps, stats.p50_ms, stats.p99_ms, stats.p999_ms,
+               stats.stutters);
+}
+
+}  // namespace
+}  // namespace FrameStatsInt
+
+void FrameStats::Initialize(const std::filesystem::path& ini_file) {
+  using namespace FrameStatsInt;
+  LARGE_INTEGER frequency;
+  if (!::QueryPerformanceFrequency(&frequency)) return;
+  frequency_ = frequency.QuadPart;
+  int log_seconds = Ini::GetValue<int>("EqwGeneral", "FrameStatsLogInterval", 0, ini_file.string().c_str());
+  log_interval_ = (log_seconds > 0) ? log_seconds * frequency_ : 0;
+}
+
+void FrameStats::OnPresent() {
+  using namespace FrameStatsInt;
+  if (!frequency_) return;
+
+  LARGE_INTEGER now;
+  ::QueryPerformanceCounter(&now);
+  if (last_present_) AddFrame((now.QuadPart - last_present_) * 1000000 / frequency_);
+  last_present_ = now.QuadPart;
+
+  if (now.QuadPart - last_publish_ >= frequency_ / kPublishesPerSecond) {
+    last_publish_ = now.QuadPart;
+    Publish();
+  }
+  if (log_interval_ && now.QuadPart - last_log_ >= log_interval_) {
+    if (last_log_) LogStats();
+    last_log_ = now.QuadPart;
+  }
+}
+
+bool FrameStats::Get(EqwFrameStats* stats) {
+  if (!stats || stats->size < offsetof(EqwFrameStats, total_frames)) return false;
+  EqwFrameStats snapshot = FrameStatsInt::published_.Load();
+  uint32_t size = (stats->size < sizeof(snapshot)) ? stats->size : sizeof(snapshot);
+  snapshot.size = size;
+  std::memcpy(stats, &snapshot, size);
+  return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Frame pacing statistics collected in the hooked Present() and published for external tools
+// through the GetFrameStats() export (see dllmain.cpp).
+//
+// The frame times of a rolling window are kept in a ring buffer and a log-linear (HDR style)
+// histogram with ~3% resolution, updated incrementally as frames enter and leave the window.
+// A snapshot of the derived statistics is published a few times per second through a sequence
+// lock, so readers on any thread never block the game thread.
+
+// Public layout returned by GetFrameStats(). New fields are only ever appended.
+struct EqwFrameStats {
+  uint32_t size;                   // Set by the caller to sizeof(EqwFrameStats).
+  uint32_t frames;                 // Frames in the rolling window.
+  uint64_t total_frames;           // Frames presented since startup.
+  uint32_t stutters;               // Frames since startup that took over twice the rolling median.
+  float window_seconds;            // Duration of the rolling window.
+  float mean_ms;                   // Frame time statistics of the window.
+  float p50_ms;
+  float p99_ms;
+  float p999_ms;
+  float fps;                       // Mean frame rate.
+  float low_1_fps;                 // Mean frame rate of the slowest 1% of frames.
+  float low_01_fps;                // Mean frame rate of the slowest 0.1% of frames.
+  uint32_t state_calls_forwarded;  // Last frame's state calls passed to the device (see StateFilter).
+  uint32_t state_calls_filtered;   // Last frame's redundant state calls dropped.
+  uint32_t textures_shared;        // Textures using another texture's copy (see TextureDedup).
+  uint32_t texture_kb_saved;       // Texture memory saved by the sharing.
+  uint32_t draws_requested;        // Last frame's draw calls before merging (see DrawMerge).
+  uint32_t draws_submitted;        // Last frame's draw calls after merging.
+};
+
+namespace FrameStats {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the optional log interval.
+
+void OnPresent();  // Records a frame. Call from the game thread after each Present().
+
+// Copies the last published statistics (up to stats->size bytes). Safe to call from any thread.
+bool Get(EqwFrameStats* stats);
+
+}  // namespace FrameStats
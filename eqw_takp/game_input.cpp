@@ -2,23 +2,29 @@
 
 #include <windows.h>
 
+#include <atomic>
+
+#include "command_channel.h"
+#include "coord_mapper.h"
 #include "dinput_manager.h"
 #include "function_hook.h"
 #include "logger.h"
+#include "window_state.h"
 
 namespace GameInputInt {
 namespace {
 
 HWND hwnd_ = nullptr;
-int game_width_ = 640;                                // Cached copy of current game screen width.
-int game_height_ = 480;                               // Cached copy of current game screen height.
-RECT game_rect_ = {0, 0, game_width_, game_height_};  // Cached client rect in screen coordinates.
+WindowState::Snapshot window_ = {};  // Per-frame copy of the window state and game resolution.
+CoordMapper mapper_;                 // Client to game cursor scaling.
 
 bool disable_keydown_clear_ = false;
 bool swap_mouse_buttons_ = false;
+bool clip_mouse_look_ = false;  // Confine the win32 cursor with ClipCursor() during mouse look.
 
 // Mouse state.
 POINT saved_rmouse_pt_ = {0, 0};
+std::atomic<bool> cursor_clipped_ = false;  // Released from either the game or the window thread.
 
 typedef int(__cdecl* GetMouseDataRel_t)();
 FunctionHook hook_get_mouse_data_rel_((GetMouseDataRel_t)(nullptr));
@@ -193,49 +199,43 @@ void ResetMouseUpdateValues(bool full_reset = true) {
   DInputManager::FlushMouse();
 }
 
-// Updates the cached game client rect on the screen and active game width and height resolutions.
+// Refreshes the cached window state (published by the wndproc thread) and active game resolution.
+// This is called every frame, so it must not make any system calls.
 void UpdateGameWindowParameters() {
-  POINT offset = {0, 0};
-  RECT rect;
-  if (::ClientToScreen(hwnd_, &offset) && ::GetClientRect(hwnd_, &rect)) {
-    game_rect_.left = rect.left + offset.x;  // Store in screen coordinates with left, top as x,y offset.
-    game_rect_.right = rect.right + offset.x;
-    game_rect_.top = rect.top + offset.y;
-    game_rect_.bottom = rect.bottom + offset.y;
-  }
-
-  game_width_ = max(*g_mouse_screen_res_x, 640);  // Ensure always non-zero.
-  game_height_ = max(*g_mouse_screen_res_y, 480);
+  window_ = WindowState::Get();
+  window_.game_width = max(*g_mouse_screen_res_x, 640);  // Ensure always non-zero.
+  window_.game_height = max(*g_mouse_screen_res_y, 480);
+  mapper_.Configure(window_.client_width(), window_.client_height(), window_.game_width, window_.game_height);
 }
 
 // DirectX will scale the game resolution to fit the screen (full scale expansion or height compression).
-bool IsScaledMode() {
-  return ((game_width_ != game_rect_.right - game_rect_.left) || (game_height_ != game_rect_.bottom - game_rect_.top));
-}
-
-// Synchronizes the internal cursor position to the win32 cursor for smooth transitions.
-void SyncToWin32Cursor() {
-  POINT cursor;
-  ::GetCursorPos(&cursor);  // This returns absolute screen x, y.
+bool IsScaledMode() { return mapper_.is_scaled(); }
 
-  cursor.x -= game_rect_.left;
-  cursor.y -= game_rect_.top;
+// Synchronizes the internal cursor position to the win32 cursor (screen coordinates) for smooth transitions.
+void SyncToWin32Cursor(POINT cursor) {
+  cursor.x -= window_.client_rect.left;
+  cursor.y -= window_.client_rect.top;
   if (IsScaledMode()) {
-    cursor.x = cursor.x * game_width_ / (game_rect_.right - game_rect_.left);
-    cursor.y = cursor.y * game_height_ / (game_rect_.bottom - game_rect_.top);
+    cursor.x = mapper_.x().ToGame(cursor.x);
+    cursor.y = mapper_.y().ToGame(cursor.y);
   }
   SetGameMousePosition(cursor.x, cursor.y);
 }
 
-// Synchronizes the win32 cursor to the internal cursor position.
-void SetWin32CursorToClientPosition(POINT pt) {
+// Converts an internal cursor position to screen coordinates.
+POINT GameToScreen(POINT pt) {
   if (IsScaledMode()) {
-    pt.x = pt.x * (game_rect_.right - game_rect_.left) / game_width_;
-    pt.y = pt.y * (game_rect_.bottom - game_rect_.top) / game_height_;
+    pt.x = mapper_.x().ToClient(pt.x);
+    pt.y = mapper_.y().ToClient(pt.y);
   }
-  pt.x += game_rect_.left;
-  pt.y += game_rect_.top;
+  pt.x += window_.client_rect.left;
+  pt.y += window_.client_rect.top;
+  return pt;
+}
 
+// Synchronizes the win32 cursor to the internal cursor position.
+void SetWin32CursorToClientPosition(POINT pt) {
+  pt = GameToScreen(pt);
   ::SetCursorPos(pt.x, pt.y);
 }
 
@@ -247,22 +247,34 @@ void SetBothCursorsToClientPosition(POINT pt) {
 
 // Sets the internal cursor location to the middle of the screen (ignores viewport / offset).
 void SetWin32CursorToCenter() {
-  POINT center = {game_width_ / 2, game_height_ / 2};
+  POINT center = {window_.game_width / 2, window_.game_height / 2};
   SetWin32CursorToClientPosition(center);
 }
 
-// Returns true if the mouse is over a visible client window.
-bool IsMouseOverClient() {
-  if (!::IsWindowVisible(hwnd_)) return false;
+// Pins the win32 cursor to the mouse look start position. The relative motion still arrives through the
+// input device, so no per-frame cursor warping is needed. Returns false if the clip failed.
+bool ClipCursorToMouseLook() {
+  POINT pt = GameToScreen(saved_rmouse_pt_);
+  RECT rect = {pt.x, pt.y, pt.x + 1, pt.y + 1};
+  if (!::ClipCursor(&rect)) return false;
+  cursor_clipped_ = true;
+  return true;
+}
 
-  POINT cursor;
-  ::GetCursorPos(&cursor);  // This returns absolute screen x, y.
-  return ::PtInRect(&game_rect_, cursor);
+void ReleaseCursorClip() {
+  if (cursor_clipped_.exchange(false)) ::ClipCursor(nullptr);
+}
+
+// Returns true if the cursor (screen coordinates) is over a visible client window.
+bool IsMouseOverClient(POINT cursor) {
+  const RECT& rect = window_.client_rect;
+  return window_.visible && cursor.x >= rect.left && cursor.x < rect.right && cursor.y >= rect.top &&
+         cursor.y < rect.bottom;
 }
 
 // This hook is called near the beginning of input processing in each of the primary game loops.
-// The windows message pump loop is running in a separate thread, so this code does brute force
-// "synchronous" polling of the current window state and cursor position.
+// The windows message pump loop is running in a separate thread, so this code uses the window
+// state snapshot published by that thread and only polls the cursor position.
 //
 // It is only called when in the game or char select game states and it is skipped if the
 // character is dead, stunned, or frozen and also skipped if the ui is safelocked (but the
@@ -278,10 +290,12 @@ int __cdecl GetMouseDataRelHook() {
   static bool mouse_disabled = true;
   static bool prev_has_focus = false;
 
-  bool has_focus = (::GetForegroundWindow() == hwnd_ && !::IsIconic(hwnd_));
-
   UpdateGameWindowParameters();  // Updates cached values used in calls below.
-  bool over_client = IsMouseOverClient();
+  bool has_focus = window_.foreground && !window_.iconic;
+
+  POINT cursor;
+  ::GetCursorPos(&cursor);  // This returns absolute screen x, y. The only per-frame system call.
+  bool over_client = IsMouseOverClient(cursor);
   bool internal_mode = has_focus && (over_client || *g_mouse_rmb_down_mouse_look);
 
   if (prev_has_focus != has_focus) {
@@ -290,6 +304,7 @@ int __cdecl GetMouseDataRelHook() {
   }
 
   if (!internal_mode) {
+    ReleaseCursorClip();
     mouse_disabled = true;
     ResetMouseUpdateValues(false);  // Drains the buffers and moves the cursor off screen.
     return 0;
@@ -297,8 +312,8 @@ int __cdecl GetMouseDataRelHook() {
 
   if (mouse_disabled) {
     mouse_disabled = false;
-    SyncToWin32Cursor();                              // Updates internal cursor position to match win32.
-    ::SendMessage(hwnd_, WM_SETCURSOR, 0, HTCLIENT);  // Queue the WndProc (blocking) to update the cursor visibility.
+    SyncToWin32Cursor(cursor);                        // Updates internal cursor position to match win32.
+    CommandChannel::Post(CommandChannel::kRefreshCursor);  // Queue the WndProc to update the cursor visibility.
   }
 
   unsigned int result = hook_get_mouse_data_rel_.original(GetMouseDataRelHook)();
@@ -311,12 +326,13 @@ int __cdecl GetMouseDataRelHook() {
   }
 
   if (*g_mouse_rmb_down_mouse_look) {
-    // Lock the game cursor to the initial position and the win32 cursor to the middle to avoid glitching
-    // across the window edge. This is a brute force alternative versus using ClipCapture() with wndproc.
+    // Lock the game cursor to the initial position. Without the cursor clip the win32 cursor is also
+    // locked to the middle to avoid glitching across the window edge.
     SetGameMousePosition(saved_rmouse_pt_.x, saved_rmouse_pt_.y);
-    SetWin32CursorToCenter();
+    if (!cursor_clipped_) SetWin32CursorToCenter();
   } else {
-    SyncToWin32Cursor();  // Override the internal absolute cursor position with the win32 cursor value.
+    ReleaseCursorClip();        // In case mouse look was exited without the RMB up hook.
+    SyncToWin32Cursor(cursor);  // Override the internal absolute cursor position with the win32 cursor value.
   }
 
   return result;
@@ -325,11 +341,17 @@ int __cdecl GetMouseDataRelHook() {
 void __fastcall RightMouseUpHook(void* this_ptr, int unused_edx, short x, short y) {
   bool mouse_look_active = *g_mouse_rmb_down_mouse_look;
   hook_right_mouse_up_.original(RightMouseUpHook)(this_ptr, unused_edx, x, y);
+  if (!mouse_look_active || *g_mouse_rmb_down_mouse_look) return;
 
   // The clamp during mouse_look keeps the win32 cursor in the enter to avoid boundary glitching,
   // and the call above puts the game cursor in the the middle at the end, so we restore both to
-  // the starting state when it exits mouse_look.
-  if (mouse_look_active && !*g_mouse_rmb_down_mouse_look) SetBothCursorsToClientPosition(saved_rmouse_pt_);
+  // the starting state when it exits mouse_look. A clipped win32 cursor never left the start.
+  if (cursor_clipped_) {
+    ReleaseCursorClip();
+    SetGameMousePosition(saved_rmouse_pt_.x, saved_rmouse_pt_.y);
+  } else {
+    SetBothCursorsToClientPosition(saved_rmouse_pt_);
+  }
 }
 
 void __fastcall RightMouseDownHook(void* this_ptr, int unused_edx, short x, short y) {
@@ -340,18 +362,22 @@ void __fastcall RightMouseDownHook(void* this_ptr, int unused_edx, short x, shor
   if (*g_mouse_rmb_down_mouse_look) {
     saved_rmouse_pt_.x = *g_mouse_x_abs_from_dinput;  // These values are clamped to within the screen res.
     saved_rmouse_pt_.y = *g_mouse_y_abs_from_dinput;
-    SetWin32CursorToCenter();  // Centered so we don't glitch off the window.
+    if (!clip_mouse_look_ || !ClipCursorToMouseLook())
+      SetWin32CursorToCenter();  // Centered so we don't glitch off the window.
   }
 }
 
-void Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear) {
+void Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear, bool clip_mouse_look) {
   hwnd_ = hwnd;
-  game_width_ = 640;  // Safe defaults until first hooked update.
-  game_height_ = 480;
-  game_rect_ = {0, 0, game_width_, game_height_};
+  window_ = {};
+  window_.client_rect = {0, 0, 640, 480};  // Safe defaults until first hooked update.
+  window_.game_width = 640;
+  window_.game_height = 480;
+  mapper_ = CoordMapper();
 
   disable_keydown_clear_ = disable_keydown_clear;
   swap_mouse_buttons_ = swap_mouse_buttons;
+  clip_mouse_look_ = clip_mouse_look;
   saved_rmouse_pt_ = {0, 0};
 
   hook_get_mouse_data_rel_.Initialize(0x0055B3B9, GetMouseDataRelHook, FunctionHook::HookType::Detour);
@@ -362,8 +388,8 @@ void Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear)
 }  // namespace
 }  // namespace GameInputInt
 
-void GameInput::Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear) {
-  GameInputInt::Initialize(hwnd, swap_mouse_buttons, disable_keydown_clear);
+void GameInput::Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear, bool clip_mouse_look) {
+  GameInputInt::Initialize(hwnd, swap_mouse_buttons, disable_keydown_clear, clip_mouse_look);
 }
 
 void GameInput::HandleGainOfFocus() {
@@ -374,3 +400,5 @@ void GameInput::HandleLossOfFocus() {
   // The mouse handling hooks will handle the loss of focus.
   GameInputInt::ResetKeyboardState(false);  // But we want to wipe internal keyboard state.
 }
+
+void GameInput::ReleaseCursorClip() { GameInputInt::ReleaseCursorClip(); }
@@ -7,9 +7,10 @@
 namespace GameInput {
 
 // Resets state and installs client hooks.
-void Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear);
+void Initialize(HWND hwnd, bool swap_mouse_buttons, bool disable_keydown_clear, bool clip_mouse_look);
 
 void HandleLossOfFocus();  // Resets state when the client loses focus.
 void HandleGainOfFocus();  // Updates state when the client regains focus.
+void ReleaseCursorClip();  // Releases the mouse look cursor confinement (safe from the wndproc thread).
 
 }  // namespace GameInput
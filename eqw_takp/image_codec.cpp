@@ -0,0 +1,256 @@
+#include "image_codec.h"
+
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_CODEC_SSE2
+#endif
+
+namespace ImageCodecInt {
+namespace {
+
+static constexpr uint32_t kStoredBlockSize = 65535;  // Maximum length of a stored deflate block.
+
+// Expands 5 and 6 bit channel values to 8 bits by replicating the high bits.
+inline uint8_t Expand5(uint32_t value) { return static_cast<uint8_t>((value << 3) | (value >> 2)); }
+inline uint8_t Expand6(uint32_t value) { return static_cast<uint8_t>((value << 2) | (value >> 4)); }
+
+inline void StorePixel(uint8_t* dest, uint8_t r, uint8_t g, uint8_t b, bool bgr) {
+  dest[0] = bgr ? b : r;
+  dest[1] = g;
+  dest[2] = bgr ? r : b;
+}
+
+void ConvertXrgb8888Scalar(const uint8_t* source, uint8_t* dest, int count, bool bgr) {
+  for (int i = 0; i < count; ++i, source += 4, dest += 3) StorePixel(dest, source[2], source[1], source[0], bgr);
+}
+
+void ConvertRgb565Scalar(const uint8_t* source, uint8_t* dest, int count, bool bgr) {
+  for (int i = 0; i < count; ++i, source += 2, dest += 3) {
+    uint32_t pixel = source[0] | (source[1] << 8);
+    StorePixel(dest, Expand5(pixel >> 11), Expand6((pixel >> 5) & 0x3f), Expand5(pixel & 0x1f), bgr);
+  }
+}
+
+void ConvertXrgb1555Scalar(const uint8_t* source, uint8_t* dest, int count, bool bgr) {
+  for (int i = 0; i < count; ++i, source += 2, dest += 3) {
+    uint32_t pixel = source[0] | (source[1] << 8);
+    StorePixel(dest, Expand5((pixel >> 10) & 0x1f), Expand5((pixel >> 5) & 0x1f), Expand5(pixel & 0x1f), bgr);
+  }
+}
+
+#ifdef IMAGE_CODEC_SSE2
+// Swaps the first and third bytes of each 32-bit pixel.
+inline __m128i SwapRedBlue(__m128i pixels) {
+  const __m128i green_mask = _mm_set1_epi32(0x0000ff00);
+  const __m128i low_mask = _mm_set1_epi32(0x000000ff);
+  __m128i green = _mm_and_si128(pixels, green_mask);
+  __m128i low = _mm_and_si128(_mm_srli_epi32(pixels, 16), low_mask);
+  __m128i high = _mm_slli_epi32(_mm_and_si128(pixels, low_mask), 16);
+  return _mm_or_si128(green, _mm_or_si128(low, high));
+}
+
+// Packs four 32-bit pixels into 12 bytes by dropping the fourth byte of each pixel.
+inline void Store4x24(__m128i pixels, uint8_t* dest) {
+  const __m128i first_mask = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+  const __m128i second_mask =
+      _mm_set_epi32(0x0000ffff, static_cast<int>(0xff000000), 0x0000ffff, static_cast<int>(0xff000000));
+  __m128i packed = _mm_or_si128(_mm_and_si128(pixels, first_mask),
+                                _mm_and_si128(_mm_srli_epi64(pixels, 8), second_mask));  // 6 bytes per lane.
+  const __m128i low_lane = _mm_set_epi32(0, 0, -1, -1);
+  packed = _mm_or_si128(_mm_and_si128(packed, low_lane), _mm_srli_si128(_mm_andnot_si128(low_lane, packed), 2));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(dest), packed);
+  int tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+  std::memcpy(dest + 8, &tail, 4);
+}
+
+void ConvertXrgb8888(const uint8_t* source, uint8_t* dest, int count, bool bgr) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4, source += 16, dest += 12) {
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    Store4x24(bgr ? pixels : SwapRedBlue(pixels), dest);
+  }
+  ConvertXrgb8888Scalar(source, dest, count - i, bgr);
+}
+
+// Converts 16-bit pixels eight at a time. The red field starts at bit kRedShift and the green
+// field is kGreenBits wide (565 or 1555 layouts).
+template <int kRedShift, int kGreenBits>
+void Convert16(const uint8_t* source, uint8_t* dest, int count, bool bgr) {
+  const __m128i mask5 = _mm_set1_epi16(0x1f);
+  const __m128i green_mask = _mm_set1_epi16((1 << kGreenBits) - 1);
+  int i = 0;
+  for (; i + 8 <= count; i += 8, source += 16, dest += 24) {
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    __m128i r = _mm_and_si128(_mm_srli_epi16(pixels, kRedShift), mask5);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), green_mask);
+    __m128i b = _mm_and_si128(pixels, mask5);
+    r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+    g = _mm_or_si128(_mm_slli_epi16(g, 8 - kGreenBits), _mm_srli_epi16(g, 2 * kGreenBits - 8));
+    b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+    // Interleave into 32-bit pixels with the first output channel in the low byte.
+    __m128i first_second = _mm_or_si128(bgr ? b : r, _mm_slli_epi16(g, 8));
+    __m128i third = bgr ? r : b;
+    Store4x24(_mm_unpacklo_epi16(first_second, third), dest);
+    Store4x24(_mm_unpackhi_epi16(first_second, third), dest + 12);
+  }
+  if constexpr (kGreenBits == 6)
+    ConvertRgb565Scalar(source, dest, count - i, bgr);
+  else
+    ConvertXrgb1555Scalar(source, dest, count - i, bgr);
+}
+#endif
+
+void AppendBytes(std::vector<uint8_t>* file, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  file->insert(file->end(), bytes, bytes + size);
+}
+
+void AppendLittleEndian(std::vector<uint8_t>* file, uint32_t value, int size) {
+  for (int i = 0; i < size; ++i) file->push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void AppendBigEndian(std::vector<uint8_t>* file, uint32_t value) {
+  for (int i = 3; i >= 0; --i) file->push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+  static uint32_t table[256] = {};
+  if (!table[1]) {  // Benign race: every thread fills in identical values.
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size) {
+  uint32_t a = 1, b = 0;
+  while (size) {
+    size_t block = size < 5552 ? size : 5552;  // Largest block that can't overflow b before the modulo.
+    size -= block;
+    for (; block; --block) {
+      a += *data++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+void AppendPngChunk(std::vector<uint8_t>* file, const char type[4], const uint8_t* data, size_t size) {
+  AppendBigEndian(file, static_cast<uint32_t>(size));
+  size_t start = file->size();
+  AppendBytes(file, type, 4);
+  AppendBytes(file, data, size);
+  AppendBigEndian(file, Crc32(file->data() + start, size + 4));
+}
+
+}  // namespace
+}  // namespace ImageCodecInt
+
+void ImageCodec::ConvertRow(PixelFormat format, const uint8_t* source, uint8_t* dest, int width, bool bgr) {
+  using namespace ImageCodecInt;
+#ifdef IMAGE_CODEC_SSE2
+  switch (format) {
+    case PixelFormat::kXrgb8888:
+      return ConvertXrgb8888(source, dest, width, bgr);
+    case PixelFormat::kRgb565:
+      return Convert16<11, 6>(source, dest, width, bgr);
+    case PixelFormat::kXrgb1555:
+      return Convert16<10, 5>(source, dest, width, bgr);
+  }
+#else
+  switch (format) {
+    case PixelFormat::kXrgb8888:
+      return ConvertXrgb8888Scalar(source, dest, width, bgr);
+    case PixelFormat::kRgb565:
+      return ConvertRgb565Scalar(source, dest, width, bgr);
+    case PixelFormat::kXrgb1555:
+      return ConvertXrgb1555Scalar(source, dest, width, bgr);
+  }
+#endif
+}
+
+// Writes a bottom-up 24-bit BMP with a BITMAPINFOHEADER.
+void ImageCodec::EncodeBmp(int width, int height, RowSource source, void* context, std::vector<uint8_t>* file) {
+  using namespace ImageCodecInt;
+  const uint32_t row_size = (width * 3 + 3) & ~3u;
+  const uint32_t image_size = row_size * height;
+  const uint32_t header_size = 14 + 40;
+  file->clear();
+  file->reserve(header_size + image_size);
+
+  AppendBytes(file, "BM", 2);
+  AppendLittleEndian(file, header_size + image_size, 4);
+  AppendLittleEndian(file, 0, 4);  // Reserved.
+  AppendLittleEndian(file, header_size, 4);
+  AppendLittleEndian(file, 40, 4);  // BITMAPINFOHEADER.
+  AppendLittleEndian(file, width, 4);
+  AppendLittleEndian(file, height, 4);
+  AppendLittleEndian(file, 1, 2);   // Planes.
+  AppendLittleEndian(file, 24, 2);  // Bits per pixel.
+  AppendLittleEndian(file, 0, 4);   // BI_RGB.
+  AppendLittleEndian(file, image_size, 4);
+  AppendLittleEndian(file, 2835, 4);  // 72 dpi.
+  AppendLittleEndian(file, 2835, 4);
+  AppendLittleEndian(file, 0, 4);  // Palette colors.
+  AppendLittleEndian(file, 0, 4);
+
+  file->resize(header_size + image_size);  // Zero fills the row padding.
+  for (int y = 0; y < height; ++y) source(context, y, file->data() + header_size + (height - 1 - y) * row_size);
+}
+
+// Writes a 24-bit PNG. The image data uses stored (uncompressed) deflate blocks to keep the
+// encode cost minimal and avoid a zlib dependency.
+void ImageCodec::EncodePng(int width, int height, RowSource source, void* context, std::vector<uint8_t>* file) {
+  using namespace ImageCodecInt;
+  const uint32_t scanline_size = 1 + width * 3;  // Filter type byte and pixels.
+  std::vector<uint8_t> scanlines(static_cast<size_t>(scanline_size) * height);
+  for (int y = 0; y < height; ++y) {
+    uint8_t* scanline = scanlines.data() + static_cast<size_t>(y) * scanline_size;
+    scanline[0] = 0;  // No filter.
+    source(context, y, scanline + 1);
+  }
+
+  std::vector<uint8_t> zlib;
+  size_t blocks = scanlines.size() / kStoredBlockSize + 1;
+  zlib.reserve(2 + scanlines.size() + blocks * 5 + 4);
+  zlib.push_back(0x78);  // Deflate with a 32K window.
+  zlib.push_back(0x01);  // No preset dictionary, fastest level, valid check bits.
+  size_t offset = 0;
+  do {
+    uint32_t size = static_cast<uint32_t>(scanlines.size() - offset);
+    if (size > kStoredBlockSize) size = kStoredBlockSize;
+    bool final_block = offset + size == scanlines.size();
+    zlib.push_back(final_block ? 1 : 0);  // BFINAL and BTYPE = 00 (stored).
+    AppendLittleEndian(&zlib, size, 2);
+    AppendLittleEndian(&zlib, ~size & 0xffff, 2);
+    AppendBytes(&zlib, scanlines.data() + offset, size);
+    offset += size;
+  } while (offset < scanlines.size());
+  AppendBigEndian(&zlib, Adler32(scanlines.data(), scanlines.size()));
+
+  uint8_t header[13] = {};
+  for (int i = 0; i < 4; ++i) {
+    header[i] = static_cast<uint8_t>(width >> (24 - 8 * i));
+    header[4 + i] = static_cast<uint8_t>(height >> (24 - 8 * i));
+  }
+  header[8] = 8;  // Bit depth.
+  header[9] = 2;  // Truecolor, with compression, filter, and interlace methods of zero.
+
+  static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  file->clear();
+  file->reserve(sizeof(kSignature) + 3 * 12 + sizeof(header) + zlib.size());
+  AppendBytes(file, kSignature, sizeof(kSignature));
+  AppendPngChunk(file, "IHDR", header, sizeof(header));
+  AppendPngChunk(file, "IDAT", zlib.data(), zlib.size());
+  AppendPngChunk(file, "IEND", nullptr, 0);
+}
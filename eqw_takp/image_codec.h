@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Portable pixel conversion and image file encoding used by the screenshot worker thread. The
+// conversion kernels use SSE2 when available with scalar fallbacks for the row tails and other
+// targets. There are no Windows or d3d dependencies.
+
+namespace ImageCodec {
+
+enum class PixelFormat {
+  kXrgb8888,  // Little-endian 32-bit (B, G, R, X bytes), also used for A8R8G8B8.
+  kRgb565,
+  kXrgb1555,
+};
+
+// Converts a row of pixels into packed 24-bit pixels in R, G, B byte order (or B, G, R if bgr).
+void ConvertRow(PixelFormat format, const uint8_t* source, uint8_t* dest, int width, bool bgr);
+
+// Encodes a top-down image into a file image. The row callback must fill in row y of the
+// converted 24-bit pixels (R, G, B order for png, B, G, R for bmp) into the provided buffer.
+using RowSource = void (*)(void* context, int y, uint8_t* row);
+void EncodeBmp(int width, int height, RowSource source, void* context, std::vector<uint8_t>* file);
+void EncodePng(int width, int height, RowSource source, void* context, std::vector<uint8_t>* file);
+
+}  // namespace ImageCodec
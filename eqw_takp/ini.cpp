@@ -0,0 +1,265 @@
+#include "ini.h"
+
+#include <windows.h>
+
+#include <map>
+
+#include "ini_document.h"
+#include "logger.h"
+
+namespace IniInt {
+namespace {
+
+static constexpr DWORD kFlushDelayMs = 1000;     // Quiet period before pending writes are persisted.
+static constexpr DWORD kFlushMaxDelayMs = 5000;  // Upper bound on the deferral under continuous writes.
+
+// A modification that has not been persisted yet. These are replayed on top of the file contents
+// if the file is modified externally before the flush.
+struct PendingOp {
+  std::string section;
+  std::string key;  // Empty when erasing the section.
+  std::string value;
+  bool erase = false;
+};
+
+struct CachedFile {
+  std::string path;
+  IniDocument document;
+  bool loaded = false;
+  FILETIME write_time = {};
+  ULONGLONG file_size = 0;
+  std::vector<PendingOp> pending;
+};
+
+SRWLOCK lock_ = SRWLOCK_INIT;        // Guards files_.
+SRWLOCK flush_lock_ = SRWLOCK_INIT;  // Serializes FlushAll() calls.
+std::map<std::string, CachedFile> files_;  // Keyed by lowercase path.
+HANDLE flush_event_ = nullptr;
+Ini::Stats stats_ = {};
+
+// Returns the full path so different spellings of the same file share one cache entry.
+std::string GetFullPath(const char* filename) {
+  char full_path[MAX_PATH];
+  DWORD length = ::GetFullPathNameA(filename, sizeof(full_path), full_path, nullptr);
+  return (length && length < sizeof(full_path)) ? full_path : filename;
+}
+
+std::string ToLower(std::string text) {
+  for (char& c : text)
+    if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+  return text;
+}
+
+// Reads the whole file. Returns false if it does not exist.
+bool ReadFileText(const std::string& path, std::string* text) {
+  text->clear();
+  HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (::GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    text->resize(static_cast<size_t>(size.QuadPart));
+    DWORD bytes_read = 0;
+    if (!::ReadFile(file, text->data(), static_cast<DWORD>(text->size()), &bytes_read, nullptr)) bytes_read = 0;
+    text->resize(bytes_read);
+  }
+  ::CloseHandle(file);
+  return true;
+}
+
+void ApplyOp(IniDocument& document, const PendingOp& op) {
+  if (!op.erase)
+    document.Set(op.section, op.key, op.value);
+  else if (op.key.empty())
+    document.DeleteSection(op.section);
+  else
+    document.DeleteKey(op.section, op.key);
+}
+
+// Returns the cached file (re)loaded from disk if it is new or the file was modified externally.
+// Must be called with the lock held exclusively.
+CachedFile& GetFile(const char* filename) {
+  std::string path = GetFullPath(filename);
+  CachedFile& file = files_[ToLower(path)];
+  if (file.path.empty()) file.path = path;
+
+  WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+  bool found = ::GetFileAttributesExA(file.path.c_str(), GetFileExInfoStandard, &attributes);
+  ULONGLONG size = (static_cast<ULONGLONG>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+  if (file.loaded && size == file.file_size && !::CompareFileTime(&attributes.ftLastWriteTime, &file.write_time))
+    return file;
+
+  LARGE_INTEGER start, end;
+  ::QueryPerformanceCounter(&start);
+  std::string text;
+  if (found) ReadFileText(file.path, &text);
+  file.document.Parse(text);
+  ::QueryPerformanceCounter(&end);
+  stats_.loads++;
+  stats_.load_ticks += end.QuadPart - start.QuadPart;
+
+  for (const PendingOp& op : file.pending) ApplyOp(file.document, op);
+  file.write_time = attributes.ftLastWriteTime;
+  file.file_size = size;
+  if (file.loaded) Logger::Info("Ini: Reloaded externally modified %s", file.path.c_str());
+  file.loaded = true;
+  return file;
+}
+
+// Writes text to a temporary file and atomically renames it over the path. A durable write also
+// forces the data and the rename to the disk before returning.
+bool WriteFileAtomic(const std::string& path, const std::string& text, bool durable) {
+  std::string temp_path = path + ".eqw_tmp";
+  HANDLE file = ::CreateFileA(temp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  DWORD written = 0;
+  bool success = ::WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) &&
+                 written == text.size() && (!durable || ::FlushFileBuffers(file));
+  ::CloseHandle(file);
+  if (success)
+    success = ::MoveFileExA(temp_path.c_str(), path.c_str(),
+                            MOVEFILE_REPLACE_EXISTING | (durable ? MOVEFILE_WRITE_THROUGH : 0));
+  if (!success) ::DeleteFileA(temp_path.c_str());
+  return success;
+}
+
+// Persists all files with pending modifications. The file I/O is performed outside of the cache
+// lock so readers are not stalled. The blocking flag is false during static destruction where the
+// flush thread may have been killed while holding a lock.
+void FlushAll(bool blocking, bool durable = true) {
+  if (blocking)
+    ::AcquireSRWLockExclusive(&flush_lock_);
+  else if (!::TryAcquireSRWLockExclusive(&flush_lock_))
+    return;
+
+  struct Job {
+    std::string key;
+    std::string path;
+    std::string text;
+    size_t op_count;
+  };
+  std::vector<Job> jobs;
+  ::AcquireSRWLockExclusive(&lock_);
+  for (auto& [key, entry] : files_) {
+    if (entry.pending.empty()) continue;
+    CachedFile& file = GetFile(entry.path.c_str());  // Picks up any external changes first.
+    jobs.push_back({key, file.path, file.document.Serialize(), file.pending.size()});
+  }
+  ::ReleaseSRWLockExclusive(&lock_);
+
+  for (const Job& job : jobs) {
+    bool success = WriteFileAtomic(job.path, job.text, durable);
+    if (!success) Logger::Error("Ini: Failed to write %s (0x%08x)", job.path.c_str(), ::GetLastError());
+
+    ::AcquireSRWLockExclusive(&lock_);
+    CachedFile& file = files_[job.key];
+    if (success) {
+      file.pending.erase(file.pending.begin(), file.pending.begin() + job.op_count);
+      file.loaded = false;  // Next access refreshes the timestamp and re-applies any newer ops.
+    }
+    ::ReleaseSRWLockExclusive(&lock_);
+  }
+  ::ReleaseSRWLockExclusive(&flush_lock_);
+}
+
+// Background thread that writes out modifications once they stop arriving.
+DWORD WINAPI FlushThread(LPVOID) {
+  for (;;) {
+    ::WaitForSingleObject(flush_event_, INFINITE);
+    ULONGLONG start = ::GetTickCount64();
+    while (::WaitForSingleObject(flush_event_, kFlushDelayMs) == WAIT_OBJECT_0 &&
+           ::GetTickCount64() - start < kFlushMaxDelayMs) {
+    }
+    FlushAll(true);
+  }
+  return 0;
+}
+
+// Wrapper class used to write out any pending modifications at static destruction.
+class IniFlusher {
+ public:
+  ~IniFlusher() { FlushAll(false); }
+};
+
+// Records the modification and wakes the flush thread. Must be called with the lock held.
+void AddPendingOp(CachedFile& file, PendingOp&& op) {
+  ApplyOp(file.document, op);
+  file.pending.push_back(std::move(op));
+
+  if (!flush_event_) {
+    static IniFlusher flusher;
+    flush_event_ = ::CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    HANDLE thread = ::CreateThread(nullptr, 0, FlushThread, nullptr, 0, nullptr);
+    if (thread) {
+      ::SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+      ::CloseHandle(thread);
+    }
+  }
+  ::SetEvent(flush_event_);
+}
+
+}  // namespace
+}  // namespace IniInt
+
+bool Ini::Lookup(const std::string& section, const std::string& key, std::string* value, const char* filename) {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  bool found = IniInt::GetFile(filename).document.Get(section, key, value);
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+  return found;
+}
+
+bool Ini::GetString(const std::string& section, const std::string& key, std::string* value, const char* filename) {
+  return Lookup(section, key, value, filename) && !value->empty();
+}
+
+void Ini::SetString(const std::string& section, const std::string& key, const std::string& value,
+                    const char* filename) {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  IniInt::AddPendingOp(IniInt::GetFile(filename), {section, key, value});
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+}
+
+std::vector<std::string> Ini::GetSectionNames(const char* filename) {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  std::vector<std::string> section_names = IniInt::GetFile(filename).document.GetSectionNames();
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+  return section_names;
+}
+
+std::vector<std::string> Ini::GetKeyNames(const std::string& section, const char* filename) {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  std::vector<std::string> key_names = IniInt::GetFile(filename).document.GetKeyNames(section);
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+  return key_names;
+}
+
+bool Ini::DeleteKey(const std::string& section, const std::string& key, const char* filename) {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  IniInt::CachedFile& file = IniInt::GetFile(filename);
+  std::string value;
+  if (file.document.Get(section, key, &value)) IniInt::AddPendingOp(file, {section, key, "", true});
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+  return true;
+}
+
+bool Ini::DeleteSection(const std::string& sectionName, const char* filename) {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  IniInt::CachedFile& file = IniInt::GetFile(filename);
+  if (file.document.HasSection(sectionName)) IniInt::AddPendingOp(file, {sectionName, "", "", true});
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+  return true;
+}
+
+void Ini::Flush() { IniInt::FlushAll(true); }
+
+void Ini::WriteThrough() { IniInt::FlushAll(true, false); }
+
+Ini::Stats Ini::GetStats() {
+  ::AcquireSRWLockExclusive(&IniInt::lock_);
+  Ini::Stats stats = IniInt::stats_;
+  ::ReleaseSRWLockExclusive(&IniInt::lock_);
+  return stats;
+}
@@ -1,15 +1,16 @@
 #pragma once
-#include <Windows.h>
 
-#include <filesystem>
-#include <fstream>
-#include <iostream>
-#include <map>
-#include <stdexcept>
+#include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 // Utility support functions to simplify reading and storing settings.
+//
+// The files are parsed once into an in-memory cache (revalidated against the file timestamp
+// so external edits are picked up). Writes update the cache immediately and are persisted
+// by a background thread after a short quiet period, so callers can read and write settings
+// from window message handlers. Call Flush() before terminating the process.
 
 namespace Ini {
 template <typename T>
@@ -26,55 +27,41 @@ T ConvertFromString(const std::string& str, const T& default_value) {
   return value;
 }
 
-static inline bool exists(const std::string& section, const std::string& key, const char* filename) {
-  char buffer[256];
-  DWORD bytes_read = ::GetPrivateProfileStringA(section.c_str(), key.c_str(), "", buffer, sizeof(buffer), filename);
+// Returns false if the key does not exist (an existing empty value is returned as found).
+bool Lookup(const std::string& section, const std::string& key, std::string* value, const char* filename);
 
-  if (bytes_read == 0) {
-    return false;
-  }
-  return true;
-}
+// Returns false if the key does not exist or has an empty value.
+bool GetString(const std::string& section, const std::string& key, std::string* value, const char* filename);
 
-static inline std::vector<std::string> GetSectionNames(const char* filename) {
-  std::vector<std::string> section_names;
-  const DWORD buffer_size = 4096;  // Adjust buffer size as needed
-  char buffer[buffer_size];
+// Updates the cached value and schedules the write to disk.
+void SetString(const std::string& section, const std::string& key, const std::string& value, const char* filename);
 
-  DWORD result = ::GetPrivateProfileSectionNamesA(buffer, buffer_size, filename);
-  if (result == 0) {
-    return section_names;
-  }
+// Synchronously writes out any pending modifications.
+void Flush();
 
-  for (char* p = buffer; *p != '\0'; p += strlen(p) + 1) {
-    section_names.push_back(p);
-  }
+// Synchronously writes out any pending modifications for other processes to read, without
+// waiting for them to reach the disk (the file is still replaced atomically).
+void WriteThrough();
 
-  return section_names;
+static inline bool exists(const std::string& section, const std::string& key, const char* filename) {
+  std::string value;
+  return GetString(section, key, &value, filename);
 }
 
-static inline bool DeleteSection(const std::string& sectionName, const char* filename) {
-  // Delete the section and its contents by writing an empty string to it
-  if (!::WritePrivateProfileSectionA(sectionName.c_str(), nullptr, filename)) {
-    return false;
-  } else {
-    return true;
-  }
-}
+std::vector<std::string> GetSectionNames(const char* filename);
 
-template <typename T>
-T GetValue(std::string section, std::string key, const T& default_value, const char* filename) {
-  char buffer[256];
-  DWORD bytes_read = ::GetPrivateProfileStringA(section.c_str(), key.c_str(), "", buffer, sizeof(buffer), filename);
+std::vector<std::string> GetKeyNames(const std::string& section, const char* filename);
 
-  // Write back the default and return it if the entry doesn't exist.
-  if (bytes_read == 0) {
-    SetValue<T>(section, key, default_value, filename);
-    return default_value;
-  }
-  if constexpr (std::is_same_v<T, std::string>) return buffer;
-  return ConvertFromString<T>(std::string(buffer), default_value);
-}
+bool DeleteKey(const std::string& section, const std::string& key, const char* filename);
+
+bool DeleteSection(const std::string& sectionName, const char* filename);
+
+// Cumulative cost of reading and parsing files from disk.
+struct Stats {
+  unsigned int loads;
+  long long load_ticks;  // QueryPerformanceCounter() ticks.
+};
+Stats GetStats();
 
 template <typename T>
 void SetValue(const std::string& section, const std::string& key, const T& value, const char* filename) {
@@ -86,6 +73,19 @@ void SetValue(const std::string& section, const std::string& key, const T& value
   } else {
     value_str = value;
   }
-  BOOL result = ::WritePrivateProfileStringA(section.c_str(), key.c_str(), value_str.c_str(), filename);
+  SetString(section, key, value_str, filename);
+}
+
+template <typename T>
+T GetValue(std::string section, std::string key, const T& default_value, const char* filename) {
+  std::string value;
+
+  // Write back the default and return it if the entry doesn't exist.
+  if (!GetString(section, key, &value, filename)) {
+    SetValue<T>(section, key, default_value, filename);
+    return default_value;
+  }
+  if constexpr (std::is_same_v<T, std::string>) return value;
+  return ConvertFromString<T>(value, default_value);
 }
 }  // namespace Ini
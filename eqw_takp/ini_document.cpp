@@ -0,0 +1,221 @@
+#include "ini_document.h"
+
+namespace {
+
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+std::string_view Trim(std::string_view text) {
+  while (!text.empty() && IsSpace(text.front())) text.remove_prefix(1);
+  while (!text.empty() && IsSpace(text.back())) text.remove_suffix(1);
+  return text;
+}
+
+std::string ToLower(std::string_view text) {
+  std::string result(text);
+  for (char& c : result)
+    if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+  return result;
+}
+
+// Returns the trimmed section name if the line is a "[name]" header.
+bool ParseHeader(std::string_view line, std::string_view* name) {
+  line = Trim(line);
+  if (line.size() < 2 || line.front() != '[') return false;
+  size_t end = line.find(']');
+  if (end == std::string_view::npos) return false;
+  *name = Trim(line.substr(1, end - 1));
+  return true;
+}
+
+}  // namespace
+
+IniDocument::IniDocument() { sections_.emplace_back(); }
+
+void IniDocument::Parse(std::string_view text) {
+  sections_.clear();
+  sections_index_.clear();
+  sections_.emplace_back();
+
+  bom_.clear();
+  if (text.substr(0, 3) == "\xEF\xBB\xBF") {
+    bom_ = text.substr(0, 3);
+    text.remove_prefix(3);
+  }
+  size_t first_newline = text.find('\n');
+  newline_ = (first_newline != std::string_view::npos && first_newline > 0 && text[first_newline - 1] != '\r')
+                 ? "\n"
+                 : "\r\n";
+  trailing_newline_ = text.empty() || text.back() == '\n';
+
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string_view::npos) end = text.size();
+    std::string_view line = text.substr(start, end - start);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    start = end + 1;
+
+    std::string_view name;
+    if (ParseHeader(line, &name)) {
+      Section& section = sections_.emplace_back();
+      section.header = line;
+      section.name = name;
+      sections_index_.emplace(ToLower(name), sections_.size() - 1);  // Keeps the first duplicate.
+      continue;
+    }
+    sections_.back().lines.push_back({std::string(line)});
+  }
+
+  for (Section& section : sections_) IndexKeys(section);
+}
+
+std::string IniDocument::Serialize() const {
+  std::string result = bom_;
+  bool first = true;
+  auto append = [&](const std::string& line) {
+    if (!first) result += newline_;
+    result += line;
+    first = false;
+  };
+  for (size_t i = 0; i < sections_.size(); ++i) {
+    const Section& section = sections_[i];
+    if (section.deleted) continue;
+    if (i) append(section.header);
+    for (const Line& line : section.lines) append(line.text);
+  }
+  if (!first && trailing_newline_) result += newline_;
+  return result;
+}
+
+bool IniDocument::Get(std::string_view section, std::string_view key, std::string* value) const {
+  int index = FindSection(section);
+  if (index < 0) return false;
+  const Section& entry = sections_[index];
+  auto it = entry.keys.find(ToLower(Trim(key)));
+  if (it == entry.keys.end()) return false;
+
+  const Line& line = entry.lines[it->second];
+  std::string_view result = Trim(std::string_view(line.text).substr(line.value_offset));
+  if (result.size() >= 2 && (result.front() == '"' || result.front() == '\'') && result.back() == result.front())
+    result = result.substr(1, result.size() - 2);
+  *value = result;
+  return true;
+}
+
+void IniDocument::Set(std::string_view section, std::string_view key, std::string_view value) {
+  key = Trim(key);
+  int index = FindSection(section);
+  if (index < 0) {
+    // Append a new section, separated from the previous contents by a blank line.
+    Section* last = nullptr;
+    for (Section& entry : sections_)
+      if (!entry.deleted && (!entry.lines.empty() || !entry.header.empty())) last = &entry;
+    if (last && !Trim(last->lines.empty() ? last->header : last->lines.back().text).empty()) last->lines.push_back({});
+
+    Section& entry = sections_.emplace_back();
+    entry.name = Trim(section);
+    entry.header = "[" + entry.name + "]";
+    sections_index_[ToLower(entry.name)] = sections_.size() - 1;
+    index = static_cast<int>(sections_.size() - 1);
+  }
+
+  Section& entry = sections_[index];
+  auto it = entry.keys.find(ToLower(key));
+  if (it != entry.keys.end()) {
+    Line& line = entry.lines[it->second];
+    line.text.replace(line.value_offset, std::string::npos, value);
+    return;
+  }
+
+  // Insert after the last key so trailing blank lines and comments stay between sections.
+  size_t position = 0;
+  for (size_t i = 0; i < entry.lines.size(); ++i)
+    if (entry.lines[i].key_length) position = i + 1;
+  std::string text(key);
+  text += '=';
+  text += value;
+  entry.lines.insert(entry.lines.begin() + position, {std::move(text)});
+  IndexKeys(entry);
+}
+
+bool IniDocument::DeleteKey(std::string_view section, std::string_view key) {
+  int index = FindSection(section);
+  if (index < 0) return false;
+  Section& entry = sections_[index];
+  auto it = entry.keys.find(ToLower(Trim(key)));
+  if (it == entry.keys.end()) return false;
+  entry.lines.erase(entry.lines.begin() + it->second);
+  IndexKeys(entry);
+  return true;
+}
+
+bool IniDocument::DeleteSection(std::string_view section) {
+  int index = FindSection(section);
+  if (index <= 0) return false;
+  sections_[index].deleted = true;
+  sections_[index].lines.clear();
+  sections_[index].keys.clear();
+
+  // Promote any later duplicate so lookups match a re-parse of the serialized text.
+  std::string name = ToLower(Trim(section));
+  sections_index_.erase(name);
+  for (size_t i = index + 1; i < sections_.size(); ++i) {
+    if (!sections_[i].deleted && ToLower(sections_[i].name) == name) {
+      sections_index_[name] = i;
+      break;
+    }
+  }
+  return true;
+}
+
+std::vector<std::string> IniDocument::GetSectionNames() const {
+  std::vector<std::string> names;
+  for (size_t i = 1; i < sections_.size(); ++i)
+    if (!sections_[i].deleted) names.push_back(sections_[i].name);
+  return names;
+}
+
+std::vector<std::string> IniDocument::GetKeyNames(std::string_view section) const {
+  std::vector<std::string> names;
+  int index = FindSection(section);
+  if (index < 0) return names;
+  for (const Line& line : sections_[index].lines)
+    if (line.key_length) names.push_back(line.text.substr(line.key_offset, line.key_length));
+  return names;
+}
+
+std::vector<std::string> IniDocument::GetSectionLines(std::string_view section) const {
+  std::vector<std::string> lines;
+  int index = FindSection(section);
+  if (index < 0) return lines;
+  for (const Line& line : sections_[index].lines) {
+    std::string_view text = Trim(line.text);
+    if (!text.empty() && text.front() != ';') lines.emplace_back(text);
+  }
+  return lines;
+}
+
+int IniDocument::FindSection(std::string_view section) const {
+  auto it = sections_index_.find(ToLower(Trim(section)));
+  return (it == sections_index_.end()) ? -1 : static_cast<int>(it->second);
+}
+
+// Rebuilds the key offsets and lookup table of the section.
+void IniDocument::IndexKeys(Section& section) {
+  section.keys.clear();
+  for (size_t i = 0; i < section.lines.size(); ++i) {
+    Line& line = section.lines[i];
+    line.key_length = 0;
+    size_t equals = line.text.find('=');
+    size_t key_offset = line.text.find_first_not_of(" \t");
+    if (equals == std::string::npos || key_offset == std::string::npos || line.text[key_offset] == ';') continue;
+
+    std::string_view key = Trim(std::string_view(line.text).substr(key_offset, equals - key_offset));
+    if (key.empty()) continue;
+    line.key_offset = key_offset;
+    line.key_length = key.size();
+    line.value_offset = line.text.find_first_not_of(" \t", equals + 1);
+    if (line.value_offset == std::string::npos) line.value_offset = line.text.size();
+    section.keys.emplace(ToLower(key), i);  // Keeps the first duplicate.
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Parsed, editable model of an INI file that round-trips the original text (comments, blank
+// lines, spacing and line endings) and only rewrites the lines that were modified. Section
+// and key lookups are case-insensitive and follow the GetPrivateProfileString() conventions
+// (the first matching section and key win, whitespace around keys and values is trimmed, and
+// a value enclosed in matching quotes is returned without them).
+//
+// This file is intentionally free of Windows dependencies so it can be tested and profiled
+// off-target.
+
+class IniDocument {
+ public:
+  IniDocument();
+
+  // Replaces the contents with the parsed text.
+  void Parse(std::string_view text);
+
+  // Returns the file contents including any modifications.
+  std::string Serialize() const;
+
+  // Returns false if the key does not exist.
+  bool Get(std::string_view section, std::string_view key, std::string* value) const;
+
+  // Updates the key in place if it exists, otherwise adds it to the end of the section
+  // (creating the section at the end of the file if needed).
+  void Set(std::string_view section, std::string_view key, std::string_view value);
+
+  // Returns false if the key or section did not exist.
+  bool DeleteKey(std::string_view section, std::string_view key);
+  bool DeleteSection(std::string_view section);
+
+  bool HasSection(std::string_view section) const { return FindSection(section) >= 0; }
+
+  // Returns the names in file order.
+  std::vector<std::string> GetSectionNames() const;
+  std::vector<std::string> GetKeyNames(std::string_view section) const;
+
+  // Returns the raw "key=value" (and other non-comment) lines of the section in file order.
+  std::vector<std::string> GetSectionLines(std::string_view section) const;
+
+ private:
+  struct Line {
+    std::string text;       // Raw line contents without the line ending.
+    size_t key_offset = 0;
+    size_t key_length = 0;    // Length of the trimmed key (zero for comments, blanks and non-key lines).
+    size_t value_offset = 0;  // Start of the value (after the '=' and any whitespace).
+  };
+
+  struct Section {
+    std::string header;  // Raw header line (empty for the leading section-less lines).
+    std::string name;
+    std::vector<Line> lines;
+    std::unordered_map<std::string, size_t> keys;  // Lowercase key to index of first matching line.
+    bool deleted = false;
+  };
+
+  int FindSection(std::string_view section) const;
+  void IndexKeys(Section& section);
+
+  std::vector<Section> sections_;  // sections_[0] holds the lines before the first header.
+  std::unordered_map<std::string, size_t> sections_index_;  // Lowercase name to index of the first match.
+  std::string bom_;  // Preserved UTF-8 byte order mark.
+  std::string newline_ = "\r\n";
+  bool trailing_newline_ = true;
+};
@@ -0,0 +1,181 @@
+#include "ini_redirect.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "iat_hook.h"
+#include "ini.h"
+#include "logger.h"
+
+namespace IniRedirectInt {
+namespace {
+
+// Note that multiple hmodules get hooked and these common hooks will store the final one. The
+// hooks call the kernel32 functions directly so a module missing an import is harmless.
+IATHook hook_GetPrivateProfileStringA_;
+IATHook hook_GetPrivateProfileIntA_;
+IATHook hook_WritePrivateProfileStringA_;
+
+std::atomic<unsigned int> calls_served_ = 0;
+std::atomic<unsigned int> calls_passed_ = 0;
+std::atomic<long long> served_ticks_ = 0;
+
+// Windows resolves filenames without a path relative to the Windows directory, so leave those alone.
+bool IsRedirected(LPCSTR filename) { return filename && (strchr(filename, '\\') || strchr(filename, '/')); }
+
+// Accumulates the time spent servicing a call from the cache.
+class ServedCallTimer {
+ public:
+  ServedCallTimer() { ::QueryPerformanceCounter(&start_); }
+
+  ~ServedCallTimer() {
+    LARGE_INTEGER end;
+    ::QueryPerformanceCounter(&end);
+    served_ticks_.fetch_add(end.QuadPart - start_.QuadPart, std::memory_order_relaxed);
+    calls_served_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  LARGE_INTEGER start_;
+};
+
+// Copies the string with truncation. Returns the number of characters copied (excluding the null).
+DWORD CopyString(const std::string& text, LPSTR buffer, DWORD size) {
+  if (!buffer || !size) return 0;
+  DWORD count = (text.size() < size - 1) ? static_cast<DWORD>(text.size()) : size - 1;
+  memcpy(buffer, text.data(), count);
+  buffer[count] = 0;
+  return count;
+}
+
+// Copies the names as a double null terminated list. Matches the API by returning size - 2 if truncated.
+DWORD CopyList(const std::vector<std::string>& names, LPSTR buffer, DWORD size) {
+  if (!buffer || !size) return 0;
+  if (size < 2) {
+    buffer[0] = 0;
+    return 0;
+  }
+  DWORD used = 0;
+  for (const std::string& name : names) {
+    if (used + name.size() + 1 > size - 1) {
+      DWORD count = size - 2 - used;
+      memcpy(buffer + used, name.data(), count);
+      buffer[size - 2] = 0;
+      buffer[size - 1] = 0;
+      return size - 2;
+    }
+    memcpy(buffer + used, name.c_str(), name.size() + 1);
+    used += static_cast<DWORD>(name.size()) + 1;
+  }
+  buffer[used] = 0;
+  return used;
+}
+
+// Matches the API's integer conversion (optional sign and 0x, 0o, or 0b prefixes).
+UINT ParseInt(const std::string& text) {
+  const char* p = text.c_str();
+  while (*p == ' ' || *p == '\t') ++p;
+  bool negative = (*p == '-');
+  if (*p == '-' || *p == '+') ++p;
+  int base = 10;
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    base = 16;
+    p += 2;
+  } else if (p[0] == '0' && (p[1] == 'o' || p[1] == 'O')) {
+    base = 8;
+    p += 2;
+  } else if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+    base = 2;
+    p += 2;
+  }
+  UINT value = 0;
+  for (;; ++p) {
+    int digit = (*p >= '0' && *p <= '9')   ? *p - '0'
+                : (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10
+                : (*p >= 'A' && *p <= 'F') ? *p - 'A' + 10
+                                           : base;
+    if (digit >= base) break;
+    value = value * base + digit;
+  }
+  return negative ? 0u - value : value;
+}
+
+DWORD WINAPI Kernel32GetPrivateProfileStringAHook(LPCSTR lpAppName, LPCSTR lpKeyName, LPCSTR lpDefault,
+                                                  LPSTR lpReturnedString, DWORD nSize, LPCSTR lpFileName) {
+  if (!IsRedirected(lpFileName)) {
+    calls_passed_.fetch_add(1, std::memory_order_relaxed);
+    return ::GetPrivateProfileStringA(lpAppName, lpKeyName, lpDefault, lpReturnedString, nSize, lpFileName);
+  }
+
+  ServedCallTimer timer;
+  if (!lpAppName) return CopyList(Ini::GetSectionNames(lpFileName), lpReturnedString, nSize);
+  if (!lpKeyName) return CopyList(Ini::GetKeyNames(lpAppName, lpFileName), lpReturnedString, nSize);
+
+  std::string value;
+  if (!Ini::Lookup(lpAppName, lpKeyName, &value, lpFileName)) {
+    value = lpDefault ? lpDefault : "";
+    while (!value.empty() && value.back() == ' ') value.pop_back();  // The API trims the default.
+  }
+  return CopyString(value, lpReturnedString, nSize);
+}
+
+UINT WINAPI Kernel32GetPrivateProfileIntAHook(LPCSTR lpAppName, LPCSTR lpKeyName, INT nDefault, LPCSTR lpFileName) {
+  if (!IsRedirected(lpFileName) || !lpAppName || !lpKeyName) {
+    calls_passed_.fetch_add(1, std::memory_order_relaxed);
+    return ::GetPrivateProfileIntA(lpAppName, lpKeyName, nDefault, lpFileName);
+  }
+
+  ServedCallTimer timer;
+  std::string value;
+  if (!Ini::Lookup(lpAppName, lpKeyName, &value, lpFileName) || value.empty()) return nDefault;
+  return ParseInt(value);
+}
+
+BOOL WINAPI Kernel32WritePrivateProfileStringAHook(LPCSTR lpAppName, LPCSTR lpKeyName, LPCSTR lpString,
+                                                   LPCSTR lpFileName) {
+  if (!IsRedirected(lpFileName) || !lpAppName) {  // A null section is a request to flush the cache.
+    calls_passed_.fetch_add(1, std::memory_order_relaxed);
+    if (IsRedirected(lpFileName)) Ini::Flush();  // Explicit flush request, so write out the pending keys.
+    return ::WritePrivateProfileStringA(lpAppName, lpKeyName, lpString, lpFileName);
+  }
+
+  ServedCallTimer timer;
+  if (!lpKeyName)
+    Ini::DeleteSection(lpAppName, lpFileName);
+  else if (!lpString)
+    Ini::DeleteKey(lpAppName, lpKeyName, lpFileName);
+  else
+    Ini::SetString(lpAppName, lpKeyName, lpString, lpFileName);
+  Ini::WriteThrough();  // Other clients sharing the file (e.g. launched back to back) see the update.
+  return TRUE;
+}
+
+}  // namespace
+}  // namespace IniRedirectInt
+
+void IniRedirect::Initialize(HMODULE handle) {
+  using namespace IniRedirectInt;
+  hook_GetPrivateProfileStringA_ = IATHook(handle, "kernel32.dll", "GetPrivateProfileStringA",
+                                           Kernel32GetPrivateProfileStringAHook);
+  hook_GetPrivateProfileIntA_ = IATHook(handle, "kernel32.dll", "GetPrivateProfileIntA",
+                                        Kernel32GetPrivateProfileIntAHook);
+  hook_WritePrivateProfileStringA_ = IATHook(handle, "kernel32.dll", "WritePrivateProfileStringA",
+                                             Kernel32WritePrivateProfileStringAHook);
+}
+
+void IniRedirect::LogStats() {
+  using namespace IniRedirectInt;
+  LARGE_INTEGER frequency;
+  ::QueryPerformanceFrequency(&frequency);
+  double ms_per_tick = 1000.0 / static_cast<double>(frequency.QuadPart);
+
+  // Each original API call re-reads and re-parses the file, so the average cache load cost is
+  // used as the estimate of what a served call would have cost.
+  Ini::Stats stats = Ini::GetStats();
+  unsigned int served = calls_served_;
+  double load_ms = stats.loads ? stats.load_ticks * ms_per_tick / stats.loads : 0;
+  double served_ms = served_ticks_ * ms_per_tick;
+  Logger::Info("IniRedirect: Served %u calls in %.2f ms (%u passed through), loads: %u (%.3f ms avg), saved ~%.1f ms",
+               served, served_ms, calls_passed_.load(), stats.loads, load_ms, served * load_ms - served_ms);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <windows.h>
+
+// Routes the client's kernel32 GetPrivateProfileStringA / GetPrivateProfileIntA /
+// WritePrivateProfileStringA imports to the shared Ini cache, so repeated reads of
+// eqclient.ini (and the other ini files) during startup and zoning no longer re-read
+// and re-parse the file on every call. Writes are applied to the cache and written
+// through to the file before returning, like the original API, so other processes see
+// them immediately. The per-key writes skip the disk flush; an explicit flush request
+// (a null section name) also forces the pending keys to the disk.
+//
+// Only filenames with a path component are redirected. Bare filenames (resolved by
+// Windows relative to the Windows directory) are passed to the original API.
+
+namespace IniRedirect {
+
+void Initialize(HMODULE handle);  // Hooks the imports of eqgame.exe or eqmain.dll.
+void LogStats();                  // Logs the calls served and estimated time saved.
+
+}  // namespace IniRedirect
@@ -0,0 +1,381 @@
+#include "log_packer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace LogPacker {
+namespace {
+
+enum class Length { kNone, kChar, kShort, kLong, kLongLong, kSize, kLongDouble, kWide };
+
+// Parsed printf conversion specification.
+struct Spec {
+  const char* flags_begin = nullptr;  // Flag characters [flags_begin, flags_end).
+  const char* flags_end = nullptr;
+  bool width_star = false;
+  const char* width_begin = nullptr;  // Width digits [width_begin, width_end).
+  const char* width_end = nullptr;
+  bool has_precision = false;
+  bool precision_star = false;
+  const char* precision_begin = nullptr;  // Precision digits [precision_begin, precision_end).
+  const char* precision_end = nullptr;
+  Length length = Length::kNone;
+  char conversion = 0;  // Zero if the format ended prematurely.
+};
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Parses the specification that starts after a '%'. Returns the pointer past the conversion character.
+const char* ParseSpec(const char* p, Spec* spec) {
+  spec->flags_begin = p;
+  while (*p && strchr("-+ #0", *p)) ++p;
+  spec->flags_end = p;
+
+  spec->width_begin = p;
+  if (*p == '*') {
+    spec->width_star = true;
+    ++p;
+  }
+  while (IsDigit(*p)) ++p;
+  spec->width_end = p;
+
+  if (*p == '.') {
+    spec->has_precision = true;
+    ++p;
+    spec->precision_begin = p;
+    if (*p == '*') {
+      spec->precision_star = true;
+      ++p;
+    }
+    while (IsDigit(*p)) ++p;
+    spec->precision_end = p;
+  }
+
+  switch (*p) {
+    case 'h':
+      spec->length = (p[1] == 'h') ? Length::kChar : Length::kShort;
+      p += (p[1] == 'h') ? 2 : 1;
+      break;
+    case 'l':
+      spec->length = (p[1] == 'l') ? Length::kLongLong : Length::kLong;
+      p += (p[1] == 'l') ? 2 : 1;
+      break;
+    case 'L':
+      spec->length = Length::kLongDouble;
+      ++p;
+      break;
+    case 'z':
+    case 't':
+      spec->length = Length::kSize;
+      ++p;
+      break;
+    case 'j':
+      spec->length = Length::kLongLong;
+      ++p;
+      break;
+    case 'w':
+      spec->length = Length::kWide;
+      ++p;
+      break;
+    case 'I':  // Microsoft specific sizes.
+      if (p[1] == '6' && p[2] == '4') {
+        spec->length = Length::kLongLong;
+        p += 3;
+      } else if (p[1] == '3' && p[2] == '2') {
+        p += 3;
+      } else {
+        spec->length = Length::kSize;
+        ++p;
+      }
+      break;
+    default:
+      break;
+  }
+
+  spec->conversion = *p;
+  return *p ? p + 1 : p;
+}
+
+bool IsIntegerConversion(char c) { return c && strchr("diouxXc", c); }
+
+bool IsFloatConversion(char c) { return c && strchr("fFeEgGaA", c); }
+
+// Simple bounds checked sequential writer.
+class Writer {
+ public:
+  Writer(uint8_t* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+  bool Put(const void* data, size_t size) {
+    if (full_ || used_ + size > size_) {
+      full_ = true;  // Stop packing at the first argument that does not fit.
+      return false;
+    }
+    memcpy(buffer_ + used_, data, size);
+    used_ += size;
+    return true;
+  }
+
+  template <typename T>
+  bool PutTagged(Tag tag, T value) {
+    uint8_t raw[1 + sizeof(T)];
+    raw[0] = tag;
+    memcpy(raw + 1, &value, sizeof(T));
+    return Put(raw, sizeof(raw));
+  }
+
+  void PutString(const char* str) {
+    if (!str) str = "(null)";
+    size_t length = strnlen(str, kMaxStringLength);
+    uint8_t raw[2 + kMaxStringLength];
+    raw[0] = kTagString;
+    raw[1] = static_cast<uint8_t>(length);
+    memcpy(raw + 2, str, length);
+    Put(raw, 2 + length);
+  }
+
+  size_t used() const { return used_; }
+
+ private:
+  uint8_t* buffer_;
+  size_t size_;
+  size_t used_ = 0;
+  bool full_ = false;
+};
+
+// Sequential reader of the packed values.
+class Reader {
+ public:
+  Reader(const uint8_t* packed, size_t size) : packed_(packed), size_(size) {}
+
+  template <typename T>
+  bool Get(Tag tag, T* value) {
+    if (pos_ + 1 + sizeof(T) > size_ || packed_[pos_] != tag) return false;
+    memcpy(value, packed_ + pos_ + 1, sizeof(T));
+    pos_ += 1 + sizeof(T);
+    return true;
+  }
+
+  // Integers may have been stored at either width depending on the producer's platform.
+  bool GetInteger(long long* value, bool* is_64bit) {
+    int32_t value32 = 0;
+    if (Get(kTagInt32, &value32)) {
+      *value = value32;
+      *is_64bit = false;
+      return true;
+    }
+    int64_t value64 = 0;
+    if (Get(kTagInt64, &value64)) {
+      *value = value64;
+      *is_64bit = true;
+      return true;
+    }
+    return false;
+  }
+
+  bool GetString(char* output, size_t output_size) {
+    if (pos_ + 2 > size_ || packed_[pos_] != kTagString) return false;
+    size_t length = packed_[pos_ + 1];
+    if (pos_ + 2 + length > size_ || length >= output_size) return false;
+    memcpy(output, packed_ + pos_ + 2, length);
+    output[length] = 0;
+    pos_ += 2 + length;
+    return true;
+  }
+
+ private:
+  const uint8_t* packed_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+// Packs a signed or unsigned integer of the native width selected by the length modifier.
+void PackInteger(Writer& writer, Length length, va_list& args) {
+  switch (length) {
+    case Length::kLongLong:
+      writer.PutTagged(kTagInt64, static_cast<int64_t>(va_arg(args, long long)));
+      break;
+    case Length::kLong:
+      if (sizeof(long) == 8)
+        writer.PutTagged(kTagInt64, static_cast<int64_t>(va_arg(args, long)));
+      else
+        writer.PutTagged(kTagInt32, static_cast<int32_t>(va_arg(args, long)));
+      break;
+    case Length::kSize:
+      if (sizeof(size_t) == 8)
+        writer.PutTagged(kTagInt64, static_cast<int64_t>(va_arg(args, size_t)));
+      else
+        writer.PutTagged(kTagInt32, static_cast<int32_t>(va_arg(args, size_t)));
+      break;
+    default:
+      writer.PutTagged(kTagInt32, static_cast<int32_t>(va_arg(args, int)));
+      break;
+  }
+}
+
+// Appends text to the output, always leaving room for the terminator.
+class TextOutput {
+ public:
+  TextOutput(char* output, size_t size) : output_(output), size_(size) {
+    if (size_) output_[0] = 0;
+  }
+
+  void Append(const char* text, size_t length) {
+    if (!size_) return;
+    size_t room = size_ - 1 - used_;
+    if (length > room) length = room;
+    memcpy(output_ + used_, text, length);
+    used_ += length;
+    output_[used_] = 0;
+  }
+
+  void Append(const char* text) { Append(text, strlen(text)); }
+
+  size_t used() const { return used_; }
+
+ private:
+  char* output_;
+  size_t size_;
+  size_t used_ = 0;
+};
+
+// Rebuilds the conversion specification with the star widths resolved and the length modifier
+// replaced to match the packed value type.
+void BuildSpec(const Spec& spec, int width, int precision, const char* length, char* output, size_t size) {
+  TextOutput text(output, size);
+  char number[16];
+  text.Append("%");
+  text.Append(spec.flags_begin, spec.flags_end - spec.flags_begin);
+  if (spec.width_star) {
+    snprintf(number, sizeof(number), "%d", width);
+    text.Append(number);
+  } else {
+    text.Append(spec.width_begin, spec.width_end - spec.width_begin);
+  }
+  if (spec.has_precision) {
+    text.Append(".");
+    if (spec.precision_star) {
+      snprintf(number, sizeof(number), "%d", precision);
+      text.Append(number);
+    } else {
+      text.Append(spec.precision_begin, spec.precision_end - spec.precision_begin);
+    }
+  }
+  text.Append(length);
+  char conversion[2] = {spec.conversion, 0};
+  text.Append(conversion);
+}
+
+}  // namespace
+
+size_t Pack(const char* format, va_list args, uint8_t* buffer, size_t buffer_size) {
+  Writer writer(buffer, buffer_size);
+  va_list local_args;
+  va_copy(local_args, args);
+
+  for (const char* p = format; p && *p;) {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      ++p;
+      continue;
+    }
+
+    Spec spec;
+    p = ParseSpec(p, &spec);
+    if (spec.width_star) writer.PutTagged(kTagInt32, static_cast<int32_t>(va_arg(local_args, int)));
+    if (spec.precision_star) writer.PutTagged(kTagInt32, static_cast<int32_t>(va_arg(local_args, int)));
+
+    char c = spec.conversion;
+    if (IsIntegerConversion(c)) {
+      PackInteger(writer, spec.length, local_args);
+    } else if (IsFloatConversion(c)) {
+      double value = (spec.length == Length::kLongDouble) ? static_cast<double>(va_arg(local_args, long double))
+                                                          : va_arg(local_args, double);
+      writer.PutTagged(kTagDouble, value);
+    } else if (c == 's' && spec.length != Length::kLong && spec.length != Length::kWide) {
+      writer.PutString(va_arg(local_args, const char*));
+    } else if (c == 's' || c == 'S' || c == 'p') {
+      writer.PutTagged(kTagPointer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(va_arg(local_args, void*))));
+    } else if (c == 'n') {
+      va_arg(local_args, int*);  // Consumed but never written.
+    } else {
+      break;  // Unknown conversion so the remaining argument sizes are unknown.
+    }
+  }
+
+  va_end(local_args);
+  return writer.used();
+}
+
+size_t Format(const char* format, const uint8_t* packed, size_t packed_size, char* output, size_t output_size) {
+  TextOutput text(output, output_size);
+  Reader reader(packed, packed_size);
+  if (!format) return 0;
+
+  const char* p = format;
+  while (*p) {
+    const char* literal = p;
+    while (*p && *p != '%') ++p;
+    text.Append(literal, p - literal);
+    if (!*p) break;
+
+    ++p;  // Skip the '%'.
+    if (*p == '%') {
+      text.Append("%");
+      ++p;
+      continue;
+    }
+
+    Spec spec;
+    p = ParseSpec(p, &spec);
+    int32_t width = 0;
+    int32_t precision = 0;
+    bool ok = (!spec.width_star || reader.Get(kTagInt32, &width)) &&
+              (!spec.precision_star || reader.Get(kTagInt32, &precision));
+
+    char spec_text[48];
+    char value_text[256];
+    value_text[0] = 0;
+    char c = spec.conversion;
+    if (ok && IsIntegerConversion(c)) {
+      long long value = 0;
+      bool is_64bit = false;
+      ok = reader.GetInteger(&value, &is_64bit);
+      if (ok && is_64bit) {
+        BuildSpec(spec, width, precision, "ll", spec_text, sizeof(spec_text));
+        snprintf(value_text, sizeof(value_text), spec_text, value);
+      } else if (ok) {
+        const char* length = (spec.length == Length::kChar) ? "hh" : (spec.length == Length::kShort) ? "h" : "";
+        BuildSpec(spec, width, precision, length, spec_text, sizeof(spec_text));
+        snprintf(value_text, sizeof(value_text), spec_text, static_cast<int>(value));
+      }
+    } else if (ok && IsFloatConversion(c)) {
+      double value = 0;
+      ok = reader.Get(kTagDouble, &value);
+      BuildSpec(spec, width, precision, "", spec_text, sizeof(spec_text));
+      if (ok) snprintf(value_text, sizeof(value_text), spec_text, value);
+    } else if (ok && c == 's' && spec.length != Length::kLong && spec.length != Length::kWide) {
+      char str[kMaxStringLength + 1];
+      ok = reader.GetString(str, sizeof(str));
+      BuildSpec(spec, width, precision, "", spec_text, sizeof(spec_text));
+      if (ok) snprintf(value_text, sizeof(value_text), spec_text, str);
+    } else if (ok && (c == 's' || c == 'S' || c == 'p')) {
+      uint64_t value = 0;
+      ok = reader.Get(kTagPointer, &value);
+      if (ok) snprintf(value_text, sizeof(value_text), "%08llX", static_cast<unsigned long long>(value));
+    } else if (ok && c == 'n') {
+      continue;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      text.Append("<...>");  // Missing (truncated) or unsupported argument.
+      break;
+    }
+    text.Append(value_text);
+  }
+
+  return text.used();
+}
+
+}  // namespace LogPacker
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Captures printf style arguments into a compact, self-describing binary blob so that the
+// (expensive) text formatting can be deferred to another thread or another machine. Strings
+// are copied (truncated to kMaxStringLength) so the blob has no pointers into caller memory.
+// The format string itself is not copied and must be a static literal.
+//
+// This file is intentionally free of Windows dependencies so it is shared with the offline
+// log decoder tool.
+
+namespace LogPacker {
+
+static constexpr size_t kMaxStringLength = 96;  // Longer %s arguments are truncated.
+
+// Packed argument type tags.
+enum Tag : uint8_t {
+  kTagInt32 = 'i',
+  kTagInt64 = 'l',
+  kTagDouble = 'd',
+  kTagString = 's',   // Followed by a one byte length and the characters (no terminator).
+  kTagPointer = 'p',  // Stored as 64 bits so 32-bit dumps decode on 64-bit hosts.
+};
+
+// Packs the arguments consumed by format into buffer. Returns the number of bytes used. Arguments
+// that do not fit are dropped and Format() will mark the output as truncated.
+size_t Pack(const char* format, va_list args, uint8_t* buffer, size_t buffer_size);
+
+// Expands format using the previously packed arguments. The output is always null terminated.
+// Returns the length of the output string.
+size_t Format(const char* format, const uint8_t* packed, size_t packed_size, char* output, size_t output_size);
+
+}  // namespace LogPacker
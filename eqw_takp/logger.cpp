@@ -3,11 +3,109 @@
 #include <share.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <windows.h>
+
+#include <atomic>
+
+#include "bounded_queue.h"
+#include "flight_recorder.h"
+#include "log_packer.h"
 
 namespace Logger {
 
+static constexpr size_t kPackedSize = 224;       // Keeps an Entry at about 256 bytes.
+static constexpr size_t kQueueSize = 1024;       // Messages buffered between writer passes.
+static constexpr DWORD kWriterPeriodMs = 100;    // Maximum latency before queued lines hit the file.
+static constexpr size_t kBatchSize = 64 * 1024;  // Bytes formatted per fwrite().
+
+// A captured (unformatted) log call.
+struct Entry {
+  LONGLONG timestamp;  // QueryPerformanceCounter() ticks.
+  DWORD thread_id;
+  const char* format;  // Must be a static string literal.
+  Level level;
+  unsigned short packed_size;
+  BYTE packed[kPackedSize];
+};
+
 static FILE* log_file = nullptr;
 static Level log_level = Level::None;
+static BoundedQueue<Entry, kQueueSize> queue;
+static std::atomic<unsigned int> dropped_count = 0;
+static HANDLE wake_event = nullptr;
+static CRITICAL_SECTION drain_lock;  // Serializes the writer thread and explicit Flush() calls.
+static LONGLONG start_timestamp = 0;
+static double seconds_per_tick = 0;
+
+// Formats and writes all queued entries. The blocking flag is false during static destruction
+// where the writer thread may have been killed while holding the lock.
+static void Drain(bool blocking) {
+  if (!log_file) return;
+  if (blocking)
+    ::EnterCriticalSection(&drain_lock);
+  else if (!::TryEnterCriticalSection(&drain_lock))
+    return;
+
+  static char batch[kBatchSize];
+  size_t used = 0;
+  auto make_room = [&]() {
+    if (kBatchSize - used < 1024) {
+      fwrite(batch, 1, used, log_file);
+      used = 0;
+    }
+  };
+  auto write_line = [&](const Entry& entry) {
+    make_room();
+    double seconds = (entry.timestamp - start_timestamp) * seconds_per_tick;
+    int count = snprintf(batch + used, kBatchSize - used, "[%10.4f %5lu] %s", seconds, entry.thread_id,
+                         (entry.level == Level::Error) ? "Error: " : "");
+    if (count > 0) used += count;
+    used += LogPacker::Format(entry.format, entry.packed, entry.packed_size, batch + used, kBatchSize - used - 1);
+    batch[used++] = '\n';
+  };
+
+  bool wrote = false;
+  while (queue.TryPop([&](Entry& entry) { write_line(entry); })) wrote = true;
+
+  unsigned int dropped = dropped_count.exchange(0);
+  if (dropped) {
+    make_room();
+    used += snprintf(batch + used, kBatchSize - used, "Logger: Dropped %u messages (queue full)\n", dropped);
+    wrote = true;
+  }
+
+  if (wrote) {
+    fwrite(batch, 1, used, log_file);
+    fflush(log_file);
+  }
+  ::LeaveCriticalSection(&drain_lock);
+}
+
+// Background writer that periodically (or when woken) drains the queue to the file.
+static DWORD WINAPI WriterThread(LPVOID) {
+  for (;;) {
+    ::WaitForSingleObject(wake_event, kWriterPeriodMs);
+    Drain(true);
+  }
+  return 0;
+}
+
+// Captures the log call into the queue. Never blocks; counts the message as dropped if full.
+static void Enqueue(Level level, const char* format, va_list args) {
+  bool pushed = queue.TryPush([&](Entry& entry) {
+    LARGE_INTEGER timestamp;
+    ::QueryPerformanceCounter(&timestamp);
+    entry.timestamp = timestamp.QuadPart;
+    entry.thread_id = ::GetCurrentThreadId();
+    entry.format = format;
+    entry.level = level;
+    entry.packed_size = static_cast<unsigned short>(LogPacker::Pack(format, args, entry.packed, kPackedSize));
+  });
+  if (!pushed) dropped_count.fetch_add(1, std::memory_order_relaxed);
+
+  // Wake the writer early for errors or when the queue is filling up.
+  if (!pushed || level == Level::Error || queue.ApproxSize() > kQueueSize / 2) ::SetEvent(wake_event);
+}
 
 // Wrapper class used to close out log file at static destruction.
 class LogFileCloser {
@@ -16,6 +114,7 @@ class LogFileCloser {
 
   ~LogFileCloser() {
     if (log_file) {
+      Drain(false);
       fclose(log_file);
       log_file = nullptr;
     }
@@ -29,47 +128,50 @@ void Initialize(const char* filename, Level level) {
 
   static LogFileCloser closer;
   log_file = _fsopen(filename, "w", _SH_DENYWR);  // Open in non-exclusive read mode.
+  if (!log_file) return;
+
+  LARGE_INTEGER value;
+  ::QueryPerformanceFrequency(&value);
+  seconds_per_tick = 1.0 / static_cast<double>(value.QuadPart);
+  ::QueryPerformanceCounter(&value);
+  start_timestamp = value.QuadPart;
+
+  ::InitializeCriticalSection(&drain_lock);
+  wake_event = ::CreateEventA(nullptr, FALSE, FALSE, nullptr);
+  HANDLE thread = ::CreateThread(nullptr, 0, WriterThread, nullptr, 0, nullptr);
+  if (thread) {
+    ::SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+    ::CloseHandle(thread);
+  }
 }
 
 // Logs at Level::Info filter.
 void Info(const char* format, ...) {
-  if (!log_file || static_cast<int>(log_level) < static_cast<int>(Level::Info)) return;
-
   va_list args;
   va_start(args, format);
-  vfprintf(log_file, format, args);
+  FlightRecorder::Record(static_cast<int>(Level::Info), format, args);  // Always recorded.
+  if (log_file && static_cast<int>(log_level) >= static_cast<int>(Level::Info)) Enqueue(Level::Info, format, args);
   va_end(args);
-
-  fprintf(log_file, "\n");
-  fflush(log_file);
 }
 
-// Logs at Level::Error filter. Just duplicating since not worth repackaging va_list.
+// Logs at Level::Error filter.
 void Error(const char* format, ...) {
-  if (!log_file || static_cast<int>(log_level) < static_cast<int>(Level::Error)) return;
-
-  fprintf(log_file, "Error: ");
-
   va_list args;
   va_start(args, format);
-  vfprintf(log_file, format, args);
+  FlightRecorder::Record(static_cast<int>(Level::Error), format, args);  // Always recorded.
+  if (log_file && static_cast<int>(log_level) >= static_cast<int>(Level::Error)) Enqueue(Level::Error, format, args);
   va_end(args);
-
-  fprintf(log_file, "\n");
-  fflush(log_file);
 }
 
-// Logs at Level::Debug filter. Just duplicating since not worth repackaging va_list.
+// Logs at Level::Debug filter.
 void Debug(const char* format, ...) {
-  if (!log_file || static_cast<int>(log_level) < static_cast<int>(Level::Debug)) return;
-
   va_list args;
   va_start(args, format);
-  vfprintf(log_file, format, args);
+  FlightRecorder::Record(static_cast<int>(Level::Debug), format, args);  // Always recorded.
+  if (log_file && static_cast<int>(log_level) >= static_cast<int>(Level::Debug)) Enqueue(Level::Debug, format, args);
   va_end(args);
-
-  fprintf(log_file, "\n");
-  fflush(log_file);
 }
 
+void Flush() { Drain(true); }
+
 }  // namespace Logger
@@ -1,6 +1,10 @@
 #pragma once
 
 // Extremely simple log support that supports conditional logging.
+//
+// The logging calls only capture the arguments into a lock-free queue and a background thread
+// formats and writes them to the file in batches, so logging is safe to use in the per-frame
+// hooks. The format parameter must be a string literal (the pointer is stored, not the text).
 
 namespace Logger {
 
@@ -18,4 +22,7 @@ void Error(const char* format, ...);
 // Logs at DEBUG level.
 void Debug(const char* format, ...);
 
-}  // namespace Logger
\ No newline at end of file
+// Synchronously writes out all queued messages. Call before terminating the process.
+void Flush();
+
+}  // namespace Logger
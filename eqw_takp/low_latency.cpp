@@ -0,0 +1,112 @@
+#include "low_latency.h"
+
+#include "ini.h"
+#include "logger.h"
+
+namespace LowLatencyInt {
+namespace {
+
+static constexpr int kMaxQueuedFrames = 3;
+static constexpr int kMarkerCount = kMaxQueuedFrames + 1;
+static constexpr unsigned int kStatsInterval = 1024;  // Frames between wait time log reports.
+
+int max_queued_ = -1;  // Disabled if negative.
+bool failed_ = false;  // Markers are unsupported (multisampled back buffer, etc).
+IDirect3DDevice8* device_ = nullptr;
+IDirect3DSurface8* markers_[kMarkerCount] = {};
+unsigned int frame_ = 0;
+
+// Wait time statistics.
+LONGLONG frequency_ = 1;
+unsigned int last_wait_us_ = 0;
+unsigned int max_wait_us_ = 0;
+unsigned long long total_wait_us_ = 0;
+unsigned int stats_frames_ = 0;
+
+void ReleaseMarkers() {
+  for (auto& marker : markers_) {
+    if (marker) marker->Release();
+    marker = nullptr;
+  }
+  device_ = nullptr;
+}
+
+bool CreateMarkers(IDirect3DDevice8* device, IDirect3DSurface8* back_buffer) {
+  D3DSURFACE_DESC desc;
+  HRESULT result = back_buffer->GetDesc(&desc);
+  for (int i = 0; SUCCEEDED(result) && i < kMarkerCount; ++i)
+    result = device->CreateRenderTarget(1, 1, desc.Format, D3DMULTISAMPLE_NONE, TRUE, &markers_[i]);
+  if (FAILED(result)) {
+    Logger::Error("LowLatency: Failed to create markers: 0x%08x", result);
+    ReleaseMarkers();
+    return false;
+  }
+  device_ = device;
+  frame_ = 0;
+  return true;
+}
+
+// Blocks until the GPU has completed the copy into the marker.
+void WaitOnMarker(IDirect3DSurface8* marker) {
+  LARGE_INTEGER start, end;
+  ::QueryPerformanceCounter(&start);
+  D3DLOCKED_RECT locked;
+  if (SUCCEEDED(marker->LockRect(&locked, nullptr, D3DLOCK_READONLY))) marker->UnlockRect();
+  ::QueryPerformanceCounter(&end);
+
+  last_wait_us_ = static_cast<unsigned int>((end.QuadPart - start.QuadPart) * 1000000 / frequency_);
+  max_wait_us_ = (last_wait_us_ > max_wait_us_) ? last_wait_us_ : max_wait_us_;
+  total_wait_us_ += last_wait_us_;
+  if (++stats_frames_ < kStatsInterval) return;
+  Logger::Info("LowLatency: GPU wait per frame avg: %u us, max: %u us",
+               static_cast<unsigned int>(total_wait_us_ / stats_frames_), max_wait_us_);
+  max_wait_us_ = 0;
+  total_wait_us_ = 0;
+  stats_frames_ = 0;
+}
+
+void OnPresent(IDirect3DDevice8* device) {
+  if (device != device_) ReleaseMarkers();  // The markers belong to a single device.
+
+  IDirect3DSurface8* back_buffer = nullptr;
+  if (FAILED(device->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &back_buffer))) return;
+  if (!markers_[0] && !CreateMarkers(device, back_buffer)) {
+    failed_ = true;
+  } else {
+    RECT rect = {0, 0, 1, 1};
+    POINT point = {0, 0};
+    HRESULT result = device->CopyRects(back_buffer, &rect, 1, markers_[frame_ % kMarkerCount], &point);
+    if (SUCCEEDED(result)) {
+      if (frame_ >= static_cast<unsigned int>(max_queued_))
+        WaitOnMarker(markers_[(frame_ - max_queued_) % kMarkerCount]);
+      ++frame_;
+    } else if (result != D3DERR_DEVICELOST) {
+      Logger::Error("LowLatency: Marker copy failed, disabling: 0x%08x", result);
+      failed_ = true;
+    }
+  }
+  back_buffer->Release();
+  if (failed_) ReleaseMarkers();
+}
+
+}  // namespace
+}  // namespace LowLatencyInt
+
+void LowLatency::Initialize(const std::filesystem::path& ini_file) {
+  using namespace LowLatencyInt;
+  if (!Ini::GetValue<bool>("EqwGeneral", "LowLatencyMode", false, ini_file.string().c_str())) return;
+  int max_queued = Ini::GetValue<int>("EqwGeneral", "MaxQueuedFrames", 1, ini_file.string().c_str());
+  max_queued_ = (max_queued < 0) ? 0 : (max_queued > kMaxQueuedFrames) ? kMaxQueuedFrames : max_queued;
+
+  LARGE_INTEGER frequency;
+  if (::QueryPerformanceFrequency(&frequency)) frequency_ = frequency.QuadPart;
+  Logger::Info("LowLatency: Enabled with max queued frames: %d", max_queued_);
+}
+
+void LowLatency::OnPresent(IDirect3DDevice8* device) {
+  if (LowLatencyInt::max_queued_ >= 0 && !LowLatencyInt::failed_) LowLatencyInt::OnPresent(device);
+}
+
+void LowLatency::ReleaseResources() { LowLatencyInt::ReleaseMarkers(); }
+
+unsigned int LowLatency::GetLastWaitMicroseconds() { return LowLatencyInt::last_wait_us_; }
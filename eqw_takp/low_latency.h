@@ -0,0 +1,30 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) low latency mode that bounds the number of frames the driver or
+// d3d8 wrapper can queue ahead of the display. Windowed mode drivers commonly buffer one to
+// three frames, which delays the mouse input sampled at the start of the frame.
+//
+// D3D8 has no event queries, so after each Present() a one pixel copy of the back buffer into
+// a small rotating set of lockable render targets serves as a frame marker. Locking the marker
+// from max_queued frames earlier blocks the game thread until the GPU has completed that frame.
+
+namespace LowLatency {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the settings.
+
+// Inserts this frame's marker and waits on an older one. Call after a successful Present().
+void OnPresent(IDirect3DDevice8* device);
+
+// Releases the marker surfaces (before a device Reset() or the final device Release()).
+void ReleaseResources();
+
+// Returns the time the last frame waited for the GPU in microseconds.
+unsigned int GetLastWaitMicroseconds();
+
+}  // namespace LowLatency
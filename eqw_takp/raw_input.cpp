@@ -0,0 +1,82 @@
+#include "raw_input.h"
+
+#include <atomic>
+
+#include "logger.h"
+
+namespace RawInputInt {
+namespace {
+
+static constexpr USHORT kUsagePageGeneric = 0x01;  // HID_USAGE_PAGE_GENERIC.
+static constexpr USHORT kUsageMouse = 0x02;
+static constexpr USHORT kUsageKeyboard = 0x06;
+
+bool enabled_ = false;
+bool suspended_ = false;
+std::atomic<bool> active_ = false;
+RawInputCore::Mouse mouse_;
+RawInputCore::Keyboard keyboard_;
+
+}  // namespace
+}  // namespace RawInputInt
+
+void RawInput::Initialize(HWND hwnd, bool enable) {
+  using namespace RawInputInt;
+  if (!enable || enabled_) return;
+
+  // INPUTSINK keeps the reports flowing while another of our wndprocs (or a modal loop) is active.
+  // Background reports are discarded in HandleInput() to match DirectInput foreground mode.
+  RAWINPUTDEVICE devices[2] = {{kUsagePageGeneric, kUsageMouse, RIDEV_INPUTSINK, hwnd},
+                               {kUsagePageGeneric, kUsageKeyboard, RIDEV_INPUTSINK, hwnd}};
+  if (!::RegisterRawInputDevices(devices, 2, sizeof(devices[0]))) {
+    Logger::Error("RawInput: Failed to register devices: 0x%08x", ::GetLastError());
+    return;
+  }
+
+  mouse_.SetAbsoluteScale(::GetSystemMetrics(SM_CXVIRTUALSCREEN), ::GetSystemMetrics(SM_CYVIRTUALSCREEN));
+  enabled_ = true;
+  active_ = !suspended_;
+  Logger::Info("RawInput: Enabled");
+}
+
+void RawInput::SetSuspended(bool suspended) {
+  using namespace RawInputInt;
+  suspended_ = suspended;
+  if (!enabled_) return;
+  Logger::Info("RawInput: Suspended: %d", suspended);
+  mouse_.Reset();
+  keyboard_.Reset();
+  active_ = !suspended;
+}
+
+bool RawInput::IsActive() { return RawInputInt::active_.load(std::memory_order_acquire); }
+
+void RawInput::HandleInput(WPARAM wParam, LPARAM lParam) {
+  using namespace RawInputInt;
+  if (!active_.load(std::memory_order_relaxed) || GET_RAWINPUT_CODE_WPARAM(wParam) != RIM_INPUT) return;
+
+  RAWINPUT raw;
+  UINT size = sizeof(raw);
+  if (::GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER)) ==
+      static_cast<UINT>(-1))
+    return;
+
+  DWORD timestamp = static_cast<DWORD>(::GetMessageTime());  // Same time base as DirectInput.
+  if (raw.header.dwType == RIM_TYPEMOUSE) {
+    const RAWMOUSE& data = raw.data.mouse;
+    mouse_.OnReport({data.usFlags, data.usButtonFlags, static_cast<int16_t>(data.usButtonData), data.lLastX,
+                     data.lLastY},
+                    timestamp);
+  } else if (raw.header.dwType == RIM_TYPEKEYBOARD) {
+    keyboard_.OnReport(raw.data.keyboard.MakeCode, raw.data.keyboard.Flags, timestamp);
+  }
+}
+
+void RawInput::HandleFocusLoss() {
+  RawInputInt::mouse_.Reset();
+  RawInputInt::keyboard_.Reset();
+}
+
+RawInputCore::Mouse& RawInput::GetMouse() { return RawInputInt::mouse_; }
+
+RawInputCore::Keyboard& RawInput::GetKeyboard() { return RawInputInt::keyboard_; }
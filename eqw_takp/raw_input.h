@@ -0,0 +1,33 @@
+#pragma once
+#include <windows.h>
+
+#include "raw_input_core.h"
+
+// Optional Raw Input (WM_INPUT) backend for the mouse and keyboard. When enabled, the shared
+// window registers for raw input and the DirectInput device hooks serve the client's
+// GetDeviceData() and GetDeviceState() calls from the raw reports instead of the emulated
+// DirectInput buffers, so the client fills its usual input globals with lower latency data.
+//
+// The backend is suspended while eqmain owns the window (it uses the DirectInput keyboard).
+
+namespace RawInput {
+
+// Registers the devices on the window if enabled. Call from the window thread.
+void Initialize(HWND hwnd, bool enable);
+
+// Suspends (eqmain active) or resumes the backend. Call from the window thread.
+void SetSuspended(bool suspended);
+
+// Returns true if the DirectInput reads should be served from raw input.
+bool IsActive();
+
+// WM_INPUT handler.
+void HandleInput(WPARAM wParam, LPARAM lParam);
+
+// Drops the held buttons and keys when the window loses focus.
+void HandleFocusLoss();
+
+RawInputCore::Mouse& GetMouse();
+RawInputCore::Keyboard& GetKeyboard();
+
+}  // namespace RawInput
@@ -0,0 +1,185 @@
+#include "raw_input_core.h"
+
+namespace RawInputCoreInt {
+namespace {
+
+static constexpr uint8_t kKeyLeftShift = 0x2a;  // DIK_LSHIFT.
+static constexpr uint8_t kKeyRightShift = 0x36;
+static constexpr uint8_t kKeyLeftControl = 0x1d;
+static constexpr uint8_t kKeyNumLock = 0x45;
+static constexpr uint8_t kKeyPause = 0xc5;  // DIK_PAUSE.
+static constexpr uint32_t kDown = 0x80;
+
+// DirectInput shares one sequence counter across devices so events can be ordered between them.
+std::atomic<uint32_t> sequence_ = 0;
+
+uint32_t NextSequence() { return sequence_.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+}  // namespace
+}  // namespace RawInputCoreInt
+
+uint8_t RawInputCore::TranslateKey(uint16_t make_code, uint16_t flags) {
+  using namespace RawInputCoreInt;
+  if (make_code == 0 || make_code > 0x7f) return 0;  // Overrun or unknown.
+  if (flags & kKeyE1) return 0;                      // Pause prefix (handled by Keyboard).
+  if (flags & kKeyE0) {
+    if (make_code == kKeyLeftShift || make_code == kKeyRightShift) return 0;  // Fake shifts.
+    return static_cast<uint8_t>(make_code | 0x80);
+  }
+  return static_cast<uint8_t>(make_code);
+}
+
+void RawInputCore::Mouse::SetAbsoluteScale(int width, int height) {
+  absolute_width_ = width;
+  absolute_height_ = height;
+}
+
+void RawInputCore::Mouse::Push(uint32_t offset, uint32_t data, uint32_t timestamp, uint32_t sequence) {
+  bool pushed = events_.TryPush([&](Event& event) { event = {offset, data, timestamp, sequence}; });
+  if (!pushed) overflow_.store(true, std::memory_order_release);
+}
+
+void RawInputCore::Mouse::PushMotion(uint32_t timestamp) {
+  int32_t x = pending_x_.exchange(0, std::memory_order_acq_rel);
+  int32_t y = pending_y_.exchange(0, std::memory_order_acq_rel);
+  if (!x && !y) return;
+  uint32_t sequence = RawInputCoreInt::NextSequence();
+  if (x) Push(kOffsetX, static_cast<uint32_t>(x), timestamp, sequence);
+  if (y) Push(kOffsetY, static_cast<uint32_t>(y), timestamp, sequence);
+}
+
+void RawInputCore::Mouse::OnReport(const MouseReport& report, uint32_t timestamp) {
+  int32_t x = report.x;
+  int32_t y = report.y;
+  if (report.flags & kMouseMoveAbsolute) {  // Normalized 0..65535 coordinates.
+    int64_t dx = has_absolute_ ? report.x - last_absolute_x_ : 0;
+    int64_t dy = has_absolute_ ? report.y - last_absolute_y_ : 0;
+    x = static_cast<int32_t>(dx * absolute_width_ / 65536);
+    y = static_cast<int32_t>(dy * absolute_height_ / 65536);
+    has_absolute_ = true;
+    last_absolute_x_ = report.x;
+    last_absolute_y_ = report.y;
+  } else {
+    has_absolute_ = false;
+  }
+
+  if (x || y) {
+    pending_x_.fetch_add(x, std::memory_order_acq_rel);
+    pending_y_.fetch_add(y, std::memory_order_acq_rel);
+    state_x_.fetch_add(x, std::memory_order_acq_rel);
+    state_y_.fetch_add(y, std::memory_order_acq_rel);
+    pending_timestamp_.store(timestamp, std::memory_order_release);
+  }
+
+  uint16_t button_flags = report.button_flags;
+  if (!button_flags) return;
+
+  PushMotion(timestamp);  // Keep the motion ordered ahead of the button edges.
+  uint32_t sequence = RawInputCoreInt::NextSequence();
+  for (int i = 0; i < kMouseButtons; ++i) {
+    uint16_t down = static_cast<uint16_t>(1 << (2 * i));
+    uint16_t up = static_cast<uint16_t>(down << 1);
+    if (button_flags & down) {
+      buttons_.fetch_or(1u << i, std::memory_order_acq_rel);
+      Push(kOffsetButton0 + i, RawInputCoreInt::kDown, timestamp, sequence);
+    }
+    if (button_flags & up) {
+      buttons_.fetch_and(~(1u << i), std::memory_order_acq_rel);
+      Push(kOffsetButton0 + i, 0, timestamp, sequence);
+    }
+  }
+  if (button_flags & kMouseWheel) {
+    state_z_.fetch_add(report.button_data, std::memory_order_acq_rel);
+    Push(kOffsetZ, static_cast<uint32_t>(static_cast<int32_t>(report.button_data)), timestamp, sequence);
+  }
+}
+
+size_t RawInputCore::Mouse::ReadEvents(Event* events, size_t max_events) {
+  size_t count = 0;
+  while (count < max_events && events_.TryPop([&](Event& event) { events[count] = event; })) ++count;
+  if (count == max_events) return count;
+
+  int32_t x = pending_x_.exchange(0, std::memory_order_acq_rel);
+  int32_t y = pending_y_.exchange(0, std::memory_order_acq_rel);
+  if (!x && !y) return count;
+  uint32_t timestamp = pending_timestamp_.load(std::memory_order_acquire);
+  uint32_t sequence = RawInputCoreInt::NextSequence();
+  if (x) events[count++] = {kOffsetX, static_cast<uint32_t>(x), timestamp, sequence};
+  if (y && count < max_events) {
+    events[count++] = {kOffsetY, static_cast<uint32_t>(y), timestamp, sequence};
+  } else if (y) {
+    pending_y_.fetch_add(y, std::memory_order_acq_rel);  // No room, return it for the next read.
+  }
+  return count;
+}
+
+void RawInputCore::Mouse::ReadState(MouseState* state) {
+  state->x = state_x_.exchange(0, std::memory_order_acq_rel);
+  state->y = state_y_.exchange(0, std::memory_order_acq_rel);
+  state->z = state_z_.exchange(0, std::memory_order_acq_rel);
+  uint32_t buttons = buttons_.load(std::memory_order_acquire);
+  for (int i = 0; i < 8; ++i) state->buttons[i] = (buttons & (1u << i)) ? RawInputCoreInt::kDown : 0;
+}
+
+void RawInputCore::Mouse::Flush() {
+  while (events_.TryPop([](Event&) {})) {
+  }
+  pending_x_.store(0, std::memory_order_release);
+  pending_y_.store(0, std::memory_order_release);
+  state_x_.store(0, std::memory_order_release);
+  state_y_.store(0, std::memory_order_release);
+  state_z_.store(0, std::memory_order_release);
+}
+
+void RawInputCore::Mouse::Reset() {
+  Flush();
+  buttons_.store(0, std::memory_order_release);
+  has_absolute_ = false;
+}
+
+void RawInputCore::Keyboard::OnReport(uint16_t make_code, uint16_t flags, uint32_t timestamp) {
+  using namespace RawInputCoreInt;
+  uint8_t key = TranslateKey(make_code, flags);
+  if (flags & kKeyE1) {
+    pause_prefix_ = (make_code == kKeyLeftControl);
+    return;
+  }
+  if (pause_prefix_ && key == kKeyNumLock) key = kKeyPause;  // E1 1D 45 is Pause, a bare 45 is NumLock.
+  pause_prefix_ = false;
+  if (!key) return;
+
+  bool down = !(flags & kKeyBreak);
+  uint32_t bit = 1u << (key & 31);
+  uint32_t previous = down ? keys_down_[key >> 5].fetch_or(bit, std::memory_order_acq_rel)
+                           : keys_down_[key >> 5].fetch_and(~bit, std::memory_order_acq_rel);
+  if (((previous & bit) != 0) == down) return;  // DirectInput does not report auto-repeat.
+
+  bool pushed = events_.TryPush([&](Event& event) {
+    event = {key, down ? kDown : 0, timestamp, NextSequence()};
+  });
+  if (!pushed) overflow_.store(true, std::memory_order_release);
+}
+
+size_t RawInputCore::Keyboard::ReadEvents(Event* events, size_t max_events) {
+  size_t count = 0;
+  while (count < max_events && events_.TryPop([&](Event& event) { events[count] = event; })) ++count;
+  return count;
+}
+
+void RawInputCore::Keyboard::ReadState(uint8_t state[256]) const {
+  for (int i = 0; i < 8; ++i) {
+    uint32_t bits = keys_down_[i].load(std::memory_order_acquire);
+    for (int j = 0; j < 32; ++j) state[i * 32 + j] = (bits & (1u << j)) ? RawInputCoreInt::kDown : 0;
+  }
+}
+
+void RawInputCore::Keyboard::Flush() {
+  while (events_.TryPop([](Event&) {})) {
+  }
+}
+
+void RawInputCore::Keyboard::Reset() {
+  Flush();
+  for (auto& keys : keys_down_) keys.store(0, std::memory_order_release);
+  pause_prefix_ = false;
+}
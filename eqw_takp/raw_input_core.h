@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "bounded_queue.h"
+
+// Platform independent core of the Raw Input backend. Translates raw mouse and keyboard reports
+// into the DirectInput device state and buffered event formats the client consumes, so the
+// DirectInput hooks can serve client reads from raw input without the client noticing.
+//
+// The window thread is the only producer (OnReport()) and the game thread the only
+// consumer (Read*()). The shared state is limited to atomics and lock-free queues.
+
+namespace RawInputCore {
+
+// Buffered event (the leading fields of DIDEVICEOBJECTDATA).
+struct Event {
+  uint32_t offset;  // DIMOFS_* for the mouse, DIK_* scan code for the keyboard.
+  uint32_t data;    // Axis delta or 0x80 / 0x00 for button down / up.
+  uint32_t timestamp;
+  uint32_t sequence;
+};
+
+// DirectInput mouse data offsets (DIMOFS_*).
+static constexpr uint32_t kOffsetX = 0;
+static constexpr uint32_t kOffsetY = 4;
+static constexpr uint32_t kOffsetZ = 8;
+static constexpr uint32_t kOffsetButton0 = 12;
+static constexpr int kMouseButtons = 5;  // Raw input reports up to five buttons.
+
+// Raw input flag values (mirror the RAWMOUSE and RAWKEYBOARD definitions in winuser.h).
+static constexpr uint16_t kMouseMoveAbsolute = 0x01;  // usFlags
+static constexpr uint16_t kMouseWheel = 0x0400;  // usButtonFlags; the button down / up pairs are bits 0-9.
+static constexpr uint16_t kKeyBreak = 0x01;      // Flags
+static constexpr uint16_t kKeyE0 = 0x02;
+static constexpr uint16_t kKeyE1 = 0x04;
+
+struct MouseReport {
+  uint16_t flags;         // RAWMOUSE.usFlags.
+  uint16_t button_flags;  // RAWMOUSE.usButtonFlags.
+  int16_t button_data;    // RAWMOUSE.usButtonData (wheel delta).
+  int32_t x;              // RAWMOUSE.lLastX / lLastY.
+  int32_t y;
+};
+
+struct MouseState {  // Layout of DIMOUSESTATE2.
+  int32_t x;
+  int32_t y;
+  int32_t z;
+  uint8_t buttons[8];
+};
+
+// Translates a raw keyboard make code and flags into a DirectInput scan code. Returns 0 for
+// reports that DirectInput does not surface (the fake shifts and the Pause prefix).
+uint8_t TranslateKey(uint16_t make_code, uint16_t flags);
+
+class Mouse {
+ public:
+  // Sets the pixel size of the (virtual) screen used to convert absolute reports (remote
+  // desktop sessions and tablets) into relative motion.
+  void SetAbsoluteScale(int width, int height);
+
+  // Producer: adds a raw report.
+  void OnReport(const MouseReport& report, uint32_t timestamp);
+
+  // Consumer: copies out up to max_events buffered events in DirectInput order. The motion since
+  // the last button or wheel event is coalesced into (at most) one X and one Y event.
+  size_t ReadEvents(Event* events, size_t max_events);
+
+  // Consumer: returns the motion since the last call and the current button state.
+  void ReadState(MouseState* state);
+
+  // Returns and clears the flag set when the event buffer overflowed.
+  bool TakeOverflow() { return overflow_.exchange(false, std::memory_order_acq_rel); }
+
+  // Discards the buffered events and motion (DirectInput flush).
+  void Flush();
+
+  // Clears the button state and flushes (focus loss). Like a DirectInput unacquire, no release
+  // events are generated. Call from the producer thread.
+  void Reset();
+
+ private:
+  void PushMotion(uint32_t timestamp);
+  void Push(uint32_t offset, uint32_t data, uint32_t timestamp, uint32_t sequence);
+
+  static constexpr size_t kQueueSize = 512;
+
+  BoundedQueue<Event, kQueueSize> events_;
+  std::atomic<int32_t> pending_x_ = 0;  // Motion not yet in the event queue.
+  std::atomic<int32_t> pending_y_ = 0;
+  std::atomic<int32_t> state_x_ = 0;  // Motion since the last ReadState().
+  std::atomic<int32_t> state_y_ = 0;
+  std::atomic<int32_t> state_z_ = 0;
+  std::atomic<uint32_t> buttons_ = 0;  // Bitmask of buttons held down.
+  std::atomic<uint32_t> pending_timestamp_ = 0;
+  std::atomic<bool> overflow_ = false;
+  int absolute_width_ = 0;
+  int absolute_height_ = 0;
+  bool has_absolute_ = false;  // Producer only.
+  int32_t last_absolute_x_ = 0;
+  int32_t last_absolute_y_ = 0;
+};
+
+class Keyboard {
+ public:
+  // Producer: adds a raw report.
+  void OnReport(uint16_t make_code, uint16_t flags, uint32_t timestamp);
+
+  // Consumer: copies out up to max_events buffered key events.
+  size_t ReadEvents(Event* events, size_t max_events);
+
+  // Consumer: fills the 256 byte DirectInput key state table.
+  void ReadState(uint8_t state[256]) const;
+
+  bool TakeOverflow() { return overflow_.exchange(false, std::memory_order_acq_rel); }
+
+  void Flush();
+
+  // Clears the key state and flushes (focus loss). Call from the producer thread.
+  void Reset();
+
+ private:
+  static constexpr size_t kQueueSize = 256;
+
+  BoundedQueue<Event, kQueueSize> events_;
+  std::atomic<uint32_t> keys_down_[8] = {};  // 256 bit key state.
+  std::atomic<bool> overflow_ = false;
+  bool pause_prefix_ = false;  // Producer only: the E1 1D prefix of the Pause key was seen.
+};
+
+}  // namespace RawInputCore
@@ -0,0 +1,331 @@
+#include "render_scale.h"
+
+#include "frame_limiter.h"
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace RenderScaleInt {
+namespace {
+
+static constexpr float kScaleStep = 0.05f;   // Controller adjustment step.
+static constexpr float kMinScale = 0.25f;
+static constexpr int kControllerFrames = 60;  // Frames averaged per controller update.
+static constexpr int kMaxClearRects = 16;
+
+enum class Phase {
+  kIdle,      // Rendering to the game's render target.
+  kRedirect,  // Rendering the scene to the scaled target.
+  kResolved,  // Scene resolved for this frame.
+};
+
+struct QuadVertex {
+  float x, y, z, rhw;
+  float u, v;
+};
+static constexpr DWORD kQuadFvf = D3DFVF_XYZRHW | D3DFVF_TEX1;
+
+// Settings.
+float min_scale_ = 1.f;  // The fixed scale, or the lower limit of the controller.
+float target_frame_us_ = 0;  // Controller target (0 = fixed scale).
+
+// Device state.
+IDirect3DDevice8* device_ = nullptr;
+void** device_vtable_ = nullptr;  // The hooked vtable (the hooks are only installed once).
+D3DFORMAT format_ = D3DFMT_UNKNOWN;
+D3DFORMAT depth_format_ = D3DFMT_UNKNOWN;  // D3DFMT_UNKNOWN if there is no depth buffer.
+UINT game_width_ = 0;
+UINT game_height_ = 0;
+D3DVIEWPORT8 game_viewport_ = {};  // Last viewport set by the game (unscaled).
+
+// Scaled targets and the saved game targets while redirected.
+float scale_ = 1.f;
+UINT scaled_width_ = 0;
+UINT scaled_height_ = 0;
+IDirect3DTexture8* texture_ = nullptr;
+IDirect3DSurface8* surface_ = nullptr;
+IDirect3DSurface8* depth_ = nullptr;
+IDirect3DSurface8* saved_target_ = nullptr;
+IDirect3DSurface8* saved_depth_ = nullptr;
+DWORD state_block_ = 0;  // Records the states changed by the resolve quad.
+Phase phase_ = Phase::kIdle;
+bool internal_ = false;  // Set while issuing our own device calls.
+bool failed_ = false;
+
+// Controller.
+LONGLONG frequency_ = 1;
+LONGLONG last_present_ = 0;
+LONGLONG busy_us_ = 0;
+int busy_frames_ = 0;
+
+VTableHook hook_Clear_;
+VTableHook hook_SetViewport_;
+VTableHook hook_GetViewport_;
+VTableHook hook_SetVertexShader_;
+
+void ReleaseTargets() {
+  if (saved_target_) saved_target_->Release();
+  if (saved_depth_) saved_depth_->Release();
+  if (surface_) surface_->Release();
+  if (texture_) texture_->Release();
+  if (depth_) depth_->Release();
+  saved_target_ = saved_depth_ = surface_ = depth_ = nullptr;
+  texture_ = nullptr;
+  if (state_block_ && device_) device_->DeleteStateBlock(state_block_);
+  state_block_ = 0;
+  phase_ = Phase::kIdle;
+}
+
+// Sets the states used to draw the resolve quad.
+void SetQuadStates(IDirect3DDevice8* device) {
+  device->SetVertexShader(kQuadFvf);
+  device->SetStreamSource(0, nullptr, 0);
+  device->SetTexture(0, texture_);
+  device->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+  device->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+  device->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_DISABLE);
+  device->SetTextureStageState(0, D3DTSS_MAGFILTER, D3DTEXF_LINEAR);
+  device->SetTextureStageState(0, D3DTSS_MINFILTER, D3DTEXF_LINEAR);
+  device->SetTextureStageState(0, D3DTSS_MIPFILTER, D3DTEXF_NONE);
+  device->SetTextureStageState(0, D3DTSS_ADDRESSU, D3DTADDRESS_CLAMP);
+  device->SetTextureStageState(0, D3DTSS_ADDRESSV, D3DTADDRESS_CLAMP);
+  device->SetTextureStageState(0, D3DTSS_TEXCOORDINDEX, 0);
+  device->SetTextureStageState(0, D3DTSS_TEXTURETRANSFORMFLAGS, D3DTTFF_DISABLE);
+  device->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+  device->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+  device->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+  device->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+  device->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+  device->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+  device->SetRenderState(D3DRS_FOGENABLE, FALSE);
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+  device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+  device->SetRenderState(D3DRS_COLORWRITEENABLE, 0xf);
+  D3DVIEWPORT8 viewport = {0, 0, game_width_, game_height_, 0.f, 1.f};
+  device->SetViewport(&viewport);
+}
+
+// Records the states changed by the resolve quad so the game's values can be captured and restored.
+bool CreateStateBlock(IDirect3DDevice8* device) {
+  internal_ = true;
+  device->BeginStateBlock();
+  SetQuadStates(device);
+  bool result = SUCCEEDED(device->EndStateBlock(&state_block_));
+  internal_ = false;
+  return result;
+}
+
+bool CreateTargets(IDirect3DDevice8* device) {
+  scaled_width_ = static_cast<UINT>(game_width_ * scale_ + 0.5f);
+  scaled_height_ = static_cast<UINT>(game_height_ * scale_ + 0.5f);
+  scaled_width_ = scaled_width_ ? scaled_width_ : 1;
+  scaled_height_ = scaled_height_ ? scaled_height_ : 1;
+
+  HRESULT result = device->CreateTexture(scaled_width_, scaled_height_, 1, D3DUSAGE_RENDERTARGET, format_,
+                                         D3DPOOL_DEFAULT, &texture_);
+  if (SUCCEEDED(result)) result = texture_->GetSurfaceLevel(0, &surface_);
+  if (SUCCEEDED(result) && depth_format_ != D3DFMT_UNKNOWN)
+    result = device->CreateDepthStencilSurface(scaled_width_, scaled_height_, depth_format_, D3DMULTISAMPLE_NONE,
+                                               &depth_);
+  if (SUCCEEDED(result) && !CreateStateBlock(device)) result = E_FAIL;
+  if (FAILED(result)) {
+    Logger::Error("RenderScale: Failed to create %d x %d targets, disabling: 0x%08x", scaled_width_, scaled_height_,
+                  result);
+    ReleaseTargets();
+    failed_ = true;
+    return false;
+  }
+  Logger::Info("RenderScale: Rendering scene at %d x %d", scaled_width_, scaled_height_);
+  return true;
+}
+
+D3DVIEWPORT8 ScaleViewport(const D3DVIEWPORT8& viewport) {
+  D3DVIEWPORT8 scaled = viewport;
+  scaled.X = viewport.X * scaled_width_ / game_width_;
+  scaled.Y = viewport.Y * scaled_height_ / game_height_;
+  scaled.Width = (viewport.X + viewport.Width) * scaled_width_ / game_width_ - scaled.X;
+  scaled.Height = (viewport.Y + viewport.Height) * scaled_height_ / game_height_ - scaled.Y;
+  return scaled;
+}
+
+void Redirect(IDirect3DDevice8* device) {
+  if (!texture_ && !CreateTargets(device)) return;
+  if (FAILED(device->GetRenderTarget(&saved_target_))) return;
+  device->GetDepthStencilSurface(&saved_depth_);  // Null without a depth buffer.
+
+  // Only redirect scenes rendered to the back buffer.
+  IDirect3DSurface8* back_buffer = nullptr;
+  bool is_back_buffer = SUCCEEDED(device->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &back_buffer)) &&
+                        back_buffer == saved_target_;
+  if (back_buffer) back_buffer->Release();
+  internal_ = true;
+  if (is_back_buffer && SUCCEEDED(device->SetRenderTarget(surface_, depth_))) {
+    D3DVIEWPORT8 viewport = ScaleViewport(game_viewport_);
+    device->SetViewport(&viewport);
+    phase_ = Phase::kRedirect;
+  } else {
+    saved_target_->Release();
+    if (saved_depth_) saved_depth_->Release();
+    saved_target_ = saved_depth_ = nullptr;
+  }
+  internal_ = false;
+}
+
+// Restores the game's render target and draws the scaled scene into the game's region.
+void Resolve(IDirect3DDevice8* device) {
+  phase_ = Phase::kResolved;
+  internal_ = true;
+  device->CaptureStateBlock(state_block_);
+  device->SetRenderTarget(saved_target_, saved_depth_);
+  saved_target_->Release();
+  if (saved_depth_) saved_depth_->Release();
+  saved_target_ = saved_depth_ = nullptr;
+
+  SetQuadStates(device);
+  float right = game_width_ - 0.5f;
+  float bottom = game_height_ - 0.5f;
+  QuadVertex quad[4] = {{-0.5f, -0.5f, 0.f, 1.f, 0.f, 0.f},
+                        {right, -0.5f, 0.f, 1.f, 1.f, 0.f},
+                        {-0.5f, bottom, 0.f, 1.f, 0.f, 1.f},
+                        {right, bottom, 0.f, 1.f, 1.f, 1.f}};
+  device->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, quad, sizeof(quad[0]));
+
+  device->ApplyStateBlock(state_block_);  // Restores the captured game states.
+  device->SetViewport(&game_viewport_);
+  internal_ = false;
+}
+
+// Adjusts the scale toward the target frame time. Returns true if the scale changed.
+bool UpdateController() {
+  LARGE_INTEGER now;
+  ::QueryPerformanceCounter(&now);
+  LONGLONG elapsed_us = last_present_ ? (now.QuadPart - last_present_) * 1000000 / frequency_ : 0;
+  last_present_ = now.QuadPart;
+  if (!target_frame_us_ || !elapsed_us) return false;
+
+  LONGLONG busy_us = elapsed_us - FrameLimiter::GetLastWaitMicroseconds();
+  busy_us_ += (busy_us > 0) ? busy_us : 0;
+  if (++busy_frames_ < kControllerFrames) return false;
+  float average_us = static_cast<float>(busy_us_) / busy_frames_;
+  busy_us_ = 0;
+  busy_frames_ = 0;
+
+  float scale = scale_;
+  if (average_us > target_frame_us_ * 1.05f) scale -= kScaleStep;
+  if (average_us < target_frame_us_ * 0.8f) scale += kScaleStep;
+  scale = (scale < min_scale_) ? min_scale_ : (scale > 1.f) ? 1.f : scale;
+  if (scale == scale_) return false;
+  scale_ = scale;
+  return true;
+}
+
+HRESULT WINAPI D3DDeviceSetViewportHook(IDirect3DDevice8* Device, CONST D3DVIEWPORT8* pViewport) {
+  if (Device != device_ || internal_ || !pViewport)
+    return hook_SetViewport_.original(D3DDeviceSetViewportHook)(Device, pViewport);
+
+  game_viewport_ = *pViewport;
+  if (phase_ != Phase::kRedirect) return hook_SetViewport_.original(D3DDeviceSetViewportHook)(Device, pViewport);
+  D3DVIEWPORT8 viewport = ScaleViewport(*pViewport);
+  return hook_SetViewport_.original(D3DDeviceSetViewportHook)(Device, &viewport);
+}
+
+HRESULT WINAPI D3DDeviceGetViewportHook(IDirect3DDevice8* Device, D3DVIEWPORT8* pViewport) {
+  if (Device != device_ || phase_ != Phase::kRedirect || !pViewport)
+    return hook_GetViewport_.original(D3DDeviceGetViewportHook)(Device, pViewport);
+  *pViewport = game_viewport_;
+  return D3D_OK;
+}
+
+// A frame may be cleared ahead of its first BeginScene(), so the clear also starts the redirect.
+// Otherwise the clear would hit the back buffer and leave the scaled depth buffer stale.
+HRESULT WINAPI D3DDeviceClearHook(IDirect3DDevice8* Device, DWORD Count, CONST D3DRECT* pRects, DWORD Flags,
+                                  D3DCOLOR Color, float Z, DWORD Stencil) {
+  if (Device == device_ && !internal_ && !failed_ && phase_ == Phase::kIdle && scale_ < 1.f) Redirect(Device);
+  if (Device != device_ || phase_ != Phase::kRedirect || !pRects || !Count || Count > kMaxClearRects)
+    return hook_Clear_.original(D3DDeviceClearHook)(Device, Count, pRects, Flags, Color, Z, Stencil);
+
+  D3DRECT rects[kMaxClearRects];
+  for (DWORD i = 0; i < Count; ++i) {
+    rects[i].x1 = pRects[i].x1 * static_cast<LONG>(scaled_width_) / static_cast<LONG>(game_width_);
+    rects[i].y1 = pRects[i].y1 * static_cast<LONG>(scaled_height_) / static_cast<LONG>(game_height_);
+    rects[i].x2 = pRects[i].x2 * static_cast<LONG>(scaled_width_) / static_cast<LONG>(game_width_);
+    rects[i].y2 = pRects[i].y2 * static_cast<LONG>(scaled_height_) / static_cast<LONG>(game_height_);
+  }
+  return hook_Clear_.original(D3DDeviceClearHook)(Device, Count, rects, Flags, Color, Z, Stencil);
+}
+
+// The UI is drawn with pretransformed vertices, which marks the end of the 3D scene.
+HRESULT WINAPI D3DDeviceSetVertexShaderHook(IDirect3DDevice8* Device, DWORD Handle) {
+  bool pretransformed = !(Handle & 1) && (Handle & D3DFVF_POSITION_MASK) == D3DFVF_XYZRHW;
+  if (Device == device_ && !internal_ && phase_ == Phase::kRedirect && pretransformed) Resolve(Device);
+  return hook_SetVertexShader_.original(D3DDeviceSetVertexShaderHook)(Device, Handle);
+}
+
+}  // namespace
+}  // namespace RenderScaleInt
+
+void RenderScale::Initialize(const std::filesystem::path& ini_file) {
+  using namespace RenderScaleInt;
+  int percent = Ini::GetValue<int>("EqwGeneral", "RenderScalePercent", 100, ini_file.string().c_str());
+  int target_fps = Ini::GetValue<int>("EqwGeneral", "RenderScaleTargetFps", 0, ini_file.string().c_str());
+  float scale = percent / 100.f;
+  min_scale_ = (scale < kMinScale) ? kMinScale : (scale > 1.f) ? 1.f : scale;
+  scale_ = min_scale_;
+  if (min_scale_ >= 1.f) return;
+
+  target_frame_us_ = (target_fps > 0) ? 1e6f / target_fps : 0;
+  scale_ = target_frame_us_ ? 1.f : min_scale_;  // The controller starts at full resolution.
+  LARGE_INTEGER frequency;
+  if (::QueryPerformanceFrequency(&frequency)) frequency_ = frequency.QuadPart;
+  Logger::Info("RenderScale: Scale: %.2f, target fps: %d", min_scale_, target_fps);
+}
+
+void RenderScale::InstallHooks(IDirect3DDevice8* device) {
+  using namespace RenderScaleInt;
+  if (min_scale_ >= 1.f) return;
+  failed_ = false;
+
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Re-hooking the slot shared with StateFilter would cycle.
+  device_vtable_ = vtable;
+
+  hook_Clear_ = VTableHook(vtable, 36, D3DDeviceClearHook, false);
+  hook_SetViewport_ = VTableHook(vtable, 40, D3DDeviceSetViewportHook, false);
+  hook_GetViewport_ = VTableHook(vtable, 41, D3DDeviceGetViewportHook, false);
+  hook_SetVertexShader_ = VTableHook(vtable, 76, D3DDeviceSetVertexShaderHook, false);
+}
+
+void RenderScale::OnDeviceReset(IDirect3DDevice8* device, const D3DPRESENT_PARAMETERS& params, UINT game_width,
+                                UINT game_height) {
+  using namespace RenderScaleInt;
+  if (min_scale_ >= 1.f) return;
+  if (device != device_ || game_width != game_width_ || game_height != game_height_) ReleaseTargets();
+  device_ = device;
+  format_ = params.BackBufferFormat;
+  depth_format_ = params.EnableAutoDepthStencil ? params.AutoDepthStencilFormat : D3DFMT_UNKNOWN;
+  game_width_ = game_width ? game_width : 1;
+  game_height_ = game_height ? game_height : 1;
+  game_viewport_ = {0, 0, game_width_, game_height_, 0.f, 1.f};
+}
+
+void RenderScale::OnBeginScene(IDirect3DDevice8* device) {
+  using namespace RenderScaleInt;
+  if (device != device_ || failed_ || phase_ != Phase::kIdle || scale_ >= 1.f) return;
+  Redirect(device);
+  if (phase_ == Phase::kIdle) phase_ = Phase::kResolved;  // Not redirected, so leave this frame alone.
+}
+
+void RenderScale::OnSetRenderTarget(IDirect3DDevice8* device) {
+  using namespace RenderScaleInt;
+  if (device == device_ && !internal_ && phase_ == Phase::kRedirect) Resolve(device);
+}
+
+void RenderScale::OnPresent(IDirect3DDevice8* device) {
+  using namespace RenderScaleInt;
+  if (device != device_) return;
+  if (phase_ == Phase::kRedirect) Resolve(device);
+  phase_ = Phase::kIdle;
+  if (UpdateController()) ReleaseTargets();  // Recreated at the new scale by the next scene.
+}
+
+void RenderScale::ReleaseResources() { RenderScaleInt::ReleaseTargets(); }
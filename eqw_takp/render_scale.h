@@ -0,0 +1,39 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) reduced internal resolution for the 3D scene to relieve gpu fill
+// rate limited systems. The scale is either fixed or adjusted by a controller that targets a
+// frame time measured from the Present() intervals (excluding the frame limiter waits).
+//
+// At the first BeginScene() or back buffer Clear() of a frame the game's render target is
+// redirected to a scaled texture and the game's viewports and clear rects are scaled to match.
+// The first pretransformed (UI) vertex format, render target change, or Present() resolves the
+// scene by drawing the texture as a filtered quad into the game's region of the back buffer. The
+// UI is then drawn at full resolution. The game resolution itself is unchanged, so the cursor
+// mapping stays exact.
+
+namespace RenderScale {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the settings.
+
+// Installs the viewport, clear, and vertex shader hooks. Call after each primary device creation.
+void InstallHooks(IDirect3DDevice8* device);
+
+// Records the device parameters and game resolution. Call after each device creation, Reset(),
+// or resize without Reset().
+void OnDeviceReset(IDirect3DDevice8* device, const D3DPRESENT_PARAMETERS& params, UINT game_width,
+                   UINT game_height);
+
+void OnBeginScene(IDirect3DDevice8* device);       // Redirects the first scene of a frame.
+void OnSetRenderTarget(IDirect3DDevice8* device);  // Resolves the scene before a game target change.
+void OnPresent(IDirect3DDevice8* device);          // Resolves the scene and updates the controller.
+
+// Releases the scaled targets (before a device Reset() or the final device Release()).
+void ReleaseResources();
+
+}  // namespace RenderScale
@@ -0,0 +1,310 @@
+#include "screenshot.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "image_codec.h"
+#include "ini.h"
+#include "logger.h"
+
+namespace ScreenshotInt {
+namespace {
+
+static constexpr int kRingSize = 2;               // Captures that can be encoding at the same time.
+static constexpr DWORD kReleaseTimeoutMs = 5000;  // Maximum wait for pending encodes at device release.
+
+enum SlotState : int {
+  kFree,    // Owned by the game thread and unlocked.
+  kQueued,  // Locked and owned by the worker thread.
+  kDone,    // Locked and returned to the game thread for unlocking.
+};
+
+struct Slot {
+  IDirect3DSurface8* surface;
+  UINT surface_width;
+  UINT surface_height;
+  D3DFORMAT surface_format;
+
+  // Capture handed to the worker thread.
+  const BYTE* bits;
+  int pitch;
+  int width;
+  int height;
+  ImageCodec::PixelFormat format;
+  unsigned int sequence;
+  std::filesystem::path path;
+
+  std::atomic<int> state;
+} slots_[kRingSize] = {};
+
+std::filesystem::path directory_;
+bool png_ = true;
+int hotkey_ = 0;  // Virtual key code, zero if disabled.
+bool hotkey_down_ = false;
+std::atomic<bool> requested_ = false;
+unsigned int sequence_ = 0;
+UINT prepared_width_ = 0;  // Game region size the ring was last allocated for.
+UINT prepared_height_ = 0;
+HANDLE wake_event_ = nullptr;
+
+bool GetPixelFormat(D3DFORMAT format, ImageCodec::PixelFormat* pixel_format) {
+  switch (format) {
+    case D3DFMT_X8R8G8B8:
+    case D3DFMT_A8R8G8B8:
+      *pixel_format = ImageCodec::PixelFormat::kXrgb8888;
+      return true;
+    case D3DFMT_R5G6B5:
+      *pixel_format = ImageCodec::PixelFormat::kRgb565;
+      return true;
+    case D3DFMT_X1R5G5B5:
+    case D3DFMT_A1R5G5B5:
+      *pixel_format = ImageCodec::PixelFormat::kXrgb1555;
+      return true;
+    default:
+      return false;
+  }
+}
+
+struct EncodeContext {
+  const Slot* slot;
+  bool bgr;
+};
+
+void ConvertRow(void* context, int y, uint8_t* row) {
+  const EncodeContext& encode = *static_cast<const EncodeContext*>(context);
+  const Slot& slot = *encode.slot;
+  ImageCodec::ConvertRow(slot.format, slot.bits + y * slot.pitch, row, slot.width, encode.bgr);
+}
+
+void Encode(const Slot& slot, std::vector<uint8_t>* file) {
+  EncodeContext context = {&slot, !png_};
+  if (png_)
+    ImageCodec::EncodePng(slot.width, slot.height, ConvertRow, &context, file);
+  else
+    ImageCodec::EncodeBmp(slot.width, slot.height, ConvertRow, &context, file);
+
+  std::error_code error;
+  std::filesystem::create_directories(slot.path.parent_path(), error);
+  FILE* output = _wfopen(slot.path.c_str(), L"wb");
+  bool success = output && fwrite(file->data(), 1, file->size(), output) == file->size();
+  if (output) success = (fclose(output) == 0) && success;
+  if (success)
+    Logger::Info("Screenshot: Saved %s", slot.path.string().c_str());
+  else
+    Logger::Error("Screenshot: Failed to write %s", slot.path.string().c_str());
+}
+
+// Returns the oldest capture queued for the worker thread.
+Slot* GetNextQueued() {
+  Slot* next = nullptr;
+  for (Slot& slot : slots_) {
+    if (slot.state.load() == kQueued && (!next || static_cast<int>(slot.sequence - next->sequence) < 0))
+      next = &slot;
+  }
+  return next;
+}
+
+DWORD WINAPI WorkerThread(LPVOID) {
+  std::vector<uint8_t> file;  // Reused to avoid reallocating the file image.
+  for (;;) {
+    ::WaitForSingleObject(wake_event_, INFINITE);
+    while (Slot* slot = GetNextQueued()) {
+      Encode(*slot, &file);
+      slot->state.store(kDone);  // The game thread unlocks the surface.
+    }
+  }
+  return 0;
+}
+
+bool StartWorker() {
+  if (wake_event_) return true;
+  HANDLE event = ::CreateEventA(nullptr, FALSE, FALSE, nullptr);
+  HANDLE thread = event ? ::CreateThread(nullptr, 0, WorkerThread, nullptr, 0, nullptr) : nullptr;
+  if (!thread) {
+    if (event) ::CloseHandle(event);
+    Logger::Error("Screenshot: Failed to start the worker thread");
+    return false;
+  }
+  wake_event_ = event;  // Set before the first capture is queued.
+  ::SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+  ::CloseHandle(thread);
+  return true;
+}
+
+void ReleaseSurface(Slot& slot) {
+  if (slot.surface) slot.surface->Release();
+  slot.surface = nullptr;
+}
+
+// Unlocks the surfaces of finished captures.
+void RecycleSlots() {
+  for (Slot& slot : slots_) {
+    if (slot.state.load() != kDone) continue;
+    if (slot.surface) slot.surface->UnlockRect();
+    slot.state.store(kFree);
+  }
+}
+
+// Allocates the idle ring surfaces to match the game's region of the back buffer so the capture
+// itself doesn't allocate.
+void PrepareRing(IDirect3DDevice8* device, UINT width, UINT height, D3DFORMAT format) {
+  for (Slot& slot : slots_) {
+    if (slot.state.load() != kFree) continue;  // Reallocated once returned.
+    if (slot.surface && slot.surface_width == width && slot.surface_height == height &&
+        slot.surface_format == format)
+      continue;
+    ReleaseSurface(slot);
+    HRESULT result = device->CreateImageSurface(width, height, format, &slot.surface);
+    if (FAILED(result)) {
+      Logger::Error("Screenshot: Failed to create a %u x %u surface: 0x%08x", width, height, result);
+      slot.surface = nullptr;
+      continue;
+    }
+    slot.surface_width = width;
+    slot.surface_height = height;
+    slot.surface_format = format;
+  }
+  prepared_width_ = width;
+  prepared_height_ = height;
+}
+
+// Returns the primary back buffer description. The caller must release the surface.
+IDirect3DSurface8* GetBackBuffer(IDirect3DDevice8* device, D3DSURFACE_DESC* desc) {
+  IDirect3DSurface8* back_buffer = nullptr;
+  if (FAILED(device->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &back_buffer))) return nullptr;
+  if (FAILED(back_buffer->GetDesc(desc))) {
+    back_buffer->Release();
+    return nullptr;
+  }
+  return back_buffer;
+}
+
+std::filesystem::path GetNextPath() {
+  SYSTEMTIME time;
+  ::GetLocalTime(&time);
+  char filename[64];
+  snprintf(filename, sizeof(filename), "eqw_%04u%02u%02u_%02u%02u%02u_%03u.%s", time.wYear, time.wMonth, time.wDay,
+           time.wHour, time.wMinute, time.wSecond, time.wMilliseconds, png_ ? "png" : "bmp");
+  return directory_ / filename;
+}
+
+// Copies the game's region of the back buffer into a free ring surface and queues it for encoding.
+void Capture(IDirect3DDevice8* device, UINT width, UINT height) {
+  D3DSURFACE_DESC desc;
+  IDirect3DSurface8* back_buffer = GetBackBuffer(device, &desc);
+  if (!back_buffer) {
+    Logger::Error("Screenshot: Failed to get the back buffer");
+    return;
+  }
+  ImageCodec::PixelFormat format;
+  if (!GetPixelFormat(desc.Format, &format) || desc.MultiSampleType != D3DMULTISAMPLE_NONE) {
+    Logger::Error("Screenshot: Unsupported back buffer format %d", desc.Format);
+    back_buffer->Release();
+    return;
+  }
+  if (!width || width > desc.Width) width = desc.Width;
+  if (!height || height > desc.Height) height = desc.Height;
+  PrepareRing(device, width, height, desc.Format);
+
+  Slot* slot = nullptr;
+  for (Slot& candidate : slots_) {
+    if (candidate.state.load() == kFree && candidate.surface && candidate.surface_width == width &&
+        candidate.surface_height == height && candidate.surface_format == desc.Format) {
+      slot = &candidate;
+      break;
+    }
+  }
+  if (!slot || !StartWorker()) {
+    Logger::Info("Screenshot: No capture surface available, skipped");
+    back_buffer->Release();
+    return;
+  }
+
+  RECT rect = {0, 0, static_cast<LONG>(width), static_cast<LONG>(height)};
+  HRESULT result = device->CopyRects(back_buffer, &rect, 1, slot->surface, nullptr);
+  back_buffer->Release();
+  D3DLOCKED_RECT locked;
+  if (SUCCEEDED(result)) result = slot->surface->LockRect(&locked, nullptr, D3DLOCK_READONLY);
+  if (FAILED(result)) {
+    Logger::Error("Screenshot: Failed to copy the back buffer: 0x%08x", result);
+    return;
+  }
+
+  slot->bits = static_cast<const BYTE*>(locked.pBits);
+  slot->pitch = locked.Pitch;
+  slot->width = static_cast<int>(width);
+  slot->height = static_cast<int>(height);
+  slot->format = format;
+  slot->sequence = sequence_++;
+  slot->path = GetNextPath();
+  slot->state.store(kQueued);  // Publishes the fields above to the worker thread.
+  ::SetEvent(wake_event_);
+}
+
+}  // namespace
+}  // namespace ScreenshotInt
+
+void Screenshot::Initialize(const std::filesystem::path& ini_file, const std::filesystem::path& directory) {
+  using namespace ScreenshotInt;
+  directory_ = directory;
+  hotkey_ = Ini::GetValue<int>("EqwGeneral", "ScreenshotKey", 0, ini_file.string().c_str());
+  std::string format = Ini::GetValue<std::string>("EqwGeneral", "ScreenshotFormat", "png", ini_file.string().c_str());
+  png_ = (_stricmp(format.c_str(), "bmp") != 0);
+  if (hotkey_ < 0 || hotkey_ > 0xff) hotkey_ = 0;
+  Logger::Info("Screenshot: Key: 0x%02x, format: %s", hotkey_, png_ ? "png" : "bmp");
+}
+
+void Screenshot::Request() { ScreenshotInt::requested_.store(true); }
+
+void Screenshot::OnPresent(IDirect3DDevice8* device, UINT game_width, UINT game_height, bool foreground) {
+  using namespace ScreenshotInt;
+  RecycleSlots();
+
+  if (hotkey_) {
+    bool down = foreground && (::GetAsyncKeyState(hotkey_) & 0x8000);
+    if (down && !hotkey_down_) requested_.store(true);
+    hotkey_down_ = down;
+
+    // Allocate the ring ahead of the first capture when the hotkey is in use.
+    if (game_width != prepared_width_ || game_height != prepared_height_) {
+      D3DSURFACE_DESC desc;
+      if (IDirect3DSurface8* back_buffer = GetBackBuffer(device, &desc)) {
+        back_buffer->Release();
+        ImageCodec::PixelFormat format;
+        if (GetPixelFormat(desc.Format, &format)) PrepareRing(device, game_width, game_height, desc.Format);
+      }
+      prepared_width_ = game_width;  // Skip retries of unsupported formats.
+      prepared_height_ = game_height;
+    }
+  }
+
+  if (requested_.exchange(false)) Capture(device, game_width, game_height);
+}
+
+void Screenshot::ReleaseResources() {
+  using namespace ScreenshotInt;
+  ULONGLONG start = ::GetTickCount64();
+  for (;;) {
+    RecycleSlots();
+    bool pending = false;
+    for (Slot& slot : slots_) pending |= (slot.state.load() == kQueued);
+    if (!pending) break;
+    if (::GetTickCount64() - start > kReleaseTimeoutMs) {
+      Logger::Error("Screenshot: Timed out waiting for the encode");
+      break;
+    }
+    ::Sleep(5);
+  }
+  for (Slot& slot : slots_) {
+    if (slot.state.load() == kFree)
+      ReleaseSurface(slot);
+    else
+      slot.surface = nullptr;  // Leaked since the worker thread is still reading it.
+  }
+  prepared_width_ = 0;
+  prepared_height_ = 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Screenshot capture that keeps the game thread cost to a single surface copy. A capture is
+// requested by the RequestScreenshot() dll export or an optional (ini file setting) hotkey and
+// performed in the Present() hook by copying the game's region of the back buffer into a ring of
+// system memory surfaces. The locked surface is handed to a worker thread for the pixel format
+// conversion and file encode, and the game thread unlocks it at a later Present() once the file
+// has been written.
+
+namespace Screenshot {
+
+// Reads the settings. The files are written to directory (created as needed).
+void Initialize(const std::filesystem::path& ini_file, const std::filesystem::path& directory);
+
+void Request();  // Thread safe. Captures the next presented frame.
+
+// Polls the hotkey, recycles finished captures, and performs any requested capture. Call before
+// the original Present() with the game's region of the back buffer.
+void OnPresent(IDirect3DDevice8* device, UINT game_width, UINT game_height, bool foreground);
+
+// Waits for pending encodes and releases the surface ring (before the final device Release()).
+void ReleaseResources();
+
+}  // namespace Screenshot
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+// Sequence lock for publishing a small, trivially copyable value from a writer thread to
+// readers without blocking them. Readers retry if they raced with a Store(). Concurrent
+// writers must be serialized by the caller.
+
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable_v<T>, "SeqLock requires a trivially copyable type");
+
+ public:
+  SeqLock() = default;
+  explicit SeqLock(const T& value) : value_(value) {}
+
+  void Store(const T& value) {
+    unsigned int sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);  // Odd while the value is being written.
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&value_, &value, sizeof(T));
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  T Load() const {
+    T value;
+    unsigned int before, after;
+    do {
+      before = sequence_.load(std::memory_order_acquire);
+      std::memcpy(&value, &value_, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence_.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return value;
+  }
+
+  // Incremented by two for every Store().
+  unsigned int sequence() const { return sequence_.load(std::memory_order_acquire); }
+
+ private:
+  std::atomic<unsigned int> sequence_ = 0;
+  T value_ = {};
+};
@@ -0,0 +1,187 @@
+#include "state_filter.h"
+
+#include <cstring>
+
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace StateFilterInt {
+namespace {
+
+static constexpr int kRenderStates = 256;  // Covers all D3DRENDERSTATETYPE values.
+static constexpr int kTextureStages = 8;
+static constexpr int kStageStates = 32;  // Covers all D3DTEXTURESTAGESTATETYPE values.
+
+bool enabled_ = false;
+IDirect3DDevice8* device_ = nullptr;  // Only the primary device is filtered.
+void** device_vtable_ = nullptr;      // The hooked vtable (the hooks are only installed once).
+bool recording_ = false;              // Between BeginStateBlock() and EndStateBlock().
+
+// Shadow of the last forwarded values. An entry is only used if its valid flag is set.
+struct Shadow {
+  DWORD render_state[kRenderStates];
+  DWORD stage_state[kTextureStages][kStageStates];
+  IDirect3DBaseTexture8* texture[kTextureStages];
+  DWORD vertex_shader;
+
+  bool render_state_valid[kRenderStates];
+  bool stage_state_valid[kTextureStages][kStageStates];
+  bool texture_valid[kTextureStages];
+  bool vertex_shader_valid;
+} shadow_ = {};
+
+// Per-frame call counts.
+unsigned int forwarded_ = 0;
+unsigned int filtered_ = 0;
+unsigned int last_forwarded_ = 0;
+unsigned int last_filtered_ = 0;
+
+VTableHook hook_SetRenderState_;
+VTableHook hook_BeginStateBlock_;
+VTableHook hook_EndStateBlock_;
+VTableHook hook_ApplyStateBlock_;
+VTableHook hook_SetTexture_;
+VTableHook hook_SetTextureStageState_;
+VTableHook hook_SetVertexShader_;
+VTableHook hook_DeleteVertexShader_;
+
+void Invalidate() {
+  std::memset(shadow_.render_state_valid, 0, sizeof(shadow_.render_state_valid));
+  std::memset(shadow_.stage_state_valid, 0, sizeof(shadow_.stage_state_valid));
+  std::memset(shadow_.texture_valid, 0, sizeof(shadow_.texture_valid));
+  shadow_.vertex_shader_valid = false;
+}
+
+// Calls while recording a state block do not change the device state and are always forwarded.
+bool IsFiltered(IDirect3DDevice8* device) { return device == device_ && !recording_; }
+
+// Returns true if the call is redundant. Otherwise the caller forwards it and calls Update().
+template <typename T>
+bool IsRedundant(const T& shadow, bool valid, const T& value) {
+  if (valid && shadow == value) {
+    ++filtered_;
+    return true;
+  }
+  ++forwarded_;
+  return false;
+}
+
+template <typename T>
+void Update(T& shadow, bool& valid, const T& value, HRESULT result) {
+  shadow = value;
+  valid = SUCCEEDED(result);
+}
+
+HRESULT WINAPI D3DDeviceSetRenderStateHook(IDirect3DDevice8* Device, D3DRENDERSTATETYPE State, DWORD Value) {
+  if (!IsFiltered(Device) || static_cast<DWORD>(State) >= kRenderStates)
+    return hook_SetRenderState_.original(D3DDeviceSetRenderStateHook)(Device, State, Value);
+
+  if (IsRedundant(shadow_.render_state[State], shadow_.render_state_valid[State], Value)) return D3D_OK;
+  HRESULT result = hook_SetRenderState_.original(D3DDeviceSetRenderStateHook)(Device, State, Value);
+  Update(shadow_.render_state[State], shadow_.render_state_valid[State], Value, result);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceSetTextureStageStateHook(IDirect3DDevice8* Device, DWORD Stage,
+                                                 D3DTEXTURESTAGESTATETYPE Type, DWORD Value) {
+  if (!IsFiltered(Device) || Stage >= kTextureStages || static_cast<DWORD>(Type) >= kStageStates)
+    return hook_SetTextureStageState_.original(D3DDeviceSetTextureStageStateHook)(Device, Stage, Type, Value);
+
+  DWORD& shadow = shadow_.stage_state[Stage][Type];
+  bool& valid = shadow_.stage_state_valid[Stage][Type];
+  if (IsRedundant(shadow, valid, Value)) return D3D_OK;
+  HRESULT result = hook_SetTextureStageState_.original(D3DDeviceSetTextureStageStateHook)(Device, Stage, Type, Value);
+  Update(shadow, valid, Value, result);
+  return result;
+}
+
+// The device holds a reference to the bound texture, so a shadowed pointer can't be recycled
+// by a new texture while it is still bound.
+HRESULT WINAPI D3DDeviceSetTextureHook(IDirect3DDevice8* Device, DWORD Stage, IDirect3DBaseTexture8* pTexture) {
+  if (!IsFiltered(Device) || Stage >= kTextureStages)
+    return hook_SetTexture_.original(D3DDeviceSetTextureHook)(Device, Stage, pTexture);
+
+  if (IsRedundant(shadow_.texture[Stage], shadow_.texture_valid[Stage], pTexture)) return D3D_OK;
+  HRESULT result = hook_SetTexture_.original(D3DDeviceSetTextureHook)(Device, Stage, pTexture);
+  Update(shadow_.texture[Stage], shadow_.texture_valid[Stage], pTexture, result);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceSetVertexShaderHook(IDirect3DDevice8* Device, DWORD Handle) {
+  if (!IsFiltered(Device)) return hook_SetVertexShader_.original(D3DDeviceSetVertexShaderHook)(Device, Handle);
+
+  if (IsRedundant(shadow_.vertex_shader, shadow_.vertex_shader_valid, Handle)) return D3D_OK;
+  HRESULT result = hook_SetVertexShader_.original(D3DDeviceSetVertexShaderHook)(Device, Handle);
+  Update(shadow_.vertex_shader, shadow_.vertex_shader_valid, Handle, result);
+  return result;
+}
+
+// A deleted shader handle can be reused by the next created shader.
+HRESULT WINAPI D3DDeviceDeleteVertexShaderHook(IDirect3DDevice8* Device, DWORD Handle) {
+  if (Device == device_ && shadow_.vertex_shader == Handle) shadow_.vertex_shader_valid = false;
+  return hook_DeleteVertexShader_.original(D3DDeviceDeleteVertexShaderHook)(Device, Handle);
+}
+
+HRESULT WINAPI D3DDeviceBeginStateBlockHook(IDirect3DDevice8* Device) {
+  HRESULT result = hook_BeginStateBlock_.original(D3DDeviceBeginStateBlockHook)(Device);
+  if (Device == device_ && SUCCEEDED(result)) recording_ = true;
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceEndStateBlockHook(IDirect3DDevice8* Device, DWORD* pToken) {
+  if (Device == device_) recording_ = false;
+  return hook_EndStateBlock_.original(D3DDeviceEndStateBlockHook)(Device, pToken);
+}
+
+HRESULT WINAPI D3DDeviceApplyStateBlockHook(IDirect3DDevice8* Device, DWORD Token) {
+  if (Device == device_) Invalidate();
+  return hook_ApplyStateBlock_.original(D3DDeviceApplyStateBlockHook)(Device, Token);
+}
+
+}  // namespace
+}  // namespace StateFilterInt
+
+void StateFilter::Initialize(const std::filesystem::path& ini_file) {
+  using namespace StateFilterInt;
+  enabled_ = Ini::GetValue<bool>("EqwGeneral", "FilterRedundantStates", false, ini_file.string().c_str());
+  if (enabled_) Logger::Info("StateFilter: Enabled");
+}
+
+void StateFilter::InstallHooks(IDirect3DDevice8* device) {
+  using namespace StateFilterInt;
+  if (!enabled_) return;
+  device_ = device;
+  recording_ = false;
+  StateFilterInt::Invalidate();
+
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Re-hooking the slots shared with other modules would cycle.
+  device_vtable_ = vtable;
+
+  hook_SetRenderState_ = VTableHook(vtable, 50, D3DDeviceSetRenderStateHook, false);
+  hook_BeginStateBlock_ = VTableHook(vtable, 52, D3DDeviceBeginStateBlockHook, false);
+  hook_EndStateBlock_ = VTableHook(vtable, 53, D3DDeviceEndStateBlockHook, false);
+  hook_ApplyStateBlock_ = VTableHook(vtable, 54, D3DDeviceApplyStateBlockHook, false);
+  hook_SetTexture_ = VTableHook(vtable, 61, D3DDeviceSetTextureHook, false);
+  hook_SetTextureStageState_ = VTableHook(vtable, 63, D3DDeviceSetTextureStageStateHook, false);
+  hook_SetVertexShader_ = VTableHook(vtable, 76, D3DDeviceSetVertexShaderHook, false);
+  hook_DeleteVertexShader_ = VTableHook(vtable, 78, D3DDeviceDeleteVertexShaderHook, false);
+}
+
+void StateFilter::Invalidate() {
+  StateFilterInt::recording_ = false;
+  StateFilterInt::Invalidate();
+}
+
+void StateFilter::OnPresent() {
+  using namespace StateFilterInt;
+  last_forwarded_ = forwarded_;
+  last_filtered_ = filtered_;
+  forwarded_ = 0;
+  filtered_ = 0;
+}
+
+unsigned int StateFilter::GetForwardedCalls() { return StateFilterInt::last_forwarded_; }
+
+unsigned int StateFilter::GetFilteredCalls() { return StateFilterInt::last_filtered_; }
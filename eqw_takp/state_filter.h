@@ -0,0 +1,34 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) filter that drops redundant render state, texture stage state,
+// texture, and vertex shader calls before they reach the d3d8 runtime or wrapper. The game
+// re-sends the full state for every mesh, and each call is a costly trip through a translation
+// layer like dgVoodoo or d3d8to9 into the real driver.
+//
+// The last value forwarded to the device is mirrored in flat shadow arrays. Calls that match the
+// shadow are dropped. The shadow is discarded whenever the device state changes outside of the
+// filtered calls (Reset() and ApplyStateBlock()), and calls recorded into a state block are
+// always forwarded.
+
+namespace StateFilter {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the enable setting.
+
+// Installs the device hooks. Call after each successful creation of the primary device.
+void InstallHooks(IDirect3DDevice8* device);
+
+void Invalidate();  // Discards the shadowed state. Call after a device Reset().
+
+void OnPresent();  // Latches the per-frame call counts. Call from the game thread on each Present().
+
+// Returns the number of filtered state calls in the last frame that were forwarded or dropped.
+unsigned int GetForwardedCalls();
+unsigned int GetFilteredCalls();
+
+}  // namespace StateFilter
@@ -0,0 +1,433 @@
+#include "texture_compress.h"
+
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dxt_codec.h"
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace TextureCompressInt {
+namespace {
+
+static constexpr UINT kMinSize = 64;  // Smaller textures (mostly fonts and icons) stay uncompressed.
+
+// Private data key of the TextureTracker attached to the compressed textures.
+static constexpr GUID kTrackerGuid = {0x5d1f3a2c, 0x8e47, 0x4b1a, {0x9c, 0x3e, 0x61, 0x0b, 0x7d, 0x25, 0xa4, 0xf8}};
+
+// An encode of one texture level. Owned by the game thread, except that the worker thread fills
+// in the blocks of queued jobs.
+struct Job {
+  std::vector<uint8_t> source;  // Staging pixels with a tight pitch.
+  std::vector<uint8_t> blocks;
+  DxtCodec::SourceFormat source_format;
+  DxtCodec::BlockFormat block_format;
+  int width;
+  int height;
+  int pitch;
+  std::atomic<bool> done = false;
+};
+
+struct Level {
+  std::vector<uint8_t> staging;  // Pixels in the source format while locked.
+  bool locked = false;
+  bool read_only = false;
+  bool written = false;  // The compressed level has contents.
+  Job* job = nullptr;    // Pending encode.
+};
+
+// A compressed texture presented to the game with the uncompressed format.
+struct Proxy {
+  D3DFORMAT source_format;
+  DxtCodec::SourceFormat codec_format;
+  DxtCodec::BlockFormat block_format;
+  UINT width;
+  UINT height;
+  std::vector<Level> levels;
+};
+
+bool enabled_ = false;
+bool unsupported_ = false;  // The device failed to create a DXT texture.
+std::unordered_map<IDirect3DTexture8*, Proxy> textures_;
+std::vector<std::pair<IDirect3DTexture8*, UINT>> pending_;  // Levels with a queued encode.
+void** texture_vtable_ = nullptr;  // All tracked textures share this vtable.
+void** device_vtable_ = nullptr;   // The hooked vtable (the hooks are only installed once).
+
+// Statistics for the log.
+unsigned int compressed_count_ = 0;
+unsigned long long saved_bytes_ = 0;
+
+SRWLOCK queue_lock_ = SRWLOCK_INIT;
+std::deque<Job*> queue_;  // Jobs not yet started by the worker thread.
+HANDLE wake_event_ = nullptr;
+
+VTableHook hook_CreateTexture_;  // Direct3DDevice.
+VTableHook hook_SetTexture_;     // Direct3DDevice.
+VTableHook hook_GetLevelDesc_;   // Direct3DTexture.
+VTableHook hook_LockRect_;       // Direct3DTexture.
+VTableHook hook_UnlockRect_;     // Direct3DTexture.
+
+UINT GetBytesPerPixel(D3DFORMAT format) { return (format == D3DFMT_R5G6B5) ? 2 : 4; }
+
+UINT GetLevelSize(UINT size, UINT level) { return (size >> level) ? (size >> level) : 1; }
+
+void Encode(Job* job) {
+  job->blocks.resize(DxtCodec::GetEncodedSize(job->block_format, job->width, job->height));
+  DxtCodec::EncodeImage(job->source_format, job->source.data(), job->pitch, job->width, job->height,
+                        job->block_format, job->blocks.data());
+  std::vector<uint8_t>().swap(job->source);  // Release the staging memory early.
+  job->done.store(true);
+}
+
+DWORD WINAPI WorkerThread(LPVOID) {
+  for (;;) {
+    ::WaitForSingleObject(wake_event_, INFINITE);
+    for (;;) {
+      ::AcquireSRWLockExclusive(&queue_lock_);
+      Job* job = nullptr;
+      if (!queue_.empty()) {
+        job = queue_.front();
+        queue_.pop_front();
+      }
+      ::ReleaseSRWLockExclusive(&queue_lock_);
+      if (!job) break;
+      Encode(job);
+    }
+  }
+  return 0;
+}
+
+bool StartWorker() {
+  if (wake_event_) return true;
+  HANDLE event = ::CreateEventA(nullptr, FALSE, FALSE, nullptr);
+  HANDLE thread = event ? ::CreateThread(nullptr, 0, WorkerThread, nullptr, 0, nullptr) : nullptr;
+  if (!thread) {
+    if (event) ::CloseHandle(event);
+    Logger::Error("TextureCompress: Failed to start the worker thread");
+    return false;
+  }
+  wake_event_ = event;
+  ::SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+  ::CloseHandle(thread);
+  return true;
+}
+
+// Queues the job for the worker thread or encodes it immediately if the worker is unavailable.
+void Submit(Job* job) {
+  if (!StartWorker()) return Encode(job);
+  ::AcquireSRWLockExclusive(&queue_lock_);
+  queue_.push_back(job);
+  ::ReleaseSRWLockExclusive(&queue_lock_);
+  ::SetEvent(wake_event_);
+}
+
+// Removes the job from the queue. Returns false if the worker has already started it.
+bool Dequeue(Job* job) {
+  bool queued = false;
+  ::AcquireSRWLockExclusive(&queue_lock_);
+  for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+    if (*it == job) {
+      queue_.erase(it);
+      queued = true;
+      break;
+    }
+  }
+  ::ReleaseSRWLockExclusive(&queue_lock_);
+  return queued;
+}
+
+// Waits for the job to complete. A job the worker hasn't started yet is encoded on this thread.
+void Finish(Job* job) {
+  if (Dequeue(job)) Encode(job);
+  while (!job->done.load()) ::Sleep(0);
+}
+
+// Frees the job without encoding it. A job the worker has already started is waited for.
+void Cancel(Job* job) {
+  if (!Dequeue(job))
+    while (!job->done.load()) ::Sleep(0);
+  delete job;
+}
+
+HRESULT WINAPI D3DTextureLockRectHook(IDirect3DTexture8* Texture, UINT Level, D3DLOCKED_RECT* pLockedRect,
+                                      CONST RECT* pRect, DWORD Flags);
+HRESULT WINAPI D3DTextureUnlockRectHook(IDirect3DTexture8* Texture, UINT Level);
+
+// Copies the encoded blocks into the compressed texture level.
+void Upload(IDirect3DTexture8* texture, UINT level, const Job& job) {
+  D3DLOCKED_RECT locked;
+  HRESULT result = hook_LockRect_.original(D3DTextureLockRectHook)(texture, level, &locked, nullptr, 0);
+  if (FAILED(result)) {
+    Logger::Error("TextureCompress: Failed to lock level %u: 0x%08x", level, result);
+    return;
+  }
+  size_t row_size = DxtCodec::GetBlockRowSize(job.block_format, job.width);
+  size_t rows = job.blocks.size() / row_size;
+  for (size_t row = 0; row < rows; ++row)
+    std::memcpy(static_cast<BYTE*>(locked.pBits) + row * locked.Pitch, job.blocks.data() + row * row_size, row_size);
+  hook_UnlockRect_.original(D3DTextureUnlockRectHook)(texture, level);
+}
+
+// Uploads and frees the pending encode of the level. Returns without waiting if wait is false and
+// the encode is still in progress.
+void CompleteLevel(IDirect3DTexture8* texture, Level& level, UINT index, bool wait) {
+  Job* job = level.job;
+  if (!job) return;
+  if (wait)
+    Finish(job);
+  else if (!job->done.load())
+    return;
+  Upload(texture, index, *job);
+  delete job;
+  level.job = nullptr;
+}
+
+void CompleteTexture(IDirect3DTexture8* texture, Proxy& proxy) {
+  for (UINT i = 0; i < proxy.levels.size(); ++i) CompleteLevel(texture, proxy.levels[i], i, true);
+}
+
+// Cancels the pending encodes of a released texture (e.g. a duplicate dropped by TextureDedup).
+void DiscardTexture(Proxy& proxy) {
+  for (Level& level : proxy.levels) {
+    if (!level.job) continue;
+    Cancel(level.job);
+    level.job = nullptr;
+  }
+}
+
+// Attached to each compressed texture as IUnknown private data, which the runtime releases when
+// the texture is destroyed. Unlike a Release() hook this also catches the final release of a
+// texture that was still bound to the device.
+class TextureTracker : public IUnknown {
+ public:
+  explicit TextureTracker(IDirect3DTexture8* texture) : texture_(texture) {}
+
+  HRESULT WINAPI QueryInterface(REFIID riid, void** object) override {
+    if (!object) return E_POINTER;
+    *object = nullptr;
+    return E_NOINTERFACE;
+  }
+  ULONG WINAPI AddRef() override { return ++references_; }
+  ULONG WINAPI Release() override {
+    ULONG count = --references_;
+    if (count == 0) {
+      auto it = textures_.find(texture_);
+      if (it != textures_.end()) {
+        DiscardTexture(it->second);
+        textures_.erase(it);
+      }
+      delete this;
+    }
+    return count;
+  }
+
+ private:
+  IDirect3DTexture8* texture_;
+  ULONG references_ = 1;
+};
+
+bool IsCompressible(UINT width, UINT height, DWORD usage, D3DFORMAT format, D3DPOOL pool) {
+  if (!enabled_ || unsupported_ || usage != 0 || pool != D3DPOOL_MANAGED) return false;
+  if (width < kMinSize || height < kMinSize || (width & 3) || (height & 3)) return false;
+  return format == D3DFMT_A8R8G8B8 || format == D3DFMT_X8R8G8B8 || format == D3DFMT_R5G6B5;
+}
+
+HRESULT WINAPI D3DTextureGetLevelDescHook(IDirect3DTexture8* Texture, UINT Level, D3DSURFACE_DESC* pDesc) {
+  HRESULT result = hook_GetLevelDesc_.original(D3DTextureGetLevelDescHook)(Texture, Level, pDesc);
+  auto it = textures_.find(Texture);
+  if (it != textures_.end() && SUCCEEDED(result) && pDesc) {
+    pDesc->Format = it->second.source_format;
+    pDesc->Size = pDesc->Width * pDesc->Height * GetBytesPerPixel(pDesc->Format);
+  }
+  return result;
+}
+
+// Decodes the current contents of the compressed level into the staging buffer.
+void ReadBack(IDirect3DTexture8* texture, const Proxy& proxy, UINT index, Level& level, UINT width, UINT height,
+              UINT pitch) {
+  D3DLOCKED_RECT locked;
+  if (FAILED(hook_LockRect_.original(D3DTextureLockRectHook)(texture, index, &locked, nullptr, D3DLOCK_READONLY)))
+    return;
+  size_t row_size = DxtCodec::GetBlockRowSize(proxy.block_format, width);
+  size_t rows = (height + 3) / 4;
+  std::vector<uint8_t> blocks(row_size * rows);
+  for (size_t row = 0; row < rows; ++row)
+    std::memcpy(blocks.data() + row * row_size, static_cast<const BYTE*>(locked.pBits) + row * locked.Pitch, row_size);
+  hook_UnlockRect_.original(D3DTextureUnlockRectHook)(texture, index);
+  DxtCodec::DecodeImage(proxy.block_format, blocks.data(), width, height, proxy.codec_format, level.staging.data(),
+                        pitch);
+}
+
+HRESULT WINAPI D3DTextureLockRectHook(IDirect3DTexture8* Texture, UINT Level, D3DLOCKED_RECT* pLockedRect,
+                                      CONST RECT* pRect, DWORD Flags) {
+  auto it = textures_.find(Texture);
+  if (it == textures_.end() || Level >= it->second.levels.size())
+    return hook_LockRect_.original(D3DTextureLockRectHook)(Texture, Level, pLockedRect, pRect, Flags);
+
+  Proxy& proxy = it->second;
+  TextureCompressInt::Level& level = proxy.levels[Level];
+  if (level.locked || !pLockedRect) return D3DERR_INVALIDCALL;
+  CompleteLevel(Texture, level, Level, true);
+
+  UINT width = GetLevelSize(proxy.width, Level);
+  UINT height = GetLevelSize(proxy.height, Level);
+  UINT bytes_per_pixel = GetBytesPerPixel(proxy.source_format);
+  UINT pitch = width * bytes_per_pixel;
+  level.staging.assign(static_cast<size_t>(pitch) * height, 0);
+  if (level.written) ReadBack(Texture, proxy, Level, level, width, height, pitch);
+
+  BYTE* bits = level.staging.data();
+  if (pRect) bits += pRect->top * pitch + pRect->left * bytes_per_pixel;
+  pLockedRect->pBits = bits;
+  pLockedRect->Pitch = static_cast<INT>(pitch);
+  level.locked = true;
+  level.read_only = (Flags & D3DLOCK_READONLY) != 0;
+  return D3D_OK;
+}
+
+HRESULT WINAPI D3DTextureUnlockRectHook(IDirect3DTexture8* Texture, UINT Level) {
+  auto it = textures_.find(Texture);
+  if (it == textures_.end() || Level >= it->second.levels.size())
+    return hook_UnlockRect_.original(D3DTextureUnlockRectHook)(Texture, Level);
+
+  Proxy& proxy = it->second;
+  TextureCompressInt::Level& level = proxy.levels[Level];
+  if (!level.locked) return D3DERR_INVALIDCALL;
+  level.locked = false;
+  if (level.read_only) {
+    std::vector<uint8_t>().swap(level.staging);
+    return D3D_OK;
+  }
+
+  Job* job = new Job;
+  job->source.swap(level.staging);
+  job->source_format = proxy.codec_format;
+  job->block_format = proxy.block_format;
+  job->width = static_cast<int>(GetLevelSize(proxy.width, Level));
+  job->height = static_cast<int>(GetLevelSize(proxy.height, Level));
+  job->pitch = job->width * static_cast<int>(GetBytesPerPixel(proxy.source_format));
+  level.job = job;
+  if (level.written) {
+    Encode(job);  // An update of a texture that may already be bound, so it isn't deferred.
+    CompleteLevel(Texture, level, Level, true);
+  } else {
+    level.written = true;
+    Submit(job);
+    pending_.emplace_back(Texture, Level);
+  }
+  return D3D_OK;
+}
+
+// Hooks the texture methods. The hooks are shared by all textures using the same vtable.
+bool HookTextureVTable(IDirect3DTexture8* texture) {
+  void** vtable = *(void***)texture;
+  if (texture_vtable_) return vtable == texture_vtable_;
+  texture_vtable_ = vtable;
+  hook_GetLevelDesc_ = VTableHook(vtable, 14, D3DTextureGetLevelDescHook, false);
+  hook_LockRect_ = VTableHook(vtable, 16, D3DTextureLockRectHook, false);
+  hook_UnlockRect_ = VTableHook(vtable, 17, D3DTextureUnlockRectHook, false);
+  return true;
+}
+
+HRESULT WINAPI D3DDeviceCreateTextureHook(IDirect3DDevice8* Device, UINT Width, UINT Height, UINT Levels,
+                                          DWORD Usage, D3DFORMAT Format, D3DPOOL Pool,
+                                          IDirect3DTexture8** ppTexture) {
+  auto create = hook_CreateTexture_.original(D3DDeviceCreateTextureHook);
+  if (!IsCompressible(Width, Height, Usage, Format, Pool) || !ppTexture)
+    return create(Device, Width, Height, Levels, Usage, Format, Pool, ppTexture);
+
+  DxtCodec::BlockFormat block_format =
+      (Format == D3DFMT_A8R8G8B8) ? DxtCodec::BlockFormat::kDxt5 : DxtCodec::BlockFormat::kDxt1;
+  D3DFORMAT dxt_format = (block_format == DxtCodec::BlockFormat::kDxt5) ? D3DFMT_DXT5 : D3DFMT_DXT1;
+  HRESULT result = create(Device, Width, Height, Levels, Usage, dxt_format, Pool, ppTexture);
+  if (FAILED(result)) {
+    Logger::Error("TextureCompress: DXT textures are not supported, disabling: 0x%08x", result);
+    unsupported_ = true;
+    return create(Device, Width, Height, Levels, Usage, Format, Pool, ppTexture);
+  }
+  IDirect3DTexture8* texture = *ppTexture;
+  TextureTracker* tracker = new TextureTracker(texture);
+  bool tracked = HookTextureVTable(texture) &&  // Expected to pass, the runtime uses a single texture class.
+                 SUCCEEDED(texture->SetPrivateData(kTrackerGuid, tracker, sizeof(IUnknown*), D3DSPD_IUNKNOWN));
+  tracker->Release();  // The texture holds the remaining reference.
+  if (!tracked) {
+    texture->Release();
+    return create(Device, Width, Height, Levels, Usage, Format, Pool, ppTexture);
+  }
+
+  Proxy& proxy = textures_[texture];
+  proxy.source_format = Format;
+  proxy.codec_format = (Format == D3DFMT_A8R8G8B8)   ? DxtCodec::SourceFormat::kArgb8888
+                       : (Format == D3DFMT_X8R8G8B8) ? DxtCodec::SourceFormat::kXrgb8888
+                                                     : DxtCodec::SourceFormat::kRgb565;
+  proxy.block_format = block_format;
+  proxy.width = Width;
+  proxy.height = Height;
+  proxy.levels.clear();
+  proxy.levels.resize(texture->GetLevelCount());
+
+  ++compressed_count_;
+  for (UINT i = 0; i < proxy.levels.size(); ++i) {
+    UINT width = GetLevelSize(Width, i), height = GetLevelSize(Height, i);
+    saved_bytes_ += width * height * GetBytesPerPixel(Format) - DxtCodec::GetEncodedSize(block_format, width, height);
+  }
+  return result;
+}
+
+// The encodes must land before the first draw with the texture.
+HRESULT WINAPI D3DDeviceSetTextureHook(IDirect3DDevice8* Device, DWORD Stage, IDirect3DBaseTexture8* pTexture) {
+  auto it = textures_.find(reinterpret_cast<IDirect3DTexture8*>(pTexture));
+  if (it != textures_.end()) CompleteTexture(it->first, it->second);
+  return hook_SetTexture_.original(D3DDeviceSetTextureHook)(Device, Stage, pTexture);
+}
+
+}  // namespace
+}  // namespace TextureCompressInt
+
+void TextureCompress::Initialize(const std::filesystem::path& ini_file) {
+  using namespace TextureCompressInt;
+  enabled_ = Ini::GetValue<bool>("EqwGeneral", "CompressTextures", false, ini_file.string().c_str());
+  if (enabled_) Logger::Info("TextureCompress: Enabled");
+}
+
+void TextureCompress::InstallHooks(IDirect3DDevice8* device) {
+  using namespace TextureCompressInt;
+  if (!enabled_) return;
+  unsupported_ = false;
+
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Re-hooking the slots shared with TextureDedup would cycle.
+  device_vtable_ = vtable;
+  hook_CreateTexture_ = VTableHook(vtable, 20, D3DDeviceCreateTextureHook, false);
+  hook_SetTexture_ = VTableHook(vtable, 61, D3DDeviceSetTextureHook, false);
+}
+
+void TextureCompress::OnPresent() {
+  using namespace TextureCompressInt;
+  size_t remaining = 0;
+  for (const auto& [texture, index] : pending_) {
+    auto it = textures_.find(texture);
+    if (it == textures_.end() || index >= it->second.levels.size()) continue;  // Released.
+    TextureCompressInt::Level& level = it->second.levels[index];
+    CompleteLevel(texture, level, index, false);
+    if (level.job) pending_[remaining++] = {texture, index};
+  }
+  pending_.resize(remaining);
+}
+
+void TextureCompress::ReleaseResources() {
+  using namespace TextureCompressInt;
+  for (auto& [texture, proxy] : textures_) DiscardTexture(proxy);
+  textures_.clear();
+  pending_.clear();
+  if (compressed_count_)
+    Logger::Info("TextureCompress: Compressed %u textures, saved %u KB", compressed_count_,
+                 static_cast<unsigned int>(saved_bytes_ / 1024));
+  compressed_count_ = 0;
+  saved_bytes_ = 0;
+}
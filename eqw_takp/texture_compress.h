@@ -0,0 +1,31 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) compression of the game's uncompressed managed textures to DXT1
+// (DXT5 for A8R8G8B8) to reduce the video memory and the 32-bit address space used by the
+// runtime's system memory copies of the managed textures.
+//
+// Eligible textures are created with the DXT format instead. The texture LockRect() calls return
+// a staging buffer in the format the game requested (also reported by GetLevelDesc()), and the
+// UnlockRect() queues the staging buffer for encoding on a worker thread. The encoded blocks are
+// uploaded at the next Present() or, if earlier, when the texture is first bound with SetTexture().
+// Relocking a level decodes the current contents and encodes synchronously at the unlock.
+
+namespace TextureCompress {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the enable setting.
+
+// Installs the texture creation and binding hooks. Call after each primary device creation.
+void InstallHooks(IDirect3DDevice8* device);
+
+void OnPresent();  // Uploads the finished encodes.
+
+// Completes the pending encodes and drops the tracking (before the final device Release()).
+void ReleaseResources();
+
+}  // namespace TextureCompress
@@ -0,0 +1,442 @@
+#include "texture_dedup.h"
+
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "content_hash.h"
+#include "ini.h"
+#include "logger.h"
+#include "vtable_hook.h"
+
+namespace TextureDedupInt {
+namespace {
+
+// Identifies textures with identical descriptions and contents.
+struct Key {
+  UINT width;
+  UINT height;
+  UINT levels;
+  D3DFORMAT format;
+  ContentHash::Hash128 hash;
+
+  bool operator==(const Key& other) const {
+    return width == other.width && height == other.height && levels == other.levels && format == other.format &&
+           hash == other.hash;
+  }
+};
+
+struct KeyHasher {
+  size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash.low); }
+};
+
+struct Entry {
+  IDirect3DTexture8* texture;       // Holds a reference while in the table.
+  unsigned int users;               // Proxies using the texture (zero while cached).
+  UINT size;                        // Bytes in all levels.
+  std::list<Key>::iterator cached;  // Position in cache_ while users is zero.
+};
+
+static constexpr unsigned int kPressureCheckFrames = 64;
+static constexpr unsigned long long kMinFreeAddressSpace = 256ull << 20;  // Trim the cache below this.
+
+bool enabled_ = false;
+std::unordered_map<Key, Entry, KeyHasher> resident_;
+std::list<Key> cache_;  // Keys of unused resident textures, most recently released first.
+unsigned long long cache_budget_ = 0;
+unsigned long long cache_bytes_ = 0;
+unsigned int cache_hits_ = 0;
+unsigned int frames_ = 0;
+void* proxy_vtable_ = nullptr;  // Identifies proxies passed to the device hooks.
+void** device_vtable_ = nullptr;  // The hooked vtable (the hooks are only installed once).
+unsigned int shared_textures_ = 0;
+unsigned long long saved_bytes_ = 0;
+
+VTableHook hook_CreateTexture_;
+VTableHook hook_SetTexture_;
+
+HRESULT WINAPI D3DDeviceCreateTextureHook(IDirect3DDevice8* Device, UINT Width, UINT Height, UINT Levels,
+                                          DWORD Usage, D3DFORMAT Format, D3DPOOL Pool,
+                                          IDirect3DTexture8** ppTexture);
+
+// Returns the bytes per row and the number of rows of a level (rows of 4x4 blocks for DXT).
+bool GetLevelLayout(D3DFORMAT format, UINT width, UINT height, UINT* row_size, UINT* rows) {
+  UINT bytes_per_pixel = 0;
+  switch (format) {
+    case D3DFMT_A8R8G8B8:
+    case D3DFMT_X8R8G8B8:
+      bytes_per_pixel = 4;
+      break;
+    case D3DFMT_R5G6B5:
+    case D3DFMT_X1R5G5B5:
+    case D3DFMT_A1R5G5B5:
+    case D3DFMT_A4R4G4B4:
+      bytes_per_pixel = 2;
+      break;
+    case D3DFMT_P8:
+    case D3DFMT_L8:
+    case D3DFMT_A8:
+      bytes_per_pixel = 1;
+      break;
+    case D3DFMT_DXT1:
+      *row_size = (width + 3) / 4 * 8;
+      *rows = (height + 3) / 4;
+      return true;
+    case D3DFMT_DXT2:
+    case D3DFMT_DXT3:
+    case D3DFMT_DXT4:
+    case D3DFMT_DXT5:
+      *row_size = (width + 3) / 4 * 16;
+      *rows = (height + 3) / 4;
+      return true;
+    default:
+      return false;
+  }
+  *row_size = width * bytes_per_pixel;
+  *rows = height;
+  return true;
+}
+
+UINT GetLevelSize(UINT size, UINT level) { return (size >> level) ? (size >> level) : 1; }
+
+// Releases the least recently used cached textures until the cache fits in budget bytes.
+void TrimCache(unsigned long long budget) {
+  while (cache_bytes_ > budget) {
+    auto it = resident_.find(cache_.back());
+    cache_bytes_ -= it->second.size;
+    it->second.texture->Release();
+    resident_.erase(it);
+    cache_.pop_back();
+  }
+}
+
+// Copies the contents of all levels between textures with the same description.
+bool CopyLevels(IDirect3DTexture8* source, IDirect3DTexture8* dest, UINT width, UINT height, UINT levels,
+                D3DFORMAT format) {
+  for (UINT i = 0; i < levels; ++i) {
+    UINT row_size = 0, rows = 0;
+    GetLevelLayout(format, GetLevelSize(width, i), GetLevelSize(height, i), &row_size, &rows);
+    D3DLOCKED_RECT from, to;
+    if (FAILED(source->LockRect(i, &from, nullptr, D3DLOCK_READONLY))) return false;
+    if (FAILED(dest->LockRect(i, &to, nullptr, 0))) {
+      source->UnlockRect(i);
+      return false;
+    }
+    for (UINT row = 0; row < rows; ++row)
+      std::memcpy(static_cast<BYTE*>(to.pBits) + row * to.Pitch,
+                  static_cast<const BYTE*>(from.pBits) + row * from.Pitch, row_size);
+    dest->UnlockRect(i);
+    source->UnlockRect(i);
+  }
+  return true;
+}
+
+// Compares the contents of all levels of textures with the same description.
+bool EqualLevels(IDirect3DTexture8* first, IDirect3DTexture8* second, UINT width, UINT height, UINT levels,
+                 D3DFORMAT format) {
+  bool equal = true;
+  for (UINT i = 0; equal && i < levels; ++i) {
+    UINT row_size = 0, rows = 0;
+    GetLevelLayout(format, GetLevelSize(width, i), GetLevelSize(height, i), &row_size, &rows);
+    D3DLOCKED_RECT a, b;
+    if (FAILED(first->LockRect(i, &a, nullptr, D3DLOCK_READONLY))) return false;
+    if (FAILED(second->LockRect(i, &b, nullptr, D3DLOCK_READONLY))) {
+      first->UnlockRect(i);
+      return false;
+    }
+    for (UINT row = 0; equal && row < rows; ++row)
+      equal = !std::memcmp(static_cast<const BYTE*>(a.pBits) + row * a.Pitch,
+                           static_cast<const BYTE*>(b.pBits) + row * b.Pitch, row_size);
+    second->UnlockRect(i);
+    first->UnlockRect(i);
+  }
+  return equal;
+}
+
+// The texture handed to the game. Forwards to the real texture, which may be shared with other
+// proxies once all levels have been filled.
+class TextureProxy final : public IDirect3DTexture8 {
+ public:
+  TextureProxy(IDirect3DTexture8* texture, UINT width, UINT height, D3DFORMAT format, DWORD usage, D3DPOOL pool)
+      : texture_(texture), width_(width), height_(height), format_(format), usage_(usage), pool_(pool) {
+    levels_.resize(texture->GetLevelCount());
+    proxy_vtable_ = *reinterpret_cast<void**>(this);
+  }
+
+  IDirect3DTexture8* texture() const { return texture_; }
+
+  // IUnknown.
+  HRESULT WINAPI QueryInterface(REFIID riid, void** ppvObj) override {
+    HRESULT result = texture_->QueryInterface(riid, ppvObj);
+    if (SUCCEEDED(result) && *ppvObj == texture_) {  // Keep the game's identity on the proxy.
+      texture_->Release();
+      *ppvObj = this;
+      AddRef();
+    }
+    return result;
+  }
+  ULONG WINAPI AddRef() override { return ++references_; }
+  ULONG WINAPI Release() override {
+    ULONG count = --references_;
+    if (count == 0) {
+      Unregister();
+      texture_->Release();
+      delete this;
+    }
+    return count;
+  }
+
+  // IDirect3DResource8 and IDirect3DBaseTexture8.
+  HRESULT WINAPI GetDevice(IDirect3DDevice8** ppDevice) override { return texture_->GetDevice(ppDevice); }
+  HRESULT WINAPI SetPrivateData(REFGUID refguid, CONST void* pData, DWORD SizeOfData, DWORD Flags) override {
+    return texture_->SetPrivateData(refguid, pData, SizeOfData, Flags);
+  }
+  HRESULT WINAPI GetPrivateData(REFGUID refguid, void* pData, DWORD* pSizeOfData) override {
+    return texture_->GetPrivateData(refguid, pData, pSizeOfData);
+  }
+  HRESULT WINAPI FreePrivateData(REFGUID refguid) override { return texture_->FreePrivateData(refguid); }
+  DWORD WINAPI SetPriority(DWORD PriorityNew) override { return texture_->SetPriority(PriorityNew); }
+  DWORD WINAPI GetPriority() override { return texture_->GetPriority(); }
+  void WINAPI PreLoad() override { texture_->PreLoad(); }
+  D3DRESOURCETYPE WINAPI GetType() override { return texture_->GetType(); }
+  DWORD WINAPI SetLOD(DWORD LODNew) override { return texture_->SetLOD(LODNew); }
+  DWORD WINAPI GetLOD() override { return texture_->GetLOD(); }
+  DWORD WINAPI GetLevelCount() override { return texture_->GetLevelCount(); }
+
+  // IDirect3DTexture8.
+  HRESULT WINAPI GetLevelDesc(UINT Level, D3DSURFACE_DESC* pDesc) override {
+    return texture_->GetLevelDesc(Level, pDesc);
+  }
+  HRESULT WINAPI GetSurfaceLevel(UINT Level, IDirect3DSurface8** ppSurfaceLevel) override {
+    MakePrivate();  // The surface allows untracked writes.
+    return texture_->GetSurfaceLevel(Level, ppSurfaceLevel);
+  }
+  HRESULT WINAPI LockRect(UINT Level, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD Flags) override;
+  HRESULT WINAPI UnlockRect(UINT Level) override;
+  HRESULT WINAPI AddDirtyRect(CONST RECT* pDirtyRect) override { return texture_->AddDirtyRect(pDirtyRect); }
+
+ private:
+  struct LevelState {
+    ContentHash::Hash128 hash = {};
+    const BYTE* bits = nullptr;  // Written data while locked.
+    INT pitch = 0;
+    bool filled = false;
+  };
+
+  void Finalize();
+  void Unregister();
+  void MakePrivate();
+
+  IDirect3DTexture8* texture_;
+  UINT width_;
+  UINT height_;
+  D3DFORMAT format_;
+  DWORD usage_;
+  D3DPOOL pool_;
+  ULONG references_ = 1;
+  std::vector<LevelState> levels_;
+  bool finalized_ = false;  // All levels were filled and the texture was entered in the table.
+  bool private_ = false;    // Excluded from sharing (partial or surface writes, or rewritten).
+  Entry* entry_ = nullptr;  // Table entry of the texture in use (node pointers are stable).
+  Key key_ = {};
+};
+
+HRESULT TextureProxy::LockRect(UINT Level, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD Flags) {
+  bool write = !(Flags & D3DLOCK_READONLY) && Level < levels_.size();
+  if (write && finalized_) MakePrivate();
+  HRESULT result = texture_->LockRect(Level, pLockedRect, pRect, Flags);
+  if (write && SUCCEEDED(result)) {
+    if (pRect) private_ = true;  // Partial updates are not tracked.
+    levels_[Level].bits = static_cast<const BYTE*>(pLockedRect->pBits);
+    levels_[Level].pitch = pLockedRect->Pitch;
+  }
+  return result;
+}
+
+HRESULT TextureProxy::UnlockRect(UINT Level) {
+  if (Level < levels_.size() && levels_[Level].bits) {
+    LevelState& level = levels_[Level];
+    if (!private_ && !finalized_) {
+      UINT row_size = 0, rows = 0;
+      GetLevelLayout(format_, GetLevelSize(width_, Level), GetLevelSize(height_, Level), &row_size, &rows);
+      ContentHash::Hasher hasher;
+      for (UINT row = 0; row < rows; ++row) hasher.Update(level.bits + row * level.pitch, row_size);
+      level.hash = hasher.Finish();
+      level.filled = true;
+    }
+    level.bits = nullptr;
+  }
+  HRESULT result = texture_->UnlockRect(Level);
+  if (!private_ && !finalized_) {
+    bool filled = true;
+    for (const auto& level : levels_) filled &= level.filled;
+    if (filled) Finalize();
+  }
+  return result;
+}
+
+// Shares a resident texture with the same contents or enters this texture in the table.
+void TextureProxy::Finalize() {
+  finalized_ = true;
+  ContentHash::Hasher hasher;
+  for (const auto& level : levels_) hasher.Update(&level.hash, sizeof(level.hash));
+  key_ = {width_, height_, static_cast<UINT>(levels_.size()), format_, hasher.Finish()};
+
+  auto it = resident_.find(key_);
+  if (it != resident_.end() &&
+      !EqualLevels(texture_, it->second.texture, width_, height_, static_cast<UINT>(levels_.size()), format_)) {
+    Logger::Info("TextureDedup: Hash collision on a %u x %u texture, not shared", width_, height_);
+    return;  // Keeps its own texture outside the table.
+  }
+  if (it == resident_.end()) {
+    UINT size = 0;
+    for (UINT i = 0; i < levels_.size(); ++i) {
+      UINT row_size = 0, rows = 0;
+      GetLevelLayout(format_, GetLevelSize(width_, i), GetLevelSize(height_, i), &row_size, &rows);
+      size += row_size * rows;
+    }
+    texture_->AddRef();
+    entry_ = &resident_.emplace(key_, Entry{texture_, 1, size, cache_.end()}).first->second;
+    return;
+  }
+
+  entry_ = &it->second;
+  entry_->texture->AddRef();
+  texture_->Release();
+  texture_ = entry_->texture;
+  if (entry_->users++) {
+    ++shared_textures_;
+    saved_bytes_ += entry_->size;
+  } else {  // Revive a cached texture.
+    cache_.erase(entry_->cached);
+    entry_->cached = cache_.end();
+    cache_bytes_ -= entry_->size;
+    ++cache_hits_;
+  }
+}
+
+// Drops this proxy's use of the table entry.
+void TextureProxy::Unregister() {
+  if (!entry_) return;
+  Entry* entry = entry_;
+  entry_ = nullptr;
+  if (entry->users > 1) {
+    --shared_textures_;
+    saved_bytes_ -= entry->size;
+  }
+  if (--entry->users) return;
+  if (entry->size > cache_budget_) {
+    entry->texture->Release();
+    resident_.erase(key_);
+    return;
+  }
+  cache_.push_front(key_);
+  entry->cached = cache_.begin();
+  cache_bytes_ += entry->size;
+  TrimCache(cache_budget_);
+}
+
+// Gives the proxy its own texture, out of the table, ahead of a modification.
+void TextureProxy::MakePrivate() {
+  private_ = true;
+  if (!entry_) return;
+  if (entry_->users > 1) {
+    IDirect3DDevice8* device = nullptr;
+    IDirect3DTexture8* copy = nullptr;
+    UINT levels = static_cast<UINT>(levels_.size());
+    if (SUCCEEDED(texture_->GetDevice(&device))) {
+      HRESULT result = hook_CreateTexture_.original(D3DDeviceCreateTextureHook)(device, width_, height_, levels, usage_,
+                                                                                format_, pool_, &copy);
+      device->Release();
+      if (SUCCEEDED(result) && !CopyLevels(texture_, copy, width_, height_, levels, format_)) {
+        copy->Release();
+        copy = nullptr;
+      }
+    }
+    if (!copy) {
+      Logger::Error("TextureDedup: Failed to copy a shared texture");
+      return;  // Keep sharing, the modification will be visible to all users.
+    }
+    texture_->Release();
+    texture_ = copy;
+    Unregister();
+    return;
+  }
+
+  // The sole user keeps the texture, which leaves the table so it is never shared or cached again.
+  entry_->texture->Release();  // The table's reference.
+  resident_.erase(key_);
+  entry_ = nullptr;
+}
+
+bool IsEligible(UINT width, UINT height, DWORD usage, D3DFORMAT format, D3DPOOL pool) {
+  UINT row_size = 0, rows = 0;
+  return enabled_ && usage == 0 && pool == D3DPOOL_MANAGED && GetLevelLayout(format, width, height, &row_size, &rows);
+}
+
+HRESULT WINAPI D3DDeviceCreateTextureHook(IDirect3DDevice8* Device, UINT Width, UINT Height, UINT Levels,
+                                          DWORD Usage, D3DFORMAT Format, D3DPOOL Pool,
+                                          IDirect3DTexture8** ppTexture) {
+  HRESULT result = hook_CreateTexture_.original(D3DDeviceCreateTextureHook)(Device, Width, Height, Levels, Usage,
+                                                                            Format, Pool, ppTexture);
+  if (SUCCEEDED(result) && ppTexture && IsEligible(Width, Height, Usage, Format, Pool))
+    *ppTexture = new TextureProxy(*ppTexture, Width, Height, Format, Usage, Pool);
+  return result;
+}
+
+HRESULT WINAPI D3DDeviceSetTextureHook(IDirect3DDevice8* Device, DWORD Stage, IDirect3DBaseTexture8* pTexture) {
+  if (pTexture && *reinterpret_cast<void**>(pTexture) == proxy_vtable_)
+    pTexture = static_cast<TextureProxy*>(static_cast<IDirect3DTexture8*>(pTexture))->texture();
+  return hook_SetTexture_.original(D3DDeviceSetTextureHook)(Device, Stage, pTexture);
+}
+
+}  // namespace
+}  // namespace TextureDedupInt
+
+void TextureDedup::Initialize(const std::filesystem::path& ini_file) {
+  using namespace TextureDedupInt;
+  enabled_ = Ini::GetValue<bool>("EqwGeneral", "DeduplicateTextures", false, ini_file.string().c_str());
+  int cache_mb = Ini::GetValue<int>("EqwGeneral", "TextureCacheMB", 0, ini_file.string().c_str());
+  cache_budget_ = (cache_mb > 0) ? static_cast<unsigned long long>(cache_mb) << 20 : 0;
+  enabled_ = enabled_ || cache_budget_;  // The cache is built on the dedup table.
+  if (enabled_) Logger::Info("TextureDedup: Enabled with a %d MB cache", (cache_mb > 0) ? cache_mb : 0);
+}
+
+void TextureDedup::InstallHooks(IDirect3DDevice8* device) {
+  using namespace TextureDedupInt;
+  if (!enabled_) return;
+
+  void** vtable = *(void***)device;
+  if (vtable == device_vtable_) return;  // Re-hooking the slots shared with TextureCompress would cycle.
+  device_vtable_ = vtable;
+  hook_CreateTexture_ = VTableHook(vtable, 20, D3DDeviceCreateTextureHook, false);
+  hook_SetTexture_ = VTableHook(vtable, 61, D3DDeviceSetTextureHook, false);
+}
+
+void TextureDedup::OnPresent() {
+  using namespace TextureDedupInt;
+  if (!cache_bytes_ || ++frames_ % kPressureCheckFrames) return;
+
+  MEMORYSTATUSEX status = {sizeof(status)};
+  if (!::GlobalMemoryStatusEx(&status) || status.ullAvailVirtual >= kMinFreeAddressSpace) return;
+  Logger::Info("TextureDedup: Low address space (%u MB free), trimming the cache",
+               static_cast<unsigned int>(status.ullAvailVirtual >> 20));
+  TrimCache(cache_bytes_ / 2);
+}
+
+void TextureDedup::Flush() {
+  using namespace TextureDedupInt;
+  if (!enabled_) return;
+  if (cache_bytes_ || cache_hits_)
+    Logger::Info("TextureDedup: Flushing %u KB of cached textures (%u cache hits)",
+                 static_cast<unsigned int>(cache_bytes_ / 1024), cache_hits_);
+  TrimCache(0);
+  cache_hits_ = 0;
+}
+
+unsigned int TextureDedup::GetSharedTextures() { return TextureDedupInt::shared_textures_; }
+
+unsigned int TextureDedup::GetSavedKilobytes() {
+  return static_cast<unsigned int>(TextureDedupInt::saved_bytes_ / 1024);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <windows.h>
+
+#include <filesystem>
+
+#include "d3dx8/d3d8.h"
+
+// Optional (ini file setting) sharing of managed textures with byte-identical contents.
+//
+// Eligible textures are returned to the game wrapped in a reference counted proxy that forwards
+// to the real texture. Each level is hashed (ContentHash) at its first unlock, and once every
+// level has been filled the proxy looks up the combined hash in a table of resident textures. On a
+// match the proxy releases its own texture and shares the resident one. The SetTexture() hook
+// binds the proxy's current texture. A later write lock or surface access of a shared texture
+// first gives the proxy a private copy (copy on write).
+//
+// An optional residency cache keeps the table entries of released textures alive, up to a memory
+// budget in least recently used order, so a texture that is re-created with the same contents
+// (e.g. after zoning back into a zone) reuses the texture that is already resident. The cache is
+// trimmed when the process runs low on address space and flushed before a device Reset().
+
+namespace TextureDedup {
+
+void Initialize(const std::filesystem::path& ini_file);  // Reads the enable and cache settings.
+
+// Installs the texture creation and binding hooks. Call after each primary device creation and
+// after the other texture hooks so the binding hook sees the proxies first.
+void InstallHooks(IDirect3DDevice8* device);
+
+// Trims the residency cache under address space pressure. Call once per frame.
+void OnPresent();
+
+// Releases all cached textures. Call before a Reset() and the final device Release().
+void Flush();
+
+unsigned int GetSharedTextures();  // Textures currently using another texture's copy.
+unsigned int GetSavedKilobytes();  // Texture memory currently saved by the sharing.
+
+}  // namespace TextureDedup
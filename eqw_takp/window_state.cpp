@@ -0,0 +1,70 @@
+#include "window_state.h"
+
+#include "seqlock.h"
+
+namespace WindowStateInt {
+namespace {
+
+const long* const g_screen_res_x = (long*)0x00798564;  // Game resolution globals.
+const long* const g_screen_res_y = (long*)0x00798568;
+
+SeqLock<WindowState::Snapshot> snapshot_;
+SRWLOCK writer_lock_ = SRWLOCK_INIT;  // Serializes the (rare) writers.
+
+static constexpr DWORD kDwmwaCloaked = 14;  // DWMWA_CLOAKED (Windows 8+).
+using DwmGetWindowAttributeFn = HRESULT(WINAPI*)(HWND, DWORD, PVOID, DWORD);
+
+// Loaded dynamically so the dll does not depend on dwmapi.dll.
+DwmGetWindowAttributeFn LoadDwmGetWindowAttribute() {
+  HMODULE dwmapi = ::LoadLibraryA("dwmapi.dll");
+  return dwmapi ? reinterpret_cast<DwmGetWindowAttributeFn>(::GetProcAddress(dwmapi, "DwmGetWindowAttribute"))
+                : nullptr;
+}
+
+// Returns true if no part of the client area can be seen. Windows covered by other windows only
+// report an empty clip box without desktop composition, which instead cloaks windows on other
+// virtual desktops.
+bool IsOccluded(HWND hwnd, const WindowState::Snapshot& snapshot) {
+  if (snapshot.iconic || !snapshot.visible) return true;
+
+  static const DwmGetWindowAttributeFn dwm_get_window_attribute = LoadDwmGetWindowAttribute();
+  DWORD cloaked = 0;
+  if (dwm_get_window_attribute &&
+      SUCCEEDED(dwm_get_window_attribute(hwnd, kDwmwaCloaked, &cloaked, sizeof(cloaked))) && cloaked)
+    return true;
+
+  HDC hdc = ::GetDC(hwnd);
+  if (!hdc) return false;
+  RECT clip_box;
+  bool empty = (::GetClipBox(hdc, &clip_box) == NULLREGION);
+  ::ReleaseDC(hwnd, hdc);
+  return empty;
+}
+
+void Publish(HWND hwnd, int foreground) {
+  WindowState::Snapshot snapshot = {};
+  POINT offset = {0, 0};
+  RECT rect = {0, 0, 0, 0};
+  if (::ClientToScreen(hwnd, &offset) && ::GetClientRect(hwnd, &rect)) {
+    snapshot.client_rect = {rect.left + offset.x, rect.top + offset.y, rect.right + offset.x, rect.bottom + offset.y};
+  }
+  snapshot.foreground = (foreground < 0) ? (::GetForegroundWindow() == hwnd) : (foreground != 0);
+  snapshot.iconic = ::IsIconic(hwnd);
+  snapshot.visible = ::IsWindowVisible(hwnd);
+  snapshot.occluded = IsOccluded(hwnd, snapshot);
+  snapshot.game_width = max(*g_screen_res_x, 640);
+  snapshot.game_height = max(*g_screen_res_y, 480);
+
+  ::AcquireSRWLockExclusive(&writer_lock_);
+  snapshot_.Store(snapshot);
+  ::ReleaseSRWLockExclusive(&writer_lock_);
+}
+
+}  // namespace
+}  // namespace WindowStateInt
+
+void WindowState::Update(HWND hwnd) { WindowStateInt::Publish(hwnd, -1); }
+
+void WindowState::Update(HWND hwnd, bool foreground) { WindowStateInt::Publish(hwnd, foreground ? 1 : 0); }
+
+WindowState::Snapshot WindowState::Get() { return WindowStateInt::snapshot_.Load(); }
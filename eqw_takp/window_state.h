@@ -0,0 +1,36 @@
+#pragma once
+#include <windows.h>
+
+// Publishes the game window geometry and focus state from the window thread so the per-frame
+// game thread hooks can read a consistent copy without any Win32 calls.
+//
+// The snapshot is refreshed by GameWndProc on the window position, activation, and display
+// change messages (and when the window is handed back from eqmain). Covering windows do not
+// send any messages, so GameWndProc also polls while the window is in the background.
+
+namespace WindowState {
+
+struct Snapshot {
+  RECT client_rect;  // Client area in screen coordinates.
+  bool foreground;   // Game window is the foreground window.
+  bool iconic;
+  bool visible;
+  bool occluded;  // No part of the client area can be seen (minimized, cloaked, or fully covered).
+
+  int game_width;  // Game resolution.
+  int game_height;
+
+  int client_width() const { return client_rect.right - client_rect.left; }
+  int client_height() const { return client_rect.bottom - client_rect.top; }
+};
+
+// Queries the window and publishes a new snapshot. Safe to call from any thread.
+void Update(HWND hwnd);
+
+// Variant for the activation messages where the new foreground state is known.
+void Update(HWND hwnd, bool foreground);
+
+// Returns the last published snapshot. Does not make any system calls.
+Snapshot Get();
+
+}  // namespace WindowState
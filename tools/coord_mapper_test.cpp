@@ -0,0 +1,147 @@
+// Checks and measures the eqw cursor coordinate mapper (coord_mapper.cpp).
+//
+// Portable (no Windows dependencies) so it runs on any workstation:
+//   g++ -std=c++17 -O2 -I../eqw_takp -o coord_mapper_test coord_mapper_test.cpp ../eqw_takp/coord_mapper.cpp
+//   ./coord_mapper_test [samples]
+//
+// The tests compare the mapping against the exact rational result for a range of client and game
+// sizes and check that round trips do not drift. The benchmark moves a random walk of mouse samples
+// (10 million by default) through the mapper and reports the cost per sample next to the plain
+// multiply-then-divide it replaced. The exit code is non-zero if a test fails.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "coord_mapper.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                      \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                             \
+    }                                                                         \
+  } while (0)
+
+int64_t FloorDiv(int64_t a, int64_t b) { return (a >= 0) ? a / b : -((-a + b - 1) / b); }
+int64_t CeilDiv(int64_t a, int64_t b) { return -FloorDiv(-a, b); }
+
+uint32_t Random(uint32_t& seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// Client and game sizes seen in practice: window scaling, dpi scaling and odd sizes.
+const int kSizes[][2] = {{640, 640},   {1024, 640},  {640, 1024},  {1920, 1280}, {2560, 1920}, {1366, 1024},
+                         {3840, 1600}, {1279, 1280}, {1281, 1280}, {7, 3},       {3, 7},       {1, 4096}};
+
+void TestExact() {
+  for (const auto& size : kSizes) {
+    CoordMapper::Axis axis;
+    axis.Configure(size[0], size[1]);
+    CHECK(axis.is_scaled() == (size[0] != size[1]));
+    for (int client = -2 * size[0]; client <= 2 * size[0]; ++client) {
+      int game = axis.ToGame(client);
+      CHECK(game == FloorDiv(static_cast<int64_t>(client) * size[1], size[0]));
+      if (game != FloorDiv(static_cast<int64_t>(client) * size[1], size[0])) break;
+    }
+    for (int game = -2 * size[1]; game <= 2 * size[1]; ++game) {
+      int client = axis.ToClient(game);
+      CHECK(client == CeilDiv(static_cast<int64_t>(game) * size[0], size[1]));
+      CHECK(axis.ToGame(client) == game || size[0] < size[1]);  // Exact inverse when not upscaling.
+      if (client != CeilDiv(static_cast<int64_t>(game) * size[0], size[1])) break;
+    }
+  }
+}
+
+void TestRoundTrip() {
+  uint32_t seed = 1;
+  for (const auto& size : kSizes) {
+    CoordMapper::Axis axis;
+    axis.Configure(size[0], size[1]);
+    for (int i = 0; i < 100000; ++i) {
+      int client = static_cast<int>(Random(seed) % (3 * size[0])) - size[0];
+      int game = axis.ToGame(client);
+      CHECK(axis.ToClient(game) == client);  // The last mapped pair carries the sub-pixel position.
+      CHECK(axis.ToGame(axis.ToClient(game)) == game);
+    }
+
+    // Repeated game to client to game updates (the per-frame cursor sync) never drift.
+    int game = size[1] / 3;
+    for (int i = 0; i < 1000; ++i) game = axis.ToGame(axis.ToClient(game));
+    CHECK(game == size[1] / 3);
+  }
+}
+
+void TestConfigure() {
+  CoordMapper mapper;
+  mapper.Configure(0, -5, 640, 480);  // Minimized windows report a zero size.
+  CHECK(mapper.is_scaled());
+  CHECK(mapper.x().ToGame(1) == 640);
+
+  mapper.Configure(800, 600, 800, 600);
+  CHECK(!mapper.is_scaled());
+  CHECK(mapper.x().ToGame(123) == 123 && mapper.y().ToClient(-7) == -7);
+
+  mapper.Configure(1600, 1200, 800, 600);
+  CHECK(mapper.x().ToGame(1599) == 799);
+  mapper.Configure(1600, 1200, 800, 600);  // Unchanged sizes keep the anchor.
+  CHECK(mapper.x().ToClient(799) == 1599);
+  mapper.Configure(1600, 1201, 800, 600);  // The x axis is unchanged.
+  CHECK(mapper.x().ToClient(799) == 1599);
+  mapper.Configure(1602, 1200, 800, 600);
+  CHECK(mapper.x().ToClient(799) == 1600);  // Resized, so mapped exactly again.
+}
+
+template <typename Function>
+double MeasureNs(const std::vector<int>& samples, Function function) {
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  int64_t sum = 0;
+  for (int sample : samples) sum += function(sample);
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  if (sum == 0x7fffffff) printf(" ");  // Keeps the loop from being optimized away.
+  return seconds * 1e9 / samples.size();
+}
+
+void Bench(int sample_count) {
+  const int client_size = 2560, game_size = 1920;
+  std::vector<int> samples(sample_count);
+  uint32_t seed = 7;
+  int position = client_size / 2;
+  for (int& sample : samples) {  // Small high-dpi mouse steps with occasional jumps.
+    position += static_cast<int>(Random(seed) % 9) - 4;
+    if (Random(seed) % 1000 == 0) position = static_cast<int>(Random(seed) % client_size);
+    position = (position < 0) ? 0 : ((position >= client_size) ? client_size - 1 : position);
+    sample = position;
+  }
+
+  CoordMapper::Axis axis;
+  axis.Configure(client_size, game_size);
+  volatile int scale = game_size;  // Keeps the reference division from being strength reduced.
+  double naive = MeasureNs(samples, [&](int client) { return client * scale / client_size; });
+  double to_game = MeasureNs(samples, [&](int client) { return axis.ToGame(client); });
+  double round_trip = MeasureNs(samples, [&](int client) { return axis.ToClient(axis.ToGame(client)); });
+  printf("%d samples  mul/div %5.2f ns  ToGame %5.2f ns  round trip %5.2f ns\n", sample_count, naive, to_game,
+         round_trip);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  TestExact();
+  TestRoundTrip();
+  TestConfigure();
+  printf("Tests: %s\n", failures ? "FAILED" : "passed");
+
+  int samples = (argc > 1) ? atoi(argv[1]) : 10000000;
+  if (samples > 0) Bench(samples);
+  return failures ? 1 : 0;
+}
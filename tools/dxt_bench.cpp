@@ -0,0 +1,175 @@
+// Measures the quality and throughput of the eqw DXT1/DXT5 texture encoder (dxt_codec.cpp).
+//
+// Portable (no Windows dependencies) so it runs on any workstation:
+//   g++ -std=c++17 -O2 -I../eqw_takp -o dxt_bench dxt_bench.cpp ../eqw_takp/dxt_codec.cpp
+//   ./dxt_bench [image.bmp ...]
+// Add -DDXT_CODEC_SCALAR to measure the scalar fallback (the output is identical).
+//
+// Without arguments a set of synthetic 256x256 images is used. Uncompressed 24 or 32-bit BMP files
+// (for example textures exported from the game's s3d archives) can be passed instead. The quality
+// is reported as the PSNR of the decoded color (and alpha for DXT5) against the source.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "dxt_codec.h"
+
+namespace {
+
+static constexpr double kMinBenchSeconds = 0.25;  // Encode repeats until at least this long.
+
+struct Image {
+  std::string name;
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;  // B, G, R, A.
+};
+
+Image MakeImage(const char* name, int size, uint32_t (*pixel)(int x, int y, uint32_t& seed)) {
+  Image image = {name, size, size, std::vector<uint8_t>(static_cast<size_t>(size) * size * 4)};
+  uint32_t seed = 12345;
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      uint32_t value = pixel(x, y, seed);
+      memcpy(&image.pixels[(static_cast<size_t>(y) * size + x) * 4], &value, 4);
+    }
+  }
+  return image;
+}
+
+uint32_t Random(uint32_t& seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+std::vector<Image> MakeSyntheticImages() {
+  std::vector<Image> images;
+  images.push_back(MakeImage("gradient", 256, [](int x, int y, uint32_t&) -> uint32_t {
+    return 0xff000000u | (x << 16) | (y << 8) | ((x + y) / 2);
+  }));
+  images.push_back(MakeImage("noisy_terrain", 256, [](int x, int y, uint32_t& seed) -> uint32_t {
+    int base = 96 + static_cast<int>(40 * std::sin(x * 0.05) * std::cos(y * 0.07));
+    int noise = static_cast<int>(Random(seed) % 24);
+    int g = base + noise, r = base * 3 / 4 + noise, b = base / 2 + noise / 2;
+    return 0xff000000u | (r << 16) | (g << 8) | b;
+  }));
+  images.push_back(MakeImage("hard_edges", 256, [](int x, int y, uint32_t&) -> uint32_t {
+    bool on = ((x / 8) ^ (y / 8)) & 1;
+    return on ? 0xffe0c040u : 0xff203080u;
+  }));
+  images.push_back(MakeImage("alpha_foliage", 256, [](int x, int y, uint32_t& seed) -> uint32_t {
+    int dx = (x % 64) - 32, dy = (y % 64) - 32;
+    int alpha = (dx * dx + dy * dy < 700) ? 255 : ((dx * dx + dy * dy < 900) ? 128 : 0);
+    int g = 100 + static_cast<int>(Random(seed) % 80);
+    return (static_cast<uint32_t>(alpha) << 24) | (40 << 16) | (g << 8) | 30;
+  }));
+  return images;
+}
+
+uint32_t Read32(const std::vector<uint8_t>& data, size_t offset) {
+  return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) |
+         (static_cast<uint32_t>(data[offset + 3]) << 24);
+}
+
+// Loads an uncompressed 24 or 32-bit BMP. Returns false on any other format.
+bool LoadBmp(const char* filename, Image* image) {
+  std::ifstream file(filename, std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (data.size() < 54 || data[0] != 'B' || data[1] != 'M') return false;
+  uint32_t offset = Read32(data, 10);
+  int width = static_cast<int>(Read32(data, 18));
+  int height = static_cast<int>(Read32(data, 22));
+  int bits = data[28] | (data[29] << 8);
+  uint32_t compression = Read32(data, 30);
+  bool bottom_up = height > 0;
+  if (!bottom_up) height = -height;
+  if ((bits != 24 && bits != 32) || compression != 0 || width <= 0 || height <= 0) return false;
+
+  size_t row_size = (static_cast<size_t>(width) * (bits / 8) + 3) & ~static_cast<size_t>(3);
+  if (data.size() < offset + row_size * height) return false;
+  image->name = filename;
+  image->width = width;
+  image->height = height;
+  image->pixels.resize(static_cast<size_t>(width) * height * 4);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t* row = data.data() + offset + row_size * (bottom_up ? height - 1 - y : y);
+    for (int x = 0; x < width; ++x) {
+      uint8_t* pixel = &image->pixels[(static_cast<size_t>(y) * width + x) * 4];
+      memcpy(pixel, row + x * (bits / 8), 3);
+      pixel[3] = (bits == 32) ? row[x * 4 + 3] : 0xff;
+    }
+  }
+  return true;
+}
+
+double Psnr(double squared_error, size_t samples) {
+  if (squared_error == 0) return 99.99;
+  double mse = squared_error / samples;
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+void Bench(const Image& image, DxtCodec::BlockFormat format) {
+  const DxtCodec::SourceFormat source_format = DxtCodec::SourceFormat::kArgb8888;
+  const int pitch = image.width * 4;
+  std::vector<uint8_t> blocks(DxtCodec::GetEncodedSize(format, image.width, image.height));
+
+  using Clock = std::chrono::steady_clock;
+  int iterations = 0;
+  auto start = Clock::now();
+  double seconds = 0;
+  do {
+    DxtCodec::EncodeImage(source_format, image.pixels.data(), pitch, image.width, image.height, format, blocks.data());
+    ++iterations;
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (seconds < kMinBenchSeconds);
+  double megapixels = static_cast<double>(image.width) * image.height * iterations / 1e6;
+
+  std::vector<uint8_t> decoded(image.pixels.size());
+  DxtCodec::DecodeImage(format, blocks.data(), image.width, image.height, source_format, decoded.data(), pitch);
+  double color_error = 0, alpha_error = 0;
+  for (size_t i = 0; i < decoded.size(); ++i) {
+    double diff = static_cast<double>(decoded[i]) - image.pixels[i];
+    ((i & 3) == 3 ? alpha_error : color_error) += diff * diff;
+  }
+  size_t pixels = static_cast<size_t>(image.width) * image.height;
+  bool dxt5 = format == DxtCodec::BlockFormat::kDxt5;
+  printf("%-24s %4s %6.2f dB", image.name.c_str(), dxt5 ? "DXT5" : "DXT1", Psnr(color_error, pixels * 3));
+  if (dxt5)
+    printf("  alpha %6.2f dB", Psnr(alpha_error, pixels));
+  else
+    printf("  %15s", "");
+  printf("  %8.1f Mpixel/s\n", megapixels / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<Image> images;
+  if (argc < 2) {
+    images = MakeSyntheticImages();
+  } else {
+    for (int i = 1; i < argc; ++i) {
+      Image image;
+      if (!LoadBmp(argv[i], &image)) {
+        fprintf(stderr, "Unsupported or missing BMP file: %s\n", argv[i]);
+        return 1;
+      }
+      images.push_back(std::move(image));
+    }
+  }
+
+  printf("%-24s %4s %9s  %15s  %17s\n", "image", "fmt", "color", "alpha", "encode");
+  for (const Image& image : images) {
+    Bench(image, DxtCodec::BlockFormat::kDxt1);
+    Bench(image, DxtCodec::BlockFormat::kDxt5);
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Converts an eqw_flight.bin dump written by the eqw flight recorder back into log text.
+//
+// Portable (no Windows dependencies) so dumps can be decoded on any workstation:
+//   g++ -std=c++17 -O2 -I../eqw_takp -o flight_decode flight_decode.cpp ../eqw_takp/log_packer.cpp
+//   ./flight_decode eqw_flight.bin > eqw_flight.txt
+//
+// The timestamps are in seconds relative to the oldest entry in the dump. The final line
+// reports the age of the newest entry at the time of the dump.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "log_packer.h"
+
+namespace {
+
+static constexpr char kMagic[8] = "EQWFR01";
+
+// Minimal little endian reader over the dump contents.
+class Reader {
+ public:
+  explicit Reader(const std::vector<uint8_t>& data) : data_(data) {}
+
+  template <typename T>
+  bool Get(T& value) {
+    return Bytes(&value, sizeof(value));
+  }
+
+  bool Bytes(void* output, size_t size) {
+    if (data_.size() - offset_ < size) return false;
+    memcpy(output, data_.data() + offset_, size);
+    offset_ += size;
+    return true;
+  }
+
+ private:
+  const std::vector<uint8_t>& data_;
+  size_t offset_ = 0;
+};
+
+const char* LevelPrefix(uint8_t level) {
+  switch (level) {
+    case 1:
+      return "Error: ";
+    case 3:
+      return "Debug: ";
+    default:
+      return "";
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s eqw_flight.bin\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream file(argv[1], std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Unable to open %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  Reader reader(data);
+  char magic[sizeof(kMagic)];
+  uint32_t count = 0;
+  int64_t frequency = 0, dump_time = 0;
+  if (!reader.Bytes(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(kMagic)) || !reader.Get(count) ||
+      !reader.Get(frequency) || !reader.Get(dump_time) || frequency <= 0) {
+    fprintf(stderr, "%s is not a flight recorder dump\n", argv[1]);
+    return 1;
+  }
+
+  double seconds_per_tick = 1.0 / static_cast<double>(frequency);
+  int64_t first_time = 0, last_time = 0;
+  uint32_t last_sequence = 0;
+  std::string format;
+  std::vector<uint8_t> packed;
+  static char line[4096];
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t sequence = 0, thread_id = 0;
+    int64_t timestamp = 0;
+    uint8_t level = 0;
+    uint16_t format_length = 0, packed_size = 0;
+    if (!reader.Get(sequence) || !reader.Get(timestamp) || !reader.Get(thread_id) || !reader.Get(level) ||
+        !reader.Get(format_length)) {
+      fprintf(stderr, "Truncated dump at entry %u\n", i);
+      return 1;
+    }
+    format.resize(format_length);
+    if (!reader.Bytes(format.data(), format_length) || !reader.Get(packed_size)) {
+      fprintf(stderr, "Truncated dump at entry %u\n", i);
+      return 1;
+    }
+    packed.resize(packed_size);
+    if (!reader.Bytes(packed.data(), packed_size)) {
+      fprintf(stderr, "Truncated dump at entry %u\n", i);
+      return 1;
+    }
+
+    if (i == 0) first_time = timestamp;
+    if (i && sequence != last_sequence + 1) printf("... %u entries missing ...\n", sequence - last_sequence - 1);
+    last_sequence = sequence;
+    last_time = timestamp;
+
+    LogPacker::Format(format.c_str(), packed.data(), packed.size(), line, sizeof(line));
+    printf("[%10.4f %5u] %s%s\n", (timestamp - first_time) * seconds_per_tick, thread_id, LevelPrefix(level), line);
+  }
+  if (count) printf("Dump written %.4f seconds after the last entry\n", (dump_time - last_time) * seconds_per_tick);
+  return 0;
+}
@@ -0,0 +1,204 @@
+// Checks and measures the eqw INI parser (ini_document.cpp) used by the Ini cache.
+//
+// Portable (no Windows dependencies) so it runs on any workstation:
+//   g++ -std=c++17 -O2 -I../eqw_takp -o ini_test ini_test.cpp ../eqw_takp/ini_document.cpp
+//   ./ini_test [file.ini ...]
+//
+// The tests cover the GetPrivateProfileString() lookup conventions and the format-preserving round
+// trip. The benchmark parses, queries and serializes a large synthetic file (and any files passed
+// as arguments) and reports the throughput. The exit code is non-zero if a test fails.
+
+#include <stdio.h>
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ini_document.h"
+
+namespace {
+
+static constexpr double kMinBenchSeconds = 0.25;  // Each pass repeats until at least this long.
+
+int failures = 0;
+
+#define CHECK(condition)                                                      \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                             \
+    }                                                                         \
+  } while (0)
+
+std::string GetValue(const IniDocument& document, const char* section, const char* key) {
+  std::string value;
+  return document.Get(section, key, &value) ? value : "<missing>";
+}
+
+void TestLookups() {
+  IniDocument document;
+  document.Parse(
+      "; leading comment\r\n"
+      "[Defaults]\r\n"
+      "  Width = 1024  \r\n"
+      "Quoted=\"  spaced  \"\r\n"
+      "Single='x'\r\n"
+      ";Commented=1\r\n"
+      "Dup=first\r\n"
+      "dup=second\r\n"
+      "Empty=\r\n"
+      "[defaults]\r\n"
+      "Height=768\r\n"
+      "[ Other ]\r\n"
+      "Key=a=b\r\n");
+
+  CHECK(GetValue(document, "Defaults", "Width") == "1024");
+  CHECK(GetValue(document, "DEFAULTS", " width ") == "1024");
+  CHECK(GetValue(document, "Defaults", "Quoted") == "  spaced  ");
+  CHECK(GetValue(document, "Defaults", "Single") == "x");
+  CHECK(GetValue(document, "Defaults", "Commented") == "<missing>");
+  CHECK(GetValue(document, "Defaults", "DUP") == "first");
+  CHECK(GetValue(document, "Defaults", "Empty").empty());
+  CHECK(GetValue(document, "Defaults", "Height") == "<missing>");  // Only the first section matches.
+  CHECK(GetValue(document, "Other", "Key") == "a=b");
+  CHECK(document.HasSection("other"));
+  CHECK(!document.HasSection("Missing"));
+  CHECK(document.GetSectionNames() == std::vector<std::string>({"Defaults", "defaults", "Other"}));
+  CHECK(document.GetKeyNames("Defaults") ==
+        std::vector<std::string>({"Width", "Quoted", "Single", "Dup", "dup", "Empty"}));
+}
+
+void TestRoundTrip() {
+  const std::string text =
+      "\xEF\xBB\xBF; comment\n"
+      "\n"
+      "[Section]\n"
+      "  Key  =  Value ; not a comment\n"
+      "\tTabbed\t=\t1\n"
+      "NoEquals\n"
+      "\n"
+      "[Next]\n"
+      "A=1";
+  IniDocument document;
+  document.Parse(text);
+  CHECK(document.Serialize() == text);  // Unmodified text, BOM and missing final newline survive.
+  CHECK(GetValue(document, "Section", "Key") == "Value ; not a comment");
+  CHECK(document.GetSectionLines("Section") ==
+        std::vector<std::string>({"Key  =  Value ; not a comment", "Tabbed\t=\t1", "NoEquals"}));
+
+  document.Set("Section", "key", "New");
+  document.Set("Section", "Added", "2");
+  document.Set("Next", "A", "3");
+  CHECK(document.Serialize() ==
+        "\xEF\xBB\xBF; comment\n"
+        "\n"
+        "[Section]\n"
+        "  Key  =  New\n"
+        "\tTabbed\t=\t1\n"
+        "Added=2\n"
+        "NoEquals\n"
+        "\n"
+        "[Next]\n"
+        "A=3");
+}
+
+void TestEdits() {
+  IniDocument document;
+  document.Parse("[A]\r\nX=1\r\n\r\n[B]\r\nY=2\r\n[a]\r\nZ=3\r\n");
+
+  document.Set("New", "K", "v");
+  CHECK(GetValue(document, "new", "k") == "v");
+  CHECK(document.Serialize() == "[A]\r\nX=1\r\n\r\n[B]\r\nY=2\r\n[a]\r\nZ=3\r\n\r\n[New]\r\nK=v\r\n");
+
+  CHECK(document.DeleteKey("B", "y"));
+  CHECK(!document.DeleteKey("B", "y"));
+  CHECK(GetValue(document, "B", "Y") == "<missing>");
+
+  CHECK(document.DeleteSection("A"));
+  CHECK(GetValue(document, "A", "Z") == "3");  // The later duplicate is promoted like a re-parse.
+  CHECK(!document.DeleteSection("Missing"));
+
+  IniDocument reparsed;
+  reparsed.Parse(document.Serialize());
+  CHECK(reparsed.Serialize() == document.Serialize());
+  CHECK(GetValue(reparsed, "A", "Z") == "3");
+
+  IniDocument empty;
+  empty.Parse("");
+  empty.Set("S", "K", "V");
+  CHECK(empty.Serialize() == "[S]\r\nK=V\r\n");
+}
+
+// Builds a file of the given number of sections with eqclient.ini style keys.
+std::string MakeLargeIni(int sections, int keys) {
+  std::string text = "; Synthetic benchmark file\r\n";
+  for (int s = 0; s < sections; ++s) {
+    text += "[Section" + std::to_string(s) + "]\r\n";
+    for (int k = 0; k < keys; ++k)
+      text += "Key" + std::to_string(k) + "=" + std::to_string(s * 1000 + k) + "\r\n";
+    text += "\r\n";
+  }
+  return text;
+}
+
+template <typename Function>
+double MeasureSeconds(Function function, int* iterations) {
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  double seconds = 0;
+  *iterations = 0;
+  do {
+    function();
+    ++*iterations;
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (seconds < kMinBenchSeconds);
+  return seconds / *iterations;
+}
+
+void Bench(const char* name, const std::string& text) {
+  IniDocument document;
+  int iterations = 0;
+  double parse = MeasureSeconds([&]() { document.Parse(text); }, &iterations);
+
+  std::vector<std::string> sections = document.GetSectionNames();
+  std::vector<std::pair<std::string, std::string>> lookups;
+  for (const std::string& section : sections)
+    for (const std::string& key : document.GetKeyNames(section)) lookups.emplace_back(section, key);
+  std::string value;
+  size_t found = 0;
+  double lookup = lookups.empty() ? 0 : MeasureSeconds([&]() {
+    for (const auto& entry : lookups) found += document.Get(entry.first, entry.second, &value);
+  }, &iterations);
+
+  std::string serialized;
+  double serialize = MeasureSeconds([&]() { serialized = document.Serialize(); }, &iterations);
+  CHECK(serialized == text);
+
+  double megabytes = text.size() / 1e6;
+  printf("%-24s %8.2f MB %8zu keys  parse %8.1f MB/s  get %7.1f ns  serialize %8.1f MB/s\n", name, megabytes,
+         lookups.size(), megabytes / parse, lookups.empty() ? 0.0 : lookup * 1e9 / lookups.size(),
+         megabytes / serialize);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  TestLookups();
+  TestRoundTrip();
+  TestEdits();
+  printf("Tests: %s\n", failures ? "FAILED" : "passed");
+
+  Bench("synthetic_2k_sections", MakeLargeIni(2000, 50));
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream file(argv[i], std::ios::binary);
+    if (!file) {
+      fprintf(stderr, "Missing INI file: %s\n", argv[i]);
+      return 1;
+    }
+    Bench(argv[i], std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()));
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+// Checks the eqw Raw Input backend core (raw_input_core.cpp) with synthetic report streams.
+//
+// Portable (no Windows dependencies) so it runs on any workstation:
+//   g++ -std=c++17 -O2 -I../eqw_takp -o raw_input_test raw_input_test.cpp ../eqw_takp/raw_input_core.cpp
+//   ./raw_input_test
+//
+// The tests feed keyboard make codes (with the E0 / E1 prefixes, fake shifts, Pause and key
+// repeats), relative and absolute mouse reports, and mixed motion and button sequences, and check
+// the DirectInput style state and buffered events the client reads. The exit code is non-zero on
+// failure.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "raw_input_core.h"
+
+namespace {
+
+using RawInputCore::Event;
+using RawInputCore::MouseReport;
+using RawInputCore::MouseState;
+
+static constexpr uint16_t kButton0Down = 0x0001;  // RI_MOUSE_LEFT_BUTTON_DOWN.
+static constexpr uint16_t kButton0Up = 0x0002;
+static constexpr uint16_t kButton1Down = 0x0004;  // RI_MOUSE_RIGHT_BUTTON_DOWN.
+static constexpr uint16_t kButton1Up = 0x0008;
+static constexpr uint32_t kDown = 0x80;
+
+int failures = 0;
+
+#define CHECK(condition)                                                      \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                             \
+    }                                                                         \
+  } while (0)
+
+// An event without the timestamp and sequence, for comparisons.
+struct Entry {
+  uint32_t offset;
+  int32_t data;
+
+  bool operator==(const Entry& other) const { return offset == other.offset && data == other.data; }
+};
+
+using Entries = std::vector<Entry>;
+
+template <typename Device>
+std::vector<Event> ReadAll(Device& device) {
+  std::vector<Event> events(1024);
+  events.resize(device.ReadEvents(events.data(), events.size()));
+  return events;
+}
+
+Entries ToEntries(const std::vector<Event>& events) {
+  Entries entries;
+  for (const Event& event : events) entries.push_back({event.offset, static_cast<int32_t>(event.data)});
+  return entries;
+}
+
+bool IsOrdered(const std::vector<Event>& events) {
+  for (size_t i = 1; i < events.size(); ++i)
+    if (events[i].sequence < events[i - 1].sequence) return false;
+  return true;
+}
+
+MouseReport Move(int32_t x, int32_t y, uint16_t button_flags = 0) { return {0, button_flags, 0, x, y}; }
+
+MouseReport MoveTo(int32_t x, int32_t y) { return {RawInputCore::kMouseMoveAbsolute, 0, 0, x, y}; }
+
+void TestTranslateKey() {
+  using RawInputCore::kKeyE0;
+  using RawInputCore::kKeyE1;
+  using RawInputCore::TranslateKey;
+  CHECK(TranslateKey(0x1e, 0) == 0x1e);            // A.
+  CHECK(TranslateKey(0x1d, kKeyE0) == 0x9d);       // Right control.
+  CHECK(TranslateKey(0x1c, kKeyE0) == 0x9c);       // Keypad enter.
+  CHECK(TranslateKey(0x47, kKeyE0) == 0xc7);       // Home (not keypad 7).
+  CHECK(TranslateKey(0x2a, kKeyE0) == 0);          // Fake left shift around the navigation keys.
+  CHECK(TranslateKey(0x36, kKeyE0) == 0);          // Fake right shift.
+  CHECK(TranslateKey(0x2a, 0) == 0x2a);            // A real left shift.
+  CHECK(TranslateKey(0x1d, kKeyE1) == 0);          // Pause prefix.
+  CHECK(TranslateKey(0, 0) == 0);                  // Overrun.
+  CHECK(TranslateKey(0xff, 0) == 0);               // Unknown.
+}
+
+void TestKeyboard() {
+  using RawInputCore::kKeyBreak;
+  using RawInputCore::kKeyE0;
+  using RawInputCore::kKeyE1;
+  RawInputCore::Keyboard keyboard;
+  uint8_t state[256];
+
+  keyboard.OnReport(0x1e, 0, 1);  // A down, then auto-repeat.
+  keyboard.OnReport(0x1e, 0, 2);
+  keyboard.OnReport(0x1e, 0, 3);
+  keyboard.ReadState(state);
+  CHECK(state[0x1e] == kDown);
+  keyboard.OnReport(0x1e, kKeyBreak, 4);
+  keyboard.ReadState(state);
+  CHECK(state[0x1e] == 0);
+  std::vector<Event> events = ReadAll(keyboard);
+  CHECK(ToEntries(events) == Entries({{0x1e, kDown}, {0x1e, 0}}));
+  CHECK(events.size() == 2 && events[0].timestamp == 1 && events[1].timestamp == 4);
+  CHECK(IsOrdered(events));
+
+  // Home with the fake shifts the keyboard wraps it in while NumLock is on.
+  keyboard.OnReport(0x2a, kKeyE0, 5);
+  keyboard.OnReport(0x47, kKeyE0, 5);
+  keyboard.OnReport(0x47, kKeyE0 | kKeyBreak, 6);
+  keyboard.OnReport(0x2a, kKeyE0 | kKeyBreak, 6);
+  CHECK(ToEntries(ReadAll(keyboard)) == Entries({{0xc7, kDown}, {0xc7, 0}}));
+  keyboard.ReadState(state);
+  CHECK(state[0x2a] == 0);
+
+  // Pause is E1 1D 45 (make and break in one press), a bare 45 is NumLock.
+  keyboard.OnReport(0x1d, kKeyE1, 7);
+  keyboard.OnReport(0x45, 0, 7);
+  keyboard.OnReport(0x1d, kKeyE1 | kKeyBreak, 7);
+  keyboard.OnReport(0x45, kKeyBreak, 7);
+  keyboard.OnReport(0x45, 0, 8);
+  keyboard.OnReport(0x45, kKeyBreak, 9);
+  CHECK(ToEntries(ReadAll(keyboard)) == Entries({{0xc5, kDown}, {0xc5, 0}, {0x45, kDown}, {0x45, 0}}));
+
+  // A repeat of a held key after a read is still suppressed, a release without a press is ignored.
+  keyboard.OnReport(0x1d, kKeyE0, 10);
+  ReadAll(keyboard);
+  keyboard.OnReport(0x1d, kKeyE0, 11);
+  keyboard.OnReport(0x10, kKeyBreak, 12);
+  CHECK(ReadAll(keyboard).empty());
+
+  keyboard.Reset();  // Focus loss drops the state without release events.
+  keyboard.ReadState(state);
+  CHECK(state[0x9d] == 0);
+  CHECK(ReadAll(keyboard).empty());
+  CHECK(!keyboard.TakeOverflow());
+
+  for (int i = 0; i < 300; ++i) keyboard.OnReport(0x1e, (i & 1) ? kKeyBreak : 0, i);
+  CHECK(keyboard.TakeOverflow());
+  CHECK(!keyboard.TakeOverflow());
+  CHECK(ReadAll(keyboard).size() == 256);
+}
+
+void TestRelativeMotion() {
+  RawInputCore::Mouse mouse;
+  mouse.OnReport(Move(1, 2), 1);
+  mouse.OnReport(Move(3, -1), 2);
+  mouse.OnReport(Move(-2, 0), 3);
+  std::vector<Event> events = ReadAll(mouse);
+  CHECK(ToEntries(events) == Entries({{RawInputCore::kOffsetX, 2}, {RawInputCore::kOffsetY, 1}}));
+  CHECK(events.size() == 2 && events[0].sequence == events[1].sequence && events[1].timestamp == 3);
+  CHECK(ReadAll(mouse).empty());
+
+  MouseState state;
+  mouse.ReadState(&state);  // The state deltas are independent of the buffered events.
+  CHECK(state.x == 2 && state.y == 1 && state.z == 0);
+  mouse.ReadState(&state);
+  CHECK(state.x == 0 && state.y == 0);
+
+  mouse.OnReport(Move(0, 5), 4);  // A read without room for the Y event keeps it.
+  mouse.OnReport(Move(4, 0), 4);
+  Event event;
+  CHECK(mouse.ReadEvents(&event, 1) == 1 && event.offset == RawInputCore::kOffsetX && event.data == 4);
+  CHECK(ToEntries(ReadAll(mouse)) == Entries({{RawInputCore::kOffsetY, 5}}));
+
+  mouse.OnReport(Move(9, 9), 5);
+  mouse.Flush();
+  mouse.ReadState(&state);
+  CHECK(ReadAll(mouse).empty() && state.x == 0 && state.y == 0);
+}
+
+void TestAbsoluteMotion() {
+  RawInputCore::Mouse mouse;
+  mouse.SetAbsoluteScale(1920, 1080);
+  mouse.OnReport(MoveTo(32768, 32768), 1);  // The first report only sets the origin.
+  CHECK(ReadAll(mouse).empty());
+  mouse.OnReport(MoveTo(49152, 16384), 2);
+  mouse.OnReport(MoveTo(49152, 16384), 3);  // Unchanged.
+  CHECK(ToEntries(ReadAll(mouse)) == Entries({{RawInputCore::kOffsetX, 480}, {RawInputCore::kOffsetY, -270}}));
+
+  mouse.OnReport(Move(5, 0), 4);  // A relative report restarts the absolute origin.
+  mouse.OnReport(MoveTo(0, 0), 5);
+  CHECK(ToEntries(ReadAll(mouse)) == Entries({{RawInputCore::kOffsetX, 5}}));
+
+  mouse.Reset();
+  mouse.OnReport(MoveTo(65535, 65535), 6);
+  CHECK(ReadAll(mouse).empty());
+}
+
+void TestButtonsAndMotion() {
+  const uint32_t x = RawInputCore::kOffsetX, y = RawInputCore::kOffsetY, z = RawInputCore::kOffsetZ;
+  const uint32_t left = RawInputCore::kOffsetButton0, right = RawInputCore::kOffsetButton0 + 1;
+  RawInputCore::Mouse mouse;
+  MouseState state;
+
+  mouse.OnReport(Move(5, 0), 1);
+  mouse.OnReport(Move(0, 0, kButton0Down), 2);
+  mouse.OnReport(Move(0, -3), 3);
+  mouse.OnReport(Move(2, 0, kButton0Up), 4);  // The motion of the report lands ahead of its edge.
+  mouse.OnReport(Move(7, 0), 5);
+  mouse.ReadState(&state);
+  CHECK(state.buttons[0] == 0 && state.x == 14 && state.y == -3);
+  std::vector<Event> events = ReadAll(mouse);
+  CHECK(ToEntries(events) == Entries({{x, 5}, {left, kDown}, {x, 2}, {y, -3}, {left, 0}, {x, 7}}));
+  CHECK(IsOrdered(events));
+  CHECK(events.size() == 6 && events[2].sequence == events[3].sequence && events[3].sequence < events[4].sequence);
+
+  // A click within one report keeps both edges, and the held state tracks the buttons.
+  mouse.OnReport(Move(1, 1, kButton0Down | kButton0Up), 6);
+  mouse.OnReport(Move(0, 0, kButton1Down), 7);
+  mouse.ReadState(&state);
+  CHECK(state.buttons[0] == 0 && state.buttons[1] == kDown);
+  CHECK(ToEntries(ReadAll(mouse)) == Entries({{x, 1}, {y, 1}, {left, kDown}, {left, 0}, {right, kDown}}));
+
+  MouseReport wheel = {0, RawInputCore::kMouseWheel | kButton1Up, -120, 0, 0};
+  mouse.OnReport(wheel, 8);
+  mouse.ReadState(&state);
+  CHECK(state.z == -120 && state.buttons[1] == 0);
+  CHECK(ToEntries(ReadAll(mouse)) == Entries({{right, 0}, {z, -120}}));
+
+  mouse.OnReport(Move(0, 0, kButton1Down), 9);
+  mouse.Reset();  // Focus loss releases the buttons without events.
+  mouse.ReadState(&state);
+  CHECK(state.buttons[1] == 0 && ReadAll(mouse).empty());
+
+  // Interleaved motion between many clicks never merges across an edge.
+  for (int i = 0; i < 100; ++i) {
+    mouse.OnReport(Move(1, 0), 10 + i);
+    mouse.OnReport(Move(0, 0, (i & 1) ? kButton0Up : kButton0Down), 10 + i);
+  }
+  events = ReadAll(mouse);
+  CHECK(events.size() == 200 && IsOrdered(events));
+  for (size_t i = 0; i + 1 < events.size(); i += 2) {
+    CHECK(events[i].offset == x && events[i].data == 1);
+    CHECK(events[i + 1].offset == left && events[i + 1].data == ((i / 2) & 1 ? 0 : kDown));
+  }
+
+  for (int i = 0; i < 300; ++i) mouse.OnReport(Move(0, 0, kButton0Down | kButton0Up), 200);
+  CHECK(mouse.TakeOverflow());
+  CHECK(ReadAll(mouse).size() == 512);
+}
+
+}  // namespace
+
+int main() {
+  TestTranslateKey();
+  TestKeyboard();
+  TestRelativeMotion();
+  TestAbsoluteMotion();
+  TestButtonsAndMotion();
+  printf("Tests: %s\n", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+// Checks the eqw redundant device state filter (state_filter.cpp) against a mock device.
+//
+// Portable so it runs on any workstation. The real state_filter.cpp and d3dx8/d3d8.h are compiled
+// against the minimal Windows declarations in win32_mock/:
+//   g++ -std=c++17 -O2 -Iwin32_mock -I../eqw_takp -o state_filter_test
+//       state_filter_test.cpp ../eqw_takp/state_filter.cpp
+//   ./state_filter_test
+//
+// The mock device is a bare IDirect3DDevice8 vtable whose methods record the calls that reach
+// the "driver". The test calls the device through the IDirect3DDevice8 interface, so it also
+// checks that the hooked slot indices match the interface. The exit code is non-zero on failure.
+
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "d3dx8/d3d8.h"
+#include "ini.h"
+#include "logger.h"
+#include "state_filter.h"
+#include "vtable_hook.h"
+
+namespace {
+
+static constexpr int kDeviceMethods = 97;  // IDirect3DDevice8 vtable size.
+
+int failures = 0;
+
+#define CHECK(condition)                                                      \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                             \
+    }                                                                         \
+  } while (0)
+
+// Calls that reached the mock device, one "Method(args)" entry per call.
+std::vector<std::string> calls;
+HRESULT next_result = D3D_OK;  // Result returned by the next mock call.
+
+HRESULT Record(const std::string& call) {
+  calls.push_back(call);
+  HRESULT result = next_result;
+  next_result = D3D_OK;
+  return result;
+}
+
+HRESULT WINAPI MockSetRenderState(IDirect3DDevice8*, D3DRENDERSTATETYPE state, DWORD value) {
+  return Record("SetRenderState(" + std::to_string(state) + "," + std::to_string(value) + ")");
+}
+
+HRESULT WINAPI MockBeginStateBlock(IDirect3DDevice8*) { return Record("BeginStateBlock()"); }
+
+HRESULT WINAPI MockEndStateBlock(IDirect3DDevice8*, DWORD* token) {
+  *token = 1;
+  return Record("EndStateBlock()");
+}
+
+HRESULT WINAPI MockApplyStateBlock(IDirect3DDevice8*, DWORD token) {
+  return Record("ApplyStateBlock(" + std::to_string(token) + ")");
+}
+
+HRESULT WINAPI MockSetTexture(IDirect3DDevice8*, DWORD stage, IDirect3DBaseTexture8* texture) {
+  return Record("SetTexture(" + std::to_string(stage) + "," + (texture ? "tex" : "null") + ")");
+}
+
+HRESULT WINAPI MockSetTextureStageState(IDirect3DDevice8*, DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value) {
+  return Record("SetTextureStageState(" + std::to_string(stage) + "," + std::to_string(type) + "," +
+                std::to_string(value) + ")");
+}
+
+HRESULT WINAPI MockSetVertexShader(IDirect3DDevice8*, DWORD handle) {
+  return Record("SetVertexShader(" + std::to_string(handle) + ")");
+}
+
+HRESULT WINAPI MockDeleteVertexShader(IDirect3DDevice8*, DWORD handle) {
+  return Record("DeleteVertexShader(" + std::to_string(handle) + ")");
+}
+
+// A device object is just a pointer to its vtable. Devices created by the same runtime share it.
+struct MockDevice {
+  void** vtable;
+  IDirect3DDevice8* get() { return reinterpret_cast<IDirect3DDevice8*>(this); }
+};
+
+void* mock_vtable[kDeviceMethods] = {};
+
+void InitializeMockVTable() {
+  mock_vtable[50] = reinterpret_cast<void*>(MockSetRenderState);
+  mock_vtable[52] = reinterpret_cast<void*>(MockBeginStateBlock);
+  mock_vtable[53] = reinterpret_cast<void*>(MockEndStateBlock);
+  mock_vtable[54] = reinterpret_cast<void*>(MockApplyStateBlock);
+  mock_vtable[61] = reinterpret_cast<void*>(MockSetTexture);
+  mock_vtable[63] = reinterpret_cast<void*>(MockSetTextureStageState);
+  mock_vtable[76] = reinterpret_cast<void*>(MockSetVertexShader);
+  mock_vtable[78] = reinterpret_cast<void*>(MockDeleteVertexShader);
+}
+
+// Returns the calls that reached the device since the last call.
+std::vector<std::string> TakeCalls() {
+  std::vector<std::string> result;
+  result.swap(calls);
+  return result;
+}
+
+using Calls = std::vector<std::string>;
+
+void TestRedundantCalls(IDirect3DDevice8* device) {
+  IDirect3DBaseTexture8* texture = reinterpret_cast<IDirect3DBaseTexture8*>(0x1000);
+  device->SetRenderState(D3DRS_ZENABLE, 1);
+  device->SetRenderState(D3DRS_ZENABLE, 1);
+  device->SetRenderState(D3DRS_ZENABLE, 0);
+  device->SetRenderState(D3DRS_LIGHTING, 0);
+  device->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  device->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  device->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_MODULATE);  // Other stage.
+  device->SetTexture(0, texture);
+  device->SetTexture(0, texture);
+  device->SetTexture(0, nullptr);
+  device->SetVertexShader(D3DFVF_XYZ);
+  device->SetVertexShader(D3DFVF_XYZ);
+  CHECK(TakeCalls() == Calls({"SetRenderState(7,1)", "SetRenderState(7,0)", "SetRenderState(137,0)",
+                              "SetTextureStageState(1,1,4)", "SetTextureStageState(0,1,4)", "SetTexture(0,tex)",
+                              "SetTexture(0,null)", "SetVertexShader(2)"}));
+
+  StateFilter::OnPresent();
+  CHECK(StateFilter::GetForwardedCalls() == 8);
+  CHECK(StateFilter::GetFilteredCalls() == 4);
+  StateFilter::OnPresent();
+  CHECK(StateFilter::GetForwardedCalls() == 0 && StateFilter::GetFilteredCalls() == 0);
+}
+
+void TestFailedCalls(IDirect3DDevice8* device) {
+  next_result = D3DERR_INVALIDCALL;  // A failed call leaves the device state unknown.
+  CHECK(device->SetRenderState(D3DRS_FOGENABLE, 1) == D3DERR_INVALIDCALL);
+  device->SetRenderState(D3DRS_FOGENABLE, 1);
+  device->SetRenderState(D3DRS_FOGENABLE, 1);
+  CHECK(TakeCalls() == Calls({"SetRenderState(28,1)", "SetRenderState(28,1)"}));
+
+  device->SetRenderState(static_cast<D3DRENDERSTATETYPE>(300), 1);  // Outside the shadow.
+  device->SetRenderState(static_cast<D3DRENDERSTATETYPE>(300), 1);
+  device->SetTextureStageState(8, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  device->SetTextureStageState(8, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  CHECK(TakeCalls().size() == 4);
+}
+
+void TestInvalidation(IDirect3DDevice8* device) {
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  device->SetVertexShader(D3DFVF_XYZRHW);
+  TakeCalls();
+
+  DWORD token = 0;
+  device->BeginStateBlock();  // Recorded calls don't change the device state, so are always sent.
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  device->EndStateBlock(&token);
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  CHECK(TakeCalls() == Calls({"BeginStateBlock()", "SetRenderState(22,2)", "SetRenderState(22,2)",
+                              "EndStateBlock()"}));
+
+  device->ApplyStateBlock(token);  // Changes the device state behind the shadow.
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  device->SetVertexShader(D3DFVF_XYZRHW);
+  CHECK(TakeCalls() == Calls({"ApplyStateBlock(1)", "SetRenderState(22,2)", "SetVertexShader(4)"}));
+
+  StateFilter::Invalidate();  // Device Reset().
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
+  CHECK(TakeCalls() == Calls({"SetRenderState(22,2)"}));
+
+  device->DeleteVertexShader(D3DFVF_XYZRHW);  // The handle can be reused by a new shader.
+  device->SetVertexShader(D3DFVF_XYZRHW);
+  CHECK(TakeCalls() == Calls({"DeleteVertexShader(4)", "SetVertexShader(4)"}));
+}
+
+void TestOtherDevice(IDirect3DDevice8* device, IDirect3DDevice8* other) {
+  device->SetRenderState(D3DRS_ALPHAREF, 8);
+  other->SetRenderState(D3DRS_ALPHAREF, 8);
+  other->SetRenderState(D3DRS_ALPHAREF, 8);
+  device->SetRenderState(D3DRS_ALPHAREF, 8);
+  CHECK(TakeCalls() == Calls({"SetRenderState(24,8)", "SetRenderState(24,8)", "SetRenderState(24,8)"}));
+}
+
+void TestReinstall(MockDevice& recreated) {
+  void* hooked = mock_vtable[54];
+  StateFilter::InstallHooks(recreated.get());  // A recreated device shares the hooked vtable.
+  CHECK(mock_vtable[54] == hooked);
+
+  IDirect3DDevice8* device = recreated.get();
+  device->SetRenderState(D3DRS_ALPHAREF, 8);  // New device, so the shadow starts empty.
+  device->SetRenderState(D3DRS_ALPHAREF, 8);
+  device->ApplyStateBlock(1);
+  CHECK(TakeCalls() == Calls({"SetRenderState(24,8)", "ApplyStateBlock(1)"}));
+}
+
+}  // namespace
+
+// Portable stand-in for vtable_hook.cpp (the mock vtable is writable, so no page protection).
+static std::unordered_map<void*, void*> vtable_hook_map;
+
+VTableHook::VTableHook(void** object_vtable, size_t index, LPVOID new_function, bool debug) {
+  ReplaceVTableFunction(object_vtable, index, new_function, debug);
+}
+
+LPVOID VTableHook::ReplaceVTableFunction(void** object_vtable, size_t index, LPVOID new_function, bool) {
+  new_function_ = new_function;
+  void* function = new_function;
+  if (object_vtable[index] == function) {
+    original_function_ = vtable_hook_map[function];
+    return original_function_;
+  }
+  original_function_ = object_vtable[index];
+  vtable_hook_map[function] = original_function_;
+  object_vtable[index] = function;
+  return original_function_;
+}
+
+// Ini and Logger stand-ins. The filter is enabled by the FilterRedundantStates setting.
+bool Ini::GetString(const std::string&, const std::string& key, std::string* value, const char*) {
+  *value = (key == "FilterRedundantStates") ? "TRUE" : "";
+  return !value->empty();
+}
+
+void Ini::SetString(const std::string&, const std::string&, const std::string&, const char*) {}
+
+void Logger::Info(const char*, ...) {}
+void Logger::Error(const char*, ...) {}
+
+int main() {
+  InitializeMockVTable();
+  MockDevice device = {mock_vtable};
+  MockDevice other = {mock_vtable};
+  MockDevice recreated = {mock_vtable};
+
+  StateFilter::Initialize("eqclient.ini");
+  StateFilter::InstallHooks(device.get());
+  TestRedundantCalls(device.get());
+  TestFailedCalls(device.get());
+  TestInvalidation(device.get());
+  TestOtherDevice(device.get(), other.get());
+  TestReinstall(recreated);
+
+  printf("Tests: %s\n", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Minimal COM declarations for the real d3dx8/d3d8.h (see windows.h).
+
+#include <windows.h>
+
+#define STDMETHOD(method) virtual HRESULT WINAPI method
+#define STDMETHOD_(type, method) virtual type WINAPI method
+#define PURE = 0
+#define THIS_
+#define THIS void
+#define DECLARE_INTERFACE_(iface, base) struct iface : public base
+
+struct IUnknown {
+  virtual HRESULT WINAPI QueryInterface(REFIID riid, void** object) = 0;
+  virtual ULONG WINAPI AddRef() = 0;
+  virtual ULONG WINAPI Release() = 0;
+};
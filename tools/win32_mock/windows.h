@@ -0,0 +1,94 @@
+#pragma once
+
+// Minimal stand-in for the Windows SDK header, just enough to compile the real d3dx8/d3d8.h and
+// the hook modules in the portable tests (see state_filter_test.cpp). The sizes match the 32-bit
+// Windows types. Nothing here is linked into the dll.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WINVER 0x0601
+#define _WIN32 1
+#define WINAPI
+#define CONST const
+#define interface struct
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+typedef int32_t HRESULT;
+typedef int BOOL;
+typedef int INT;
+typedef unsigned int UINT;
+typedef float FLOAT;
+typedef char CHAR;
+typedef void VOID;
+typedef void* HANDLE;
+
+// MSVC implicitly converts function pointers to LPVOID, which the hook installers rely on.
+class LPVOID {
+ public:
+  LPVOID(void* pointer = nullptr) : pointer_(pointer) {}
+
+  template <typename R, typename... Args>
+  LPVOID(R (*function)(Args...)) : pointer_(reinterpret_cast<void*>(function)) {}
+
+  template <typename T>
+  operator T*() const {
+    return reinterpret_cast<T*>(pointer_);
+  }
+
+ private:
+  void* pointer_;
+};
+
+typedef struct _GUID {
+  DWORD Data1;
+  WORD Data2;
+  WORD Data3;
+  BYTE Data4[8];
+} GUID, IID;
+typedef const GUID& REFGUID;
+typedef const IID& REFIID;
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) extern const GUID name
+
+struct HWND__;
+typedef HWND__* HWND;
+struct HMONITOR__;
+typedef HMONITOR__* HMONITOR;
+
+typedef struct tagRECT {
+  LONG left, top, right, bottom;
+} RECT;
+typedef struct tagPOINT {
+  LONG x, y;
+} POINT;
+typedef struct tagPALETTEENTRY {
+  BYTE peRed, peGreen, peBlue, peFlags;
+} PALETTEENTRY;
+typedef struct _RGNDATAHEADER {
+  DWORD dwSize, iType, nCount, nRgnSize;
+  RECT rcBound;
+} RGNDATAHEADER;
+typedef struct _RGNDATA {
+  RGNDATAHEADER rdh;
+  char Buffer[1];
+} RGNDATA;
+typedef union _LARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  };
+  LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define MAKE_HRESULT(sev, fac, code) \
+  ((HRESULT)(((uint32_t)(sev) << 31) | ((uint32_t)(fac) << 16) | ((uint32_t)(code))))
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005L)